@@ -17,6 +17,12 @@
 #include "pgut/pgut-fe.h"
 #include "pgut/pgut-list.h"
 
+#include <sys/stat.h>
+
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
 const char *PROGRAM_VERSION	= PG_BULKLOAD_VERSION;
 const char *PROGRAM_URL		= "http://pgbulkload.projects.postgresql.org/";
 const char *PROGRAM_EMAIL	= "pgbulkload-general@pgfoundry.org";
@@ -61,6 +67,10 @@ extern int LoaderRecoveryMain(void);
 static PGresult *RemoteLoad(PGconn *conn, FILE *copystream, bool isbinary);
 static bool ParseControlFileLine(char buf[], char **outKeyword, char **outValue);
 static char *TrimSpaces(char *str);
+static bool IsFile(const char *path, bool in_control_file,
+				   const char *control_file, const char *cwd);
+static void AbsolutePath(char *abspath, const char *path, bool in_control_file,
+						 const char *control_file, const char *cwd);
 static char *UnquoteString(char *str, char quote, char escape);
 static char *FindUnquotedChar(char *str, char target, char quote, char escape);
 
@@ -185,36 +195,77 @@ main(int argc, char *argv[])
 			const pgut_option  *opt = &options[i];
 			const char		   *path = *(const char **) opt->var;
 			char				abspath[MAXPGPATH];
-			char				item[MAXPGPATH + 32];
+			StringInfoData		item;
 
 			if (path == NULL)
 				continue;
 
-			if ((i == 0 || i == 1) &&
-				(pg_strcasecmp(path, "stdin") == 0 || type_function))
+			initStringInfo(&item);
+			appendStringInfo(&item, "%s=", opt->lname);
+
+			if ((i == 0 || i == 1) && pg_strncasecmp(path, "program:", 8) == 0)
 			{
-				/* special case for stdin and input from function */
-				strlcpy(abspath, path, lengthof(abspath));
+				/* command line of the program is passed as-is */
+				appendStringInfoString(&item, path);
 			}
-			else if (is_absolute_path(path) || (i == 2 && !writer_binary))
+			else if (((i == 0 || i == 1) &&
+					  (pg_strcasecmp(path, "stdin") == 0 || type_function)) ||
+					 (i == 2 && !writer_binary))
 			{
-				/* absolute path */
+				/*
+				 * special case for stdin and input from function, and OUTPUT
+				 * as a table name
+				 */
 				strlcpy(abspath, path, lengthof(abspath));
+				canonicalize_path(abspath);
+				appendStringInfoString(&item, abspath);
 			}
-			else if (opt->source == SOURCE_FILE)
+			else if ((i == 0 || i == 1) && strchr(path, ',') != NULL &&
+					 !IsFile(path, opt->source == SOURCE_FILE, control_file, cwd))
 			{
-				/* control file relative path */
-				join_path_components(abspath, control_file, path);
+				/*
+				 * list of input files; resolve each of them. An escaped
+				 * comma "\," is a part of the path and kept escaped.
+				 */
+				char   *paths = pgut_strdup(path);
+				char   *tok;
+				char   *next;
+				bool	first = true;
+
+				for (tok = paths; tok != NULL; tok = next)
+				{
+					for (next = tok; *next; next++)
+					{
+						if (next[0] == '\\' && next[1] == ',')
+							next++;
+						else if (*next == ',')
+							break;
+					}
+					if (*next == ',')
+						*next++ = '\0';
+					else
+						next = NULL;
+
+					tok = TrimSpaces(tok);
+					if (tok[0] == '\0')
+						continue;
+					AbsolutePath(abspath, tok, opt->source == SOURCE_FILE,
+								 control_file, cwd);
+					if (!first)
+						appendStringInfoChar(&item, ',');
+					appendStringInfoString(&item, abspath);
+					first = false;
+				}
+				free(paths);
 			}
 			else
 			{
-				/* current working directory relative path */
-				join_path_components(abspath, cwd, path);
+				AbsolutePath(abspath, path, opt->source == SOURCE_FILE,
+							 control_file, cwd);
+				appendStringInfoString(&item, abspath);
 			}
 
-			canonicalize_path(abspath);
-			snprintf(item, lengthof(item), "%s=%s", opt->lname, abspath);
-			bulkload_options = lappend(bulkload_options, pgut_strdup(item));
+			bulkload_options = lappend(bulkload_options, item.data);
 		}
 
 		return LoaderLoadMain(bulkload_options);
@@ -352,101 +403,295 @@ LoaderLoadMain(List *options)
  * and got back a PGRES_COPY_IN result.
  * copystream is the file stream to read the data from.
  * isbinary can be set from PQbinaryTuples().
+ *
+ * Input is sent in large CopyData messages, and a reader thread reads the
+ * next chunk while the current one is sent. The reader state is allocated in
+ * the heap and shared by the sender and the reader thread, and the last one
+ * to release it frees it, so the thread never needs to be joined; it might be
+ * blocked in reading stdin after the sender has stopped.
  */
 
-/* read chunk size for COPY IN - size is not critical */
-#define COPYBUFSIZ 8192
+/* read chunk size for COPY IN; the server parses each message in place */
+#define COPYBUFSIZ		(1024 * 1024)
+#define COPYBUFNUM		2
 
-static PGresult *
-RemoteLoad(PGconn *conn, FILE *copystream, bool isbinary)
+typedef struct ChunkReader
 {
-	bool		OK;
-	char		buf[COPYBUFSIZ];
+	FILE   *stream;
+	bool	isbinary;
+	bool	line_start;		/* the last chunk ended with a newline? */
+	char   *carry;			/* partial line read for the next chunk */
+	size_t	carry_len;
+
+	char   *bufs[COPYBUFNUM];
+	size_t	lens[COPYBUFNUM];
+	int		head;			/* number of chunks read */
+	int		tail;			/* number of chunks sent */
+	bool	done;			/* no more chunks */
+	bool	error;			/* read error */
+	bool	quit;			/* sender stopped */
+	int		refs;			/* sender and reader thread */
+
+#ifndef WIN32
+	pthread_t		th;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+#endif
+} ChunkReader;
 
-	OK = true;
+/*
+ * Read the next chunk into buf. In text mode, a chunk ends at the end of a
+ * line if possible so that the server can parse it in place, and a line of
+ * "\." terminates the data. Returns false if there is no more data.
+ */
+static bool
+ReadChunk(ChunkReader *r, char *buf, size_t *len)
+{
+	size_t	n = r->carry_len;
+	char   *p;
+	char   *end;
+
+	memcpy(buf, r->carry, r->carry_len);
+	r->carry_len = 0;
+	n += fread(buf + n, 1, COPYBUFSIZ - n, r->stream);
+	if (ferror(r->stream))
+		r->error = true;
+	*len = n;
+	if (n == 0)
+		return false;
+	if (r->isbinary)
+		return true;
 
-	if (isbinary)
+	/* look for the end-of-data marker at the head of each line */
+	end = buf + n;
+	for (p = buf; p < end; p++)
 	{
-		while (!interrupted)
+		if (r->line_start && *p == '\\' &&
+			((end - p >= 3 && memcmp(p, "\\.\n", 3) == 0) ||
+			 (end - p >= 4 && memcmp(p, "\\.\r\n", 4) == 0)))
 		{
-			int			buflen;
-
-			buflen = fread(buf, 1, COPYBUFSIZ, copystream);
+			*len = p - buf;
+			return false;
+		}
 
-			if (buflen <= 0)
-				break;
+		p = memchr(p, '\n', end - p);
+		if (p == NULL)
+		{
+			r->line_start = false;
+			break;
+		}
+		r->line_start = true;
+	}
 
-			if (PQputCopyData(conn, buf, buflen) <= 0)
-			{
-				OK = false;
-				break;
-			}
+	/* keep the last partial line for the next chunk */
+	if (!feof(r->stream) && r->line_start == false)
+	{
+		for (p = end; p > buf && p[-1] != '\n'; p--);
+		if (p > buf)
+		{
+			r->carry_len = end - p;
+			memcpy(r->carry, p, r->carry_len);
+			*len = p - buf;
+			r->line_start = true;
 		}
 	}
-	else
+
+	return true;
+}
+
+/*
+ * Release the reader state; the last one frees it.
+ */
+static void
+ChunkReaderFree(ChunkReader *r)
+{
+	int		i;
+
+#ifndef WIN32
+	bool	last;
+
+	pthread_mutex_lock(&r->lock);
+	last = (--r->refs == 0);
+	pthread_mutex_unlock(&r->lock);
+	if (!last)
+		return;
+
+	pthread_cond_destroy(&r->cond);
+	pthread_mutex_destroy(&r->lock);
+#endif
+
+	for (i = 0; i < COPYBUFNUM; i++)
+		free(r->bufs[i]);
+	free(r->carry);
+	free(r);
+}
+
+#ifndef WIN32
+static void *
+ChunkReaderMain(void *arg)
+{
+	ChunkReader *r = (ChunkReader *) arg;
+	bool		more = true;
+
+	while (more)
 	{
-		bool		copydone = false;
+		int		slot;
+		size_t	len;
 
-		while (!interrupted && !copydone)
-		{						/* for each input line ... */
-			bool		firstload;
-			bool		linedone;
+		pthread_mutex_lock(&r->lock);
+		while (r->head - r->tail >= COPYBUFNUM && !r->quit)
+			pthread_cond_wait(&r->cond, &r->lock);
+		if (r->quit)
+		{
+			pthread_mutex_unlock(&r->lock);
+			break;
+		}
+		pthread_mutex_unlock(&r->lock);
 
-			firstload = true;
-			linedone = false;
+		slot = r->head % COPYBUFNUM;
+		more = ReadChunk(r, r->bufs[slot], &len);
 
-			while (!linedone)
-			{					/* for each bufferload in line ... */
-				int			linelen;
-				char	   *fgresult;
+		pthread_mutex_lock(&r->lock);
+		r->lens[slot] = len;
+		r->head++;
+		if (!more || r->error)
+		{
+			r->done = true;
+			more = false;
+		}
+		pthread_cond_signal(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+	}
 
-				fgresult = fgets(buf, sizeof(buf), copystream);
+	ChunkReaderFree(r);
+	return NULL;
+}
+#endif
 
-				if (!fgresult)
-				{
-					copydone = true;
-					break;
-				}
+/*
+ * Start reading stream. The reader thread holds its own reference to the
+ * returned state.
+ */
+static ChunkReader *
+ChunkReaderCreate(FILE *stream, bool isbinary)
+{
+	ChunkReader *r;
+	int			i;
 
-				linelen = strlen(buf);
+	r = pgut_malloc(sizeof(ChunkReader));
+	memset(r, 0, sizeof(ChunkReader));
+	r->stream = stream;
+	r->isbinary = isbinary;
+	r->line_start = true;
+	for (i = 0; i < COPYBUFNUM; i++)
+		r->bufs[i] = pgut_malloc(COPYBUFSIZ);
+	r->carry = pgut_malloc(COPYBUFSIZ);
+	r->refs = 1;
+
+#ifndef WIN32
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	r->refs++;
+	if (pthread_create(&r->th, NULL, ChunkReaderMain, r) != 0)
+		elog(ERROR, "could not create reader thread");
+	pthread_detach(r->th);
+#endif
+
+	return r;
+}
 
-				/* current line is done? */
-				if (linelen > 0 && buf[linelen - 1] == '\n')
-					linedone = true;
+/*
+ * Get the next chunk to send. Returns NULL at end of data.
+ */
+static char *
+ChunkReaderNext(ChunkReader *r, size_t *len)
+{
+	int		slot;
 
-				/* check for EOF marker, but not on a partial line */
-				if (firstload)
-				{
-					if (strcmp(buf, "\\.\n") == 0 ||
-						strcmp(buf, "\\.\r\n") == 0)
-					{
-						copydone = true;
-						break;
-					}
+#ifndef WIN32
+	bool	found;
 
-					firstload = false;
-				}
+	pthread_mutex_lock(&r->lock);
+	while (r->head == r->tail && !r->done)
+		pthread_cond_wait(&r->cond, &r->lock);
+	found = (r->head != r->tail);
+	pthread_mutex_unlock(&r->lock);
+	if (!found)
+		return NULL;
+#else
+	/* read synchronously */
+	if (r->done)
+		return NULL;
+	slot = r->head % COPYBUFNUM;
+	r->done = !ReadChunk(r, r->bufs[slot], &r->lens[slot]) || r->error;
+	r->head++;
+#endif
+
+	slot = r->tail % COPYBUFNUM;
+	*len = r->lens[slot];
+	return r->bufs[slot];
+}
 
-				if (PQputCopyData(conn, buf, linelen) <= 0)
-				{
-					OK = false;
-					copydone = true;
-					break;
-				}
-			}
+/*
+ * Give the chunk got by ChunkReaderNext back to the reader.
+ */
+static void
+ChunkReaderRelease(ChunkReader *r)
+{
+#ifndef WIN32
+	pthread_mutex_lock(&r->lock);
+	r->tail++;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+#else
+	r->tail++;
+#endif
+}
+
+static PGresult *
+RemoteLoad(PGconn *conn, FILE *copystream, bool isbinary)
+{
+	bool		OK;
+	ChunkReader *r;
+	char	   *chunk;
+	size_t		len;
+
+	OK = true;
+
+	r = ChunkReaderCreate(copystream, isbinary);
+
+	while (!interrupted && (chunk = ChunkReaderNext(r, &len)) != NULL)
+	{
+		bool	sent = (len == 0 || PQputCopyData(conn, chunk, len) > 0);
+
+		ChunkReaderRelease(r);
+		if (!sent)
+		{
+			OK = false;
+			break;
 		}
 	}
 
+	/* stop the reader; it frees the state if it is still reading */
+#ifndef WIN32
+	pthread_mutex_lock(&r->lock);
+	r->quit = true;
+	if (r->error)
+		OK = false;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+#else
+	if (r->error)
+		OK = false;
+#endif
+	ChunkReaderFree(r);
+
 	if (interrupted)
 	{
 		PQputCopyEnd(conn, "canceled by user");
 		return PQgetResult(conn);
 	}
 
-	/* Check for read error */
-	if (ferror(copystream))
-		OK = false;
-
 	/* Terminate data transfer */
 	if (PQputCopyEnd(conn, OK ? NULL : "aborted because of read failure") <= 0)
 		OK = false;
@@ -595,6 +840,40 @@ ParseControlFileLine(char buf[], char **outKeyword, char **outValue)
 	return true;
 }
 
+/*
+ * Make an absolute path of a path option. A relative path is relative to the
+ * control file if it is given in the control file, or to the current working
+ * directory otherwise.
+ */
+static void
+AbsolutePath(char *abspath, const char *path, bool in_control_file,
+			 const char *control_file, const char *cwd)
+{
+	if (is_absolute_path(path))
+		strlcpy(abspath, path, MAXPGPATH);
+	else if (in_control_file)
+		join_path_components(abspath, control_file, path);
+	else
+		join_path_components(abspath, cwd, path);
+
+	canonicalize_path(abspath);
+}
+
+/*
+ * Return true if path names an existing file as a whole. Such a path is
+ * never split as a list of input files even if it contains commas.
+ */
+static bool
+IsFile(const char *path, bool in_control_file,
+	   const char *control_file, const char *cwd)
+{
+	char		abspath[MAXPGPATH];
+	struct stat	st;
+
+	AbsolutePath(abspath, path, in_control_file, control_file, cwd);
+	return stat(abspath, &st) == 0 && !S_ISDIR(st.st_mode);
+}
+
 /**
  * @brief Trim white spaces before and after input value.
  *
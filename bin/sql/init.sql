@@ -38,6 +38,29 @@ CREATE INDEX idx_btree_fn ON customer USING btree ((abs(c_w_id) + c_d_id));
 CREATE INDEX idx_hash ON customer USING hash (c_d_id);
 CREATE INDEX idx_hash_fn ON customer USING hash ((abs(c_w_id) + c_d_id));
 
+---------------------------------------------------------------------------
+-- load_csv test
+CREATE TABLE fmt_target (
+    id  int,
+    d   date,
+    t   time(2),
+    ts  timestamp(3),
+    tz  timestamptz
+);
+
+---------------------------------------------------------------------------
+-- load_arrow test
+CREATE DOMAIN arrow_pos AS int CHECK (VALUE > 0);
+CREATE TABLE arrow_target (
+    i4  int,
+    u8  bigint,
+    n   numeric(6,2),
+    s   text,
+    p   arrow_pos,
+    d   date,
+    nul int
+);
+
 ---------------------------------------------------------------------------
 -- load_check test
 CREATE TABLE master (
@@ -0,0 +1,18 @@
+-- an Arrow IPC file of two record batches; values are converted at once for
+-- the batch, taken as they are, cast, passed to the input functions or
+-- formatted and parsed, and NULLs are read from the validity bitmaps
+\pset null (null)
+\! pg_bulkload -d contrib_regression data/arrow1.ctl -i data/data1.arrow -l results/arrow1.log -P results/arrow1.prs -u results/arrow1.dup
+\! grep Rejected results/arrow1.log
+\! cat results/arrow1.prs
+SET DateStyle = 'ISO';
+SELECT * FROM arrow_target ORDER BY i4;
+RESET DateStyle;
+
+-- an Arrow IPC stream with a dictionary encoded field, which must be skipped
+\! pg_bulkload -d contrib_regression data/arrow2.ctl -i data/data2.arrow -l results/arrow2.log -P results/arrow2.prs -u results/arrow2.dup
+\! pg_bulkload -d contrib_regression data/arrow2.ctl -i data/data2.arrow -l results/arrow3.log -P results/arrow3.prs -u results/arrow3.dup -o "FIELDS=id, -, master"
+SELECT * FROM target_like ORDER BY id;
+
+-- a record batch which does not match the schema
+\! pg_bulkload -d contrib_regression data/arrow2.ctl -i data/data3.arrow -l results/arrow4.log -P results/arrow4.prs -u results/arrow4.dup
@@ -144,3 +144,15 @@ SET enable_seqscan = off;
 SET enable_indexscan = on;
 SET enable_bitmapscan = off;
 SELECT * FROM customer ORDER BY c_id;
+
+-- RECORD_HEADER; bytes after the fields are ignored
+\! pg_bulkload -d contrib_regression data/bin7.ctl -i data/data5.bin -l results/bin14.log -P results/bin14.prs -u results/bin14.dup
+\! grep Rejected results/bin14.log
+\! cat results/bin14.prs | wc -c | tr -d ' '
+SELECT * FROM target_like ORDER BY id;
+
+-- VARCHAR PREFIX
+\! pg_bulkload -d contrib_regression data/bin8.ctl -i data/data6.bin -l results/bin15.log -P results/bin15.prs -u results/bin15.dup
+\! grep Rejected results/bin15.log
+\! cat results/bin15.prs | wc -c | tr -d ' '
+SELECT * FROM target_like ORDER BY id;
@@ -84,3 +84,58 @@ SET enable_bitmapscan = off;
 SELECT * FROM customer ORDER BY c_id;
 
 \! diff data/data3.csv results/csv7.prs
+
+-- an existing file is loaded as is even if its name has "," or "["
+\! cp data/data8.csv 'results/a,b.csv'
+\! cp data/data9.csv 'results/[c].csv'
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i 'results/a,b.csv' -l results/csv8.log -P results/csv8.prs -u results/csv8.dup
+SELECT * FROM target_like ORDER BY id;
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i 'results/[c].csv' -l results/csv9.log -P results/csv9.prs -u results/csv9.dup
+SELECT * FROM target_like ORDER BY id;
+
+-- a list of files with an escaped comma, and a wildcard pattern
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i 'results/a\,b.csv, results/\[c\].csv' -l results/csv10.log -P results/csv10.prs -u results/csv10.dup
+SELECT * FROM target_like ORDER BY id;
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i 'data/data[89].csv' -l results/csv11.log -P results/csv11.prs -u results/csv11.dup
+SELECT * FROM target_like ORDER BY id;
+
+-- a pattern matching one file is read as a plain file
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i 'data/data[8].csv' -l results/csv22.log -P results/csv22.prs -u results/csv22.dup -o "MMAP=YES"
+SELECT * FROM target_like ORDER BY id;
+
+-- COLUMN_FORMAT; values not in the format are passed to the input function
+\! pg_bulkload -d contrib_regression data/csv8.ctl -i data/data10.csv -l results/csv12.log -P results/csv12.prs -u results/csv12.dup
+\! grep 'COLUMN_FORMAT "' results/csv12.log
+\! cat results/csv12.prs
+SET TimeZone = 'UTC';
+SET DateStyle = 'ISO';
+SELECT * FROM fmt_target ORDER BY id;
+RESET TimeZone;
+RESET DateStyle;
+
+-- FIELDS and HEADER; the header is read for each file
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i data/data11.csv -l results/csv13.log -P results/csv13.prs -u results/csv13.dup -o "FIELDS=id, -, str"
+SELECT * FROM target_like ORDER BY id;
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i 'data/data12.csv, data/data13.csv' -l results/csv14.log -P results/csv14.prs -u results/csv14.dup -o "HEADER=YES"
+SELECT * FROM target_like ORDER BY id;
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i data/data12.csv -l results/csv15.log -P results/csv15.prs -u results/csv15.dup -o "HEADER=YES" -o "FIELDS=-, -, id"
+SELECT * FROM target_like ORDER BY id;
+
+-- BATCH_SIZE rejects the same records as loading row at a time
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i data/data14.csv -l results/csv16.log -P results/csv16.prs -u results/csv16.dup -o "PARSE_ERRORS=3" -o "VERBOSE=YES"
+SELECT * FROM target_like ORDER BY id;
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i data/data14.csv -l results/csv17.log -P results/csv17.prs -u results/csv17.dup -o "PARSE_ERRORS=3" -o "VERBOSE=YES" -o "BATCH_SIZE=4"
+SELECT * FROM target_like ORDER BY id;
+\! diff results/csv16.prs results/csv17.prs
+\! grep 'Rejected\|Rows' results/csv16.log > results/csv16.err
+\! grep 'Rejected\|Rows' results/csv17.log | diff results/csv16.err -
+
+-- SKIP across the record buffer, SKIP_BYTES with SKIP, and files too short
+\! awk 'BEGIN { for (i = 1; i <= 100000; i++) print i ",x" i "," i }' > results/skip.csv
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i results/skip.csv -l results/csv18.log -P results/csv18.prs -u results/csv18.dup -o "SKIP=99997"
+SELECT * FROM target_like ORDER BY id;
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i results/skip.csv -l results/csv19.log -P results/csv19.prs -u results/csv19.dup -o "SKIP_BYTES=1866470" -o "SKIP=8"
+\! grep 'First record' results/csv19.log
+SELECT * FROM target_like ORDER BY id;
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i data/data14.csv -l results/csv20.log -P results/csv20.prs -u results/csv20.dup -o "SKIP=10"
+\! pg_bulkload -d contrib_regression data/csv5.ctl -i data/data14.csv -l results/csv21.log -P results/csv21.prs -u results/csv21.dup -o "SKIP_BYTES=100"
@@ -0,0 +1,156 @@
+-- FILTER_BATCH; the calls before an error are run again, and only the record
+-- in error is rejected
+CREATE TABLE filter_log (id int);
+CREATE FUNCTION batch_f(int4, text, int4) RETURNS target_like AS
+$$
+DECLARE
+    ret target_like;
+BEGIN
+    INSERT INTO filter_log VALUES ($1);
+    IF $3 < 0 THEN
+        RAISE EXCEPTION 'negative master %', $3;
+    END IF;
+    ret.id := $1;
+    ret.str := upper($2);
+    ret.master := $3;
+    RETURN ret;
+END;
+$$ LANGUAGE plpgsql;
+
+\pset null (null)
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data15.csv -l results/filter_call1.log -P results/filter_call1.prs -u results/filter_call1.dup -o "FILTER=batch_f" -o "BATCH_SIZE=4" -o "FILTER_BATCH=3"
+\! grep Rejected results/filter_call1.log
+\! cat results/filter_call1.prs
+SELECT * FROM target_like ORDER BY id;
+SELECT * FROM filter_log ORDER BY id;
+-- the rows of the calls run again are loaded
+CREATE SEQUENCE filter_seq;
+CREATE FUNCTION seq_f(int4, text, int4) RETURNS target_like AS
+$$
+DECLARE
+    ret target_like;
+BEGIN
+    IF $3 < 0 THEN
+        RAISE EXCEPTION 'negative master %', $3;
+    END IF;
+    ret.id := $1;
+    ret.str := $2;
+    ret.master := nextval('filter_seq');
+    RETURN ret;
+END;
+$$ LANGUAGE plpgsql;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data15.csv -l results/filter_call16.log -P results/filter_call16.prs -u results/filter_call16.dup -o "FILTER=seq_f" -o "BATCH_SIZE=4" -o "FILTER_BATCH=3"
+\! grep Rejected results/filter_call16.log
+SELECT * FROM target_like ORDER BY id;
+SELECT last_value FROM filter_seq;
+-- FILTER_BATCH needs BATCH_SIZE
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data15.csv -l results/filter_call17.log -P results/filter_call17.prs -u results/filter_call17.dup -o "FILTER=batch_f" -o "FILTER_BATCH=3"
+-- inlined SQL functions; the empty str is NULL
+CREATE FUNCTION inline_f(int4, text, int4) RETURNS target_like AS
+$$ SELECT $1, $2 || '!', $3 * 10 $$ LANGUAGE sql;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data16.csv -l results/filter_call2.log -P results/filter_call2.prs -u results/filter_call2.dup -o "FILTER=inline_f"
+SELECT * FROM target_like ORDER BY id;
+CREATE FUNCTION inline_strict_f(int4, text, int4) RETURNS target_like AS
+$$ SELECT $1, $2 || '!', $3 * 10 $$ LANGUAGE sql STRICT;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data16.csv -l results/filter_call3.log -P results/filter_call3.prs -u results/filter_call3.dup -o "FILTER=inline_strict_f"
+SELECT * FROM target_like ORDER BY id;
+-- SQL functions which cannot be inlined are called as usual
+CREATE FUNCTION inline_from_f(int4, text, int4) RETURNS target_like AS
+$$ SELECT $1, s.x, $3 FROM (SELECT upper($2) AS x) s $$ LANGUAGE sql;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data16.csv -l results/filter_call4.log -P results/filter_call4.prs -u results/filter_call4.dup -o "FILTER=inline_from_f"
+SELECT * FROM target_like ORDER BY id;
+CREATE FUNCTION inline_cast_f(int4, text, int4) RETURNS target_like AS
+$$ SELECT $1, $2::varchar, $3 $$ LANGUAGE sql;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data16.csv -l results/filter_call5.log -P results/filter_call5.prs -u results/filter_call5.dup -o "FILTER=inline_cast_f"
+SELECT * FROM target_like ORDER BY id;
+-- dropped columns of the target are NULL
+CREATE TABLE filter_drop (id int, dropped int, str text, master int);
+ALTER TABLE filter_drop DROP COLUMN dropped;
+CREATE FUNCTION inline_drop_f(int4, text, int4) RETURNS filter_drop AS
+$$ SELECT $1, $2, $3 $$ LANGUAGE sql;
+\! pg_bulkload -d contrib_regression data/filter2.ctl -i data/data16.csv -l results/filter_call6.log -P results/filter_call6.prs -u results/filter_call6.dup -o "FILTER=inline_drop_f"
+SELECT * FROM filter_drop ORDER BY id;
+-- inlined functions share the sub-transaction of the records read at a time
+CREATE FUNCTION inline_div_f(int4, text, int4) RETURNS target_like AS
+$$ SELECT $1, upper($2), 100 / $3 $$ LANGUAGE sql;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data17.csv -l results/filter_call18.log -P results/filter_call18.prs -u results/filter_call18.dup -o "FILTER=inline_div_f" -o "BATCH_SIZE=4"
+\! grep Rejected results/filter_call18.log
+\! cat results/filter_call18.prs
+SELECT * FROM target_like ORDER BY id;
+-- functions taking arrays; if the call for a batch fails, they are called
+-- for each record, and only the records in error are rejected
+CREATE FUNCTION array_f(int4[], text[], int4[]) RETURNS SETOF target_like AS
+$$ SELECT $1[i], upper($2[i]), 100 / $3[i] FROM generate_series(1, array_upper($1, 1)) i $$
+LANGUAGE sql;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data17.csv -l results/filter_call7.log -P results/filter_call7.prs -u results/filter_call7.dup -o "FILTER=array_f" -o "BATCH_SIZE=4"
+\! grep Rejected results/filter_call7.log
+\! cat results/filter_call7.prs
+SELECT * FROM target_like ORDER BY id;
+CREATE FUNCTION array_where_f(int4[], text[], int4[]) RETURNS SETOF target_like AS
+$$ SELECT $1[i], upper($2[i]), $3[i] FROM generate_series(1, array_upper($1, 1)) i WHERE $3[i] IS NOT NULL $$
+LANGUAGE sql;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data17.csv -l results/filter_call8.log -P results/filter_call8.prs -u results/filter_call8.dup -o "FILTER=array_where_f" -o "BATCH_SIZE=4"
+\! grep Rejected results/filter_call8.log
+\! cat results/filter_call8.prs
+SELECT * FROM target_like ORDER BY id;
+-- SFRM_Materialize, with and without BATCH_SIZE
+CREATE FUNCTION array_next_f(int4[], text[], int4[]) RETURNS SETOF target_like AS
+$$
+DECLARE
+    ret target_like;
+BEGIN
+    FOR i IN 1 .. array_upper($1, 1) LOOP
+        ret.id := $1[i];
+        ret.str := upper($2[i]);
+        ret.master := 100 / $3[i];
+        RETURN NEXT ret;
+    END LOOP;
+    RETURN;
+END;
+$$ LANGUAGE plpgsql;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data17.csv -l results/filter_call9.log -P results/filter_call9.prs -u results/filter_call9.dup -o "FILTER=array_next_f" -o "BATCH_SIZE=4"
+\! grep Rejected results/filter_call9.log
+SELECT * FROM target_like ORDER BY id;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data17.csv -l results/filter_call10.log -P results/filter_call10.prs -u results/filter_call10.dup -o "FILTER=array_next_f"
+\! grep Rejected results/filter_call10.log
+SELECT * FROM target_like ORDER BY id;
+-- rows returned in SFRM_Materialize survive the next rows of the set
+CREATE FUNCTION array_query_f(int4[], text[], int4[]) RETURNS SETOF target_like AS
+$$
+BEGIN
+    RETURN QUERY SELECT $1[i], repeat(upper($2[i]), 1000), $3[i] FROM generate_series(1, array_upper($1, 1)) i;
+END;
+$$ LANGUAGE plpgsql;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data15.csv -l results/filter_call15.log -P results/filter_call15.prs -u results/filter_call15.dup -o "FILTER=array_query_f" -o "BATCH_SIZE=8"
+SELECT id, length(str), substr(str, 1, 3), master FROM target_like ORDER BY id;
+-- default arguments are not supported
+CREATE FUNCTION array_default_f(int4[], text[], int4[] DEFAULT NULL) RETURNS SETOF target_like AS
+$$ SELECT $1[i], $2[i], $3[i] FROM generate_series(1, array_upper($1, 1)) i $$
+LANGUAGE sql;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data17.csv -l results/filter_call11.log -P results/filter_call11.prs -u results/filter_call11.dup -o "FILTER=array_default_f" -o "BATCH_SIZE=4"
+-- results of IMMUTABLE functions are cached, including NULL
+CREATE FUNCTION cache_f(int4, text, int4) RETURNS target_like AS
+$$
+DECLARE
+    ret target_like;
+BEGIN
+    IF $3 = 0 THEN
+        RETURN NULL;
+    END IF;
+    ret.id := $1;
+    ret.str := upper($2);
+    ret.master := $3;
+    RETURN ret;
+END;
+$$ LANGUAGE plpgsql IMMUTABLE;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data18.csv -l results/filter_call12.log -P results/filter_call12.prs -u results/filter_call12.dup -o "FILTER=cache_f"
+\! grep 'FILTER cache' results/filter_call12.log
+SELECT * FROM target_like ORDER BY id;
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i data/data18.csv -l results/filter_call13.log -P results/filter_call13.prs -u results/filter_call13.dup -o "FILTER=cache_f" -o "FILTER_CACHE=0"
+\! grep 'FILTER cache' results/filter_call13.log
+SELECT * FROM target_like ORDER BY id;
+-- the cache is disabled if it is hardly hit
+\! awk 'BEGIN { for (i = 1; i <= 10005; i++) print i ",x," i }' > results/filter_cache.csv
+\! pg_bulkload -d contrib_regression data/filter1.ctl -i results/filter_cache.csv -l results/filter_call14.log -P results/filter_call14.prs -u results/filter_call14.dup -o "FILTER=cache_f"
+\! grep 'FILTER cache' results/filter_call14.log
+SELECT count(*), min(id), max(id) FROM target_like WHERE str = 'X';
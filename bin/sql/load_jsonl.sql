@@ -0,0 +1,22 @@
+-- KEY maps keys to columns, escapes are resolved, the last of duplicate keys
+-- is loaded and objects are loaded as JSON text
+\pset null (null)
+\! pg_bulkload -d contrib_regression data/jsonl1.ctl -i data/data1.jsonl -l results/jsonl1.log -P results/jsonl1.prs -u results/jsonl1.dup
+\! grep Rejected results/jsonl1.log
+\! grep 'not mapped' results/jsonl1.log
+\! cat results/jsonl1.prs
+SELECT * FROM target_like ORDER BY id;
+
+-- the input is in UTF-8, and \u escapes are resolved into UTF-8
+\connect contrib_regression_utf8
+\! pg_bulkload -d contrib_regression_utf8 data/jsonl2.ctl -i data/data2.jsonl -l results/jsonl2.log -P results/jsonl2.prs -u results/jsonl2.dup
+\! grep Rejected results/jsonl2.log
+SELECT id, encode(str::bytea, 'hex'), master FROM target ORDER BY id;
+
+\connect contrib_regression_sqlascii
+\! pg_bulkload -d contrib_regression_sqlascii data/jsonl2.ctl -i data/data2.jsonl -l results/jsonl3.log -P results/jsonl3.prs -u results/jsonl3.dup
+\! grep Rejected results/jsonl3.log
+SELECT id, encode(str::bytea, 'hex'), master FROM target ORDER BY id;
+
+-- ENCODING other than UTF8 is an error
+\! pg_bulkload -d contrib_regression_sqlascii data/jsonl2.ctl -i data/data2.jsonl -l results/jsonl4.log -P results/jsonl4.prs -u results/jsonl4.dup -o "ENCODING=LATIN1"
@@ -0,0 +1,6 @@
+-- values of keys mapped to json columns are loaded as JSON text
+\pset null (null)
+CREATE TABLE jsonl_target (id int, j json);
+\! pg_bulkload -d contrib_regression data/jsonl3.ctl -i data/data3.jsonl -l results/jsonl5.log -P results/jsonl5.prs -u results/jsonl5.dup
+SELECT id, j::text FROM jsonl_target ORDER BY id;
+DROP TABLE jsonl_target;
@@ -0,0 +1,18 @@
+-- a file with OIDs; records of a wrong field count or field size are rejected
+\! pg_bulkload -d contrib_regression data/pgcopy1.ctl -i data/data1.pgcopy -l results/pgcopy1.log -P results/pgcopy1.prs -u results/pgcopy1.dup
+\! grep Rejected results/pgcopy1.log
+SELECT * FROM target_like ORDER BY id;
+
+-- the parse badfile is a COPY binary file without OIDs
+\! pg_bulkload -d contrib_regression data/pgcopy1.ctl -i results/pgcopy1.prs -l results/pgcopy2.log -P results/pgcopy2.prs -u results/pgcopy2.dup
+\! grep Rejected results/pgcopy2.log
+\! cmp results/pgcopy1.prs results/pgcopy2.prs
+
+-- a skipped field
+\! pg_bulkload -d contrib_regression data/pgcopy1.ctl -i data/data2.pgcopy -l results/pgcopy3.log -P results/pgcopy3.prs -u results/pgcopy3.dup -o "FIELDS=id, -, master"
+SELECT * FROM target_like ORDER BY id;
+
+-- SKIP applies to each file
+\! pg_bulkload -d contrib_regression data/pgcopy1.ctl -i 'data/data1.pgcopy, data/data2.pgcopy' -l results/pgcopy4.log -P results/pgcopy4.prs -u results/pgcopy4.dup -o "SKIP=1"
+\! grep 'Rejected\|Input file' results/pgcopy4.log | sed 's/"[^"]*\//"/'
+SELECT * FROM target_like ORDER BY id;
@@ -0,0 +1,6 @@
+-- \N is NULL, backslash escapes are resolved and \. ends the input
+\pset null (null)
+\! pg_bulkload -d contrib_regression data/text1.ctl -i data/data1.txt -l results/text1.log -P results/text1.prs -u results/text1.dup
+\! grep Rejected results/text1.log
+\! cat results/text1.prs
+SELECT * FROM target_like ORDER BY id;
@@ -17,23 +17,32 @@
 typedef struct Field	Field;
 typedef Datum (*Read)(TupleFormer *former, char *in, const Field* field, int i, bool *isnull);
 typedef void (*Write)(char *out, size_t len, Datum value, bool null);
+typedef void (*ReadColumn)(const Field *field, Oid typid, const char *in, size_t stride, int n, Datum *values, bool *isnull);
 
 struct Field
 {
 	Read	read;		/**< parse function of the field */
 	Write	write;		/**< write function of the field */
+	ReadColumn	readColumn;	/**< parse function for records at once, if any */
 	int		offset;		/**< offset from head */
-	int		len;		/**< byte length of the field */
+	int		len;		/**< byte length of the field, or of the prefix */
+	int		prefix;		/**< byte length of the length prefix, or 0 */
 	char   *nullif;		/**< null pattern, if any */
 	int		nulllen;	/**< length of nullif */
 	char   *in;			/**< pointer to the character string or binary */
 	bool	character;	/**< field is CHAR or VARCHAR? */
 	Oid		typeid;		/**< field typeid */
+	char	endian;		/**< 'B' or 'L' if byte order is specified */
+	bool	swap;		/**< byte order differs from the server's? */
 	char   *str;		/**< work buffer */
 };
 
 extern void BinaryParam(Field **fields, int *nfield, char *value, bool preserve_blanks, bool length_only);
 extern int BinaryDumpParam(Field *field, StringInfo buf, int offset);
 extern void BinaryDumpParams(Field *fields, int nfield, StringInfo buf, char *param);
+extern bool BinaryColumnar(const Field *field, Oid typid);
+extern void BinaryParsePrefix(const char *value, int *len, char *endian);
+extern uint32 BinaryReadPrefix(const char *in, int len, char endian);
+extern void BinaryReverseBytes(char *p, int len);
 
 #endif   /* BINARY_H_INCLUDED */
@@ -18,26 +18,82 @@
 #include "nodes/execnodes.h"
 #include "nodes/primnodes.h"
 #include "utils/relcache.h"
+#include "utils/resowner.h"
 
 /*
  * Source
  */
 
 typedef size_t (*SourceReadProc)(Source *self, void *buffer, size_t len);
+typedef char *(*SourceWindowProc)(Source *self, size_t need, size_t *avail);
+typedef void (*SourceConsumeProc)(Source *self, size_t len);
+typedef int64 (*SourceSkipProc)(Source *self, int64 len);
+typedef bool (*SourceNextFileProc)(Source *self);
 typedef void (*SourceCloseProc)(Source *self);
 
+/*
+ * window and consume are optional. A source that has them can lend its
+ * buffer to parsers instead of copying data out with read: window returns
+ * a read-only pointer to the data at the current position with at least
+ * 'need' bytes, or less only at end of input, and the pointer is valid until
+ * the next call to the source. consume advances the current position.
+ *
+ * A source reading multiple files returns EOF at the end of each file, and
+ * next_file moves to the head of the next file. It returns false after the
+ * last file.
+ *
+ * skip is optional. A source that has it can move forward without reading
+ * the data; SourceSkip() reads and discards the data otherwise. It returns
+ * the number of bytes skipped, which is less than 'len' only at end of input.
+ */
 struct Source
 {
-	SourceReadProc		read;	/** read */
-	SourceCloseProc		close;	/** close */
+	SourceReadProc		read;		/** read */
+	SourceWindowProc	window;		/** lend a window (optional) */
+	SourceConsumeProc	consume;	/** advance over lent data (optional) */
+	SourceSkipProc		skip;		/** skip without reading (optional) */
+	SourceNextFileProc	next_file;	/** go to the next file (optional) */
+	SourceCloseProc		close;		/** close */
+
+	const char		   *filename;	/** current file if INPUT has multiple files */
 };
 
-extern Source *CreateSource(const char *path, TupleDesc desc, bool async_read);
+/**
+ * @brief Compression method of the input file.
+ */
+typedef enum SourceCompression
+{
+	COMPRESSION_NONE,
+	COMPRESSION_AUTO,			/**< detect by magic number */
+	COMPRESSION_GZIP,
+	COMPRESSION_ZSTD,
+	COMPRESSION_LZ4
+} SourceCompression;
+
+/**
+ * @brief Source options given in the control file.
+ */
+typedef struct SourceOptions
+{
+	bool				use_mmap;		/**< map the input file into memory? */
+	SourceCompression	compression;	/**< compression of the input file */
+} SourceOptions;
+
+extern Source *CreateSource(const char *path, TupleDesc desc, bool async_read, const SourceOptions *options);
+extern bool SourceParam(SourceOptions *options, const char *keyword, char *value);
+extern void SourceDumpParams(const SourceOptions *options, StringInfo buf);
+extern int64 SourceSkip(Source *self, int64 len);
 
 #define SourceRead(self, buffer, len)	((self)->read((self), (buffer), (len)))
+#define SourceHasWindow(self)			((self)->window != NULL)
+#define SourceWindow(self, need, avail)	((self)->window((self), (need), (avail)))
+#define SourceConsume(self, len)		((self)->consume((self), (len)))
+#define SourceNextFile(self)			((self)->next_file ? (self)->next_file((self)) : false)
 #define SourceClose(self)				((self)->close((self)))
 
 typedef struct Checker	Checker;
+typedef struct RecordBatch	RecordBatch;
+typedef struct Filter	Filter;
 
 /*
  * Parser
@@ -49,6 +105,8 @@ typedef int64 (*ParserTermProc)(Parser *self);
 typedef bool (*ParserParamProc)(Parser *self, const char *keyword, char *value);
 typedef void (*ParserDumpParamsProc)(Parser *self);
 typedef void (*ParserDumpRecordProc)(Parser *self, FILE *fp, char *badfile);
+typedef bool (*ParserNextFileProc)(Parser *self);
+typedef bool (*ParserReadBatchProc)(Parser *self, Checker *checker, RecordBatch *batch, int max);
 
 struct Parser
 {
@@ -58,15 +116,35 @@ struct Parser
 	ParserParamProc			param;		/**< parse a parameter */
 	ParserDumpParamsProc	dumpParams;	/**< dump parameters */
 	ParserDumpRecordProc	dumpRecord;	/**< dump parse error record */
+	ParserNextFileProc		nextFile;	/**< go to the next input file (optional) */
+
+	/*
+	 * readBatch is optional. It appends records to the batch until it has
+	 * max records, and returns false at the end of the current input file,
+	 * so that a batch never spans input files. The parser sets its
+	 * TupleFormer to the batch, and for each record calls RecordBatchStart()
+	 * and RecordBatchRecord() as soon as the extent of the record is known,
+	 * then RecordBatchField() for each field and RecordBatchEnd() when the
+	 * record is parsed. A record which raises an error in between is kept in
+	 * the batch as rejected.
+	 */
+	ParserReadBatchProc		readBatch;	/**< read records into a batch (optional) */
 
 	int			parsing_field;	/**< field number being parsed */
 	int64		count;			/**< number of records read from stream */
+	const char *filename;		/**< current file if INPUT has multiple files */
+	bool		reuse_tuple;	/**< tuples read are overwritten by the next read */
+	Filter	   *filter;			/**< FILTER of the parser, or NULL */
 };
 
 extern Parser *CreateBinaryParser(void);
 extern Parser *CreateCSVParser(void);
+extern Parser *CreateTextParser(void);
 extern Parser *CreateTupleParser(void);
 extern Parser *CreateFunctionParser(void);
+extern Parser *CreatePgCopyBinaryParser(void);
+extern Parser *CreateJSONLParser(void);
+extern Parser *CreateArrowParser(void);
 
 #define ParserInit(self, checker, infile, relid, multi_process, collation)		((self)->init((self), (checker), (infile), (relid), (multi_process), (collation)))
 #define ParserRead(self, checker)					((self)->read((self), (checker)))
@@ -74,6 +152,10 @@ extern Parser *CreateFunctionParser(void);
 #define ParserParam(self, keyword, value)	((self)->param((self), (keyword), (value)))
 #define ParserDumpParams(self)				((self)->dumpParams((self)))
 #define ParserDumpRecord(self, fp, fname)	((self)->dumpRecord((self), (fp), (fname)))
+#define ParserNextFile(self)				((self)->nextFile ? (self)->nextFile((self)) : false)
+#define ParserReadBatch(self, checker, batch, max)	((self)->readBatch((self), (checker), (batch), (max)))
+
+extern void ParserLogOffset(Parser *self, int64 offset);
 
 /* Checker */
 
@@ -123,6 +205,8 @@ struct Checker
 	bool			check_encoding;	/**< encoding check needed? */
 	int				encoding;		/**< input data encoding */
 	int				db_encoding;	/**< database encoding */
+	bool			source_conversion;	/**< converted by the source? */
+	bool			check_fields;	/**< the source found invalid input */
 
 	/* Check the constraints */
 	bool			check_constraints;
@@ -135,9 +219,20 @@ struct Checker
 	TupleChecker   *tchecker;
 };
 
+/* the input is converted, and not only checked */
+#define CheckerNeedConversion(checker) \
+	((checker)->encoding != (checker)->db_encoding && \
+	 (checker)->encoding != PG_SQL_ASCII && \
+	 (checker)->db_encoding != PG_SQL_ASCII)
+
 extern void CheckerInit(Checker *checker, Relation rel, TupleChecker *tchecker);
 extern void CheckerTerm(Checker *checker);
 extern char *CheckerConversion(Checker *checker, char *src);
+extern char *CheckerConversionBytes(Checker *checker, char *src, int len);
+extern bool CheckerVerifyBytes(Checker *checker, const char *src, int len);
+extern void CheckerVerifyField(Checker *checker, char *str);
+extern bool CheckerWriteRecord(Checker *checker, FILE *fp, const char *data, size_t len);
+extern Source *CreateConversionSource(Source *source, Checker *checker);
 extern HeapTuple CheckerConstraints(Checker *checker, HeapTuple tuple, int *parsing_field);
 
 /**
@@ -169,17 +264,46 @@ struct Reader
 	 */
 	int64			parse_errors;	/**< number of parse errors ignored */
 	FILE		   *parse_fp;
+	int64			file_count;		/**< records read before the current file */
+	int64			file_errors;	/**< parse errors before the current file */
+
+	int				batch_size;		/**< records read at a time */
+	int				filter_batch;	/**< records filtered in a sub-transaction */
+	int				filter_cache;	/**< results of IMMUTABLE FILTER cached, or -1 */
+	RecordBatch	   *batch;			/**< records being read, or NULL */
+	bool			file_done;		/**< the current file ended in the batch */
+	bool			eof;			/**< no more records to read */
 };
 
 extern Reader *ReaderCreate(char *type);
 extern void ReaderInit(Reader *self);
 extern bool ReaderParam(Reader *rd, const char *keyword, char *value);
 extern HeapTuple ReaderNext(Reader *rd);
+extern int ReaderNextBatch(Reader *rd, int64 max, HeapTuple **tuples);
 extern void ReaderDumpParams(Reader *rd);
 extern int64 ReaderClose(Reader *rd, bool onError);
 
 /* TupleFormer */
 
+/**
+ * @brief Fast input function.  Returns false if the string must be passed to
+ * the input function of the type.
+ */
+typedef bool (*FastInputProc)(const char *str, int32 typmod, Datum *value);
+
+/**
+ * @brief Fixed format of date and time values given by COLUMN_FORMAT.
+ */
+typedef struct ColumnFormat
+{
+	char	   *format;		/**< format string */
+	Oid			typeid;		/**< date, time, timestamp or timestamptz */
+	struct FormatItem *items;	/**< parsed format */
+	int			nitems;		/**< number of items */
+	int64		tz_hour;	/**< local hour of tz_offset, or -1 */
+	int			tz_offset;	/**< cached offset of the session time zone */
+} ColumnFormat;
+
 typedef struct TupleFormer
 {
 	TupleDesc	desc;		/**< descriptor */
@@ -189,16 +313,66 @@ typedef struct TupleFormer
 	Oid		   *typIOParam;	/**< array[desc->natts] of type information */
 	FmgrInfo   *typInput;	/**< array[desc->natts] of type input functions */
 	Oid		   *typMod;		/**< array[desc->natts] of type modifiers */
-	int		   *attnum;		/**< array[maxfields] of attnum mapping */
+	FastInputProc *typFast;	/**< array[desc->natts] of fast input functions */
+	int64	   *fastHits;	/**< array[desc->natts] of values read by typFast or typFormat */
+	int64	   *fastMisses;	/**< array[desc->natts] of values they passed */
+	List	   *formats;	/**< list of COLUMN_FORMAT options */
+	ColumnFormat **typFormat;	/**< array[desc->natts] of COLUMN_FORMAT */
+	List	   *fields;		/**< list of FIELDS names */
+	int		   *attnum;		/**< array[maxfields] of attnum mapping, or -1 to skip */
 	int			minfields;	/**< min number of valid fields */
 	int			maxfields;	/**< max number of valid fields */
 } TupleFormer;
 
-typedef struct Filter	Filter;
+/**
+ * @brief Records read at a time, stored field by field.
+ *
+ * The string of the field f in the record r is at
+ * data.data + offsets[f * capacity + r] unless nulls[f * capacity + r] is
+ * set.  The values are read from the strings of a field for all records at
+ * once, so the input function of each column runs over the whole batch.
+ * A record rejected while parsing has an error message instead of fields.
+ */
+struct RecordBatch
+{
+	MemoryContext	context;	/**< context of the arrays */
+	TupleFormer	   *former;		/**< former of the parser */
+	int			capacity;		/**< max number of records */
+	int			nrecords;		/**< number of records */
+	int			nfields;		/**< number of fields of each record */
+	int			maxfields;		/**< fields allocated for each record */
+	bool		pending;		/**< a record is started but not ended */
+	int		   *offsets;		/**< array[maxfields * capacity] of offsets to data */
+	int		   *lengths;		/**< array[maxfields * capacity] of string lengths */
+	bool	   *nulls;			/**< array[maxfields * capacity] of NULL markers */
+	Datum	   *values;			/**< array[maxfields * capacity] of values */
+	int64	   *count;			/**< array[capacity] of record numbers in the input */
+	int		   *record;			/**< array[capacity] of offsets of the records to data */
+	int		   *record_len;		/**< array[capacity] of length of the records */
+	int		   *error;			/**< array[capacity] of offsets of error messages to data, or -1 */
+	int		   *error_field;	/**< array[capacity] of fields causing the errors */
+	HeapTuple  *tuples;			/**< array[capacity] of tuples formed */
+	struct Filter *filter;		/**< FILTER taking arrays of the parser, or NULL */
+	HeapTuple  *filtered;		/**< array[capacity] of rows returned by FILTER */
+	StringInfoData	data;		/**< records for the parse bad file, field strings and error messages */
+};
+
+extern RecordBatch *RecordBatchCreate(int capacity);
+extern void RecordBatchStart(RecordBatch *batch, int64 count);
+extern void RecordBatchRecord(RecordBatch *batch, const char *data, int len);
+extern void RecordBatchField(RecordBatch *batch, int field, const char *str);
+extern void RecordBatchEnd(RecordBatch *batch);
+
 extern void TupleFormerInit(TupleFormer *former, Filter *filter, TupleDesc desc);
 extern void TupleFormerTerm(TupleFormer *former);
 extern HeapTuple TupleFormerTuple(TupleFormer *former);
 extern Datum TupleFormerValue(TupleFormer *former, const char *str, int col);
+extern void TupleFormerSetFields(TupleFormer *former, List *names, bool skip_unknown);
+extern bool TupleFormerParam(TupleFormer *former, const char *keyword, char *value);
+extern void TupleFormerDumpParams(const TupleFormer *former, StringInfo buf);
+extern FastInputProc FastInputLookup(Oid typeid, int32 typmod);
+extern ColumnFormat *ColumnFormatCreate(const char *format, Oid typeid);
+extern bool ColumnFormatInput(ColumnFormat *self, const char *str, int32 typmod, Datum *value);
 
 /* Filter */
 
@@ -210,13 +384,47 @@ struct Filter
 	int				fn_ndargs;
 	bool			fn_strict;
 	Oid				argtypes[FUNC_MAX_ARGS];
+	int16		   *arglen;			/* of argtypes */
+	bool		   *argbyval;
+	char		   *argalign;
 	Datum		   *defaultValues;
 	bool		   *defaultIsnull;
 	ExprContext	   *econtext;
-	HeapTupleData	tuple;
 	bool			tupledesc_matched;
 	Oid				fn_rettype;
 	Oid				collation;
+	FmgrInfo		flinfo;
+	FunctionCallInfoData	fcinfo;
+
+	/* SQL function inlined into expressions of the columns */
+	TupleDesc		desc;			/* target of the expressions */
+	ExprState	  **exprs;			/* expression of each column, or NULL */
+	Datum		   *values;
+	bool		   *nulls;
+
+	/* function taking arrays of the records and returning SETOF rows */
+	bool			array;			/* argtypes are the element types */
+
+	/* results of an IMMUTABLE function cached by the arguments */
+	struct FilterCacheEntry *cache;	/* open addressing table, or NULL */
+	int				cache_mask;		/* number of slots - 1 */
+	int				cache_entries;
+	MemoryContext	cache_context;	/* arguments and rows of the entries */
+	int64			cache_hits;
+	int64			cache_misses;
+
+	int				cache_size;		/* max entries of the cache, or 0 */
+
+	/* FILTER_BATCH */
+	int				batch_size;		/* records in a sub-transaction, or 0 */
+	int				read_size;		/* records read at a time, or 0 */
+	int				batch_rows;		/* records in the sub-transaction */
+	bool		   *batch_called;	/* the function is called for the record? */
+	Datum		   *batch_args;		/* arguments of the calls, to run again */
+	bool		   *batch_nulls;
+	HeapTuple	   *batch_tuples;	/* rows returned by running them again */
+	int				batch_replayed;	/* records run again for the last error */
+	ResourceOwner	batch_owner;	/* owner of the sub-transaction, or NULL */
 };
 
 extern bool tupledesc_match(TupleDesc dst_tupdesc, TupleDesc src_tupdesc);
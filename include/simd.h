@@ -0,0 +1,61 @@
+/*
+ * pg_bulkload: include/simd.h
+ *
+ *	  Copyright (c) 2007-2011, NIPPON TELEGRAPH AND TELEPHONE CORPORATION
+ */
+
+/**
+ * @file
+ * @brief Vectorized byte scanning.
+ */
+#ifndef SIMD_H_INCLUDED
+#define SIMD_H_INCLUDED
+
+/**
+ * @brief Set of bytes to search for.  Unused slots repeat another byte.
+ */
+typedef struct ByteSet
+{
+	char	c[4];
+} ByteSet;
+
+/**
+ * @brief Returns the offset of the first byte in p[0 .. len-1] found in set,
+ * or len if there is no such byte.
+ *
+ * The implementation is chosen on the first call from what the CPU supports.
+ */
+typedef int (*ByteSetScan)(const char *p, int len, const ByteSet *set);
+
+extern ByteSetScan	SimdScan;
+extern void ByteSetInit(ByteSet *set, char c0, char c1, char c2, char c3);
+
+/**
+ * @brief Skips at most *lines lines ending with line feeds in p[0 .. len-1].
+ * Returns the offset just after the last line feed skipped, or the offset of
+ * the first carriage return or len if it comes first; *lines is decreased by
+ * the number of lines skipped.
+ *
+ * The implementation is chosen on the first call from what the CPU supports.
+ */
+typedef int (*LineSkip)(const char *p, int len, int64 *lines);
+
+extern LineSkip	SimdSkipLines;
+
+/**
+ * @brief Returns the offset of the first byte in p[0 .. len-1] with the high
+ * bit set, or len if all of them are ASCII.
+ */
+extern int ScanNonAscii(const char *p, int len);
+
+/**
+ * @brief Returns true if p[0 .. len-1] is valid UTF-8.  NUL bytes are
+ * accepted.
+ *
+ * The implementation is chosen on the first call from what the CPU supports.
+ */
+typedef bool (*Utf8Validate)(const char *p, int len);
+
+extern Utf8Validate	SimdUtf8Valid;
+
+#endif   /* SIMD_H_INCLUDED */
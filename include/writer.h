@@ -38,6 +38,7 @@ typedef struct WriterResult
 
 typedef void (*WriterInitProc)(Writer *self);
 typedef bool (*WriterInsertProc)(Writer *self, HeapTuple tuple);
+typedef void (*WriterInsertBatchProc)(Writer *self, HeapTuple *tuples, int ntuples);
 typedef WriterResult (*WriterCloseProc)(Writer *self, bool onError);
 typedef bool (*WriterParamProc)(Writer *self, const char *keyword, char *value);
 typedef void (*WriterDumpParamsProc)(Writer *self);
@@ -47,6 +48,7 @@ struct Writer
 {
 	WriterInitProc			init;		/**< initialize */
 	WriterInsertProc		insert;		/**< insert one tuple */
+	WriterInsertBatchProc	insertBatch;	/**< insert tuples (optional) */
 	WriterCloseProc			close;		/**< clean up */
 	WriterParamProc			param;		/**< parse a parameter */
 	WriterDumpParamsProc	dumpParams;	/**< dump parameters */
@@ -82,6 +84,7 @@ extern void WriterInit(Writer *self);
 extern WriterResult WriterClose(Writer *self, bool onError);
 extern bool WriterParam(Writer *self, const char *keyword, char *value);
 extern void WriterDumpParams(Writer *self);
+extern void WriterInsertBatch(Writer *self, HeapTuple *tuples, int ntuples);
 
 #define WriterInsert(self, tuple)	((self)->insert((self), (tuple)))
 
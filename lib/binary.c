@@ -12,6 +12,7 @@
 
 #include "catalog/pg_type.h"
 #include "utils/builtins.h"
+#include "utils/lsyscache.h"
 
 #include "binary.h"
 #include "pg_strutil.h"
@@ -26,6 +27,14 @@ static Datum Read_uint32(TupleFormer *former, char *in, const Field* field, int
 static Datum Read_float4(TupleFormer *former, char *in, const Field* field, int i, bool *isnull);
 static Datum Read_float8(TupleFormer *former, char *in, const Field* field, int i, bool *isnull);
 
+static void ReadColumn_int16(const Field *field, Oid typid, const char *in, size_t stride, int n, Datum *values, bool *isnull);
+static void ReadColumn_int32(const Field *field, Oid typid, const char *in, size_t stride, int n, Datum *values, bool *isnull);
+static void ReadColumn_int64(const Field *field, Oid typid, const char *in, size_t stride, int n, Datum *values, bool *isnull);
+static void ReadColumn_uint16(const Field *field, Oid typid, const char *in, size_t stride, int n, Datum *values, bool *isnull);
+static void ReadColumn_uint32(const Field *field, Oid typid, const char *in, size_t stride, int n, Datum *values, bool *isnull);
+static void ReadColumn_float4(const Field *field, Oid typid, const char *in, size_t stride, int n, Datum *values, bool *isnull);
+static void ReadColumn_float8(const Field *field, Oid typid, const char *in, size_t stride, int n, Datum *values, bool *isnull);
+
 static void Write_char(char *out, size_t len, Datum value, bool null);
 static void Write_int16(char *out, size_t len, Datum value, bool null);
 static void Write_int32(char *out, size_t len, Datum value, bool null);
@@ -53,20 +62,21 @@ struct TypeInfo
 	const char *name;
 	Read		read;
 	Write		write;
+	ReadColumn	readColumn;
 	int			len;
 	Oid			typeid;
 }
 TYPES[] =
 {
-	{ "CHAR"				, Read_char		, Write_char	, 0					, CSTRINGOID},
-	{ "VARCHAR"				, Read_varchar	, Write_char	, 0					, CSTRINGOID},
-	{ "SMALLINT"			, Read_int16	, Write_int16	, sizeof(int16)		, INT2OID	},
-	{ "INTEGER"				, Read_int32	, Write_int32	, sizeof(int32)		, INT4OID	},
-	{ "BIGINT"				, Read_int64	, Write_int64	, sizeof(int64)		, INT8OID	},
-	{ "UNSIGNED SMALLINT"	, Read_uint16	, Write_uint16	, sizeof(uint16)	, INT4OID	},
-	{ "UNSIGNED INTEGER"	, Read_uint32	, Write_uint32	, sizeof(uint32)	, INT8OID	},
-	{ "FLOAT"				, Read_float4	, Write_float4	, sizeof(float4)	, FLOAT4OID	},
-	{ "DOUBLE"				, Read_float8	, Write_float8	, sizeof(float8)	, FLOAT8OID	},
+	{ "CHAR"				, Read_char		, Write_char	, NULL				, 0					, CSTRINGOID},
+	{ "VARCHAR"				, Read_varchar	, Write_char	, NULL				, 0					, CSTRINGOID},
+	{ "SMALLINT"			, Read_int16	, Write_int16	, ReadColumn_int16	, sizeof(int16)		, INT2OID	},
+	{ "INTEGER"				, Read_int32	, Write_int32	, ReadColumn_int32	, sizeof(int32)		, INT4OID	},
+	{ "BIGINT"				, Read_int64	, Write_int64	, ReadColumn_int64	, sizeof(int64)		, INT8OID	},
+	{ "UNSIGNED SMALLINT"	, Read_uint16	, Write_uint16	, ReadColumn_uint16	, sizeof(uint16)	, INT4OID	},
+	{ "UNSIGNED INTEGER"	, Read_uint32	, Write_uint32	, ReadColumn_uint32	, sizeof(uint32)	, INT8OID	},
+	{ "FLOAT"				, Read_float4	, Write_float4	, ReadColumn_float4	, sizeof(float4)	, FLOAT4OID	},
+	{ "DOUBLE"				, Read_float8	, Write_float8	, ReadColumn_float8	, sizeof(float8)	, FLOAT8OID	},
 };
 
 struct TypeAlias
@@ -117,6 +127,18 @@ ParseTypeName(const char *value)
 	return 0;	/* keep complier quiet */
 }
 
+/*
+ * Returns 'B' or 'L' if the string starts with byte order BE or LE.
+ */
+static char
+ParseByteOrder(const char *s)
+{
+	if ((pg_strncasecmp(s, "BE", 2) == 0 || pg_strncasecmp(s, "LE", 2) == 0) &&
+		(s[2] == '\0' || isspace((unsigned char) s[2])))
+		return toupper((unsigned char) s[0]);
+	return '\0';
+}
+
 /*
  * Is string terminated with ')' ?
  */
@@ -215,7 +237,8 @@ hex_out(int c)
 }
 
 /*
- * Parse field format like "TYPE(STRIDE) NULLIF { 'str' | hex }"
+ * Parse field format like
+ * "TYPE(STRIDE) [PREFIX(N)] [BE | LE] NULLIF { 'str' | hex }"
  */
 static void
 ParseFormat(const char *value, Field *field, bool length_only)
@@ -223,11 +246,13 @@ ParseFormat(const char *value, Field *field, bool length_only)
 	StringInfoData	buf;
 	TypeId		id;
 	size_t		nulliflen;
+	size_t		prefixlen;
 	const char *p;
 	const struct TypeInfo *type;
 
 	initStringInfo(&buf);
 	nulliflen = strlen("NULLIF");
+	prefixlen = strlen("PREFIX");
 
 	/* parse typename */
 	p = value;
@@ -247,7 +272,8 @@ ParseFormat(const char *value, Field *field, bool length_only)
 		while (isspace((unsigned char) *p))
 			p++;
 
-		if (*p == '(' || *p == '\0' ||
+		if (*p == '(' || *p == '\0' || ParseByteOrder(p) ||
+			pg_strncasecmp(p, "PREFIX", prefixlen) == 0 ||
 			pg_strncasecmp(p, "NULLIF", nulliflen) == 0)
 			break;
 	}
@@ -278,6 +304,48 @@ ParseFormat(const char *value, Field *field, bool length_only)
 	else
 		field->len = type->len;	/* use default */
 
+	/* parse length prefix */
+	field->prefix = 0;
+	if (pg_strncasecmp(p, "PREFIX", prefixlen) == 0)
+	{
+		char   *end;
+
+		if (length_only)
+			ereport(ERROR, (errcode(ERRCODE_SYNTAX_ERROR),
+				errmsg("PREFIX is available only for input : %s", value)));
+		if (id != T_VARCHAR)
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("PREFIX is available only for VARCHAR : %s", value)));
+		if (field->len > 0)
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("TYPE length cannot be specified with PREFIX : %s", value)));
+
+		p += prefixlen;
+		while (isspace((unsigned char) *p))
+			p++;
+		if (*p != '(')
+			ereport(ERROR, (errcode(ERRCODE_SYNTAX_ERROR),
+				errmsg("PREFIX argument must be ( N ) : %s", value)));
+		field->prefix = strtol(p + 1, &end, 0);
+		p = end;
+		if (!CheckRightparenthesis(p))
+			ereport(ERROR, (errcode(ERRCODE_SYNTAX_ERROR),
+				errmsg("PREFIX argument must be ( N ) : %s", value)));
+		if (field->prefix != 1 && field->prefix != 2 && field->prefix != 4)
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("length of PREFIX should be 1, 2 or 4")));
+
+		/* skip spaces and ')' */
+		while (isspace((unsigned char) *p))
+			p++;
+		p++;
+		while (isspace((unsigned char) *p))
+			p++;
+
+		/* the field is the prefix and the following string */
+		field->len = field->prefix;
+	}
+
 	switch (id)
 	{
 	case T_CHAR:
@@ -343,6 +411,23 @@ ParseFormat(const char *value, Field *field, bool length_only)
 		break;
 	}
 
+	/* parse byte order */
+	if ((field->endian = ParseByteOrder(p)) != '\0')
+	{
+		if (type->len == 0 && field->prefix == 0)
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("byte order cannot be specified for %s", type->name)));
+#ifdef WORDS_BIGENDIAN
+		field->swap = (field->endian == 'L');
+#else
+		field->swap = (field->endian == 'B');
+#endif
+
+		p += 2;
+		while (isspace((unsigned char) *p))
+			p++;
+	}
+
 	/* parse nullif */
 	if (pg_strncasecmp(p, "NULLIF", nulliflen) == 0 && isspace(p[nulliflen]))
 	{
@@ -402,12 +487,13 @@ ParseFormat(const char *value, Field *field, bool length_only)
 
 	field->read = type->read;
 	field->write = type->write;
+	field->readColumn = type->readColumn;
 	field->typeid = type->typeid;
 	field->character =
 		(field->read == Read_char || field->read == Read_varchar) ?
 			true : false;
 
-	if ((type->len == 0 && field->len < field->nulllen) ||
+	if ((type->len == 0 && field->prefix == 0 && field->len < field->nulllen) ||
         (type->len > 0 && field->nulllen > 0 && field->len != field->nulllen))
 	{
 		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
@@ -437,6 +523,10 @@ BinaryParam(Field **fields, int *nfield, char *value, bool preserve_blanks, bool
 		field->offset = 0;
 	field->nullif = "";
 	field->nulllen = 0;
+	field->prefix = 0;
+	field->readColumn = NULL;
+	field->endian = '\0';
+	field->swap = false;
 
 	if (isdigit((unsigned char) value[0]))
 	{
@@ -469,7 +559,9 @@ BinaryDumpParam(Field *field, StringInfo buf, int offset)
 	{
 		if (TYPES[i].read == field->read)
 		{
-			if (offset == field->offset)
+			if (field->prefix > 0)
+				appendStringInfo(buf, "%s PREFIX(%d)", TYPES[i].name, field->prefix);
+			else if (offset == field->offset)
 				appendStringInfo(buf, "%s (%d)", TYPES[i].name, field->len);
 			else
 				appendStringInfo(buf, "%s (%d + %d)", TYPES[i].name, field->offset + 1, field->len);
@@ -483,6 +575,9 @@ BinaryDumpParam(Field *field, StringInfo buf, int offset)
 		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 			errmsg("invalid type")));
 
+	if (field->endian)
+		appendStringInfo(buf, " %cE", field->endian);
+
 	if (field->nulllen > 0)
 	{
 		bool	hex;
@@ -553,7 +648,8 @@ Read_char(TupleFormer *former, char *in, const Field* field, int idx, bool *isnu
 		/* Trim trailing spaces */
 		for (; len > 0 && IsWhiteSpace(in[len - 1]); len--);
 
-		memcpy(field->str, in, len);
+		/* in might be the work buffer itself */
+		memmove(field->str, in, len);
 		field->str[len] = '\0';
 
 		*isnull = false;
@@ -669,6 +765,8 @@ Read_##T(TupleFormer *former, char *in, const Field* field, int idx, bool *isnul
 		return 0; \
 	} \
 	memcpy(&v, in, sizeof(v)); \
+	if (field->swap) \
+		BinaryReverseBytes((char *) &v, sizeof(v)); \
 	*isnull = false; \
 	switch (former->typId[idx]) \
 	{ \
@@ -697,3 +795,168 @@ DefineRead(uint16)
 DefineRead(uint32)
 DefineRead(float4)
 DefineRead(float8)
+
+#define BSWAP16(x)	((uint16) (((x) << 8) | ((x) >> 8)))
+#define BSWAP32(x) \
+	((((x) << 24) & 0xFF000000) | (((x) << 8) & 0x00FF0000) | \
+	 (((x) >> 8) & 0x0000FF00) | (((x) >> 24) & 0x000000FF))
+#define BSWAP64(x) \
+	(((uint64) BSWAP32((uint32) (x)) << 32) | \
+	 (uint64) BSWAP32((uint32) ((x) >> 32)))
+
+/*
+ * Read a field of n records at once. The column type is resolved once for
+ * the records, and the loop has no calls but memcpy of a constant size.
+ */
+#define READ_COLUMN(T, U, BSWAP, C, GetDatum) \
+	for (r = 0; r < n; r++, in += stride) \
+	{ \
+		U		u; \
+		T		v; \
+		if (field->nulllen > 0 && \
+			memcmp(in, field->nullif, field->nulllen) == 0) \
+		{ \
+			isnull[r] = true; \
+			values[r] = 0; \
+			continue; \
+		} \
+		memcpy(&u, in, sizeof(u)); \
+		if (swap) \
+			u = BSWAP(u); \
+		memcpy(&v, &u, sizeof(v)); \
+		isnull[r] = false; \
+		values[r] = GetDatum((C) v); \
+	}
+
+#define DefineReadColumn(T, U, BSWAP) \
+static void \
+ReadColumn_##T(const Field *field, Oid typid, const char *in, size_t stride, int n, Datum *values, bool *isnull) \
+{ \
+	bool	swap = field->swap; \
+	int		r; \
+	switch (typid) \
+	{ \
+	case INT2OID: \
+		READ_COLUMN(T, U, BSWAP, int16, Int16GetDatum); \
+		break; \
+	case INT4OID: \
+		READ_COLUMN(T, U, BSWAP, int32, Int32GetDatum); \
+		break; \
+	case INT8OID: \
+		READ_COLUMN(T, U, BSWAP, int64, Int64GetDatum); \
+		break; \
+	case FLOAT4OID: \
+		READ_COLUMN(T, U, BSWAP, float4, Float4GetDatum); \
+		break; \
+	case FLOAT8OID: \
+		READ_COLUMN(T, U, BSWAP, float8, Float8GetDatum); \
+		break; \
+	default: \
+		elog(ERROR, "unexpected column type: %u", typid); \
+	} \
+}
+
+DefineReadColumn(int16, uint16, BSWAP16)
+DefineReadColumn(int32, uint32, BSWAP32)
+DefineReadColumn(int64, uint64, BSWAP64)
+DefineReadColumn(uint16, uint16, BSWAP16)
+DefineReadColumn(uint32, uint32, BSWAP32)
+DefineReadColumn(float4, uint32, BSWAP32)
+DefineReadColumn(float8, uint64, BSWAP64)
+
+/*
+ * Can the field be read for records at once? The values must be cast to the
+ * column, which never fails, and passed by value to live until each tuple is
+ * formed.
+ */
+bool
+BinaryColumnar(const Field *field, Oid typid)
+{
+	if (field->readColumn == NULL)
+		return false;
+
+	switch (typid)
+	{
+	case INT2OID:
+	case INT4OID:
+	case INT8OID:
+	case FLOAT4OID:
+	case FLOAT8OID:
+		return get_typbyval(typid);
+	default:
+		return false;
+	}
+}
+
+/*
+ * Reverse the byte order of a value in place.
+ */
+void
+BinaryReverseBytes(char *p, int len)
+{
+	int		i;
+
+	for (i = 0; i < len / 2; i++)
+	{
+		char	c = p[i];
+
+		p[i] = p[len - 1 - i];
+		p[len - 1 - i] = c;
+	}
+}
+
+/*
+ * Parse length prefix like "N [BE | LE]".
+ */
+void
+BinaryParsePrefix(const char *value, int *len, char *endian)
+{
+	char   *p;
+
+	*len = strtol(value, &p, 0);
+	if (p == value || (*len != 1 && *len != 2 && *len != 4))
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			errmsg("length prefix should be 1, 2 or 4 bytes : %s", value)));
+
+	while (isspace((unsigned char) *p))
+		p++;
+	if ((*endian = ParseByteOrder(p)) != '\0')
+	{
+		p += 2;
+		while (isspace((unsigned char) *p))
+			p++;
+	}
+
+	if (*p != '\0')
+		ereport(ERROR, (errcode(ERRCODE_SYNTAX_ERROR),
+			errmsg("syntax error at or near \"%s\" : %s", p, value)));
+}
+
+/*
+ * Read an unsigned length prefix of len bytes.
+ */
+uint32
+BinaryReadPrefix(const char *in, int len, char endian)
+{
+	const unsigned char *p = (const unsigned char *) in;
+	uint32	v = 0;
+	int		i;
+
+	if (endian == '\0')
+	{
+#ifdef WORDS_BIGENDIAN
+		endian = 'B';
+#else
+		endian = 'L';
+#endif
+	}
+
+	if (endian == 'B')
+		for (i = 0; i < len; i++)
+			v = (v << 8) | p[i];
+	else
+		for (i = len - 1; i >= 0; i--)
+			v = (v << 8) | p[i];
+
+	return v;
+}
@@ -0,0 +1,877 @@
+/*
+ * pg_bulkload: lib/fast_input.c
+ *
+ *	  Copyright (c) 2011, NIPPON TELEGRAPH AND TELEPHONE CORPORATION
+ */
+
+/**
+ * @file
+ * @brief Fast input functions for common built-in types and for date and
+ * time values in the format given by COLUMN_FORMAT.
+ *
+ * Each function accepts only the plain form of the type, for example digits
+ * without surrounding spaces, and returns false for anything else so that
+ * the caller falls back to the input function of the type.  A value accepted
+ * here is always the same as what the input function returns.
+ */
+#include "pg_bulkload.h"
+
+#include <ctype.h>
+#include <float.h>
+
+#include "catalog/pg_type.h"
+#include "pgtime.h"
+#include "utils/builtins.h"
+#include "utils/datetime.h"
+#include "utils/date.h"
+#include "utils/timestamp.h"
+
+#include "reader.h"
+
+#if PG_VERSION_NUM < 80400
+#define session_timezone	global_timezone
+#endif
+
+/*
+ * Fast path of float input relies on IEEE arithmetic without excess
+ * precision; the x87 unit does not give it.
+ */
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+#define FAST_FLOAT_INPUT
+#endif
+
+static bool Int2FastIn(const char *str, int32 typmod, Datum *value);
+static bool Int4FastIn(const char *str, int32 typmod, Datum *value);
+static bool Int8FastIn(const char *str, int32 typmod, Datum *value);
+static bool NumericFastIn(const char *str, int32 typmod, Datum *value);
+#ifdef FAST_FLOAT_INPUT
+static bool Float4FastIn(const char *str, int32 typmod, Datum *value);
+static bool Float8FastIn(const char *str, int32 typmod, Datum *value);
+#endif
+static bool DateFastIn(const char *str, int32 typmod, Datum *value);
+static bool TextFastIn(const char *str, int32 typmod, Datum *value);
+static bool VarcharFastIn(const char *str, int32 typmod, Datum *value);
+#if PG_VERSION_NUM >= 90000
+static bool ByteaFastIn(const char *str, int32 typmod, Datum *value);
+#endif
+
+static const struct FastInput
+{
+	Oid				typeid;
+	FastInputProc	input;
+	bool			typmod;		/**< accepts a type modifier */
+}
+FAST_INPUTS[] =
+{
+	{ INT2OID		, Int2FastIn	, false	},
+	{ INT4OID		, Int4FastIn	, false	},
+	{ INT8OID		, Int8FastIn	, false	},
+	{ NUMERICOID	, NumericFastIn	, false	},
+#ifdef FAST_FLOAT_INPUT
+	{ FLOAT4OID		, Float4FastIn	, false	},
+	{ FLOAT8OID		, Float8FastIn	, false	},
+#endif
+	{ DATEOID		, DateFastIn	, false	},
+	{ TEXTOID		, TextFastIn	, false	},
+	{ VARCHAROID	, VarcharFastIn	, true	},
+#if PG_VERSION_NUM >= 90000
+	{ BYTEAOID		, ByteaFastIn	, false	},
+#endif
+};
+
+/**
+ * @brief Returns the fast input function for the type, or NULL.
+ */
+FastInputProc
+FastInputLookup(Oid typeid, int32 typmod)
+{
+	int		i;
+
+	for (i = 0; i < lengthof(FAST_INPUTS); i++)
+	{
+		if (FAST_INPUTS[i].typeid != typeid)
+			continue;
+		if (typmod >= 0 && !FAST_INPUTS[i].typmod)
+			return NULL;
+		return FAST_INPUTS[i].input;
+	}
+
+	return NULL;
+}
+
+static const double POW10[] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ * Parses an optionally signed decimal integer of at most maxdigits digits.
+ * The absolute value is returned to *abs.
+ */
+static bool
+ParseInteger(const char *str, int maxdigits, bool *neg, uint64 *abs)
+{
+	const char *s = str;
+	uint64		v = 0;
+
+	*neg = (*s == '-');
+	if (*s == '-' || *s == '+')
+		s++;
+	if (*s == '\0')
+		return false;
+
+	for (; *s >= '0' && *s <= '9'; s++)
+	{
+		if (--maxdigits < 0)
+			return false;
+		v = v * 10 + (*s - '0');
+	}
+	if (*s != '\0')
+		return false;
+
+	*abs = v;
+	return true;
+}
+
+static bool
+Int2FastIn(const char *str, int32 typmod, Datum *value)
+{
+	bool	neg;
+	uint64	v;
+
+	if (!ParseInteger(str, 5, &neg, &v) || v > (neg ? 32768 : 32767))
+		return false;
+	*value = Int16GetDatum((int16) (neg ? -(int64) v : (int64) v));
+	return true;
+}
+
+static bool
+Int4FastIn(const char *str, int32 typmod, Datum *value)
+{
+	bool	neg;
+	uint64	v;
+
+	if (!ParseInteger(str, 10, &neg, &v) ||
+		v > (neg ? UINT64CONST(2147483648) : UINT64CONST(2147483647)))
+		return false;
+	*value = Int32GetDatum((int32) (neg ? -(int64) v : (int64) v));
+	return true;
+}
+
+static bool
+Int8FastIn(const char *str, int32 typmod, Datum *value)
+{
+	bool	neg;
+	uint64	v;
+
+	/* 19 digits never overflow uint64 */
+	if (!ParseInteger(str, 19, &neg, &v) ||
+		v > (neg ? UINT64CONST(0x8000000000000000) : UINT64CONST(0x7FFFFFFFFFFFFFFF)))
+		return false;
+	*value = Int64GetDatum(neg ? (int64) (0 - v) : (int64) v);
+	return true;
+}
+
+/*
+ * Integers without a type modifier are converted from int8, which skips
+ * the decimal parser of numeric_in.
+ */
+static bool
+NumericFastIn(const char *str, int32 typmod, Datum *value)
+{
+	bool	neg;
+	uint64	v;
+
+	if (!ParseInteger(str, 18, &neg, &v))
+		return false;
+	*value = DirectFunctionCall1(int8_numeric,
+								 Int64GetDatum(neg ? -(int64) v : (int64) v));
+	return true;
+}
+
+#ifdef FAST_FLOAT_INPUT
+
+/*
+ * Parses a decimal number of at most 19 significant digits into
+ * mantissa * 10^exponent.  Special values like NaN are rejected.
+ */
+static bool
+ParseDecimal(const char *str, bool *neg, uint64 *mantissa, int *exponent)
+{
+	const char *s = str;
+	uint64		m = 0;
+	int			digits = 0;		/* significant digits */
+	int			scale = 0;		/* digits after the decimal point */
+	bool		any = false;
+
+	*neg = (*s == '-');
+	if (*s == '-' || *s == '+')
+		s++;
+
+	for (; *s >= '0' && *s <= '9'; s++)
+	{
+		any = true;
+		if (m == 0 && *s == '0')
+			continue;
+		if (++digits > 19)
+			return false;
+		m = m * 10 + (*s - '0');
+	}
+	if (*s == '.')
+	{
+		for (s++; *s >= '0' && *s <= '9'; s++)
+		{
+			any = true;
+			scale++;
+			if (m == 0 && *s == '0')
+				continue;
+			if (++digits > 19)
+				return false;
+			m = m * 10 + (*s - '0');
+		}
+	}
+	if (!any)
+		return false;
+
+	if (*s == 'e' || *s == 'E')
+	{
+		bool	eneg;
+		uint64	e;
+
+		if (!ParseInteger(s + 1, 4, &eneg, &e))
+			return false;
+		*exponent = (eneg ? -(int) e : (int) e) - scale;
+	}
+	else if (*s == '\0')
+		*exponent = -scale;
+	else
+		return false;
+
+	*mantissa = m;
+	return true;
+}
+
+/*
+ * Clinger's fast path: when both the mantissa and the power of ten are
+ * exact, a single multiplication or division rounds correctly.
+ */
+static bool
+Float8FastIn(const char *str, int32 typmod, Datum *value)
+{
+	bool	neg;
+	uint64	m;
+	int		e;
+	double	d;
+
+	if (!ParseDecimal(str, &neg, &m, &e))
+		return false;
+
+	if (m == 0)
+		d = 0.0;
+	else if (m > (UINT64CONST(1) << 53) || e < -22 || e > 22)
+		return false;
+	else if (e >= 0)
+		d = (double) m * POW10[e];
+	else
+		d = (double) m / POW10[-e];
+
+	*value = Float8GetDatum(neg ? -d : d);
+	return true;
+}
+
+static bool
+Float4FastIn(const char *str, int32 typmod, Datum *value)
+{
+	bool	neg;
+	uint64	m;
+	int		e;
+	float4	f;
+
+	if (!ParseDecimal(str, &neg, &m, &e))
+		return false;
+
+#if PG_VERSION_NUM >= 120000
+	/* float4in rounds the decimal directly to float */
+	if (m == 0)
+		f = 0.0f;
+	else if (m > (UINT64CONST(1) << 24) || e < -10 || e > 10)
+		return false;
+	else if (e >= 0)
+		f = (float4) m * (float4) POW10[e];
+	else
+		f = (float4) m / (float4) POW10[-e];
+#else
+	/* float4in rounds the decimal to double, and then to float */
+	if (m == 0)
+		f = 0.0f;
+	else if (m > (UINT64CONST(1) << 53) || e < -22 || e > 22)
+		return false;
+	else if (e >= 0)
+		f = (float4) ((double) m * POW10[e]);
+	else
+		f = (float4) ((double) m / POW10[-e]);
+#endif
+
+	*value = Float4GetDatum(neg ? -f : f);
+	return true;
+}
+
+#endif   /* FAST_FLOAT_INPUT */
+
+/*
+ * ISO 8601 dates (YYYY-MM-DD) are read in the same way for any DateStyle.
+ */
+static bool
+DateFastIn(const char *str, int32 typmod, Datum *value)
+{
+	static const int mdays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	int		i;
+	int		y, m, d;
+
+	for (i = 0; i < 10; i++)
+	{
+		if (i == 4 || i == 7)
+		{
+			if (str[i] != '-')
+				return false;
+		}
+		else if (str[i] < '0' || str[i] > '9')
+			return false;
+	}
+	if (str[10] != '\0')
+		return false;
+
+	y = (str[0] - '0') * 1000 + (str[1] - '0') * 100 + (str[2] - '0') * 10 + (str[3] - '0');
+	m = (str[5] - '0') * 10 + (str[6] - '0');
+	d = (str[8] - '0') * 10 + (str[9] - '0');
+
+	if (y < 1 || m < 1 || m > 12 || d < 1 ||
+		d > mdays[m - 1] + (m == 2 && isleap(y)))
+		return false;
+
+	*value = DateADTGetDatum(date2j(y, m, d) - POSTGRES_EPOCH_JDATE);
+	return true;
+}
+
+/*
+ * Builds a text varlena from the field; textin does the same.
+ */
+static bool
+TextFastIn(const char *str, int32 typmod, Datum *value)
+{
+	size_t	len = strlen(str);
+	text   *result = (text *) palloc(len + VARHDRSZ);
+
+	SET_VARSIZE(result, len + VARHDRSZ);
+	memcpy(VARDATA(result), str, len);
+	*value = PointerGetDatum(result);
+	return true;
+}
+
+/*
+ * A value no longer than the limit in bytes is not longer in characters, so
+ * varchar_input would store it as is.
+ */
+static bool
+VarcharFastIn(const char *str, int32 typmod, Datum *value)
+{
+	if (typmod >= (int32) VARHDRSZ && strlen(str) > (size_t) (typmod - VARHDRSZ))
+		return false;
+	return TextFastIn(str, typmod, value);
+}
+
+#if PG_VERSION_NUM >= 90000
+
+static const int8 HEXVAL[256] =
+{
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+/*
+ * Hex format (\x0123...) without white spaces.
+ */
+static bool
+ByteaFastIn(const char *str, int32 typmod, Datum *value)
+{
+	const unsigned char *s = (const unsigned char *) str;
+	size_t		len;
+	bytea	   *result;
+	char	   *out;
+
+	if (s[0] != '\\' || s[1] != 'x')
+		return false;
+	s += 2;
+	len = strlen((const char *) s);
+	if (len % 2 != 0)
+		return false;
+
+	result = (bytea *) palloc(len / 2 + VARHDRSZ);
+	out = VARDATA(result);
+	for (; *s; s += 2)
+	{
+		int		hi = HEXVAL[s[0]];
+		int		lo = HEXVAL[s[1]];
+
+		if (hi < 0 || lo < 0)
+		{
+			pfree(result);
+			return false;
+		}
+		*out++ = (char) (hi << 4 | lo);
+	}
+	SET_VARSIZE(result, len / 2 + VARHDRSZ);
+	*value = PointerGetDatum(result);
+	return true;
+}
+
+#endif   /* PG_VERSION_NUM >= 90000 */
+
+/* ========================================================================
+ * COLUMN_FORMAT
+ * ========================================================================*/
+
+typedef enum FormatKind
+{
+	FMT_LITERAL,
+	FMT_YEAR,
+	FMT_MONTH,
+	FMT_DAY,
+	FMT_HOUR,
+	FMT_MINUTE,
+	FMT_SECOND,
+	FMT_FRACTION,
+	FMT_OFFSET,
+	FMT_EPOCH
+} FormatKind;
+
+struct FormatItem
+{
+	FormatKind	kind;
+	char		c;			/**< character for FMT_LITERAL */
+};
+
+static const struct FormatToken
+{
+	const char *name;
+	FormatKind	kind;
+}
+FORMAT_TOKENS[] =
+{
+	{ "YYYY"	, FMT_YEAR		},
+	{ "MM"		, FMT_MONTH		},
+	{ "DD"		, FMT_DAY		},
+	{ "HH24"	, FMT_HOUR		},
+	{ "MI"		, FMT_MINUTE	},
+	{ "SS"		, FMT_SECOND	},
+	{ "FF"		, FMT_FRACTION	},
+	{ "OF"		, FMT_OFFSET	},
+	{ "EPOCH"	, FMT_EPOCH		},
+};
+
+#define FMT_BIT(kind)	(1 << (kind))
+#define DATE_BITS		(FMT_BIT(FMT_YEAR) | FMT_BIT(FMT_MONTH) | FMT_BIT(FMT_DAY))
+#define TIME_BITS		(FMT_BIT(FMT_HOUR) | FMT_BIT(FMT_MINUTE) | \
+						 FMT_BIT(FMT_SECOND) | FMT_BIT(FMT_FRACTION))
+
+/**
+ * @brief Parse a COLUMN_FORMAT for a column of the type.
+ *
+ * The format consists of YYYY, MM, DD, HH24, MI, SS (fixed number of digits),
+ * FF (1 to 6 digits of fractional seconds), OF (Z, +hh, +hhmm or +hh:mm) and
+ * literal characters.  Letters other than T must be double-quoted.  EPOCH is
+ * an integer of seconds since 1970-01-01 00:00:00 UTC, and must be the whole
+ * format.  Patterns are case-insensitive.
+ */
+ColumnFormat *
+ColumnFormatCreate(const char *format, Oid typeid)
+{
+	ColumnFormat   *self;
+	const char	   *f = format;
+	int				seen = 0;
+	int				required;
+	int				allowed;
+
+	switch (typeid)
+	{
+		case DATEOID:
+			required = DATE_BITS;
+			allowed = DATE_BITS;
+			break;
+		case TIMEOID:
+			required = FMT_BIT(FMT_HOUR) | FMT_BIT(FMT_MINUTE);
+			allowed = TIME_BITS;
+			break;
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			required = DATE_BITS;
+			allowed = DATE_BITS | TIME_BITS | FMT_BIT(FMT_OFFSET);
+			break;
+		default:
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("COLUMN_FORMAT is not supported for type %s",
+							format_type_be(typeid))));
+			return NULL;	/* keep compiler quiet */
+	}
+
+	self = palloc0(sizeof(ColumnFormat));
+	self->format = pstrdup(format);
+	self->typeid = typeid;
+	self->items = palloc(sizeof(struct FormatItem) * (strlen(format) + 1));
+	self->tz_hour = -1;
+
+	while (*f)
+	{
+		struct FormatItem  *item = &self->items[self->nitems];
+		int					i;
+
+		for (i = 0; i < lengthof(FORMAT_TOKENS); i++)
+		{
+			if (pg_strncasecmp(f, FORMAT_TOKENS[i].name,
+							   strlen(FORMAT_TOKENS[i].name)) == 0)
+				break;
+		}
+
+		if (i < lengthof(FORMAT_TOKENS))
+		{
+			item->kind = FORMAT_TOKENS[i].kind;
+			f += strlen(FORMAT_TOKENS[i].name);
+			if (seen & FMT_BIT(item->kind))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("invalid COLUMN_FORMAT \"%s\": %s appears twice",
+								format, FORMAT_TOKENS[i].name)));
+			seen |= FMT_BIT(item->kind);
+			self->nitems++;
+		}
+		else if (*f == '"')
+		{
+			for (f++; *f && *f != '"'; f++)
+			{
+				self->items[self->nitems].kind = FMT_LITERAL;
+				self->items[self->nitems].c = *f;
+				self->nitems++;
+			}
+			if (*f != '"')
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("invalid COLUMN_FORMAT \"%s\": unterminated quoted string",
+								format)));
+			f++;
+		}
+		else if (isalpha((unsigned char) *f) && *f != 'T')
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("invalid COLUMN_FORMAT \"%s\": unknown pattern at \"%s\"",
+							format, f),
+					 errhint("Letters must be double-quoted.")));
+		else
+		{
+			item->kind = FMT_LITERAL;
+			item->c = *f++;
+			self->nitems++;
+		}
+	}
+
+	if (seen & FMT_BIT(FMT_EPOCH))
+	{
+		if (self->nitems != 1 ||
+			(typeid != TIMESTAMPOID && typeid != TIMESTAMPTZOID))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("invalid COLUMN_FORMAT \"%s\": EPOCH must be the whole format for timestamp",
+							format)));
+		return self;
+	}
+
+	if ((seen & required) != required || (seen & ~allowed) != 0 ||
+		((seen & FMT_BIT(FMT_MINUTE)) && !(seen & FMT_BIT(FMT_HOUR))) ||
+		((seen & FMT_BIT(FMT_SECOND)) && !(seen & FMT_BIT(FMT_MINUTE))) ||
+		((seen & FMT_BIT(FMT_FRACTION)) && !(seen & FMT_BIT(FMT_SECOND))))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid COLUMN_FORMAT \"%s\" for type %s",
+						format, format_type_be(typeid))));
+
+	return self;
+}
+
+/*
+ * Reads a fixed number of digits.
+ */
+static bool
+ReadDigits(const char **s, int ndigits, int *value)
+{
+	const char *p = *s;
+	int			v = 0;
+
+	for (; ndigits > 0; ndigits--, p++)
+	{
+		if (*p < '0' || *p > '9')
+			return false;
+		v = v * 10 + (*p - '0');
+	}
+
+	*s = p;
+	*value = v;
+	return true;
+}
+
+/*
+ * Would rounding to the precision of typmod leave the value as is?
+ */
+static bool
+FractionFitsTypmod(int digits, int32 typmod)
+{
+	if (typmod < 0 || digits == 0)
+		return true;
+#ifdef HAVE_INT64_TIMESTAMP
+	return digits <= typmod;
+#else
+	return false;	/* rounding of float timestamps is not exact */
+#endif
+}
+
+/*
+ * Offset of the session time zone at the local time.  The offset is cached
+ * for each local hour, unless it changes within the hour.
+ */
+static int
+ColumnFormatZone(ColumnFormat *self, struct pg_tm *tm)
+{
+	int64		hour;
+	struct pg_tm tt;
+	int			head;
+
+	hour = ((((int64) tm->tm_year * 13 + tm->tm_mon) * 32) + tm->tm_mday) * 24 +
+		tm->tm_hour;
+	if (hour == self->tz_hour)
+		return self->tz_offset;
+
+	tt = *tm;
+	tt.tm_min = 0;
+	tt.tm_sec = 0;
+	head = DetermineTimeZoneOffset(&tt, session_timezone);
+	tt.tm_min = 59;
+	tt.tm_sec = 59;
+	if (DetermineTimeZoneOffset(&tt, session_timezone) != head)
+		return DetermineTimeZoneOffset(tm, session_timezone);
+
+	self->tz_hour = hour;
+	self->tz_offset = head;
+	return head;
+}
+
+/*
+ * Reads seconds since the Unix epoch.
+ */
+static bool
+ColumnFormatEpoch(const char *str, Datum *value)
+{
+	bool		neg;
+	uint64		v;
+	int64		secs;
+	Timestamp	result;
+
+	/* 11 digits are far inside the range of timestamp */
+	if (!ParseInteger(str, 11, &neg, &v))
+		return false;
+	secs = neg ? -(int64) v : (int64) v;
+	secs -= (int64) (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * SECS_PER_DAY;
+
+#ifdef HAVE_INT64_TIMESTAMP
+	result = secs * USECS_PER_SEC;
+#else
+	result = (double) secs;
+#endif
+	*value = TimestampGetDatum(result);
+	return true;
+}
+
+/**
+ * @brief Read a value in the format.  Returns false if the string does not
+ * match the format, and then it must be passed to the input function.
+ */
+bool
+ColumnFormatInput(ColumnFormat *self, const char *str, int32 typmod, Datum *value)
+{
+	static const int mdays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	struct pg_tm	tt;
+	struct pg_tm   *tm = &tt;
+	const char	   *s = str;
+	int				fdigits = 0;
+	int				fvalue = 0;
+	bool			has_tz = false;
+	int				tz = 0;
+	fsec_t			fsec;
+	int				i;
+
+	if (self->items[0].kind == FMT_EPOCH)
+		return ColumnFormatEpoch(str, value);
+
+	/* time has no date fields */
+	memset(tm, 0, sizeof(tt));
+	tm->tm_year = 2000;
+	tm->tm_mon = 1;
+	tm->tm_mday = 1;
+
+	for (i = 0; i < self->nitems; i++)
+	{
+		const struct FormatItem *item = &self->items[i];
+
+		switch (item->kind)
+		{
+			case FMT_LITERAL:
+				if (*s++ != item->c)
+					return false;
+				break;
+			case FMT_YEAR:
+				if (!ReadDigits(&s, 4, &tm->tm_year))
+					return false;
+				break;
+			case FMT_MONTH:
+				if (!ReadDigits(&s, 2, &tm->tm_mon))
+					return false;
+				break;
+			case FMT_DAY:
+				if (!ReadDigits(&s, 2, &tm->tm_mday))
+					return false;
+				break;
+			case FMT_HOUR:
+				if (!ReadDigits(&s, 2, &tm->tm_hour))
+					return false;
+				break;
+			case FMT_MINUTE:
+				if (!ReadDigits(&s, 2, &tm->tm_min))
+					return false;
+				break;
+			case FMT_SECOND:
+				if (!ReadDigits(&s, 2, &tm->tm_sec))
+					return false;
+				break;
+			case FMT_FRACTION:
+				for (; *s >= '0' && *s <= '9'; s++)
+				{
+					if (++fdigits > 6)
+						return false;
+					fvalue = fvalue * 10 + (*s - '0');
+				}
+				if (fdigits == 0)
+					return false;
+				break;
+			case FMT_OFFSET:
+			{
+				int		hh;
+				int		mm = 0;
+				bool	neg;
+
+				has_tz = true;
+				if (*s == 'Z')
+				{
+					s++;
+					break;
+				}
+				if (*s != '+' && *s != '-')
+					return false;
+				neg = (*s++ == '-');
+				if (!ReadDigits(&s, 2, &hh))
+					return false;
+				if (*s == ':')
+				{
+					s++;
+					if (!ReadDigits(&s, 2, &mm))
+						return false;
+				}
+				else if (*s >= '0' && *s <= '9' && !ReadDigits(&s, 2, &mm))
+					return false;
+				if (hh > 15 || mm > 59)
+					return false;
+				/* pg_tm counts the offset west of UTC */
+				tz = (hh * SECS_PER_HOUR + mm * SECS_PER_MINUTE) * (neg ? 1 : -1);
+				break;
+			}
+			case FMT_EPOCH:
+				return false;	/* must be the whole format */
+		}
+	}
+	if (*s != '\0')
+		return false;
+
+	/* leap seconds and 24:00:00 are left to the input function */
+	if (tm->tm_year < 1 || tm->tm_mon < 1 || tm->tm_mon > 12 ||
+		tm->tm_mday < 1 ||
+		tm->tm_mday > mdays[tm->tm_mon - 1] + (tm->tm_mon == 2 && isleap(tm->tm_year)) ||
+		tm->tm_hour > 23 || tm->tm_min > 59 || tm->tm_sec > 59)
+		return false;
+
+	if (!FractionFitsTypmod(fdigits, typmod))
+		return false;
+#ifdef HAVE_INT64_TIMESTAMP
+	fsec = fvalue;
+	for (i = fdigits; i < 6; i++)
+		fsec *= 10;
+#else
+	fsec = fdigits > 0 ? (double) fvalue / POW10[fdigits] : 0;
+#endif
+
+	switch (self->typeid)
+	{
+		case DATEOID:
+			*value = DateADTGetDatum(date2j(tm->tm_year, tm->tm_mon, tm->tm_mday) -
+									 POSTGRES_EPOCH_JDATE);
+			return true;
+		case TIMEOID:
+		{
+			TimeADT		result;
+
+#ifdef HAVE_INT64_TIMESTAMP
+			result = ((((tm->tm_hour * MINS_PER_HOUR + tm->tm_min) * SECS_PER_MINUTE) +
+					   tm->tm_sec) * USECS_PER_SEC) + fsec;
+#else
+			result = ((tm->tm_hour * MINS_PER_HOUR + tm->tm_min) * SECS_PER_MINUTE) +
+					 tm->tm_sec + fsec;
+#endif
+			*value = TimeADTGetDatum(result);
+			return true;
+		}
+		case TIMESTAMPOID:
+		{
+			Timestamp	result;
+
+			/* timestamp ignores the time zone in the input */
+			if (tm2timestamp(tm, fsec, NULL, &result) != 0)
+				return false;
+			*value = TimestampGetDatum(result);
+			return true;
+		}
+		case TIMESTAMPTZOID:
+		{
+			TimestampTz	result;
+
+			if (!has_tz)
+				tz = ColumnFormatZone(self, tm);
+			if (tm2timestamp(tm, fsec, &tz, &result) != 0)
+				return false;
+			*value = TimestampTzGetDatum(result);
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,1771 @@
+/*
+ * pg_bulkload: lib/parser_arrow.c
+ *
+ *	  Copyright (c) 2007-2011, NIPPON TELEGRAPH AND TELEPHONE CORPORATION
+ */
+
+/**
+ * @file
+ * @brief Implementation of Arrow IPC stream processing module
+ *
+ * The input is a sequence of messages: a Schema followed by RecordBatches.
+ * Each message has its metadata in a flatbuffer, followed by its body which
+ * has the buffers of the columns.  The values are read from the buffers in
+ * place; they are never formatted as text but for the columns of types
+ * without a cast from the Arrow type.
+ */
+#include "pg_bulkload.h"
+
+#include <math.h>
+
+#include "access/htup.h"
+#include "catalog/pg_type.h"
+#include "mb/pg_wchar.h"
+#include "miscadmin.h"
+#include "parser/parse_coerce.h"
+#include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/datetime.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+#include "logger.h"
+#include "reader.h"
+#include "pg_strutil.h"
+#include "pg_profile.h"
+
+/**
+ * @brief  Initial size of the record buffer
+ */
+#define READ_BUFFER_SIZE	(64 * 1024)
+
+/**
+ * @brief  Magic at the head of Arrow IPC files, followed by a stream
+ */
+static const char ArrowMagic[6] = "ARROW1";
+
+/* MetadataVersion V4, the oldest one with the current layouts */
+#define ARROW_METADATA_V4		3
+
+/* MessageHeader union in Message.fbs */
+#define MESSAGE_SCHEMA			1
+#define MESSAGE_DICTIONARY		2
+#define MESSAGE_RECORD_BATCH	3
+
+/* Type union in Schema.fbs */
+#define ARROW_NULL				1
+#define ARROW_INT				2
+#define ARROW_FLOAT				3
+#define ARROW_BINARY			4
+#define ARROW_UTF8				5
+#define ARROW_BOOL				6
+#define ARROW_DECIMAL			7
+#define ARROW_DATE				8
+#define ARROW_TIME				9
+#define ARROW_TIMESTAMP			10
+#define ARROW_INTERVAL			11
+#define ARROW_LIST				12
+#define ARROW_STRUCT			13
+#define ARROW_UNION				14
+#define ARROW_FIXED_BINARY		15
+#define ARROW_FIXED_LIST		16
+#define ARROW_MAP				17
+#define ARROW_DURATION			18
+#define ARROW_LARGE_BINARY		19
+#define ARROW_LARGE_UTF8		20
+#define ARROW_LARGE_LIST		21
+#define ARROW_RUN_END			22
+#define ARROW_LIST_VIEW			25
+#define ARROW_LARGE_LIST_VIEW	26
+
+/* Precision, DateUnit and TimeUnit */
+#define PRECISION_HALF			0
+#define PRECISION_SINGLE		1
+#define DATE_DAY				0
+#define DATE_MILLISECOND		1
+#define TIME_SECOND				0
+#define TIME_MILLISECOND		1
+#define TIME_MICROSECOND		2
+
+/* Microseconds between the Unix epoch and the PostgreSQL epoch */
+#define EPOCH_DIFF_USECS \
+	((int64) (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * USECS_PER_DAY)
+
+/**
+ * @brief A table in a flatbuffer
+ *
+ * Offsets are checked against the length of the flatbuffer as they are
+ * followed, so a broken file cannot make us read outside of it.
+ */
+typedef struct FbTable
+{
+	const char *buf;			/**< head of the flatbuffer */
+	size_t		len;			/**< length of the flatbuffer */
+	size_t		pos;			/**< offset of the table */
+	size_t		vtable;			/**< offset of the vtable */
+	size_t		vtable_len;		/**< length of the vtable */
+} FbTable;
+
+/**
+ * @brief How the values of a field are converted into the column
+ */
+typedef enum ArrowConversion
+{
+	ARROW_CONV_NONE,			/**< skipped field */
+	ARROW_CONV_BATCH,			/**< for the whole batch at once */
+	ARROW_CONV_VALUE,			/**< the value is of the type of the column */
+	ARROW_CONV_CAST,			/**< by the cast function */
+	ARROW_CONV_INPUT,			/**< a string to the input function */
+	ARROW_CONV_IO				/**< by the output and input functions */
+} ArrowConversion;
+
+typedef struct ArrowField
+{
+	char	   *name;			/**< name of the field */
+	int			type;			/**< Type union id */
+	bool		supported;		/**< can be read? */
+	bool		dictionary;		/**< dictionary encoded */
+	bool		varlen;			/**< values have offsets */
+	int			width;			/**< bytes of each value, or of each offset */
+	bool		is_signed;		/**< integers are signed */
+	int			unit;			/**< unit of time, or precision of floats */
+	Oid			typid;			/**< type of the values */
+	int			node;			/**< index of the field node in batches */
+	int			buffer;			/**< index of the first buffer in batches */
+
+	ArrowConversion	conv;		/**< conversion into the column */
+	FmgrInfo	cast;			/**< cast function */
+	int			cast_nargs;		/**< number of arguments of cast */
+	FmgrInfo	typmod_cast;	/**< length coercion function, if any */
+	FmgrInfo	typOutput;		/**< output function of typid */
+
+	/* buffers in the current record batch */
+	const char *validity;		/**< null bitmap, or NULL if no nulls */
+	const char *offsets;		/**< offsets of variable-length values */
+	const char *data;			/**< values */
+	Datum	   *values;			/**< array[rows] of values for CONV_BATCH */
+	bool	   *nulls;			/**< array[rows] of NULL markers */
+} ArrowField;
+
+typedef struct ArrowParser
+{
+	Parser	base;
+
+	Source		   *source;
+	SourceOptions	source_opts;
+	Filter			filter;
+	TupleFormer		former;
+
+	int64	offset;				/**< rows to skip */
+	int64	need_offset;		/**< rows to skip */
+	int		nfiles;				/**< number of input files started */
+	bool	need_schema;		/**< schema of the file is not read yet */
+	bool	eof;				/**< end of the stream is read */
+
+	char   *buffer;				/**< Record buffer, or window of the source */
+	size_t	buffer_len;			/**< # of bytes in buffer */
+	size_t	buffer_size;		/**< allocated size of buffer */
+	size_t	pos;				/**< offset of the next message in buffer */
+
+	MemoryContext	context;	/**< context of the schema */
+	MemoryContext	batch_context;	/**< context of the current batch */
+	ArrowField *fields;			/**< array[nfields] of fields */
+	int			nfields;		/**< number of fields in the schema */
+	int			nnodes;			/**< number of field nodes in batches */
+	int			nbuffers;		/**< number of buffers in batches */
+	int64		rows;			/**< number of rows in the current batch */
+	int64		row;			/**< next row in the current batch */
+	int64		current;		/**< row being read */
+	StringInfoData	buf;		/**< work buffer for strings */
+} ArrowParser;
+
+/*
+ * Prototype declaration for local functions
+ */
+static void	ArrowParserInit(ArrowParser *self, Checker *checker, const char *infile, TupleDesc desc, bool multi_process, Oid collation);
+static HeapTuple ArrowParserRead(ArrowParser *self, Checker *checker);
+static int64	ArrowParserTerm(ArrowParser *self);
+static bool ArrowParserParam(ArrowParser *self, const char *keyword, char *value);
+static void ArrowParserDumpParams(ArrowParser *self);
+static void ArrowParserDumpRecord(ArrowParser *self, FILE *fp, char *badfile);
+static bool ArrowParserNextFile(ArrowParser *self);
+
+static size_t ArrowParserFill(ArrowParser *self, size_t need);
+static bool ArrowParserNextMessage(ArrowParser *self, int *type, FbTable *header, const char **body, int64 *body_len);
+static void ArrowParserReadSchema(ArrowParser *self);
+static bool ArrowParserNextBatch(ArrowParser *self);
+static void ExtractValuesFromArrow(ArrowParser *self, int64 row);
+
+/**
+ * @brief Create a new Arrow IPC stream parser.
+ */
+Parser *
+CreateArrowParser(void)
+{
+	ArrowParser *self = palloc0(sizeof(ArrowParser));
+	self->base.init = (ParserInitProc) ArrowParserInit;
+	self->base.read = (ParserReadProc) ArrowParserRead;
+	self->base.term = (ParserTermProc) ArrowParserTerm;
+	self->base.param = (ParserParamProc) ArrowParserParam;
+	self->base.dumpParams = (ParserDumpParamsProc) ArrowParserDumpParams;
+	self->base.dumpRecord = (ParserDumpRecordProc) ArrowParserDumpRecord;
+	self->base.nextFile = (ParserNextFileProc) ArrowParserNextFile;
+	self->base.filter = &self->filter;
+	self->offset = -1;
+	return (Parser *)self;
+}
+
+/*
+ * Flatbuffers are always little endian.
+ */
+static uint16
+GetUInt16(const char *in)
+{
+	const unsigned char *p = (const unsigned char *) in;
+
+	return (uint16) (p[0] | (p[1] << 8));
+}
+
+static uint32
+GetUInt32(const char *in)
+{
+	const unsigned char *p = (const unsigned char *) in;
+
+	return (uint32) p[0] | ((uint32) p[1] << 8) |
+		   ((uint32) p[2] << 16) | ((uint32) p[3] << 24);
+}
+
+static uint64
+GetUInt64(const char *in)
+{
+	return (uint64) GetUInt32(in) | ((uint64) GetUInt32(in + 4) << 32);
+}
+
+static void
+ArrowMetadataError(void)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_DATA_EXCEPTION),
+			 errmsg("invalid metadata in Arrow stream")));
+}
+
+static void
+FbCheck(const FbTable *table, size_t pos, size_t size)
+{
+	if (pos > table->len || size > table->len - pos)
+		ArrowMetadataError();
+}
+
+/*
+ * Set up the table at pos in the flatbuffer.
+ */
+static void
+FbTableAt(FbTable *table, const char *buf, size_t len, size_t pos)
+{
+	int64	vtable;
+
+	table->buf = buf;
+	table->len = len;
+	FbCheck(table, pos, 4);
+
+	vtable = (int64) pos - (int32) GetUInt32(buf + pos);
+	if (vtable < 0)
+		ArrowMetadataError();
+	FbCheck(table, (size_t) vtable, 4);
+
+	table->pos = pos;
+	table->vtable = (size_t) vtable;
+	table->vtable_len = GetUInt16(buf + vtable);
+	if (table->vtable_len < 4)
+		ArrowMetadataError();
+	FbCheck(table, table->vtable, table->vtable_len);
+}
+
+/*
+ * Offset of the field id of size bytes in the flatbuffer, or 0 if the table
+ * does not have the field.
+ */
+static size_t
+FbField(const FbTable *table, int id, size_t size)
+{
+	size_t	entry = 4 + 2 * id;
+	uint16	off;
+
+	if (entry + 2 > table->vtable_len)
+		return 0;
+	off = GetUInt16(table->buf + table->vtable + entry);
+	if (off == 0)
+		return 0;
+	FbCheck(table, table->pos + off, size);
+	return table->pos + off;
+}
+
+/*
+ * Read the scalar field id of size bytes. Scalars of 1 byte are unsigned.
+ */
+static int64
+FbScalar(const FbTable *table, int id, size_t size, int64 defval)
+{
+	size_t	pos = FbField(table, id, size);
+
+	if (pos == 0)
+		return defval;
+
+	switch (size)
+	{
+		case 1:
+			return (unsigned char) table->buf[pos];
+		case 2:
+			return (int16) GetUInt16(table->buf + pos);
+		case 4:
+			return (int32) GetUInt32(table->buf + pos);
+		default:
+			return (int64) GetUInt64(table->buf + pos);
+	}
+}
+
+/*
+ * Follow the offset in the field id. Returns 0 if the table does not have it.
+ */
+static size_t
+FbOffset(const FbTable *table, int id)
+{
+	size_t	pos = FbField(table, id, 4);
+	uint32	off;
+
+	if (pos == 0)
+		return 0;
+	off = GetUInt32(table->buf + pos);
+	if (off > table->len - pos)
+		ArrowMetadataError();
+	FbCheck(table, pos + off, 4);
+	return pos + off;
+}
+
+static bool
+FbSubTable(const FbTable *table, int id, FbTable *sub)
+{
+	size_t	pos = FbOffset(table, id);
+
+	if (pos == 0)
+		return false;
+	FbTableAt(sub, table->buf, table->len, pos);
+	return true;
+}
+
+/*
+ * Find the vector in the field id. Returns the offset of the elements, and
+ * sets the number of them to count.
+ */
+static size_t
+FbVector(const FbTable *table, int id, size_t elemsize, uint32 *count)
+{
+	size_t	pos = FbOffset(table, id);
+
+	*count = 0;
+	if (pos == 0)
+		return 0;
+	*count = GetUInt32(table->buf + pos);
+	if (*count > (table->len - pos - 4) / elemsize)
+		ArrowMetadataError();
+	return pos + 4;
+}
+
+static void
+FbVectorTable(const FbTable *table, size_t vector, uint32 i, FbTable *elem)
+{
+	size_t	pos = vector + 4 * i;
+	uint32	off = GetUInt32(table->buf + pos);
+
+	if (off > table->len - pos)
+		ArrowMetadataError();
+	FbTableAt(elem, table->buf, table->len, pos + off);
+}
+
+/*
+ * Copy the string in the field id, or return NULL if the table does not
+ * have it.
+ */
+static char *
+FbString(const FbTable *table, int id)
+{
+	size_t	pos = FbOffset(table, id);
+	uint32	len;
+	char   *str;
+
+	if (pos == 0)
+		return NULL;
+	len = GetUInt32(table->buf + pos);
+	if (len > table->len - pos - 4)
+		ArrowMetadataError();
+	str = palloc(len + 1);
+	memcpy(str, table->buf + pos + 4, len);
+	str[len] = '\0';
+	return str;
+}
+
+/**
+ * @brief Initialize a module for reading Arrow IPC stream
+ *
+ * The fields of the schema are mapped to the columns, or to the arguments of
+ * the filter, from left to right. The schema is read with the first row so
+ * that the conversions can be chosen for the types of each file.
+ */
+static void
+ArrowParserInit(ArrowParser *self, Checker *checker, const char *infile, TupleDesc desc, bool multi_process, Oid collation)
+{
+	TupleCheckStatus	status;
+
+	/*
+	 * set default values
+	 */
+	self->need_offset = self->offset = self->offset > 0 ? self->offset : 0;
+
+	/* Strings in Arrow are always in UTF-8. */
+	if (checker->encoding != -1)
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("does not support parameter \"ENCODING\" in \"TYPE = ARROW\"")));
+
+	self->source = CreateSource(infile, desc, multi_process, &self->source_opts);
+	self->base.filename = self->source->filename;
+	self->nfiles = 1;
+	self->need_schema = true;
+
+	status = FilterInit(&self->filter, desc, collation);
+	if (checker->tchecker)
+		checker->tchecker->status = status;
+
+	TupleFormerInit(&self->former, &self->filter, desc);
+
+	self->context = AllocSetContextCreate(CurrentMemoryContext,
+										  "ArrowParser",
+										  ALLOCSET_DEFAULT_MINSIZE,
+										  ALLOCSET_DEFAULT_INITSIZE,
+										  ALLOCSET_DEFAULT_MAXSIZE);
+	self->batch_context = AllocSetContextCreate(CurrentMemoryContext,
+										  "ArrowBatch",
+										  ALLOCSET_DEFAULT_MINSIZE,
+										  ALLOCSET_DEFAULT_INITSIZE,
+										  ALLOCSET_DEFAULT_MAXSIZE);
+	initStringInfo(&self->buf);
+
+	/* Messages are parsed in place if the source lends its buffer. */
+	if (SourceHasWindow(self->source))
+		self->buffer = NULL;
+	else
+	{
+		self->buffer_size = READ_BUFFER_SIZE;
+		self->buffer = palloc(self->buffer_size);
+	}
+}
+
+/**
+ * @brief Free the resources used in the reading Arrow IPC stream module.
+ */
+static int64
+ArrowParserTerm(ArrowParser *self)
+{
+	int64	skip;
+
+	/* SKIP applies to each input file */
+	skip = self->offset * self->nfiles;
+
+	if (self->buffer && !SourceHasWindow(self->source))
+		pfree(self->buffer);
+	if (self->source)
+		SourceClose(self->source);
+	if (self->context)
+		MemoryContextDelete(self->context);
+	if (self->batch_context)
+		MemoryContextDelete(self->batch_context);
+	if (self->buf.data)
+		pfree(self->buf.data);
+	FilterTerm(&self->filter);
+	TupleFormerTerm(&self->former);
+	pfree(self);
+
+	return skip;
+}
+
+/**
+ * @brief Read one row from input stream and transfer the values to
+ * PostgreSQL internal format.
+ *
+ * Process flow
+ *	 - Read the schema at the head of each input file.
+ *	 - If all rows of the current record batch are read, read the next one
+ *	   and convert the columns which can be converted at once.
+ *		 * Return NULL if we reach the end of the stream.
+ *		 * If the stream is broken, notify it to caller by ereport().
+ *	 - Take the values of the row, and convert the others.
+ * @return	The tuple, or NULL at the end of the input file.
+ */
+static HeapTuple
+ArrowParserRead(ArrowParser *self, Checker *checker)
+{
+	/* Errors in the stream cannot be skipped. */
+	self->base.parsing_field = -1;
+
+	if (unlikely(self->need_schema))
+	{
+		ArrowParserReadSchema(self);
+		self->need_schema = false;
+	}
+
+	/* Skip first offset rows in the input file */
+	while (self->row >= self->rows || self->need_offset > 0)
+	{
+		if (self->row < self->rows)
+		{
+			int64	n = Min(self->need_offset, self->rows - self->row);
+
+			self->row += n;
+			self->need_offset -= n;
+			continue;
+		}
+
+		if (!ArrowParserNextBatch(self))
+		{
+			if (self->need_offset > 0)
+				ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+								errmsg("could not skip " int64_FMT
+								" rows in the input file",
+								self->offset)));
+			return NULL;	/* eof */
+		}
+	}
+
+	/*
+	 * Increment the position *before* parsing the record so that we can
+	 * skip it when there are some errors on parsing it.
+	 */
+	self->base.count++;
+	self->current = self->row++;
+
+	ExtractValuesFromArrow(self, self->current);
+	self->base.parsing_field = -1;
+
+	if (self->filter.funcstr)
+		return FilterTuple(&self->filter, &self->former,
+						   &self->base.parsing_field);
+	else
+		return TupleFormerTuple(&self->former);
+}
+
+static bool
+ArrowParserParam(ArrowParser *self, const char *keyword, char *value)
+{
+	if (CompareKeyword(keyword, "SKIP") ||
+		CompareKeyword(keyword, "OFFSET"))
+	{
+		ASSERT_ONCE(self->offset < 0);
+		self->offset = ParseInt64(value, 0);
+	}
+	else if (CompareKeyword(keyword, "FILTER"))
+	{
+		ASSERT_ONCE(!self->filter.funcstr);
+		self->filter.funcstr = pstrdup(value);
+	}
+	else if (!SourceParam(&self->source_opts, keyword, value) &&
+			 !TupleFormerParam(&self->former, keyword, value))
+		return false;	/* unknown parameter */
+
+	return true;
+}
+
+static void
+ArrowParserDumpParams(ArrowParser *self)
+{
+	StringInfoData	buf;
+
+	initStringInfo(&buf);
+	appendStringInfoString(&buf, "TYPE = ARROW\n");
+	appendStringInfo(&buf, "SKIP = " int64_FMT "\n", self->offset);
+	if (self->filter.funcstr)
+		appendStringInfo(&buf, "FILTER = %s\n", self->filter.funcstr);
+	SourceDumpParams(&self->source_opts, &buf);
+	TupleFormerDumpParams(&self->former, &buf);
+
+	LoggerLog(INFO, buf.data);
+	pfree(buf.data);
+}
+
+/*
+ * Go on to the next input file. Each file starts with its own schema, and
+ * SKIP applies to the rows after it.
+ */
+static bool
+ArrowParserNextFile(ArrowParser *self)
+{
+	if (!SourceNextFile(self->source))
+	{
+		self->base.filename = NULL;
+		return false;
+	}
+
+	self->base.filename = self->source->filename;
+	self->nfiles++;
+	self->need_offset = self->offset;
+	self->need_schema = true;
+	self->eof = false;
+	self->buffer_len = self->pos = 0;
+	self->rows = self->row = 0;
+
+	return true;
+}
+
+/**
+ * @brief Make need bytes from the next message available in the record buffer
+ *
+ * Same as BinaryParserFill(). Returns the number of bytes available, which is
+ * less than need only at the end of the input file.
+ */
+static size_t
+ArrowParserFill(ArrowParser *self, size_t need)
+{
+	size_t	avail = self->buffer_len - self->pos;
+
+	if (avail >= need)
+		return avail;
+
+	if (SourceHasWindow(self->source))
+	{
+		SourceConsume(self->source, self->pos);
+		self->buffer = SourceWindow(self->source, need, &avail);
+	}
+	else
+	{
+		if (self->pos > 0)
+			memmove(self->buffer, self->buffer + self->pos, avail);
+		if (need > self->buffer_size)
+		{
+			self->buffer_size = Max(need, self->buffer_size * 2);
+			self->buffer = repalloc(self->buffer, self->buffer_size);
+		}
+		while (avail < need)
+		{
+			size_t	len;
+
+			len = SourceRead(self->source, self->buffer + avail,
+							 self->buffer_size - avail);
+			if (len == 0)
+				break;
+			avail += len;
+		}
+	}
+
+	self->buffer_len = avail;
+	self->pos = 0;
+
+	return avail;
+}
+
+static void
+ArrowEOFError(void)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_DATA_EXCEPTION),
+			 errmsg("unexpected EOF in Arrow stream")));
+}
+
+/**
+ * @brief Read the next message
+ *
+ * Each message starts with 0xFFFFFFFF and the length of the metadata in 32
+ * bits, or only the length in older streams, followed by the metadata and
+ * the body. The length is 0 at the end of the stream.
+ * @return false at the end of the stream. The message is valid until the
+ * next call.
+ */
+static bool
+ArrowParserNextMessage(ArrowParser *self, int *type, FbTable *header, const char **body, int64 *body_len)
+{
+	size_t	avail;
+	size_t	prefix = 4;
+	uint32	len;
+	size_t	need;
+	FbTable	message;
+
+	if (self->eof)
+		return false;
+
+	BULKLOAD_PROFILE(&prof_reader_parser);
+	avail = ArrowParserFill(self, 8);
+	BULKLOAD_PROFILE(&prof_reader_source);
+	if (avail < 4)
+	{
+		/* EOF without the end of stream marker is accepted. */
+		if (avail > 0)
+			ArrowEOFError();
+		self->eof = true;
+		return false;
+	}
+
+	len = GetUInt32(self->buffer + self->pos);
+	if (len == 0xFFFFFFFF)
+	{
+		if (avail < 8)
+			ArrowEOFError();
+		len = GetUInt32(self->buffer + self->pos + 4);
+		prefix = 8;
+	}
+	if (len == 0)
+	{
+		/* end of stream; the footer of a file follows */
+		self->pos += prefix;
+		self->eof = true;
+		return false;
+	}
+	if (len < 4 || len > MaxAllocSize - prefix)
+		ArrowMetadataError();
+
+	need = prefix + len;
+	BULKLOAD_PROFILE(&prof_reader_parser);
+	avail = ArrowParserFill(self, need);
+	BULKLOAD_PROFILE(&prof_reader_source);
+	if (avail < need)
+		ArrowEOFError();
+
+	FbTableAt(&message, self->buffer + self->pos + prefix, len,
+			  GetUInt32(self->buffer + self->pos + prefix));
+	*body_len = FbScalar(&message, 3, 8, 0);
+	if (*body_len < 0 || *body_len > MaxAllocSize - need)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("invalid body length " int64_FMT " in Arrow stream",
+						*body_len)));
+
+	/* The buffer might move to read the body. */
+	need += *body_len;
+	BULKLOAD_PROFILE(&prof_reader_parser);
+	avail = ArrowParserFill(self, need);
+	BULKLOAD_PROFILE(&prof_reader_source);
+	if (avail < need)
+		ArrowEOFError();
+
+	FbTableAt(&message, self->buffer + self->pos + prefix, len,
+			  GetUInt32(self->buffer + self->pos + prefix));
+	if (FbScalar(&message, 0, 2, 0) < ARROW_METADATA_V4)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("Arrow metadata version is too old")));
+	*type = (int) FbScalar(&message, 1, 1, 0);
+	if (!FbSubTable(&message, 2, header))
+		ArrowMetadataError();
+	*body = self->buffer + self->pos + prefix + len;
+	self->pos += need;
+
+	return true;
+}
+
+/*
+ * Read the type of the field. The type is supported if its values can be
+ * read into typid.
+ */
+static void
+ArrowFieldType(ArrowField *f, const FbTable *table)
+{
+	FbTable	type;
+	bool	has_type;
+	int		bits;
+
+	f->type = (int) FbScalar(table, 2, 1, 0);
+	has_type = FbSubTable(table, 3, &type);
+	f->supported = true;
+	f->is_signed = true;
+
+	switch (f->type)
+	{
+		case ARROW_NULL:
+			f->typid = InvalidOid;
+			break;
+		case ARROW_INT:
+			if (!has_type)
+				ArrowMetadataError();
+			bits = (int) FbScalar(&type, 0, 4, 0);
+			f->is_signed = FbScalar(&type, 1, 1, 0) != 0;
+			if (bits != 8 && bits != 16 && bits != 32 && bits != 64)
+				ArrowMetadataError();
+			f->width = bits / 8;
+			if (f->width + (f->is_signed ? 0 : 1) <= 2)
+				f->typid = INT2OID;
+			else if (f->width + (f->is_signed ? 0 : 1) <= 4)
+				f->typid = INT4OID;
+			else
+				f->typid = INT8OID;
+			break;
+		case ARROW_FLOAT:
+			f->unit = has_type ? (int) FbScalar(&type, 0, 2, 0) : 0;
+			switch (f->unit)
+			{
+				case PRECISION_HALF:
+					f->width = 2;
+					f->typid = FLOAT4OID;
+					break;
+				case PRECISION_SINGLE:
+					f->width = 4;
+					f->typid = FLOAT4OID;
+					break;
+				default:
+					f->width = 8;
+					f->typid = FLOAT8OID;
+					break;
+			}
+			break;
+		case ARROW_BOOL:
+			f->typid = BOOLOID;
+			break;
+		case ARROW_UTF8:
+		case ARROW_LARGE_UTF8:
+			f->varlen = true;
+			f->width = (f->type == ARROW_UTF8 ? 4 : 8);
+			f->typid = TEXTOID;
+			break;
+		case ARROW_BINARY:
+		case ARROW_LARGE_BINARY:
+			f->varlen = true;
+			f->width = (f->type == ARROW_BINARY ? 4 : 8);
+			f->typid = BYTEAOID;
+			break;
+		case ARROW_FIXED_BINARY:
+			if (!has_type)
+				ArrowMetadataError();
+			f->width = (int) FbScalar(&type, 0, 4, 0);
+			if (f->width < 0)
+				ArrowMetadataError();
+			f->typid = BYTEAOID;
+			break;
+		case ARROW_DATE:
+			f->unit = has_type ? (int) FbScalar(&type, 0, 2, DATE_MILLISECOND) : DATE_MILLISECOND;
+			f->width = (f->unit == DATE_DAY ? 4 : 8);
+			f->typid = DATEOID;
+			break;
+		case ARROW_TIME:
+			f->unit = has_type ? (int) FbScalar(&type, 0, 2, TIME_MILLISECOND) : TIME_MILLISECOND;
+			bits = has_type ? (int) FbScalar(&type, 1, 4, 32) : 32;
+			if (bits != (f->unit <= TIME_MILLISECOND ? 32 : 64))
+				ArrowMetadataError();
+			f->width = bits / 8;
+			f->typid = TIMEOID;
+			break;
+		case ARROW_TIMESTAMP:
+		{
+			char   *tz = has_type ? FbString(&type, 1) : NULL;
+
+			f->unit = has_type ? (int) FbScalar(&type, 0, 2, TIME_SECOND) : TIME_SECOND;
+			f->width = 8;
+			f->typid = (tz && tz[0] ? TIMESTAMPTZOID : TIMESTAMPOID);
+			break;
+		}
+		default:
+			f->supported = false;
+			break;
+	}
+}
+
+/*
+ * Count the field nodes and the buffers of the field and its children in
+ * record batches.
+ */
+static void
+ArrowFieldLayout(const FbTable *field, int *nnodes, int *nbuffers)
+{
+	int		type;
+	FbTable	type_table;
+	uint32	nchildren;
+	size_t	children;
+	uint32	i;
+
+	check_stack_depth();
+
+	(*nnodes)++;
+	type = (int) FbScalar(field, 2, 1, 0);
+
+	/* Dictionary encoded fields have the indexes of the dictionary. */
+	if (FbOffset(field, 4) != 0)
+	{
+		*nbuffers += 2;
+		return;
+	}
+
+	switch (type)
+	{
+		case ARROW_NULL:
+		case ARROW_RUN_END:
+			break;
+		case ARROW_STRUCT:
+		case ARROW_FIXED_LIST:
+			*nbuffers += 1;
+			break;
+		case ARROW_INT:
+		case ARROW_FLOAT:
+		case ARROW_BOOL:
+		case ARROW_DECIMAL:
+		case ARROW_DATE:
+		case ARROW_TIME:
+		case ARROW_TIMESTAMP:
+		case ARROW_INTERVAL:
+		case ARROW_FIXED_BINARY:
+		case ARROW_DURATION:
+		case ARROW_LIST:
+		case ARROW_LARGE_LIST:
+		case ARROW_MAP:
+			*nbuffers += 2;
+			break;
+		case ARROW_BINARY:
+		case ARROW_UTF8:
+		case ARROW_LARGE_BINARY:
+		case ARROW_LARGE_UTF8:
+		case ARROW_LIST_VIEW:
+		case ARROW_LARGE_LIST_VIEW:
+			*nbuffers += 3;
+			break;
+		case ARROW_UNION:
+			/* type ids, and offsets if dense */
+			if (FbSubTable(field, 3, &type_table) &&
+				FbScalar(&type_table, 0, 2, 0) != 0)
+				*nbuffers += 2;
+			else
+				*nbuffers += 1;
+			break;
+		default:
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("Arrow type %d is not supported", type)));
+	}
+
+	children = FbVector(field, 5, 4, &nchildren);
+	for (i = 0; i < nchildren; i++)
+	{
+		FbTable	child;
+
+		FbVectorTable(field, children, i, &child);
+		ArrowFieldLayout(&child, nnodes, nbuffers);
+	}
+}
+
+/*
+ * Can the values be converted into the type for the whole batch? They can if
+ * the conversion never fails; integers to wider integers, and floats to
+ * floats as wide.
+ */
+static bool
+ArrowBatchConversion(const ArrowField *f, Oid target)
+{
+	switch (f->type)
+	{
+		case ARROW_INT:
+			switch (target)
+			{
+				case INT2OID:
+					return f->typid == INT2OID;
+				case INT4OID:
+					return f->typid == INT2OID || f->typid == INT4OID;
+				case INT8OID:
+					return f->is_signed || f->width < 8;
+			}
+			return false;
+		case ARROW_FLOAT:
+			return target == FLOAT8OID ||
+				   (target == FLOAT4OID && f->typid == FLOAT4OID);
+		case ARROW_BOOL:
+			return target == BOOLOID;
+	}
+	return false;
+}
+
+/*
+ * Choose the conversion of the values of the field into the type.
+ */
+static void
+ArrowFieldConversion(ArrowField *f, Oid target, int32 typmod)
+{
+	Oid		funcid;
+
+	if (f->dictionary)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("dictionary encoded field \"%s\" is not supported",
+						f->name),
+				 errhint("Skip the field with \"-\" in FIELDS.")));
+	if (!f->supported)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("Arrow type %d of field \"%s\" is not supported",
+						f->type, f->name)));
+
+	if (f->type == ARROW_NULL)
+		f->conv = ARROW_CONV_BATCH;	/* all NULL */
+	else if (f->type == ARROW_UTF8 || f->type == ARROW_LARGE_UTF8)
+		f->conv = ARROW_CONV_INPUT;
+	else if (get_typtype(target) == TYPTYPE_DOMAIN)
+		f->conv = ARROW_CONV_IO;	/* check the constraints of the domain */
+	else if (ArrowBatchConversion(f, target))
+		f->conv = ARROW_CONV_BATCH;
+	else if (f->typid == target)
+		f->conv = ARROW_CONV_VALUE;
+	else
+	{
+		switch (find_coercion_pathway(target, f->typid, COERCION_ASSIGNMENT, &funcid))
+		{
+			case COERCION_PATH_RELABELTYPE:
+				f->conv = ARROW_CONV_VALUE;
+				break;
+			case COERCION_PATH_FUNC:
+				f->conv = ARROW_CONV_CAST;
+				fmgr_info(funcid, &f->cast);
+				f->cast_nargs = get_func_nargs(funcid);
+				break;
+			case COERCION_PATH_COERCEVIAIO:
+				f->conv = ARROW_CONV_IO;
+				break;
+			default:
+				ereport(ERROR,
+						(errcode(ERRCODE_DATATYPE_MISMATCH),
+						 errmsg("cannot load field \"%s\" of type %s into type %s",
+								f->name, format_type_be(f->typid),
+								format_type_be(target))));
+		}
+	}
+
+	/* Casts taking the typmod apply it by themselves. */
+	if (typmod >= 0 &&
+		(f->conv == ARROW_CONV_VALUE ||
+		 (f->conv == ARROW_CONV_CAST && f->cast_nargs < 2)) &&
+		find_typmod_coercion_function(target, &funcid) == COERCION_PATH_FUNC)
+		fmgr_info(funcid, &f->typmod_cast);
+}
+
+/**
+ * @brief Read the schema at the head of the stream
+ *
+ * An Arrow IPC file has the magic before the stream. Fields of types which
+ * cannot be read are allowed only if they are skipped by FIELDS.
+ */
+static void
+ArrowParserReadSchema(ArrowParser *self)
+{
+	TupleFormer	   *former = &self->former;
+	MemoryContext	oldcxt;
+	int				type;
+	FbTable			schema;
+	const char	   *body;
+	int64			body_len;
+	size_t			fields;
+	uint32			nfields;
+	int				i;
+
+	if (ArrowParserFill(self, 8) >= 8 &&
+		memcmp(self->buffer + self->pos, ArrowMagic, sizeof(ArrowMagic)) == 0)
+		self->pos += 8;
+
+	if (!ArrowParserNextMessage(self, &type, &schema, &body, &body_len) ||
+		type != MESSAGE_SCHEMA)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("Arrow stream does not start with a schema")));
+
+	/* Schema.endianness is 0 for little endian. */
+#ifdef WORDS_BIGENDIAN
+	if (FbScalar(&schema, 0, 2, 0) != 1)
+#else
+	if (FbScalar(&schema, 0, 2, 0) != 0)
+#endif
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("byte order of Arrow stream does not match the server")));
+
+	MemoryContextReset(self->context);
+	MemoryContextReset(self->batch_context);
+	self->rows = self->row = 0;
+	oldcxt = MemoryContextSwitchTo(self->context);
+
+	fields = FbVector(&schema, 1, 4, &nfields);
+	if ((int) nfields < former->minfields || (int) nfields > former->maxfields)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("Arrow schema has %u fields, expected %d",
+						nfields, former->maxfields)));
+
+	self->nfields = nfields;
+	self->fields = palloc0(sizeof(ArrowField) * Max(nfields, 1));
+	self->nnodes = self->nbuffers = 0;
+	for (i = 0; i < self->nfields; i++)
+	{
+		ArrowField *f = &self->fields[i];
+		int			j = former->attnum[i];
+		FbTable		field;
+
+		FbVectorTable(&schema, fields, i, &field);
+		f->name = FbString(&field, 0);
+		if (f->name == NULL)
+			f->name = "";
+		f->node = self->nnodes;
+		f->buffer = self->nbuffers;
+		ArrowFieldLayout(&field, &self->nnodes, &self->nbuffers);
+
+		if (FbOffset(&field, 4) != 0)
+		{
+			f->supported = false;
+			f->dictionary = true;
+		}
+		else
+			ArrowFieldType(f, &field);
+
+		if (f->supported && OidIsValid(f->typid))
+		{
+			Oid		out_func_oid;
+			bool	isvarlena;
+
+			getTypeOutputInfo(f->typid, &out_func_oid, &isvarlena);
+			fmgr_info(out_func_oid, &f->typOutput);
+		}
+
+		if (j >= 0)
+			ArrowFieldConversion(f, former->typId[j], former->typMod[j]);
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/*
+ * Locate the buffer in the body, which must have minlen bytes at least.
+ */
+static const char *
+ArrowBuffer(const char *buffers, int index, const char *body, int64 body_len, int64 minlen)
+{
+	int64	offset = (int64) GetUInt64(buffers + 16 * index);
+	int64	length = (int64) GetUInt64(buffers + 16 * index + 8);
+
+	if (offset < 0 || length < 0 || offset > body_len ||
+		length > body_len - offset || length < minlen)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("invalid buffer in Arrow record batch")));
+
+	return body + offset;
+}
+
+static int64
+ArrowOffset(const ArrowField *f, int64 row)
+{
+	if (f->width == 4)
+	{
+		int32	v;
+
+		memcpy(&v, f->offsets + row * 4, 4);
+		return v;
+	}
+	else
+	{
+		int64	v;
+
+		memcpy(&v, f->offsets + row * 8, 8);
+		return v;
+	}
+}
+
+/*
+ * Read an integer of the width. Unsigned 64 bit integers are returned as
+ * their bits.
+ */
+static int64
+ArrowInt(const ArrowField *f, int64 row)
+{
+	const char *p = f->data + row * f->width;
+
+	switch (f->width)
+	{
+		case 1:
+			return f->is_signed ? (int64) *(const int8 *) p : (int64) *(const uint8 *) p;
+		case 2:
+		{
+			int16	v;
+
+			memcpy(&v, p, 2);
+			return f->is_signed ? (int64) v : (int64) (uint16) v;
+		}
+		case 4:
+		{
+			int32	v;
+
+			memcpy(&v, p, 4);
+			return f->is_signed ? (int64) v : (int64) (uint32) v;
+		}
+		default:
+		{
+			int64	v;
+
+			memcpy(&v, p, 8);
+			return v;
+		}
+	}
+}
+
+static bool
+ArrowIsNull(const ArrowField *f, int64 row)
+{
+	if (f->type == ARROW_NULL)
+		return true;
+	return f->validity && !(f->validity[row >> 3] & (1 << (row & 7)));
+}
+
+/*
+ * Bytes of the string or the binary value.
+ */
+static const char *
+ArrowBytes(const ArrowField *f, int64 row, int64 *len)
+{
+	int64	start;
+
+	if (!f->varlen)
+	{
+		*len = f->width;
+		return f->data + row * f->width;
+	}
+
+	start = ArrowOffset(f, row);
+	*len = ArrowOffset(f, row + 1) - start;
+	return f->data + start;
+}
+
+static float4
+HalfToFloat(uint16 h)
+{
+	int		exp = (h >> 10) & 0x1f;
+	int		mant = h & 0x3ff;
+	float4	v;
+
+	if (exp == 0)
+		v = (float4) ldexp(mant, -24);
+	else if (exp == 31)
+		v = mant ? get_float4_nan() : get_float4_infinity();
+	else
+		v = (float4) ldexp(mant + 1024, exp - 25);
+
+	return (h & 0x8000) ? -v : v;
+}
+
+/*
+ * Divide rounding toward minus infinity.
+ */
+static int64
+FloorDiv(int64 v, int64 d)
+{
+	return v / d - (v % d < 0 ? 1 : 0);
+}
+
+/*
+ * Read the value as a Datum of typid. Returns false if the value is out of
+ * the range of typid.
+ */
+static bool
+ArrowValue(const ArrowField *f, int64 row, Datum *value)
+{
+	int64	v;
+
+	switch (f->type)
+	{
+		case ARROW_INT:
+			v = ArrowInt(f, row);
+			if (!f->is_signed && f->width == 8 && v < 0)
+				return false;
+			switch (f->typid)
+			{
+				case INT2OID:
+					*value = Int16GetDatum((int16) v);
+					break;
+				case INT4OID:
+					*value = Int32GetDatum((int32) v);
+					break;
+				default:
+					*value = Int64GetDatum(v);
+					break;
+			}
+			return true;
+
+		case ARROW_FLOAT:
+			if (f->unit == PRECISION_HALF)
+			{
+				uint16	h;
+
+				memcpy(&h, f->data + row * 2, 2);
+				*value = Float4GetDatum(HalfToFloat(h));
+			}
+			else if (f->unit == PRECISION_SINGLE)
+			{
+				float4	fv;
+
+				memcpy(&fv, f->data + row * 4, 4);
+				*value = Float4GetDatum(fv);
+			}
+			else
+			{
+				float8	fv;
+
+				memcpy(&fv, f->data + row * 8, 8);
+				*value = Float8GetDatum(fv);
+			}
+			return true;
+
+		case ARROW_BOOL:
+			*value = BoolGetDatum((f->data[row >> 3] >> (row & 7)) & 1);
+			return true;
+
+		case ARROW_BINARY:
+		case ARROW_LARGE_BINARY:
+		case ARROW_FIXED_BINARY:
+		{
+			const char *p;
+			int64		len;
+			bytea	   *b;
+
+			p = ArrowBytes(f, row, &len);
+			if (len > MaxAllocSize - VARHDRSZ)
+				return false;
+			b = palloc(len + VARHDRSZ);
+			SET_VARSIZE(b, len + VARHDRSZ);
+			memcpy(VARDATA(b), p, len);
+			*value = PointerGetDatum(b);
+			return true;
+		}
+
+		case ARROW_DATE:
+		{
+			DateADT		date;
+
+			v = ArrowInt(f, row);
+			if (f->unit != DATE_DAY)
+				v = FloorDiv(v, (int64) SECS_PER_DAY * 1000);
+			if (v < (int64) INT_MIN + (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE))
+				return false;
+			v -= POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE;
+			if (v > INT_MAX)
+				return false;
+			date = (DateADT) v;
+#ifdef IS_VALID_DATE
+			if (!IS_VALID_DATE(date))
+				return false;
+#endif
+			*value = DateADTGetDatum(date);
+			return true;
+		}
+
+		case ARROW_TIME:
+			v = ArrowInt(f, row);
+			switch (f->unit)
+			{
+				case TIME_SECOND:
+					v *= USECS_PER_SEC;
+					break;
+				case TIME_MILLISECOND:
+					v *= 1000;
+					break;
+				case TIME_MICROSECOND:
+					break;
+				default:
+					v = FloorDiv(v, 1000);
+					break;
+			}
+			if (v < 0 || v > USECS_PER_DAY)
+				return false;
+#ifdef HAVE_INT64_TIMESTAMP
+			*value = TimeADTGetDatum((TimeADT) v);
+#else
+			*value = TimeADTGetDatum((TimeADT) v / USECS_PER_SEC);
+#endif
+			return true;
+
+		case ARROW_TIMESTAMP:
+		{
+			Timestamp	ts;
+
+			v = ArrowInt(f, row);
+			switch (f->unit)
+			{
+				case TIME_SECOND:
+					if (v > INT64_MAX / USECS_PER_SEC ||
+						v < (-INT64_MAX - 1) / USECS_PER_SEC)
+						return false;
+					v *= USECS_PER_SEC;
+					break;
+				case TIME_MILLISECOND:
+					if (v > INT64_MAX / 1000 || v < (-INT64_MAX - 1) / 1000)
+						return false;
+					v *= 1000;
+					break;
+				case TIME_MICROSECOND:
+					break;
+				default:
+					v = FloorDiv(v, 1000);
+					break;
+			}
+			if (v < (-INT64_MAX - 1) + EPOCH_DIFF_USECS)
+				return false;
+			v -= EPOCH_DIFF_USECS;
+#ifdef HAVE_INT64_TIMESTAMP
+			ts = v;
+#else
+			ts = (double) v / USECS_PER_SEC;
+#endif
+#ifdef IS_VALID_TIMESTAMP
+			if (!IS_VALID_TIMESTAMP(ts))
+				return false;
+#endif
+			*value = TimestampGetDatum(ts);
+			return true;
+		}
+	}
+
+	return false;	/* keep compiler quiet */
+}
+
+/**
+ * @brief Set up the fields for a record batch
+ *
+ * Buffers of all fields which can be read are located so that rejected rows
+ * can be written to PARSE_BADFILE. NULL markers of the mapped fields are
+ * taken from the bitmaps, and the fields of CONV_BATCH are converted for
+ * all rows here, column by column.
+ */
+static void
+ArrowParserReadBatch(ArrowParser *self, const FbTable *batch, const char *body, int64 body_len)
+{
+	const char	   *meta = batch->buf;
+	MemoryContext	oldcxt;
+	size_t			nodes;
+	size_t			buffers;
+	uint32			nnodes;
+	uint32			nbuffers;
+	int64			rows;
+	int				i;
+
+	rows = FbScalar(batch, 0, 8, 0);
+	nodes = FbVector(batch, 1, 16, &nnodes);
+	buffers = FbVector(batch, 2, 16, &nbuffers);
+	if (rows < 0 || rows > (int64) (MaxAllocSize / sizeof(Datum)) ||
+		nnodes != self->nnodes || nbuffers != self->nbuffers)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("Arrow record batch does not match the schema")));
+	if (FbOffset(batch, 3) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("compressed Arrow record batches are not supported")));
+
+	MemoryContextReset(self->batch_context);
+	oldcxt = MemoryContextSwitchTo(self->batch_context);
+	self->rows = rows;
+	self->row = 0;
+
+	for (i = 0; i < self->nfields; i++)
+	{
+		ArrowField *f = &self->fields[i];
+		const char *node = meta + nodes + 16 * f->node;
+		int64		null_count = (int64) GetUInt64(node + 8);
+		int64		r;
+
+		if (!f->supported)
+			continue;
+		if ((int64) GetUInt64(node) != rows)
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_EXCEPTION),
+					 errmsg("Arrow record batch does not match the schema")));
+
+		if (f->type != ARROW_NULL)
+		{
+			f->validity = NULL;
+			if (null_count > 0)
+				f->validity = ArrowBuffer(meta + buffers, f->buffer, body,
+										  body_len, (rows + 7) / 8);
+
+			if (f->varlen)
+			{
+				int64	data_len;
+				int64	prev;
+
+				f->offsets = ArrowBuffer(meta + buffers, f->buffer + 1, body,
+										 body_len, rows > 0 ? (rows + 1) * f->width : 0);
+				f->data = ArrowBuffer(meta + buffers, f->buffer + 2, body,
+									  body_len, 0);
+				data_len = (int64) GetUInt64(meta + buffers + 16 * (f->buffer + 2) + 8);
+
+				/* Offsets must be ascending within the data. */
+				prev = rows > 0 ? ArrowOffset(f, 0) : 0;
+				for (r = 1; r <= rows; r++)
+				{
+					int64	next = ArrowOffset(f, r);
+
+					if (prev < 0 || next < prev || next > data_len)
+						ereport(ERROR,
+								(errcode(ERRCODE_DATA_EXCEPTION),
+								 errmsg("invalid offsets in Arrow record batch")));
+					prev = next;
+				}
+			}
+			else
+				f->data = ArrowBuffer(meta + buffers, f->buffer + 1, body,
+									  body_len, f->type == ARROW_BOOL ?
+									  (rows + 7) / 8 : rows * f->width);
+		}
+
+		if (f->conv == ARROW_CONV_NONE)
+			continue;
+
+		f->nulls = palloc(sizeof(bool) * Max(rows, 1));
+		for (r = 0; r < rows; r++)
+			f->nulls[r] = ArrowIsNull(f, r);
+
+		if (f->conv == ARROW_CONV_BATCH && f->type != ARROW_NULL)
+		{
+			Oid		target = self->former.typId[self->former.attnum[i]];
+
+			f->values = palloc(sizeof(Datum) * Max(rows, 1));
+			switch (target)
+			{
+				case INT2OID:
+					for (r = 0; r < rows; r++)
+						f->values[r] = Int16GetDatum((int16) ArrowInt(f, r));
+					break;
+				case INT4OID:
+					for (r = 0; r < rows; r++)
+						f->values[r] = Int32GetDatum((int32) ArrowInt(f, r));
+					break;
+				case INT8OID:
+					for (r = 0; r < rows; r++)
+						f->values[r] = Int64GetDatum(ArrowInt(f, r));
+					break;
+				case FLOAT8OID:
+					for (r = 0; r < rows; r++)
+					{
+						Datum	v;
+
+						ArrowValue(f, r, &v);
+						f->values[r] = (f->typid == FLOAT4OID ?
+							Float8GetDatum((float8) DatumGetFloat4(v)) : v);
+					}
+					break;
+				default:
+					/* float4 and bool */
+					for (r = 0; r < rows; r++)
+						ArrowValue(f, r, &f->values[r]);
+					break;
+			}
+		}
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/*
+ * Read the next record batch. Dictionary batches are only for the fields
+ * skipped, and are ignored.
+ */
+static bool
+ArrowParserNextBatch(ArrowParser *self)
+{
+	int			type;
+	FbTable		header;
+	const char *body;
+	int64		body_len;
+
+	while (ArrowParserNextMessage(self, &type, &header, &body, &body_len))
+	{
+		switch (type)
+		{
+			case MESSAGE_RECORD_BATCH:
+				ArrowParserReadBatch(self, &header, body, body_len);
+				return true;
+			case MESSAGE_DICTIONARY:
+				break;
+			default:
+				ereport(ERROR,
+						(errcode(ERRCODE_DATA_EXCEPTION),
+						 errmsg("unexpected message type %d in Arrow stream",
+								type)));
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief Extract internal format for each column from a row
+ *
+ * Values of CONV_BATCH are taken as they are. The others are read here so
+ * that errors on them point at the row.
+ * @note If error occurs, return to the caller by ereport().
+ */
+static void
+ExtractValuesFromArrow(ArrowParser *self, int64 row)
+{
+	TupleFormer	   *former = &self->former;
+	int				i;
+
+	for (i = 0; i < self->nfields; i++)
+	{
+		ArrowField *f = &self->fields[i];
+		int			j = former->attnum[i];	/* Index of physical fields */
+		Datum		value;
+
+		self->base.parsing_field = i + 1;	/* 1 origin */
+
+		if (j < 0)
+			continue;	/* skipped field */
+
+		former->isnull[j] = f->nulls[row];
+		if (f->nulls[row])
+		{
+			former->values[j] = (Datum) 0;
+			continue;
+		}
+
+		switch (f->conv)
+		{
+			case ARROW_CONV_BATCH:
+				former->values[j] = f->values[row];
+				continue;
+
+			case ARROW_CONV_INPUT:
+			{
+				const char *str;
+				int64		len;
+
+				str = ArrowBytes(f, row, &len);
+				if (len > MaxAllocSize - 1)
+					ereport(ERROR,
+							(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+							 errmsg("string is too long")));
+				resetStringInfo(&self->buf);
+				appendBinaryStringInfo(&self->buf, str, (int) len);
+				str = pg_any_to_server(self->buf.data, (int) len, PG_UTF8);
+				former->values[j] = TupleFormerValue(former, str, j);
+				continue;
+			}
+
+			default:
+				break;
+		}
+
+		if (!ArrowValue(f, row, &value))
+			ereport(ERROR,
+					(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+					 errmsg("value of field \"%s\" is out of range for type %s",
+							f->name, format_type_be(f->typid))));
+
+		switch (f->conv)
+		{
+			case ARROW_CONV_CAST:
+				if (f->cast_nargs >= 2)
+					value = FunctionCall3(&f->cast, value,
+										  Int32GetDatum(former->typMod[j]),
+										  BoolGetDatum(false));
+				else
+					value = FunctionCall1(&f->cast, value);
+				break;
+			case ARROW_CONV_IO:
+				value = TupleFormerValue(former,
+									OutputFunctionCall(&f->typOutput, value), j);
+				break;
+			default:
+				break;
+		}
+
+		if (OidIsValid(f->typmod_cast.fn_oid))
+			value = FunctionCall3(&f->typmod_cast, value,
+								  Int32GetDatum(former->typMod[j]),
+								  BoolGetDatum(false));
+		former->values[j] = value;
+	}
+
+	/* set function default value */
+	for (; i < former->maxfields; i++)
+	{
+		int		index;
+
+		index = i - former->minfields;
+		former->isnull[i] = self->filter.defaultIsnull[index];
+		former->values[i] = self->filter.defaultValues[index];
+	}
+}
+
+static void
+AppendCSVField(StringInfo buf, const char *str, int len)
+{
+	int		i;
+
+	for (i = 0; i < len; i++)
+	{
+		if (str[i] == '"' || str[i] == ',' || str[i] == '\n' || str[i] == '\r')
+			break;
+	}
+	if (i == len && len > 0)
+	{
+		appendBinaryStringInfo(buf, str, len);
+		return;
+	}
+
+	appendStringInfoChar(buf, '"');
+	for (i = 0; i < len; i++)
+	{
+		if (str[i] == '"')
+			appendStringInfoChar(buf, '"');
+		appendStringInfoChar(buf, str[i]);
+	}
+	appendStringInfoChar(buf, '"');
+}
+
+/*
+ * Rows have no text of their own; the parse badfile is a CSV file of the
+ * values formatted by the output functions of the types of the fields.
+ * NULLs are empty, and fields of types which cannot be read are empty too.
+ * Values out of range are written as the integers in the stream.
+ */
+static void
+ArrowParserDumpRecord(ArrowParser *self, FILE *fp, char *badfile)
+{
+	StringInfoData	buf;
+	int				i;
+
+	initStringInfo(&buf);
+	for (i = 0; i < self->nfields; i++)
+	{
+		ArrowField *f = &self->fields[i];
+		Datum		value;
+
+		if (i > 0)
+			appendStringInfoChar(&buf, ',');
+
+		if (!f->supported || ArrowIsNull(f, self->current))
+			continue;
+
+		if (f->type == ARROW_UTF8 || f->type == ARROW_LARGE_UTF8)
+		{
+			const char *str;
+			int64		len;
+
+			str = ArrowBytes(f, self->current, &len);
+			AppendCSVField(&buf, str, (int) Min(len, MaxAllocSize / 4));
+		}
+		else if (ArrowValue(f, self->current, &value))
+		{
+			char   *str = OutputFunctionCall(&f->typOutput, value);
+
+			AppendCSVField(&buf, str, strlen(str));
+		}
+		else if (f->type == ARROW_INT)
+			appendStringInfo(&buf, UINT64_FORMAT, (uint64) ArrowInt(f, self->current));
+		else
+			appendStringInfo(&buf, int64_FMT, ArrowInt(f, self->current));
+	}
+	appendStringInfoChar(&buf, '\n');
+
+	if (fwrite(buf.data, 1, buf.len, fp) != buf.len || fflush(fp))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write parse badfile \"%s\": %m",
+						badfile)));
+
+	pfree(buf.data);
+}
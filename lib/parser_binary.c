@@ -15,6 +15,7 @@
 #include "executor/executor.h"
 #include "mb/pg_wchar.h"
 #include "nodes/execnodes.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
 
 #include "binary.h"
@@ -28,6 +29,11 @@
  */
 #define READ_LINE_NUM		100
 
+/**
+ * @brief  Initial size of the record buffer for records of variable length
+ */
+#define READ_BUFFER_SIZE	(64 * 1024)
+
 #define MAX_CONVERSION_GROWTH  4
 
 typedef struct BinaryParser
@@ -35,21 +41,38 @@ typedef struct BinaryParser
 	Parser	base;
 
 	Source		   *source;
+	SourceOptions	source_opts;
 	Filter			filter;
 	TupleFormer		former;
 
 	int64	offset;				/**< lines to skip */
 	int64	need_offset;		/**< lines to skip */
+	int64	skip_bytes;			/**< bytes to skip, or -1 if not given */
+	bool	need_skip;			/**< SKIP_BYTES or SKIP is not done yet */
+	int		nfiles;				/**< number of input files started */
 
 	size_t	rec_len;			/**< One record length */
-	char   *buffer;				/**< Record buffer to keep input data */
+	char   *buffer;				/**< Record buffer, or window of the source */
+	size_t	buffer_len;			/**< # of bytes in buffer */
 	int		total_rec_cnt;		/**< # of records in buffer */
 	int		used_rec_cnt;		/**< # of returned records in buffer */
-	char	next_head;			/**< Preserved the head of next record */
+	char   *record;				/**< Current record */
+
+	/* records of variable length */
+	int		record_header;		/**< byte length of the record length, or 0 */
+	char	record_endian;		/**< byte order of the record length */
+	bool	varlen_fields;		/**< some fields are length-prefixed */
+	size_t	buffer_size;		/**< allocated size of buffer */
+	size_t	pos;				/**< offset of the next record in buffer */
+	size_t	record_len;			/**< length of the current record */
 
 	bool	preserve_blanks;	/**< preserve trailing spaces? */
 	int		nfield;				/**< number of fields */
 	Field  *fields;				/**< array of field descriptor */
+
+	bool   *columnar;			/**< array[nfield] of fields read at once */
+	Datum  *columns;			/**< array[nfield * READ_LINE_NUM] of values */
+	bool   *column_nulls;		/**< array[nfield * READ_LINE_NUM] of nulls */
 } BinaryParser;
 
 /*
@@ -61,7 +84,12 @@ static int64	BinaryParserTerm(BinaryParser *self);
 static bool BinaryParserParam(BinaryParser *self, const char *keyword, char *value);
 static void BinaryParserDumpParams(BinaryParser *self);
 static void BinaryParserDumpRecord(BinaryParser *self, FILE *fp, char *badfile);
+static bool BinaryParserNextFile(BinaryParser *self);
 
+static void BinaryParserSkip(BinaryParser *self);
+static size_t BinaryParserFill(BinaryParser *self, size_t need);
+static char *BinaryParserNextRecord(BinaryParser *self);
+static void ReadColumns(BinaryParser *self);
 static void ExtractValuesFromFixed(BinaryParser *self, char *record);
 
 /**
@@ -77,7 +105,10 @@ CreateBinaryParser(void)
 	self->base.param = (ParserParamProc) BinaryParserParam;
 	self->base.dumpParams = (ParserDumpParamsProc) BinaryParserDumpParams;
 	self->base.dumpRecord = (ParserDumpRecordProc) BinaryParserDumpRecord;
+	self->base.nextFile = (ParserNextFileProc) BinaryParserNextFile;
+	self->base.filter = &self->filter;
 	self->offset = -1;
+	self->skip_bytes = -1;
 	return (Parser *)self;
 }
 
@@ -106,6 +137,7 @@ BinaryParserInit(BinaryParser *self, Checker *checker, const char *infile, Tuple
 	 * set default values
 	 */
 	self->need_offset = self->offset = self->offset > 0 ? self->offset : 0;
+	self->need_skip = self->offset > 0 || self->skip_bytes >= 0;
 
 	/*
 	 * checking necessary setting items for fixed length file
@@ -114,7 +146,9 @@ BinaryParserInit(BinaryParser *self, Checker *checker, const char *infile, Tuple
 		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 						errmsg("no COL specified")));
 
-	self->source = CreateSource(infile, desc, multi_process);
+	self->source = CreateSource(infile, desc, multi_process, &self->source_opts);
+	self->base.filename = self->source->filename;
+	self->nfiles = 1;
 
 	status = FilterInit(&self->filter, desc, collation);
 	if (checker->tchecker)
@@ -141,6 +175,54 @@ BinaryParserInit(BinaryParser *self, Checker *checker, const char *infile, Tuple
 		self->former.values[i] = self->filter.defaultValues[index];
 	}
 
+	/*
+	 * Length-prefixed fields follow one another, so their offsets are known
+	 * only when each record is read.
+	 */
+	for (i = 0; i < self->nfield; i++)
+	{
+		if (self->fields[i].prefix > 0)
+			self->varlen_fields = true;
+	}
+	if (self->varlen_fields)
+	{
+		if (self->record_header == 0)
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("PREFIX requires RECORD_HEADER")));
+		for (i = 1; i < self->nfield; i++)
+		{
+			if (self->fields[i].offset !=
+				self->fields[i - 1].offset + self->fields[i - 1].len)
+				ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+								errmsg("COL offset cannot be specified with PREFIX")));
+		}
+	}
+	if (self->record_header > 0 && self->rec_len > 0)
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("cannot use STRIDE with RECORD_HEADER")));
+
+	/*
+	 * Numeric fields cast to their columns are read for all the records in
+	 * the record buffer at once. Records of variable length are read one by
+	 * one.
+	 */
+	self->columnar = palloc0(sizeof(bool) * self->nfield);
+	for (i = 0; i < self->nfield; i++)
+	{
+		int		j = self->former.attnum[i];
+
+		if (j >= 0 && self->record_header == 0 &&
+			BinaryColumnar(&self->fields[i], self->former.typId[j]))
+		{
+			self->columnar[i] = true;
+			if (self->columns == NULL)
+			{
+				self->columns = palloc(sizeof(Datum) * self->nfield * READ_LINE_NUM);
+				self->column_nulls = palloc(sizeof(bool) * self->nfield * READ_LINE_NUM);
+			}
+		}
+	}
+
 	/*
 	 * Acquire record buffer as much as input file record length
 	 */
@@ -156,7 +238,17 @@ BinaryParserInit(BinaryParser *self, Checker *checker, const char *infile, Tuple
 		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 			errmsg("STRIDE should be %ld or greater (%ld given)",
 				(long) maxlen, (long) self->rec_len)));
-	self->buffer = palloc(self->rec_len * READ_LINE_NUM + 1);
+
+	/* Records are parsed in place if the source lends its buffer. */
+	if (SourceHasWindow(self->source))
+		self->buffer = NULL;
+	else if (self->record_header > 0)
+	{
+		self->buffer_size = READ_BUFFER_SIZE;
+		self->buffer = palloc(self->buffer_size);
+	}
+	else
+		self->buffer = palloc(self->rec_len * READ_LINE_NUM);
 }
 
 /**
@@ -173,14 +265,22 @@ BinaryParserTerm(BinaryParser *self)
 {
 	int64	skip;
 
-	skip = self->offset;
+	/* SKIP applies to each input file */
+	skip = self->offset * self->nfiles;
 
+	if (self->buffer && !SourceHasWindow(self->source))
+		pfree(self->buffer);
 	if (self->source)
 		SourceClose(self->source);
-	if (self->buffer)
-		pfree(self->buffer);
 	if (self->fields)
 		pfree(self->fields);
+	if (self->columnar)
+		pfree(self->columnar);
+	if (self->columns)
+	{
+		pfree(self->columns);
+		pfree(self->column_nulls);
+	}
 	FilterTerm(&self->filter);
 	TupleFormerTerm(&self->former);
 	pfree(self);
@@ -194,15 +294,15 @@ BinaryParserTerm(BinaryParser *self)
  *
  * Process flow
  *	 - If record buffer is empty
- *	   + Read records up to READ_LINE_NUM by read(2)
+ *	   + Read records up to READ_LINE_NUM by read(2), or borrow them from
+ *		 the source if it lends its buffer.
  *		 * Return 0 if we reach EOF.
  *		 * If an error occurs, notify it to caller by ereport().
  *	   + Count the number of records in the record buffer.
  *	   + Initialize the number of used records to 0.
- *	   + Store the head byte of the next record.
- *	 - If the number of records remained in the record buffer and there is not
- *	   enough room, notify it to the caller by ereport().
- *	 - Get back the stored head byte, and store the head byte of the next record.
+ *	   + Read numeric fields of all the records, see ReadColumns().
+ *	 - Copy character fields to work buffers and convert them to the server
+ *	   encoding. Other fields are read in place.
  *	 - Update the number of records used.
  * @param rd [in/out] Control information
  * @return	Return true if there is a next record, or false if EOF.
@@ -212,50 +312,51 @@ BinaryParserRead(BinaryParser *self, Checker *checker)
 {
 	HeapTuple	tuple;
 	char	   *record;
+	size_t		pos;
 	int			i;
 
-	/* Skip first offset lines in the input file */
-	if (unlikely(self->need_offset > 0))
-	{
-		int		i;
-
-		for (i = 0; i < self->need_offset; i++)
-		{
-			int		len;
-			len = SourceRead(self->source, self->buffer, self->rec_len);
-
-			if (len != self->rec_len)
-			{
-				if (errno == 0)
-					errno = EINVAL;
-				ereport(ERROR, (errcode_for_file_access(),
-								errmsg("could not skip " int64_FMT " lines ("
-								int64_FMT " bytes) in the input file: %m",
-								self->need_offset,
-								self->rec_len * self->need_offset)));
-			}
-		}
-		self->need_offset = 0;
-	}
+	/* Skip the head of the input file */
+	if (unlikely(self->need_skip))
+		BinaryParserSkip(self);
 
 	/*
 	 * If the record buffer is exhausted, read next records from file
-	 * up to READ_LINE_NUM rows at once.
+	 * up to READ_LINE_NUM rows at once. Records of variable length are
+	 * walked in the record buffer one by one.
 	 */
-	if (self->used_rec_cnt >= self->total_rec_cnt)
+	if (self->record_header > 0)
+	{
+		record = BinaryParserNextRecord(self);
+		if (record == NULL)
+			return NULL;	/* eof */
+	}
+	else if (self->used_rec_cnt >= self->total_rec_cnt)
 	{
 		int		len;
 		div_t	v;
 
 		BULKLOAD_PROFILE(&prof_reader_parser);
-		while ((len = SourceRead(self->source, self->buffer,
-						self->rec_len * READ_LINE_NUM)) < 0)
+		if (SourceHasWindow(self->source))
+		{
+			size_t	avail;
+
+			SourceConsume(self->source, self->buffer_len);
+			self->buffer = SourceWindow(self->source,
+							self->rec_len * READ_LINE_NUM, &avail);
+			len = Min(avail, self->rec_len * READ_LINE_NUM);
+		}
+		else
 		{
-			if (errno != EAGAIN && errno != EINTR)
-				ereport(ERROR, (errcode_for_file_access(),
-								errmsg("could not read input file: %m")));
+			while ((len = SourceRead(self->source, self->buffer,
+							self->rec_len * READ_LINE_NUM)) < 0)
+			{
+				if (errno != EAGAIN && errno != EINTR)
+					ereport(ERROR, (errcode_for_file_access(),
+									errmsg("could not read input file: %m")));
+			}
 		}
 		BULKLOAD_PROFILE(&prof_reader_source);
+		self->buffer_len = len;
 
 		/*
 		 * Calculate the actual number of rows. Trailing remainder bytes
@@ -272,6 +373,8 @@ BinaryParserRead(BinaryParser *self, Checker *checker)
 			return NULL;	/* eof */
 
 		record = self->buffer;
+		if (self->columns)
+			ReadColumns(self);
 	}
 	else
 	{
@@ -284,31 +387,69 @@ BinaryParserRead(BinaryParser *self, Checker *checker)
 	 */
 	self->used_rec_cnt++;
 	self->base.count++;
+	self->record = record;
+
+	/* A record of variable length might be shorter than the fields. */
+	if (self->record_header > 0 && !self->varlen_fields &&
+		self->record_len < self->rec_len)
+	{
+		self->base.parsing_field = 0;
+		ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+						errmsg("record is too short (%ld bytes)",
+							   (long) self->record_len)));
+	}
 
+	pos = 0;
 	for (i = 0; i < self->nfield; i++)
 	{
-		/* Convert it to server encoding. */
-		if (self->fields[i].character)
-		{
-			char   *str = record + self->fields[i].offset;
-			int		next_head = self->fields[i].offset + self->fields[i].len;
+		Field  *field = &self->fields[i];
+		char   *in;
+		size_t	len = field->len;
 
-			self->next_head = record[next_head];
-			record[next_head] = '\0';
+		/* Length-prefixed fields and the following fields are walked. */
+		if (self->varlen_fields)
+		{
 			self->base.parsing_field = i + 1;
+			if (field->prefix > 0 && pos + field->prefix <= self->record_len)
+			{
+				len = BinaryReadPrefix(record + pos, field->prefix, field->endian);
+				pos += field->prefix;
+			}
+			if (pos + len > self->record_len)
+				ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+								errmsg("field is beyond the end of the record (%ld bytes)",
+									   (long) self->record_len)));
+			in = record + pos;
+			pos += len;
+		}
+		else
+			in = record + field->offset;
+
+		/*
+		 * Character fields are copied to their work buffer to be terminated
+		 * with NUL because the record buffer might be read-only. Then convert
+		 * it to server encoding. Length-prefixed fields have a work buffer
+		 * for each record.
+		 */
+		if (field->character)
+		{
+			char   *str = field->str;
 
-			self->fields[i].in = CheckerConversion(checker, str);
+			if (field->prefix > 0)
+				str = palloc(len + 1);
+			memcpy(str, in, len);
+			str[len] = '\0';
+			self->base.parsing_field = i + 1;
 
-			record[next_head] = self->next_head;
+			field->in = CheckerConversion(checker, str);
 		}
 		else
 		{
-			self->fields[i].in = record + self->fields[i].offset;
+			field->in = in;
 		}
 	}
 
 	ExtractValuesFromFixed(self, record);
-	self->next_head = '\0';
 	self->base.parsing_field = -1;
 
 	if (self->filter.funcstr)
@@ -327,7 +468,8 @@ BinaryParserParam(BinaryParser *self, const char *keyword, char *value)
 	{
 		BinaryParam(&self->fields, &self->nfield, value, self->preserve_blanks, false);
 
-		if (self->fields[self->nfield - 1].character)
+		if (self->fields[self->nfield - 1].character &&
+			self->fields[self->nfield - 1].prefix == 0)
 			self->fields[self->nfield - 1].str =
 				palloc(self->fields[self->nfield - 1].len * MAX_CONVERSION_GROWTH + 1);
 	}
@@ -340,18 +482,29 @@ BinaryParserParam(BinaryParser *self, const char *keyword, char *value)
 		ASSERT_ONCE(self->rec_len == 0);
 		self->rec_len = ParseInt32(value, 1);
 	}
+	else if (CompareKeyword(keyword, "RECORD_HEADER"))
+	{
+		ASSERT_ONCE(self->record_header == 0);
+		BinaryParsePrefix(value, &self->record_header, &self->record_endian);
+	}
 	else if (CompareKeyword(keyword, "SKIP") ||
 			 CompareKeyword(keyword, "OFFSET"))
 	{
 		ASSERT_ONCE(self->offset < 0);
 		self->offset = ParseInt64(value, 0);
 	}
+	else if (CompareKeyword(keyword, "SKIP_BYTES"))
+	{
+		ASSERT_ONCE(self->skip_bytes < 0);
+		self->skip_bytes = ParseInt64(value, 0);
+	}
 	else if (CompareKeyword(keyword, "FILTER"))
 	{
 		ASSERT_ONCE(!self->filter.funcstr);
 		self->filter.funcstr = pstrdup(value);
 	}
-	else
+	else if (!SourceParam(&self->source_opts, keyword, value) &&
+			 !TupleFormerParam(&self->former, keyword, value))
 		return false;	/* unknown parameter */
 
 	return true;
@@ -365,9 +518,21 @@ BinaryParserDumpParams(BinaryParser *self)
 	initStringInfo(&buf);
 	appendStringInfoString(&buf, "TYPE = BINARY\n");
 	appendStringInfo(&buf, "SKIP = " int64_FMT "\n", self->offset);
-	appendStringInfo(&buf, "STRIDE = %ld\n", (long) self->rec_len);
+	if (self->skip_bytes >= 0)
+		appendStringInfo(&buf, "SKIP_BYTES = " int64_FMT "\n", self->skip_bytes);
+	if (self->record_header > 0)
+	{
+		appendStringInfo(&buf, "RECORD_HEADER = %d", self->record_header);
+		if (self->record_endian)
+			appendStringInfo(&buf, " %cE", self->record_endian);
+		appendStringInfoChar(&buf, '\n');
+	}
+	else
+		appendStringInfo(&buf, "STRIDE = %ld\n", (long) self->rec_len);
 	if (self->filter.funcstr)
 		appendStringInfo(&buf, "FILTER = %s\n", self->filter.funcstr);
+	SourceDumpParams(&self->source_opts, &buf);
+	TupleFormerDumpParams(&self->former, &buf);
 
 	BinaryDumpParams(self->fields, self->nfield, &buf, "COL");
 
@@ -378,50 +543,238 @@ BinaryParserDumpParams(BinaryParser *self)
 static void
 BinaryParserDumpRecord(BinaryParser *self, FILE *fp, char *badfile)
 {
-	int		len;
-	char   *record = self->buffer + (self->rec_len * (self->used_rec_cnt - 1));
+	char   *record = self->record;
+	size_t	rec_len = self->rec_len;
+	size_t	len;
 
-	if (self->base.parsing_field > 0 && self->next_head != '\0')
+	/* A record of variable length is written with its header. */
+	if (self->record_header > 0)
 	{
-		int	next_head;
-
-		next_head = self->fields[self->base.parsing_field - 1].offset +
-					self->fields[self->base.parsing_field - 1].len;
-
-		record[next_head] = self->next_head;
+		record -= self->record_header;
+		rec_len = self->record_header + self->record_len;
 	}
 
-	len = fwrite(record, 1, self->rec_len, fp);
-	if (len < self->rec_len || fflush(fp))
+	len = fwrite(record, 1, rec_len, fp);
+	if (len < rec_len || fflush(fp))
 		ereport(ERROR,
 				(errcode_for_file_access(),
 				 errmsg("could not write parse badfile \"%s\": %m",
 						badfile)));
 }
 
+/*
+ * Go on to the next input file. A record never spans input files, and SKIP
+ * and SKIP_BYTES apply to the head of each file.
+ */
+static bool
+BinaryParserNextFile(BinaryParser *self)
+{
+	if (!SourceNextFile(self->source))
+	{
+		self->base.filename = NULL;
+		return false;
+	}
+
+	self->base.filename = self->source->filename;
+	self->nfiles++;
+	self->need_offset = self->offset;
+	self->need_skip = self->offset > 0 || self->skip_bytes >= 0;
+	self->total_rec_cnt = self->used_rec_cnt = 0;
+	self->buffer_len = self->pos = 0;
+
+	return true;
+}
+
+/**
+ * @brief Skip SKIP_BYTES bytes and then SKIP records at the head of the input
+ * file.
+ *
+ * Records of fixed length are skipped at once, so the source seeks over them
+ * if it can. If SKIP_BYTES is given, the offset of the first record is logged
+ * so that a later load can start there.
+ */
+static void
+BinaryParserSkip(BinaryParser *self)
+{
+	int64	offset = Max(self->skip_bytes, 0);
+	int64	i;
+
+	if (offset > 0 && SourceSkip(self->source, offset) < offset)
+		ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+						errmsg("could not skip " int64_FMT
+						" bytes in the input file", offset)));
+
+	if (self->record_header > 0)
+	{
+		for (i = 0; i < self->need_offset; i++)
+		{
+			if (BinaryParserNextRecord(self) == NULL)
+				ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+								errmsg("could not skip " int64_FMT
+								" records in the input file",
+								self->need_offset)));
+			offset += self->record_header + self->record_len;
+		}
+	}
+	else if (self->need_offset > 0)
+	{
+		int64	len = self->rec_len * self->need_offset;
+
+		if (SourceSkip(self->source, len) < len)
+			ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+							errmsg("could not skip " int64_FMT " lines ("
+							int64_FMT " bytes) in the input file",
+							self->need_offset, len)));
+		offset += len;
+	}
+	self->need_offset = 0;
+	self->need_skip = false;
+
+	if (self->skip_bytes >= 0)
+		ParserLogOffset(&self->base, offset);
+}
+
+/**
+ * @brief Make need bytes from the next record available in the record buffer
+ *
+ * The bytes before the next record are consumed. If the source does not lend
+ * its buffer, the rest of the buffer is moved to the head, so that records
+ * are not copied one by one. Returns the number of bytes available, which is
+ * less than need only at the end of the input file.
+ */
+static size_t
+BinaryParserFill(BinaryParser *self, size_t need)
+{
+	size_t	avail = self->buffer_len - self->pos;
+
+	if (avail >= need)
+		return avail;
+
+	if (SourceHasWindow(self->source))
+	{
+		SourceConsume(self->source, self->pos);
+		self->buffer = SourceWindow(self->source, need, &avail);
+	}
+	else
+	{
+		if (self->pos > 0)
+			memmove(self->buffer, self->buffer + self->pos, avail);
+		if (need > self->buffer_size)
+		{
+			self->buffer_size = Max(need, self->buffer_size * 2);
+			self->buffer = repalloc(self->buffer, self->buffer_size);
+		}
+		while (avail < need)
+		{
+			size_t	len;
+
+			len = SourceRead(self->source, self->buffer + avail,
+							 self->buffer_size - avail);
+			if (len == 0)
+				break;
+			avail += len;
+		}
+	}
+
+	self->buffer_len = avail;
+	self->pos = 0;
+
+	return avail;
+}
+
+/**
+ * @brief Find the next record of variable length in the record buffer
+ *
+ * Each record starts with its length in RECORD_HEADER bytes, which does not
+ * include the header itself.
+ * @return The record, or NULL at the end of the input file.
+ */
+static char *
+BinaryParserNextRecord(BinaryParser *self)
+{
+	size_t	header = self->record_header;
+	size_t	avail;
+	size_t	len = 0;
+	char   *record;
+
+	BULKLOAD_PROFILE(&prof_reader_parser);
+	avail = BinaryParserFill(self, header);
+	if (avail >= header)
+	{
+		len = BinaryReadPrefix(self->buffer + self->pos, header,
+							   self->record_endian);
+		if (len > MaxAllocSize - header)
+			ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+							errmsg("record length %lu is too large",
+								   (unsigned long) len)));
+		avail = BinaryParserFill(self, header + len);
+	}
+	BULKLOAD_PROFILE(&prof_reader_source);
+
+	if (avail < header || avail < header + len)
+	{
+		/* Trailing bytes of an incomplete record are ignored. */
+		if (avail > 0)
+			elog(WARNING, "Ignore %d bytes at the end of file", (int) avail);
+		self->pos = self->buffer_len;
+		return NULL;
+	}
+
+	record = self->buffer + self->pos + header;
+	self->record_len = len;
+	self->pos += header + len;
+
+	return record;
+}
+
+/**
+ * @brief Read numeric fields of all the records in the record buffer
+ *
+ * The values are stored column by column, and picked up by
+ * ExtractValuesFromFixed() for each record. Only fields which cannot raise
+ * errors are read here, so parse errors are still reported for each record.
+ */
+static void
+ReadColumns(BinaryParser *self)
+{
+	int			i;
+
+	for (i = 0; i < self->nfield; i++)
+	{
+		Field  *field = &self->fields[i];
+
+		if (!self->columnar[i])
+			continue;
+
+		field->readColumn(field, self->former.typId[self->former.attnum[i]],
+						  self->buffer + field->offset, self->rec_len,
+						  self->total_rec_cnt,
+						  self->columns + i * READ_LINE_NUM,
+						  self->column_nulls + i * READ_LINE_NUM);
+	}
+}
+
 /**
  * @brief Extract internal format for each column from string data in a record
  *
  * Process flow
  * -# Loop from the head of fields and process as follow
- *	 -# Reserve the head byte of the next field
- *	 -# Make sure whether it is NUL character
- *	   - If it is NUL character:
+ *	 -# Make sure whether it matches the NULLIF pattern
+ *	   - If it matches:
  *		 -# Return to the caller by ereport() if it is violate to NOT NULL
  *			constraint
  *	   - If not
- *		 -# Terminate the input string by rewrite the head byte of the next
- *			field or the first white space character following string.
- *		 -# Transfer each field value to internal format by FunctionCall3()
- *	 -# Retrurn the stored value to next field
+ *		 -# Transfer each field value to internal format. Character fields
+ *			have been terminated in their work buffers, and numeric fields
+ *			might have been read by ReadColumns().
  *
  * @param rd [in/out] Controll information
- * @param record [in/out] One record data (which must be NUL terminated)
+ * @param record [in] One record data
  * @return void
  * @note Memory allocated in this function is not able to be freed. So if you
  *		 call this function, you have to be in a memory context which is able
  *		 to be reseted or destroyed.
- * @note When exit, the context record is pointing may be modified.
+ * @note The record is not modified, so it can be a read-only window.
  * @note If error occurs, return to the caller by ereport().
  */
 static void
@@ -437,17 +790,24 @@ ExtractValuesFromFixed(BinaryParser *self, char *record)
 		int			j = self->former.attnum[i];	/* Index of physical fields */
 		bool		isnull;
 		Datum		value;
-		int			next_head = self->fields[i].offset + self->fields[i].len;
 
-		self->next_head = record[next_head];
-		record[next_head] = '\0';
+		if (j < 0)
+			continue;	/* skipped field */
+
+		if (self->columnar[i])
+		{
+			int		k = i * READ_LINE_NUM + self->used_rec_cnt - 1;
+
+			self->former.isnull[j] = self->column_nulls[k];
+			self->former.values[j] = self->columns[k];
+			continue;
+		}
+
 		self->base.parsing_field = i + 1;	/* 1 origin */
 
 		value = self->fields[i].read(&self->former,
 			self->fields[i].in, &self->fields[i], j, &isnull);
 
-		record[next_head] = self->next_head;
-
 		self->former.isnull[j] = isnull;
 		self->former.values[j] = value;
 	}
@@ -20,6 +20,7 @@
 #include "reader.h"
 #include "pg_strutil.h"
 #include "pg_profile.h"
+#include "simd.h"
 
 /**
  * @brief Initial size of the record buffer and the field buffer.
@@ -33,16 +34,26 @@ typedef struct CSVParser
 	Parser	base;
 
 	Source		   *source;
+	SourceOptions	source_opts;
 	Filter			filter;
 	TupleFormer		former;
+	Checker		   *checker;
 
 	int64	offset;				/**< lines to skip */
 	int64	need_offset;		/**< lines to skip */
+	int64	skip_bytes;			/**< bytes to skip, or -1 if not given */
+	bool	need_skip;			/**< SKIP_BYTES or SKIP is not done yet */
+	int64	buf_offset;			/**< input offset of the record buffer */
+	int		nfiles;				/**< number of input files started */
+	bool	header;				/**< each input file starts with a header */
+	bool	need_header;		/**< the header is not read yet */
 
 	/**
 	 * @brief Record Buffer.
 	 *
-	 * This buffer stores the data read from the input file.
+	 * This buffer stores the data read from the input file. If the source
+	 * lends its own buffer, this points to the read-only window of the source
+	 * and must not be modified.
 	 */
 	char *rec_buf;
 	
@@ -79,6 +90,11 @@ typedef struct CSVParser
 	 * @brief Pointer to the current record in the record buffer.
 	 */
 	char *cur;
+
+	/**
+	 * @brief Length of the current record, excluding the record delimiter.
+	 */
+	int	cur_len;
 	
 	/**
 	 * @brief Pointer to the next record in the record buffer.
@@ -97,21 +113,38 @@ typedef struct CSVParser
 	 */
 	int	null_len;
 
+	bool		text;			/**< text format of COPY */
 	char		delim;			/**< delimeter */
 	char		quote;			/**< quotation string */
 	char		escape;			/**< escape letter */
 	char	   *null;			/**< NULL value string */
 	List	   *fnn_name;		/**< list of NOT NULL column names */
 	bool	   *fnn;			/**< array of NOT NULL column flag */
+	bool		skipping;		/**< the current field is not loaded */
+	bool		unescaped;		/**< the record has escaped fields */
+
+	ByteSet		plain_set;		/**< bytes significant out of quotes */
+	ByteSet		quoted_set;		/**< bytes significant in quotes */
+	ByteSet		text_set;		/**< bytes significant in text format */
 } CSVParser;
 
 static void	CSVParserInit(CSVParser *self, Checker *checker, const char *infile, TupleDesc desc, bool multi_process, Oid collation);
 static HeapTuple	CSVParserRead(CSVParser *self, Checker *checker);
+static bool	CSVParserReadBatch(CSVParser *self, Checker *checker, RecordBatch *batch, int max);
 static int64	CSVParserTerm(CSVParser *self);
 static bool CSVParserParam(CSVParser *self, const char *keyword, char *value);
 static void CSVParserDumpParams(CSVParser *self);
 static void CSVParserDumpRecord(CSVParser *self, FILE *fp, char *badfile);
-
+static bool CSVParserNextFile(CSVParser *self);
+
+static int	CSVParserFill(CSVParser *self, int field_num, int *shift);
+static void	CSVParserSkip(CSVParser *self);
+static void	CSVParserSkipBytes(CSVParser *self);
+static void	CSVParserSkipLines(CSVParser *self);
+static void	CSVParserReadHeader(CSVParser *self);
+static int	CSVParserTokenize(CSVParser *self, Checker *checker, RecordBatch *batch);
+static int	TextParserTokenize(CSVParser *self, Checker *checker, RecordBatch *batch);
+static int	CSVParserEndRecord(CSVParser *self, Checker *checker, RecordBatch *batch, bool in_quote);
 static void	ExtractValuesFromCSV(CSVParser *self, int parsed_field);
 
 /*
@@ -126,6 +159,7 @@ static void	ExtractValuesFromCSV(CSVParser *self, int parsed_field);
  *
  * Flow
  * -# If non-zero lenght is specified, copies data and shift source/destination pointer.
+ *	  Nothing is copied for a field which is not loaded.
  * -# Increment the source pointer to skip characters not to copy.
  *
  * @param dst [in/out] Copy destination address (field buffer index)
@@ -136,17 +170,16 @@ static void	ExtractValuesFromCSV(CSVParser *self, int parsed_field);
 static void
 appendToField(CSVParser *self, int *dst, int *src, int len)
 {
-	if (len)
+	if (len && !self->skipping)
 	{
 		memcpy(self->field_buf + *dst, self->rec_buf + *src, len);
 		*dst += len;
-		*src += len;
 		self->field_buf[*dst] = '\0';
 	}
 	/*
 	 * Shift the source address for non-loading character.
 	 */
-	(*src)++;
+	*src += len + 1;
 }
 
 /**
@@ -162,7 +195,25 @@ CreateCSVParser(void)
 	self->base.param = (ParserParamProc) CSVParserParam;
 	self->base.dumpParams = (ParserDumpParamsProc) CSVParserDumpParams;
 	self->base.dumpRecord = (ParserDumpRecordProc) CSVParserDumpRecord;
+	self->base.nextFile = (ParserNextFileProc) CSVParserNextFile;
+	self->base.readBatch = (ParserReadBatchProc) CSVParserReadBatch;
+	self->base.filter = &self->filter;
 	self->offset = -1;
+	self->skip_bytes = -1;
+	return (Parser *)self;
+}
+
+/**
+ * @brief Create a new parser for the text format of COPY.
+ *
+ * Fields are separated by tabs and special characters are escaped with
+ * backslashes, as in the output of COPY ... TO without CSV.
+ */
+Parser *
+CreateTextParser(void)
+{
+	CSVParser *self = (CSVParser *) CreateCSVParser();
+	self->text = true;
 	return (Parser *)self;
 }
 
@@ -185,11 +236,20 @@ CSVParserInit(CSVParser *self, Checker *checker, const char *infile, TupleDesc d
 	/*
 	 * set default values
 	 */
-	self->delim = self->delim ? self->delim : ',';
-	self->quote = self->quote ? self->quote : '"';
-	self->escape = self->escape ? self->escape : '"';
-	self->null = self->null ? self->null : "";
+	if (self->text)
+	{
+		self->delim = self->delim ? self->delim : '\t';
+		self->null = self->null ? self->null : "\\N";
+	}
+	else
+	{
+		self->delim = self->delim ? self->delim : ',';
+		self->quote = self->quote ? self->quote : '"';
+		self->escape = self->escape ? self->escape : '"';
+		self->null = self->null ? self->null : "";
+	}
 	self->need_offset = self->offset = self->offset > 0 ? self->offset : 0;
+	self->need_skip = self->offset > 0 || self->skip_bytes >= 0;
 
 	/*
 	 * validation check
@@ -199,7 +259,13 @@ CSVParserInit(CSVParser *self, Checker *checker, const char *infile, TupleDesc d
 				(errcode(ERRCODE_INTERNAL_ERROR),
 				 errmsg
 				 ("DELIMITER cannot be appear in the NULL parameter")));
-	if (strchr(self->null, self->quote))
+	if (self->text &&
+		(self->delim == '\\' || self->delim == '\n' || self->delim == '\r'))
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg
+				 ("DELIMITER cannot be backslash or newline for TYPE = TEXT")));
+	if (!self->text && strchr(self->null, self->quote))
 		ereport(ERROR,
 				(errcode(ERRCODE_INTERNAL_ERROR),
 				 errmsg
@@ -209,8 +275,26 @@ CSVParserInit(CSVParser *self, Checker *checker, const char *infile, TupleDesc d
 				(errcode(ERRCODE_INTERNAL_ERROR),
 				 errmsg
 				 ("cannot use FILTER with FORCE_NOT_NULL")));
-
-	self->source = CreateSource(infile, desc, multi_process);
+	if (self->header && self->filter.funcstr)
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg
+				 ("cannot use FILTER with HEADER")));
+
+	/* The input is converted into the server encoding as it is read. */
+	self->source = CreateSource(infile, desc, multi_process, &self->source_opts);
+	if (checker->check_encoding)
+		self->source = CreateConversionSource(self->source, checker);
+	self->checker = checker;
+	self->base.filename = self->source->filename;
+	self->nfiles = 1;
+
+	/* Offsets are not known in the input if it is converted. */
+	if (self->skip_bytes >= 0 && checker->check_encoding &&
+		CheckerNeedConversion(checker))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot use SKIP_BYTES with ENCODING which needs conversion")));
 
 	status = FilterInit(&self->filter, desc, collation);
 	if (checker->tchecker)
@@ -218,6 +302,10 @@ CSVParserInit(CSVParser *self, Checker *checker, const char *infile, TupleDesc d
 
 	TupleFormerInit(&self->former, &self->filter, desc);
 
+	/* FILTER is called for each record unless it takes arrays. */
+	if (self->filter.funcstr && !self->filter.array)
+		self->base.readBatch = NULL;
+
 	/*
 	 * set not NULL column information
 	 */
@@ -226,7 +314,7 @@ CSVParserInit(CSVParser *self, Checker *checker, const char *infile, TupleDesc d
 		int			i;
 		ListCell   *name;
 
-		self->fnn = palloc0(sizeof(bool) * self->former.maxfields);
+		self->fnn = palloc0(sizeof(bool) * Max(desc->natts, 1));
 		foreach(name, self->fnn_name)
 		{
 			for (i = 0; i < desc->natts; i++)
@@ -255,15 +343,27 @@ CSVParserInit(CSVParser *self, Checker *checker, const char *infile, TupleDesc d
 	 * little bit ugly...
 	 */
 	self->buf_len = INITIAL_BUF_LEN / 2;
-	self->rec_buf = palloc(self->buf_len);
-	self->rec_buf[0] = '\0';
+	if (SourceHasWindow(self->source))
+		self->rec_buf = NULL;	/* use the window of the source */
+	else
+	{
+		self->rec_buf = palloc(self->buf_len);
+		self->rec_buf[0] = '\0';
+	}
 	self->used_len = 0;
+	self->buf_offset = 0;
 	self->field_buf = palloc(self->buf_len);
-	self->next = self->rec_buf;
+	self->next = self->cur = self->rec_buf;
+	self->cur_len = 0;
 	self->fields = palloc(Max(self->former.maxfields, 1) * sizeof(char *));
 	self->fields[0] = NULL;
 	self->null_len = strlen(self->null);
 	self->eof = false;
+	self->need_header = self->header;
+
+	ByteSetInit(&self->plain_set, self->quote, self->delim, '\r', '\n');
+	ByteSetInit(&self->quoted_set, self->quote, self->escape, self->quote, self->escape);
+	ByteSetInit(&self->text_set, '\\', self->delim, '\r', '\n');
 }
 
 /**
@@ -283,14 +383,15 @@ CSVParserTerm(CSVParser *self)
 {
 	int64	skip;
 
-	skip = self->offset;
+	/* SKIP applies to each input file */
+	skip = self->offset * self->nfiles;
 
+	if (self->rec_buf && !SourceHasWindow(self->source))
+		pfree(self->rec_buf);
 	if (self->source)
 		SourceClose(self->source);
 	if (self->fields)
 		pfree(self->fields);
-	if (self->rec_buf)
-		pfree(self->rec_buf);
 	if (self->field_buf)
 		pfree(self->field_buf);
 	FilterTerm(&self->filter);
@@ -307,9 +408,14 @@ checkFieldIsNull(CSVParser *self, int field_num, int len)
 	 * We have to determine NULL value using character string before quote mark
 	 * and escape character handling.	For this, we use the record buffer, not
 	 * the field buffer (field buffer contains character string after these marks
-	 * are handled).
+	 * are handled).  A field which is not loaded is regarded as NULL.
 	 */
-	if (self->former.maxfields != 0 &&
+	if (self->skipping)
+	{
+		self->fields[field_num] = NULL;
+		return true;
+	}
+	else if (self->former.maxfields != 0 &&
 		!self->fnn[self->former.attnum[field_num]] &&
 		self->null_len == len &&
 		0 == memcmp(self->null, self->fields[field_num], self->null_len))
@@ -321,6 +427,380 @@ checkFieldIsNull(CSVParser *self, int field_num, int len)
 		return false;
 }
 
+/**
+ * @brief Make more input available in the record buffer.
+ *
+ * Data from self->cur is kept, and moved to the head of the record buffer.
+ * If the source lends its buffer, the record buffer is the window of the
+ * source and nothing is copied.
+ *
+ * @param field_num [in] Number of self->fields already parsed
+ * @param shift [out] Distance the current record moved; indexes to the
+ * record buffer must be adjusted with it.
+ * @return The number of bytes added, or zero at EOF.
+ */
+static int
+CSVParserFill(CSVParser *self, int field_num, int *shift)
+{
+	int		move_size = self->cur - self->rec_buf;	/* Amount to move buffer. */
+	int		ret;
+	int		parsing_field = self->base.parsing_field;
+
+	/*
+	 * Errors of the source, e.g. invalid characters for ENCODING, are not
+	 * parse errors of the record; the buffers might be half updated.
+	 */
+	self->base.parsing_field = -1;
+
+	if (SourceHasWindow(self->source))
+	{
+		size_t	avail;
+		int		remain = self->used_len - move_size;
+
+		/* The current record is not available while the window moves. */
+		self->cur = NULL;
+		self->cur_len = 0;
+
+		SourceConsume(self->source, move_size);
+		self->rec_buf = SourceWindow(self->source, remain + 1, &avail);
+		self->used_len = (int) avail;
+		ret = self->used_len - remain;
+
+		/*
+		 * Field buffer does not exceed a single record size, so it must be
+		 * as large as the window.
+		 */
+		if (self->buf_len <= self->used_len)
+		{
+			int			j;
+			char	   *old_buf = self->field_buf;
+
+			while (self->buf_len <= self->used_len)
+				self->buf_len *= 2;
+			self->field_buf = repalloc(self->field_buf, self->buf_len);
+			for (j = 0; j <= field_num; j++)
+			{
+				if (self->fields[j])
+					self->fields[j] += self->field_buf - old_buf;
+			}
+		}
+	}
+	else
+	{
+		/*
+		 * When an escape character is found at the last of the buffer or no
+		 * record delimiter is found in the record buffer, we extend the record
+		 * buffer.
+		 * - When the current line starts at the beginning of the record buffer,
+		 *	 -> Buffer size is doubled and more data is read.
+		 * - The current line is not at the begenning of the record buffer,
+		 *	 -> Move the current line to the beginning of the record buffer and continue to read.
+		 */
+		if (move_size > 0)
+		{
+			memmove(self->rec_buf, self->cur, self->used_len - move_size);
+			self->used_len -= move_size;
+		}
+		else if (self->buf_len - self->used_len <= 1)
+		{
+			int			j;
+			char	   *old_buf = self->field_buf;
+
+			self->buf_len *= 2;
+			self->field_buf = repalloc(self->field_buf, self->buf_len);
+			/*
+			 * After repalloc(), address of each field needs to be adjusted.
+			 */
+			for (j = 0; j <= field_num; j++)
+			{
+				if (self->fields[j])
+					self->fields[j] += self->field_buf - old_buf;
+			}
+
+			self->rec_buf = repalloc(self->rec_buf, self->buf_len);
+		}
+
+		ret = SourceRead(self->source, self->rec_buf + self->used_len,
+						 self->buf_len - self->used_len - 1);
+		self->used_len += ret;
+		self->rec_buf[self->used_len] = '\0';
+	}
+
+	/*
+	 * Expanded buffer may be different from the original one, so we reset the
+	 * record beginning.
+	 */
+	self->cur = self->rec_buf;
+	self->cur_len = self->used_len;
+	self->buf_offset += move_size;
+	*shift = move_size;
+	self->base.parsing_field = parsing_field;
+
+	return ret;
+}
+
+/**
+ * @brief Skip the head of the input file by SKIP_BYTES and SKIP.
+ *
+ * If SKIP_BYTES is given, the offset of the first record is logged so that
+ * a later load can start there without parsing the lines again.
+ */
+static void
+CSVParserSkip(CSVParser *self)
+{
+	if (self->skip_bytes > 0)
+		CSVParserSkipBytes(self);
+	if (self->need_offset > 0)
+		CSVParserSkipLines(self);
+	self->need_skip = false;
+
+	if (self->skip_bytes >= 0)
+		ParserLogOffset(&self->base,
+						self->buf_offset + (self->next - self->rec_buf));
+}
+
+/**
+ * @brief Skip to the record at the byte offset SKIP_BYTES in the input file.
+ *
+ * The source skips the bytes without reading them if it can seek. The offset
+ * need not be at the head of a record: the line which has the byte just
+ * before the offset is skipped too, so the offset of a record is used as it
+ * is. The header is read from the head of the file before skipping.
+ */
+static void
+CSVParserSkipBytes(CSVParser *self)
+{
+	int64	target = self->skip_bytes - 1;	/* the byte before the record */
+	int64	end = self->buf_offset + self->used_len;
+
+	if (target < self->buf_offset + (self->next - self->rec_buf))
+		return;		/* the header ends after the offset */
+
+	if (target <= end)
+		self->next = self->rec_buf + (target - self->buf_offset);
+	else
+	{
+		int64	len = target - end;
+
+		/* Drop the record buffer, and skip the rest in the source. */
+		if (SourceHasWindow(self->source))
+			SourceConsume(self->source, self->used_len);
+		else
+			self->rec_buf[0] = '\0';
+		self->buf_offset = end;
+		self->used_len = 0;
+		self->next = self->cur = self->rec_buf;
+		self->cur_len = 0;
+
+		if (SourceSkip(self->source, len) < len)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("could not skip " int64_FMT " bytes in the input file",
+							self->skip_bytes)));
+		self->buf_offset += len;
+	}
+
+	/* Resynchronize to the head of the next line. */
+	self->need_offset++;
+}
+
+/**
+ * @brief Skip first offset lines in the input file.
+ *
+ * Lines ending with line feeds are counted by blocks with SimdSkipLines, and
+ * carriage returns are handled here one by one.
+ */
+static void
+CSVParserSkipLines(CSVParser *self)
+{
+	int64	skipped = 0;
+	bool	inCR = false;
+	int		i;
+
+	for (i = self->next - self->rec_buf;; i++)
+	{
+		if (i >= self->used_len)
+		{
+			int		shift;
+
+			/* Lines scanned so far are not needed anymore. */
+			self->cur = self->rec_buf + self->used_len;
+			if (CSVParserFill(self, 0, &shift) == 0)
+			{
+				/* A carriage return at the end of file terminates the line. */
+				if (inCR && ++skipped >= self->need_offset)
+				{
+					self->next = self->rec_buf + self->used_len;
+					break;
+				}
+				/* The end of file is not an I/O error; errno means nothing. */
+				ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+					errmsg("could not skip " int64_FMT " lines in the input file",
+						self->need_offset)));
+			}
+			i -= shift;
+		}
+
+		/* Skip the lines up to the next carriage return. */
+		if (!inCR)
+		{
+			int64	lines = self->need_offset - skipped;
+
+			i += SimdSkipLines(self->rec_buf + i, self->used_len - i, &lines);
+			skipped = self->need_offset - lines;
+			if (lines == 0)
+			{
+				/* Seek to head of the next line. */
+				self->next = self->rec_buf + i;
+				break;
+			}
+			if (i >= self->used_len)
+			{
+				i--;	/* continue to the end of the buffer */
+				continue;
+			}
+
+			inCR = true;
+			continue;
+		}
+
+		/* A carriage return ends the line with or without a line feed. */
+		inCR = false;
+		if (self->rec_buf[i] != '\n')
+			i--;	/* re-read the char as the head of the next line */
+
+		/* Skip the line */
+		if (++skipped >= self->need_offset)
+		{
+			/* Seek to head of the next line. */
+			self->next = self->rec_buf + i + 1;
+			break;
+		}
+	}
+
+	/* done */
+	self->need_offset = 0;
+}
+
+/**
+ * @brief Read the header line at the head of the input file.
+ *
+ * Unless FIELDS is specified, the fields are mapped to the columns of the
+ * same names, and the fields of other names are not loaded.  Like SKIP, the
+ * header is a single line even if a quoted name contains a record delimiter.
+ */
+static void
+CSVParserReadHeader(CSVParser *self)
+{
+	bool	inCR = false;
+	bool	in_quote = false;
+	int		start;
+	int		len;
+	int		i;
+	char   *line;
+	char   *p;
+	List   *names = NIL;
+	StringInfoData	name;
+	ByteSet	newlines;
+
+	ByteSetInit(&newlines, '\r', '\n', '\r', '\n');
+	self->need_header = false;
+	self->cur = self->next;
+	self->fields[0] = NULL;
+
+	start = self->cur - self->rec_buf;
+	for (i = start;; i++)
+	{
+		char	c;
+
+		if (i >= self->used_len)
+		{
+			int		shift;
+
+			if (CSVParserFill(self, 0, &shift) == 0)
+			{
+				/* The header is the last line. */
+				len = self->used_len - start - (inCR ? 1 : 0);
+				self->next = self->rec_buf + self->used_len;
+				break;
+			}
+			i -= shift;
+			start -= shift;
+		}
+
+		/* Jump to the record delimiter. */
+		if (!inCR)
+		{
+			i += SimdScan(self->rec_buf + i, self->used_len - i, &newlines);
+			if (i >= self->used_len)
+			{
+				i--;	/* continue to the end of the buffer */
+				continue;
+			}
+		}
+
+		c = self->rec_buf[i];
+		if (inCR)
+		{
+			len = i - 1 - start;
+			if (c != '\n')
+				i--;	/* re-read the char as the head of the next line */
+			self->next = self->rec_buf + i + 1;
+			break;
+		}
+		else if (c == '\r')
+			inCR = true;
+		else
+		{
+			len = i - start;
+			self->next = self->rec_buf + i + 1;
+			break;
+		}
+	}
+
+	/* FIELDS takes precedence over the header. */
+	if (self->former.fields != NIL)
+		return;
+
+	/* Split the header into names with the quote mark and the escape. */
+	line = pnstrdup(self->rec_buf + start, len);
+	initStringInfo(&name);
+	for (p = line;; p++)
+	{
+		if (in_quote)
+		{
+			if (*p == '\0')
+				ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR),
+								errmsg("unterminated CSV quoted field in the header")));
+			else if (*p == self->escape &&
+					 (p[1] == self->quote || p[1] == self->escape))
+				appendStringInfoChar(&name, *++p);
+			else if (*p == self->quote)
+				in_quote = false;
+			else
+				appendStringInfoChar(&name, *p);
+		}
+		else if (!self->text && *p == self->quote)
+			in_quote = true;
+		else if (*p == self->delim || *p == '\0')
+		{
+			names = lappend(names, pstrdup(name.data));
+			if (*p == '\0')
+				break;
+			resetStringInfo(&name);
+		}
+		else
+			appendStringInfoChar(&name, *p);
+	}
+	pfree(name.data);
+	pfree(line);
+
+	TupleFormerSetFields(&self->former, names, true);
+	self->fields = repalloc(self->fields,
+							Max(self->former.maxfields, 1) * sizeof(char *));
+	self->fields[0] = NULL;
+}
+
 /**
  * @brief Reads one record from the input file, converts each field's
  * character string representation into PostgreSQL internal representation
@@ -331,7 +811,7 @@ checkFieldIsNull(CSVParser *self, int field_num, int len)
  * the memory context is switched to the tuple context.
  *
  * To cordinate the memory context in releasing memory, self->rec_buf and
-  *self->field_buf are allocated only within this function.	Caller must
+ * self->field_buf are allocated only within this function.	Caller must
  * release these memory by releasing whole memory context.
  *
  * @param rd [in/out] Control Info.
@@ -341,7 +821,58 @@ checkFieldIsNull(CSVParser *self, int field_num, int len)
 static HeapTuple
 CSVParserRead(CSVParser *self, Checker *checker)
 {
-	HeapTuple	tuple;			/* return tuple */
+	int			parsed_field;
+
+	parsed_field = CSVParserTokenize(self, checker, NULL);
+	if (parsed_field < 0)
+		return NULL;
+
+	ExtractValuesFromCSV(self, parsed_field);
+	self->base.parsing_field = -1;
+
+	if (self->filter.funcstr)
+		return FilterTuple(&self->filter, &self->former,
+						   &self->base.parsing_field);
+	else
+		return TupleFormerTuple(&self->former);
+}
+
+/**
+ * @brief Reads records into the batch as strings of fields.
+ */
+static bool
+CSVParserReadBatch(CSVParser *self, Checker *checker, RecordBatch *batch, int max)
+{
+	batch->former = &self->former;
+	batch->filter = self->filter.funcstr ? &self->filter : NULL;
+
+	while (batch->nrecords < max)
+	{
+		int		parsed_field;
+		int		i;
+
+		parsed_field = CSVParserTokenize(self, checker, batch);
+		if (parsed_field < 0)
+			return false;
+
+		for (i = 0; i < parsed_field; i++)
+			RecordBatchField(batch, i, self->fields[i]);
+		RecordBatchEnd(batch);
+	}
+
+	self->base.parsing_field = -1;
+	return true;
+}
+
+/**
+ * @brief Splits one record from the input file into self->fields.  The record
+ * is started in the batch if given.
+ *
+ * @return Returns the number of fields, or -1 when EOF is found.
+ */
+static int
+CSVParserTokenize(CSVParser *self, Checker *checker, RecordBatch *batch)
+{
 	int			i = 0;			/* Index of the scanned character */
 	int			ret;
 	char		c;				/* Cache for the scanned character */
@@ -359,62 +890,26 @@ CSVParserRead(CSVParser *self, Checker *checker)
 	int			dst;			/* Index to the next destination */
 	int			src;			/* Index to the next source */
 	int			field_num = 0;	/* Number of self->fields already parsed */
-	int			parsed_field;
+
+	if (self->text)
+		return TextParserTokenize(self, checker, batch);
 
 	/*
 	 * If EOF found in the previous calls, returns zero.
 	 */
 	if (self->eof)
-		return NULL;
-
-	/* Skip first offset lines in the input file */
-	if (unlikely(self->need_offset > 0))
-	{
-		int		len;
-		int		skipped = 0;
-		bool	inCR = false;
-
-		while ((len = SourceRead(self->source, self->rec_buf, self->buf_len - 1)) > 0)
-		{
-			int		i;
+		return -1;
 
-			for (i = 0; i < len; i++)
-			{
-				if (self->rec_buf[i] == '\r')
-				{
-					if (i == len - 1)
-					{
-						inCR = true;
-						continue;
-					}
-					else if (self->rec_buf[i + 1] == '\n')
-						i++;
-				}
-				else if (!inCR && self->rec_buf[i] != '\n')
-					continue;
+	/* Read the header at the head of the input file */
+	if (unlikely(self->need_header))
+		CSVParserReadHeader(self);
 
-				/* Skip the line */
-				inCR = false;
-				++skipped;
-				if (skipped >= self->need_offset)
-				{
-					/* Seek to head of the next line. */
-					self->next = self->rec_buf + i + 1;
-					self->used_len = len;
-					self->rec_buf[self->used_len] = '\0';
-					goto skip_done;
-				}
-			}
-		}
-		ereport(ERROR, (errcode_for_file_access(),
-			errmsg("could not skip " int64_FMT " lines in the input file: %m",
-				self->need_offset)));
-skip_done:
-		/* done */
-		self->need_offset = 0;
-	}
+	/* Skip the head of the input file */
+	if (unlikely(self->need_skip))
+		CSVParserSkip(self);
 
 	self->cur = self->next;
+	self->cur_len = 0;
 
 	/*
 	 * Initialize variables related to fied data.
@@ -425,6 +920,7 @@ skip_done:
 	self->base.parsing_field = 1;
 	self->field_buf[dst] = '\0';
 	self->fields[field_num] = self->field_buf + dst;
+	self->skipping = self->former.maxfields > 0 && self->former.attnum[0] < 0;
 
 	/*
 	 * Loop for each input character to parse record buffer.
@@ -439,54 +935,16 @@ skip_done:
 		 */
 		if (need_data)
 		{
-			/*
-			 * When an escape character is found at the last of the buffer or no
-			 * record delimiter is found in the record buffer, we extend the record
-			 * buffer.
-			 * - When the current line starts at the beginning of the record buffer,
-			 *	 -> Buffer size is doubled and more data is read.
-			 * - The current line is not at the begenning of the record buffer,
-			 *	 -> Move the current line to the beginning of the record buffer and continue to read.
-			 */
-			if (self->cur != self->rec_buf)
-			{
-				int			move_size = self->cur - self->rec_buf;	/* Amount to move buffer. */
-
-				memmove(self->rec_buf, self->cur, self->buf_len - move_size);
-				self->used_len -= move_size;
-				i -= move_size;
-				field_head -= move_size;
-				src -= move_size;
-				self->cur = self->rec_buf;
-			}
-			else if (self->buf_len - self->used_len <= 1)
-			{
-				int			j;
-				char	   *old_buf = self->field_buf;
-
-				self->buf_len *= 2;
-				self->field_buf = repalloc(self->field_buf, self->buf_len);
-				/*
-				 * After repalloc(), address of each field needs to be adjusted.
-				 */
-				for (j = 0; j <= field_num; j++)
-				{
-					if (self->fields[j])
-						self->fields[j] += self->field_buf - old_buf;
-				}
-
-				self->rec_buf = repalloc(self->rec_buf, self->buf_len);
-				/*
-				 * Expanded buffer may be different from the original one, so we reset the
-				 * record beginning.
-				 */
-				self->cur = self->rec_buf;
-			}
+			int		shift;
 
 			BULKLOAD_PROFILE(&prof_reader_parser);
-			ret = SourceRead(self->source, self->rec_buf + self->used_len,
-								self->buf_len - self->used_len - 1);
+			ret = CSVParserFill(self, field_num, &shift);
 			BULKLOAD_PROFILE(&prof_reader_source);
+
+			i -= shift;
+			field_head -= shift;
+			src -= shift;
+
 			if (ret == 0)
 			{
 				self->eof = true;
@@ -494,53 +952,68 @@ skip_done:
 				 * When no data is found in the record buffer and we encounter EOF,
 				 * there're no  more input to handle and return false.
 				 */
-				if (self->cur[0] == '\0')
-					return NULL;
+				if (self->used_len == 0)
+					return -1;
+			}
+			need_data = false;
+		}
 
+		if (i >= self->used_len)
+		{
+			if (!self->eof)
+			{
 				/*
-				 * When no corresponding (closing) quote mark is found and EOF is found,
-				 * it's an error.   At this point, whole line has been parsed and exit from the loop.
+				 * If parsing has been done upto the last of the buffer, we read next data.
 				 */
-				if (in_quote)
-				{
-					/* Record string does not include a new line of the end. */
-					if (self->rec_buf[i - 1] == '\n')
-						i--;
-					if (self->rec_buf[i - 1] == '\r')
-						i--;
-					self->rec_buf[i] = '\0';
-					break;
-				}
+				need_data = true;
+				i--;			/* 'i--' is needed to cancel the incrementation in the for() loop definition. */
+				continue;
+			}
 
-				/*
-				 * To simplify the following parsing, when the last character of the input
-				 * file is not new line code, we add this.
-				 */
-				if (self->rec_buf[i] == '\0')
-				{
-					ret++;
-					self->rec_buf[i] = '\n';
-				}
+			/*
+			 * When no corresponding (closing) quote mark is found and EOF is found,
+			 * it's an error.   At this point, whole line has been parsed and exit from the loop.
+			 */
+			if (in_quote)
+			{
+				/* Record string does not include a new line of the end. */
+				if (i > 0 && self->rec_buf[i - 1] == '\n')
+					i--;
+				if (i > 0 && self->rec_buf[i - 1] == '\r')
+					i--;
+				self->cur_len = i - (self->cur - self->rec_buf);
+				break;
 			}
-			else if (ret < 0)
-				ereport(ERROR, (errcode_for_file_access(),
-								errmsg("could not read input file %m")));
 
-			self->used_len += ret;
-			self->rec_buf[self->used_len] = '\0';
-			need_data = false;
+			/*
+			 * To simplify the following parsing, when the last character of the input
+			 * file is not new line code, we behave as if there is one.
+			 */
+			c = '\n';
 		}
-
-		c = self->rec_buf[i];
-		if (c == '\0')
+		else
 		{
 			/*
-			 * If parsing has been done upto the last of the buffer, we read next data.
+			 * Skip the run of bytes the state machine below passes over: all
+			 * but the quote mark and the escape character in a quoted field,
+			 * and all but the quote mark, the delimiter and the record
+			 * delimiters out of quotes.  The head of the record, which is
+			 * counted, and the byte after a carriage return are examined.
 			 */
-			need_data = true;
-			i--;				/* 'i--' is needed to cancel the incrementation in the for() loop definition. */
+			if (!inCR && i > self->cur - self->rec_buf)
+			{
+				i += SimdScan(self->rec_buf + i, self->used_len - i,
+							  in_quote ? &self->quoted_set : &self->plain_set);
+				if (i >= self->used_len)
+				{
+					i--;	/* handle the end of the buffer above */
+					continue;
+				}
+			}
+			c = self->rec_buf[i];
 		}
-		else if (in_quote)
+
+		if (in_quote)
 		{
 			/*
 			 * Escape character must be followed by a quote mark or an excape character.
@@ -549,16 +1022,17 @@ skip_done:
 			 */
 			if (c == escape)
 			{
-				if (self->rec_buf[i + 1] == quote || self->rec_buf[i + 1] == escape)
-				{
-					appendToField(self, &dst, &src, i - src);
-					i++;
-				}
-				else if (!self->rec_buf[i + 1])
+				if (i + 1 >= self->used_len && !self->eof)
 				{
 					need_data = true;
 					i--;		/* 'i--' is needed here to cancel increment in for statement. */
 				}
+				else if (i + 1 < self->used_len &&
+						 (self->rec_buf[i + 1] == quote || self->rec_buf[i + 1] == escape))
+				{
+					appendToField(self, &dst, &src, i - src);
+					i++;
+				}
 				else if (c == quote)
 				{
 					/*
@@ -580,7 +1054,7 @@ skip_done:
 		{
 			appendToField(self, &dst, &src, i - src - 1);
 			checkFieldIsNull(self, field_num, i - field_head - 1);
-			self->rec_buf[i - 1] = '\0';
+			self->cur_len = i - 1 - (self->cur - self->rec_buf);
 
 			if (c != '\n')
 				i--;	/* re-read the char */
@@ -614,7 +1088,7 @@ skip_done:
 				/*
 				 * We determine the end of a field when a delimiter or line feed is found.
 				 * Even if no line feed is found at the end of the input file, there will
-				 * be no problem because we have already added line feed at EOF test above.
+				 * be no problem because we have assumed line feed at EOF test above.
 				 */
 				appendToField(self, &dst, &src, i - src);
 
@@ -624,7 +1098,7 @@ skip_done:
 				 * Line feed other than a quote mark is the record delimiter.  Record parse
 				 * terminates when the record delmiter is found.
 				 */
-				self->rec_buf[i] = '\0';
+				self->cur_len = i - (self->cur - self->rec_buf);
 				self->next = self->rec_buf + i + 1;
 				break;
 			}
@@ -657,10 +1131,34 @@ skip_done:
 				 */
 				self->field_buf[dst] = '\0';
 				self->fields[field_num] = self->field_buf + dst;
+				self->skipping = field_num < self->former.maxfields &&
+					self->former.attnum[field_num] < 0;
 			}
 		}
 	}
 
+	return CSVParserEndRecord(self, checker, batch, in_quote);
+}
+
+/**
+ * @brief Checks the number of fields of the record just split.
+ *
+ * @return Returns the number of fields.
+ */
+static int
+CSVParserEndRecord(CSVParser *self, Checker *checker, RecordBatch *batch, bool in_quote)
+{
+	int			parsed_field;
+	int			i;
+
+	if (batch)
+	{
+		RecordBatchStart(batch, self->base.count);
+		if (self->cur_len > 0)
+			RecordBatchRecord(batch, self->cur, self->cur_len);
+		RecordBatchRecord(batch, "\n", 1);
+	}
+
 	/*
 	 * If no corresponding (closing) quote mark is found when a record parse terminates, it's an error. 
 	 */
@@ -672,7 +1170,7 @@ skip_done:
 	 * We accept a record only for new lines as input of the functions without
 	 * the arguments.
 	 */
-	if (self->former.maxfields == 0 && strlen(self->cur) == 0)
+	if (self->former.maxfields == 0 && self->cur_len == 0)
 		self->base.parsing_field = 0;
 
 	/*
@@ -693,6 +1191,11 @@ skip_done:
 							errmsg("missing data for argument %d",
 								   self->base.parsing_field + 1),
 							errdetail("only %d arguments, required %d", self->base.parsing_field, self->former.maxfields)));
+		else if (self->former.attnum[self->base.parsing_field] < 0)
+			ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR),
+							errmsg("missing data for field %d",
+								   self->base.parsing_field + 1),
+							errdetail("only %d fields, required %d", self->base.parsing_field, self->former.maxfields)));
 		else
 			ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR),
 							errmsg("missing data for column \"%s\"",
@@ -701,27 +1204,333 @@ skip_done:
 
 	}
 
-	/* Convert it to server encoding. */
+	/*
+	 * The source has checked the record, but escapes in the text format might
+	 * make invalid characters. Fields are checked also after the source found
+	 * invalid input, to reject the record.
+	 */
 	parsed_field = self->base.parsing_field;
-	for (i = 0; i < parsed_field; i++)
+	if ((self->unescaped || checker->check_fields) && checker->check_encoding)
 	{
-		if (self->fields[i] == NULL)
-			continue;
+		for (i = 0; i < parsed_field; i++)
+		{
+			if (self->fields[i] == NULL)
+				continue;
 
-		self->base.parsing_field = i + 1;
-		self->fields[i] = CheckerConversion(checker, self->fields[i]);
+			self->base.parsing_field = i + 1;
+			CheckerVerifyField(checker, self->fields[i]);
+		}
 	}
 
-	ExtractValuesFromCSV(self, parsed_field);
-	self->base.parsing_field = -1;
+	return parsed_field;
+}
 
-	if (self->filter.funcstr)
-		tuple = FilterTuple(&self->filter, &self->former,
-							&self->base.parsing_field);
+/*
+ * Value of a hexadecimal digit.
+ */
+static int
+HexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	else if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
 	else
-		tuple = TupleFormerTuple(&self->former);
+		return c - 'A' + 10;
+}
+
+#define ISOCTAL(c)	((c) >= '0' && (c) <= '7')
+#define ISHEX(c) \
+	(((c) >= '0' && (c) <= '9') || ((c) >= 'a' && (c) <= 'f') || \
+	 ((c) >= 'A' && (c) <= 'F'))
+
+/**
+ * @brief Copies a field in the text format to dst, resolving backslash
+ * escapes as COPY does.
+ *
+ * @return Returns the length of the field copied.
+ */
+static int
+TextUnescape(char *dst, const char *src, int len)
+{
+	const char *end = src + len;
+	char	   *start = dst;
+
+	while (src < end)
+	{
+		char	c = *src++;
+
+		if (c == '\\' && src < end)
+		{
+			c = *src++;
+			switch (c)
+			{
+				case '0':
+				case '1':
+				case '2':
+				case '3':
+				case '4':
+				case '5':
+				case '6':
+				case '7':
+				{
+					/* 1 to 3 octal digits */
+					int		val = c - '0';
+
+					if (src < end && ISOCTAL(*src))
+					{
+						val = (val << 3) + (*src++ - '0');
+						if (src < end && ISOCTAL(*src))
+							val = (val << 3) + (*src++ - '0');
+					}
+					c = val & 0377;
+					break;
+				}
+				case 'x':
+					/* 1 or 2 hex digits, or 'x' itself */
+					if (src < end && ISHEX(*src))
+					{
+						int		val = HexValue(*src++);
+
+						if (src < end && ISHEX(*src))
+							val = (val << 4) + HexValue(*src++);
+						c = val & 0xff;
+					}
+					break;
+				case 'b':
+					c = '\b';
+					break;
+				case 'f':
+					c = '\f';
+					break;
+				case 'n':
+					c = '\n';
+					break;
+				case 'r':
+					c = '\r';
+					break;
+				case 't':
+					c = '\t';
+					break;
+				case 'v':
+					c = '\v';
+					break;
+				default:
+					/* any other character is taken literally */
+					break;
+			}
+		}
+		*dst++ = c;
+	}
 
-	return tuple;
+	return dst - start;
+}
+
+/**
+ * @brief Ends the current field in the text format at the index end of the
+ * record buffer.
+ *
+ * The NULL string is compared with the field before escapes are resolved,
+ * and the field is copied to the field buffer as it is unless it contains
+ * backslashes.
+ */
+static void
+TextEndField(CSVParser *self, int *dst, int field_num, int head, int end, bool escaped)
+{
+	const char *src = self->rec_buf + head;
+	int			len = end - head;
+
+	if (self->skipping ||
+		(self->former.maxfields != 0 &&
+		 !self->fnn[self->former.attnum[field_num]] &&
+		 self->null_len == len &&
+		 memcmp(self->null, src, len) == 0))
+	{
+		self->fields[field_num] = NULL;
+		return;
+	}
+
+	if (escaped)
+	{
+		*dst += TextUnescape(self->field_buf + *dst, src, len);
+		self->unescaped = true;
+	}
+	else
+	{
+		memcpy(self->field_buf + *dst, src, len);
+		*dst += len;
+	}
+	self->field_buf[(*dst)++] = '\0';
+}
+
+/**
+ * @brief Splits one record in the text format of COPY into self->fields.  The
+ * record is started in the batch if given.
+ *
+ * Same as CSVParserTokenize(), but a backslash escapes the next byte instead
+ * of quote marks, and fields with backslashes are unescaped when copied to
+ * the field buffer.  A line of "\." ends the input file.
+ *
+ * @return Returns the number of fields, or -1 when EOF is found.
+ */
+static int
+TextParserTokenize(CSVParser *self, Checker *checker, RecordBatch *batch)
+{
+	int			i;				/* Index of the scanned character */
+	int			ret;
+	char		c;				/* Cache for the scanned character */
+	char		delim = self->delim;	/* Cache for the delimiter */
+	bool		need_data = false;		/* Flag indicating the need to read more characters */
+	bool		inCR = false;
+	bool		escaped = false;	/* the current field has backslashes */
+	int			field_head;		/* Index to the current field */
+	int			dst;			/* Index to the next destination */
+	int			field_num = 0;	/* Number of self->fields already parsed */
+
+	if (self->eof)
+		return -1;
+
+	/* Read the header at the head of the input file */
+	if (unlikely(self->need_header))
+		CSVParserReadHeader(self);
+
+	/* Skip the head of the input file */
+	if (unlikely(self->need_skip))
+		CSVParserSkip(self);
+
+	self->cur = self->next;
+	self->cur_len = 0;
+
+	dst = 0;
+	field_head = self->cur - self->rec_buf;
+	self->base.parsing_field = 1;
+	self->unescaped = false;
+	self->field_buf[dst] = '\0';
+	self->fields[field_num] = self->field_buf + dst;
+	self->skipping = self->former.maxfields > 0 && self->former.attnum[0] < 0;
+
+	for (i = field_head;; i++)
+	{
+		if (need_data)
+		{
+			int		shift;
+
+			BULKLOAD_PROFILE(&prof_reader_parser);
+			ret = CSVParserFill(self, field_num, &shift);
+			BULKLOAD_PROFILE(&prof_reader_source);
+
+			i -= shift;
+			field_head -= shift;
+
+			if (ret == 0)
+			{
+				self->eof = true;
+				if (self->used_len == 0)
+					return -1;
+			}
+			need_data = false;
+		}
+
+		if (i >= self->used_len)
+		{
+			if (!self->eof)
+			{
+				need_data = true;
+				i--;	/* cancel the increment */
+				continue;
+			}
+
+			/* The last line might have no new line. */
+			c = '\n';
+		}
+		else
+		{
+			/*
+			 * Skip the run of bytes other than backslashes, the delimiter and
+			 * the record delimiters.  The byte after a carriage return is
+			 * examined.
+			 */
+			if (!inCR)
+			{
+				i += SimdScan(self->rec_buf + i, self->used_len - i,
+							  &self->text_set);
+				if (i >= self->used_len)
+				{
+					i--;	/* handle the end of the buffer above */
+					continue;
+				}
+			}
+			c = self->rec_buf[i];
+		}
+
+		if (inCR)
+		{
+			TextEndField(self, &dst, field_num, field_head, i - 1, escaped);
+			self->cur_len = i - 1 - (self->cur - self->rec_buf);
+
+			if (c != '\n')
+				i--;	/* re-read the char */
+			self->next = self->rec_buf + i + 1;
+			break;
+		}
+		else if (c == '\\')
+		{
+			/*
+			 * The next byte belongs to the field even if it is a delimiter.
+			 * A backslash at the end of the input file is taken literally.
+			 */
+			if (i + 1 < self->used_len)
+			{
+				escaped = true;
+				i++;
+			}
+			else if (!self->eof)
+			{
+				need_data = true;
+				i--;	/* re-read the backslash */
+			}
+			else
+				escaped = true;
+		}
+		else if (c == '\r')
+		{
+			inCR = true;
+		}
+		else if (c == '\n')
+		{
+			TextEndField(self, &dst, field_num, field_head, i, escaped);
+			self->cur_len = i - (self->cur - self->rec_buf);
+			self->next = self->rec_buf + i + 1;
+			break;
+		}
+		else if (c == delim)
+		{
+			TextEndField(self, &dst, field_num, field_head, i, escaped);
+
+			/* Extra fields overwrite the last one, as CSVParserTokenize(). */
+			if (field_num + 1 < self->former.maxfields)
+				field_num++;
+			self->base.parsing_field++;
+
+			field_head = i + 1;
+			escaped = false;
+			self->field_buf[dst] = '\0';
+			self->fields[field_num] = self->field_buf + dst;
+			self->skipping = field_num < self->former.maxfields &&
+				self->former.attnum[field_num] < 0;
+		}
+	}
+
+	/* End-of-data marker */
+	if (self->cur_len == 2 && self->cur[0] == '\\' && self->cur[1] == '.')
+	{
+		self->eof = true;
+		return -1;
+	}
+
+	self->base.count++;
+
+	return CSVParserEndRecord(self, checker, batch, false);
 }
 
 static bool
@@ -732,12 +1541,12 @@ CSVParserParam(CSVParser *self, const char *keyword, char *value)
 		ASSERT_ONCE(!self->delim);
 		self->delim = ParseSingleChar(value);
 	}
-	else if (CompareKeyword(keyword, "QUOTE"))
+	else if (!self->text && CompareKeyword(keyword, "QUOTE"))
 	{
 		ASSERT_ONCE(!self->quote);
 		self->quote = ParseSingleChar(value);
 	}
-	else if (CompareKeyword(keyword, "ESCAPE"))
+	else if (!self->text && CompareKeyword(keyword, "ESCAPE"))
 	{
 		ASSERT_ONCE(!self->escape);
 		self->escape = ParseSingleChar(value);
@@ -757,12 +1566,22 @@ CSVParserParam(CSVParser *self, const char *keyword, char *value)
 		ASSERT_ONCE(self->offset < 0);
 		self->offset = ParseInt64(value, 0);
 	}
+	else if (CompareKeyword(keyword, "SKIP_BYTES"))
+	{
+		ASSERT_ONCE(self->skip_bytes < 0);
+		self->skip_bytes = ParseInt64(value, 0);
+	}
 	else if (CompareKeyword(keyword, "FILTER"))
 	{
 		ASSERT_ONCE(!self->filter.funcstr);
 		self->filter.funcstr = pstrdup(value);
 	}
-	else
+	else if (CompareKeyword(keyword, "HEADER"))
+	{
+		self->header = ParseBoolean(value);
+	}
+	else if (!SourceParam(&self->source_opts, keyword, value) &&
+			 !TupleFormerParam(&self->former, keyword, value))
 		return false;	/* unknown parameter */
 
 	return true;
@@ -777,26 +1596,36 @@ CSVParserDumpParams(CSVParser *self)
 
 	initStringInfo(&buf);
 
-	appendStringInfoString(&buf, "TYPE = CSV\n");
+	appendStringInfoString(&buf, self->text ? "TYPE = TEXT\n" : "TYPE = CSV\n");
 
 	appendStringInfo(&buf, "SKIP = " int64_FMT "\n", self->offset);
+	if (self->skip_bytes >= 0)
+		appendStringInfo(&buf, "SKIP_BYTES = " int64_FMT "\n", self->skip_bytes);
+	if (self->header)
+		appendStringInfoString(&buf, "HEADER = YES\n");
 
 	str = QuoteSingleChar(self->delim);
 	appendStringInfo(&buf, "DELIMITER = %s\n", str);
 	pfree(str);
 
-	str = QuoteSingleChar(self->quote);
-	appendStringInfo(&buf, "QUOTE = %s\n", str);
-	pfree(str);
+	if (!self->text)
+	{
+		str = QuoteSingleChar(self->quote);
+		appendStringInfo(&buf, "QUOTE = %s\n", str);
+		pfree(str);
 
-	str = QuoteSingleChar(self->escape);
-	appendStringInfo(&buf, "ESCAPE = %s\n", str);
-	pfree(str);
+		str = QuoteSingleChar(self->escape);
+		appendStringInfo(&buf, "ESCAPE = %s\n", str);
+		pfree(str);
+	}
 
 	str = QuoteString(self->null);
 	appendStringInfo(&buf, "NULL = %s\n", str);
 	pfree(str);
 
+	SourceDumpParams(&self->source_opts, &buf);
+	TupleFormerDumpParams(&self->former, &buf);
+
 	if (self->filter.funcstr)
 		appendStringInfo(&buf, "FILTER = %s\n", self->filter.funcstr);
 
@@ -814,21 +1643,47 @@ CSVParserDumpParams(CSVParser *self)
 static void
 CSVParserDumpRecord(CSVParser *self, FILE *fp, char *badfile)
 {
-	int	len;
-
-	len = fprintf(fp, "%s\n", self->cur);
-	if (len < strlen(self->cur) || fflush(fp))
+	if (!CheckerWriteRecord(self->checker, fp, self->cur, self->cur_len) ||
+		putc('\n', fp) == EOF || fflush(fp))
 		ereport(ERROR,
 				(errcode_for_file_access(),
 				 errmsg("could not write parse badfile \"%s\": %m",
 						badfile)));
 }
 
+/*
+ * Go on to the next input file. A record never spans input files, and SKIP
+ * and SKIP_BYTES apply to the head of each file.
+ */
+static bool
+CSVParserNextFile(CSVParser *self)
+{
+	if (!SourceNextFile(self->source))
+	{
+		self->base.filename = NULL;
+		return false;
+	}
+
+	self->base.filename = self->source->filename;
+	self->nfiles++;
+	self->need_offset = self->offset;
+	self->need_skip = self->offset > 0 || self->skip_bytes >= 0;
+	self->need_header = self->header;
+	self->eof = false;
+
+	/* The rest of the previous file has been parsed. */
+	self->next = self->cur = self->rec_buf + self->used_len;
+	self->cur_len = 0;
+	self->buf_offset = -(int64) self->used_len;	/* the file starts at next */
+
+	return true;
+}
+
 /**
  * @brief Obtain an internal representation of each column from field array data for a record.
  *
  * Flow
- * -# For each field array member, repeat the following.
+ * -# For each field array member which is loaded, repeat the following.
  *	 <dl>
  *	   <dt>When either FORCE_NOT_NULL is specified or the address stored in the field array
  *		   is not NULL,</dt>
@@ -866,6 +1721,8 @@ ExtractValuesFromCSV(CSVParser *self, int parsed_field)
 		self->base.parsing_field = i + 1;		/* 1 origin */
 
 		index = self->former.attnum[i];	/* Physical column index */
+		if (index < 0)
+			continue;	/* skipped field */
 		if (self->fields[i] || self->fnn[index])
 		{
 			value = TupleFormerValue(&self->former, self->fields[i], index);
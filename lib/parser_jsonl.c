@@ -0,0 +1,997 @@
+/*
+ * pg_bulkload: lib/parser_jsonl.c
+ *
+ *	  Copyright (c) 2007-2011, NIPPON TELEGRAPH AND TELEPHONE CORPORATION
+ */
+
+/**
+ * @file
+ * @brief Implementation of JSON lines file processing module
+ *
+ * Each line of the input file is a JSON object, and the values of the keys
+ * mapped to columns are passed to the input functions of the columns.  The
+ * object is scanned once without building any tree: values of other keys
+ * are skipped, and mapped strings are unescaped only if they have escapes.
+ */
+#include "pg_bulkload.h"
+
+#include <ctype.h>
+
+#include "access/htup.h"
+#include "catalog/pg_type.h"
+#include "mb/pg_wchar.h"
+#include "utils/memutils.h"
+
+#include "logger.h"
+#include "reader.h"
+#include "pg_strutil.h"
+#include "pg_profile.h"
+#include "simd.h"
+
+/**
+ * @brief  Initial size of the record buffer
+ */
+#define READ_BUFFER_SIZE	(64 * 1024)
+#define MAX_UNMAPPED_KEYS	10	/* unmapped keys named in the log */
+
+/**
+ * @brief Skip white spaces of JSON
+ */
+#define SKIP_SPACES(p, end) \
+	while ((p) < (end) && \
+		   (*(p) == ' ' || *(p) == '\t' || *(p) == '\r' || *(p) == '\n')) \
+		(p)++
+
+/**
+ * @brief A key of the objects mapped to a column
+ */
+typedef struct JSONLKey
+{
+	char   *name;			/**< key in UTF-8 */
+	int		len;			/**< length of name */
+	int		attnum;			/**< index of the column */
+	bool	raw;			/**< pass the JSON text of the value */
+} JSONLKey;
+
+typedef struct JSONLParser
+{
+	Parser	base;
+
+	Source		   *source;
+	SourceOptions	source_opts;
+	Filter			filter;
+	TupleFormer		former;
+
+	int64	offset;				/**< lines to skip */
+	int64	need_offset;		/**< lines to skip */
+	int		nfiles;				/**< number of input files started */
+
+	List	   *key_map;		/**< list of KEY options */
+	JSONLKey   *keys;			/**< array[nkeys] of mapped keys */
+	int			nkeys;			/**< number of mapped keys */
+	int		   *values;			/**< array[nkeys] of offsets to field_buf, or -1 */
+	int64		unmapped;		/**< number of values of unmapped keys */
+	List	   *unmapped_keys;	/**< first unmapped keys in UTF-8 */
+	MemoryContext	context;	/**< context of unmapped_keys */
+
+	char   *buffer;				/**< Record buffer, or window of the source */
+	size_t	buffer_len;			/**< # of bytes in buffer */
+	size_t	buffer_size;		/**< allocated size of buffer */
+	size_t	pos;				/**< offset of the next line in buffer */
+	char   *record;				/**< Current line */
+	size_t	record_len;			/**< length of the current line */
+
+	StringInfoData	field_buf;	/**< values of the mapped keys */
+	StringInfoData	key_buf;	/**< work buffer for keys with escapes */
+	ByteSet			string_set;	/**< bytes significant in strings */
+} JSONLParser;
+
+/*
+ * Prototype declaration for local functions
+ */
+static void	JSONLParserInit(JSONLParser *self, Checker *checker, const char *infile, TupleDesc desc, bool multi_process, Oid collation);
+static HeapTuple JSONLParserRead(JSONLParser *self, Checker *checker);
+static int64	JSONLParserTerm(JSONLParser *self);
+static bool JSONLParserParam(JSONLParser *self, const char *keyword, char *value);
+static void JSONLParserDumpParams(JSONLParser *self);
+static void JSONLParserDumpRecord(JSONLParser *self, FILE *fp, char *badfile);
+static bool JSONLParserNextFile(JSONLParser *self);
+
+static size_t JSONLParserFill(JSONLParser *self, size_t need);
+static char *JSONLParserNextLine(JSONLParser *self);
+static void JSONLParserScan(JSONLParser *self);
+static void UnmappedKey(JSONLParser *self, const char *name, int len);
+
+/**
+ * @brief Create a new JSON lines parser.
+ */
+Parser *
+CreateJSONLParser(void)
+{
+	JSONLParser *self = palloc0(sizeof(JSONLParser));
+	self->base.init = (ParserInitProc) JSONLParserInit;
+	self->base.read = (ParserReadProc) JSONLParserRead;
+	self->base.term = (ParserTermProc) JSONLParserTerm;
+	self->base.param = (ParserParamProc) JSONLParserParam;
+	self->base.dumpParams = (ParserDumpParamsProc) JSONLParserDumpParams;
+	self->base.dumpRecord = (ParserDumpRecordProc) JSONLParserDumpRecord;
+	self->base.nextFile = (ParserNextFileProc) JSONLParserNextFile;
+	self->base.filter = &self->filter;
+	self->offset = -1;
+	return (Parser *)self;
+}
+
+/*
+ * Add a key mapped to the column of index attnum.
+ */
+static void
+AddKey(JSONLParser *self, const char *name, int attnum)
+{
+	JSONLKey   *key;
+	char	   *utf8;
+	Oid			typid;
+	int			i;
+
+	/*
+	 * Keys in the input are UTF-8, so the name in the server encoding is
+	 * converted once here instead of converting each key in the input.
+	 */
+	utf8 = (char *) pg_do_encoding_conversion((unsigned char *) name,
+											  strlen(name),
+											  GetDatabaseEncoding(), PG_UTF8);
+	if (utf8 == name)
+		utf8 = pstrdup(name);
+
+	for (i = 0; i < self->nkeys; i++)
+	{
+		if (strcmp(self->keys[i].name, utf8) == 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("KEY \"%s\" specified more than once", name)));
+		if (self->keys[i].attnum == attnum)
+			ereport(ERROR,
+					(errcode(ERRCODE_DUPLICATE_COLUMN),
+					 errmsg("column \"%s\" specified more than once",
+							NameStr(self->former.desc->attrs[attnum]->attname))));
+	}
+
+	key = &self->keys[self->nkeys++];
+	key->name = utf8;
+	key->len = strlen(utf8);
+	key->attnum = attnum;
+
+	/* json and jsonb columns take the JSON text of any value. */
+	typid = self->former.typId[attnum];
+#ifdef JSONOID
+	key->raw = (typid == JSONOID);
+#endif
+#ifdef JSONBOID
+	key->raw = key->raw || (typid == JSONBOID);
+#endif
+}
+
+/**
+ * @brief Initialize a module for reading JSON lines file
+ *
+ * Keys are mapped to columns by KEY options, or to the columns of the same
+ * names if not specified.  Columns without a key are loaded with NULL.
+ */
+static void
+JSONLParserInit(JSONLParser *self, Checker *checker, const char *infile, TupleDesc desc, bool multi_process, Oid collation)
+{
+	TupleCheckStatus	status;
+	ListCell		   *cell;
+	int					i;
+
+	/*
+	 * set default values
+	 */
+	self->need_offset = self->offset = self->offset > 0 ? self->offset : 0;
+	self->context = CurrentMemoryContext;
+
+	/*
+	 * validation check
+	 */
+	if (self->filter.funcstr)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("cannot use FILTER with TYPE = JSONL")));
+	if (self->former.fields != NIL)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("cannot use FIELDS with TYPE = JSONL"),
+				 errhint("Use KEY = column:key to map keys to columns.")));
+
+	/*
+	 * JSON text is exchanged in UTF-8, and \uXXXX escapes are resolved into
+	 * UTF-8, so the values are always converted from UTF-8.
+	 */
+	if (checker->encoding == -1)
+	{
+		checker->encoding = PG_UTF8;
+		checker->check_encoding = true;
+	}
+	else if (checker->encoding != PG_UTF8)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("does not support ENCODING \"%s\" in \"TYPE = JSONL\"",
+						pg_encoding_to_char(checker->encoding)),
+				 errhint("JSON lines files must be encoded in UTF8.")));
+
+	self->source = CreateSource(infile, desc, multi_process, &self->source_opts);
+	self->base.filename = self->source->filename;
+	self->nfiles = 1;
+
+	status = FilterInit(&self->filter, desc, collation);
+	if (checker->tchecker)
+		checker->tchecker->status = status;
+
+	TupleFormerInit(&self->former, &self->filter, desc);
+
+	/*
+	 * map keys to columns
+	 */
+	self->keys = palloc0(sizeof(JSONLKey) * Max(desc->natts, 1));
+	if (self->key_map == NIL)
+	{
+		for (i = 0; i < desc->natts; i++)
+		{
+			if (!desc->attrs[i]->attisdropped)
+				AddKey(self, NameStr(desc->attrs[i]->attname), i);
+		}
+	}
+	foreach(cell, self->key_map)
+	{
+		char   *name = pstrdup(lfirst(cell));
+		char   *key = strchr(name, ':');
+
+		*key++ = '\0';
+		for (i = 0; i < desc->natts; i++)
+		{
+			if (!desc->attrs[i]->attisdropped &&
+				strcmp(name, NameStr(desc->attrs[i]->attname)) == 0)
+				break;
+		}
+		if (i == desc->natts)
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_COLUMN),
+					 errmsg("invalid column name [%s]", name)));
+		AddKey(self, key, i);
+		pfree(name);
+	}
+	self->values = palloc(sizeof(int) * Max(self->nkeys, 1));
+
+	/* all columns are NULL unless mapped */
+	for (i = 0; i < desc->natts; i++)
+	{
+		self->former.values[i] = (Datum) 0;
+		self->former.isnull[i] = true;
+	}
+
+	initStringInfo(&self->field_buf);
+	initStringInfo(&self->key_buf);
+	ByteSetInit(&self->string_set, '"', '\\', '"', '\\');
+
+	/* Lines are parsed in place if the source lends its buffer. */
+	if (SourceHasWindow(self->source))
+		self->buffer = NULL;
+	else
+	{
+		self->buffer_size = READ_BUFFER_SIZE;
+		self->buffer = palloc(self->buffer_size);
+	}
+}
+
+/**
+ * @brief Free the resources used in the reading JSON lines file module.
+ */
+static int64
+JSONLParserTerm(JSONLParser *self)
+{
+	int64	skip;
+
+	/* SKIP applies to each input file */
+	skip = self->offset * self->nfiles;
+
+	/* key names are written as they are in the input */
+	if (self->unmapped > 0)
+	{
+		StringInfoData	buf;
+		ListCell	   *cell;
+
+		initStringInfo(&buf);
+		foreach(cell, self->unmapped_keys)
+		{
+			if (buf.len > 0)
+				appendStringInfoString(&buf, ", ");
+			appendStringInfo(&buf, "\"%s\"", (char *) lfirst(cell));
+		}
+		LoggerLog(INFO, "JSONL: " int64_FMT " values of keys not mapped to "
+				  "any column were skipped, first keys: %s\n",
+				  self->unmapped, buf.data);
+		pfree(buf.data);
+		list_free_deep(self->unmapped_keys);
+	}
+
+	if (self->buffer && !SourceHasWindow(self->source))
+		pfree(self->buffer);
+	if (self->source)
+		SourceClose(self->source);
+	if (self->keys)
+		pfree(self->keys);
+	if (self->values)
+		pfree(self->values);
+	if (self->field_buf.data)
+		pfree(self->field_buf.data);
+	if (self->key_buf.data)
+		pfree(self->key_buf.data);
+	FilterTerm(&self->filter);
+	TupleFormerTerm(&self->former);
+	pfree(self);
+
+	return skip;
+}
+
+/**
+ * @brief Read one line from input file and transfer the values of the mapped
+ * keys to PostgreSQL internal format.
+ *
+ * Process flow
+ *	 - Find the next line in the record buffer, which is filled as needed or
+ *	   borrowed from the source if it lends its buffer. Blank lines are
+ *	   skipped.
+ *		 * Return NULL if we reach EOF.
+ *	 - Scan the object and copy the values of the mapped keys, see
+ *	   JSONLParserScan().
+ *	 - Convert the values into the server encoding and pass them to the
+ *	   input functions of the columns.
+ * @return	The tuple, or NULL at the end of the input file.
+ */
+static HeapTuple
+JSONLParserRead(JSONLParser *self, Checker *checker)
+{
+	TupleFormer	   *former = &self->former;
+	int				i;
+
+	/* Skip first offset lines in the input file */
+	if (unlikely(self->need_offset > 0))
+	{
+		int64	i;
+
+		for (i = 0; i < self->need_offset; i++)
+		{
+			if (JSONLParserNextLine(self) == NULL)
+				ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+								errmsg("could not skip " int64_FMT
+								" lines in the input file",
+								self->need_offset)));
+		}
+		self->need_offset = 0;
+	}
+
+	/* Blank lines are counted but not loaded. */
+	for (;;)
+	{
+		const char *p;
+		const char *end;
+
+		p = JSONLParserNextLine(self);
+		if (p == NULL)
+			return NULL;	/* eof */
+
+		/*
+		 * Increment the position *before* parsing the record so that we can
+		 * skip it when there are some errors on parsing it.
+		 */
+		self->base.count++;
+
+		end = p + self->record_len;
+		SKIP_SPACES(p, end);
+		if (p < end)
+			break;
+	}
+
+	self->base.parsing_field = 0;
+	JSONLParserScan(self);
+
+	for (i = 0; i < self->nkeys; i++)
+	{
+		JSONLKey   *key = &self->keys[i];
+		int			j = key->attnum;
+
+		self->base.parsing_field = j + 1;	/* 1 origin */
+		if (self->values[i] < 0)
+		{
+			former->isnull[j] = true;
+			former->values[j] = (Datum) 0;
+		}
+		else
+		{
+			char   *str = self->field_buf.data + self->values[i];
+
+			str = CheckerConversion(checker, str);
+			former->isnull[j] = false;
+			former->values[j] = TupleFormerValue(former, str, j);
+		}
+	}
+	self->base.parsing_field = -1;
+
+	return TupleFormerTuple(former);
+}
+
+static bool
+JSONLParserParam(JSONLParser *self, const char *keyword, char *value)
+{
+	if (CompareKeyword(keyword, "KEY"))
+	{
+		if (strchr(value, ':') == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("invalid KEY \"%s\"", value),
+					 errhint("KEY must be column:key.")));
+		self->key_map = lappend(self->key_map, pstrdup(value));
+	}
+	else if (CompareKeyword(keyword, "SKIP") ||
+			 CompareKeyword(keyword, "OFFSET"))
+	{
+		ASSERT_ONCE(self->offset < 0);
+		self->offset = ParseInt64(value, 0);
+	}
+	else if (CompareKeyword(keyword, "FILTER"))
+	{
+		ASSERT_ONCE(!self->filter.funcstr);
+		self->filter.funcstr = pstrdup(value);
+	}
+	else if (!SourceParam(&self->source_opts, keyword, value) &&
+			 !TupleFormerParam(&self->former, keyword, value))
+		return false;	/* unknown parameter */
+
+	return true;
+}
+
+static void
+JSONLParserDumpParams(JSONLParser *self)
+{
+	StringInfoData	buf;
+	ListCell	   *cell;
+
+	initStringInfo(&buf);
+	appendStringInfoString(&buf, "TYPE = JSONL\n");
+	appendStringInfo(&buf, "SKIP = " int64_FMT "\n", self->offset);
+	foreach(cell, self->key_map)
+		appendStringInfo(&buf, "KEY = %s\n", (char *) lfirst(cell));
+	SourceDumpParams(&self->source_opts, &buf);
+	TupleFormerDumpParams(&self->former, &buf);
+
+	LoggerLog(INFO, buf.data);
+	pfree(buf.data);
+}
+
+static void
+JSONLParserDumpRecord(JSONLParser *self, FILE *fp, char *badfile)
+{
+	size_t	len = 0;
+
+	if (self->record_len > 0)
+		len = fwrite(self->record, 1, self->record_len, fp);
+	if (len < self->record_len || putc('\n', fp) == EOF || fflush(fp))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write parse badfile \"%s\": %m",
+						badfile)));
+}
+
+/*
+ * Go on to the next input file. A line never spans input files, and SKIP
+ * applies to the head of each file.
+ */
+static bool
+JSONLParserNextFile(JSONLParser *self)
+{
+	if (!SourceNextFile(self->source))
+	{
+		self->base.filename = NULL;
+		return false;
+	}
+
+	self->base.filename = self->source->filename;
+	self->nfiles++;
+	self->need_offset = self->offset;
+	self->buffer_len = self->pos = 0;
+
+	return true;
+}
+
+/**
+ * @brief Make need bytes from the next line available in the record buffer
+ *
+ * Same as BinaryParserFill(). Returns the number of bytes available, which is
+ * less than need only at the end of the input file.
+ */
+static size_t
+JSONLParserFill(JSONLParser *self, size_t need)
+{
+	size_t	avail = self->buffer_len - self->pos;
+
+	if (avail >= need)
+		return avail;
+
+	if (SourceHasWindow(self->source))
+	{
+		SourceConsume(self->source, self->pos);
+		self->buffer = SourceWindow(self->source, need, &avail);
+	}
+	else
+	{
+		if (self->pos > 0)
+			memmove(self->buffer, self->buffer + self->pos, avail);
+		if (need > self->buffer_size)
+		{
+			self->buffer_size = Max(need, self->buffer_size * 2);
+			self->buffer = repalloc(self->buffer, self->buffer_size);
+		}
+		while (avail < need)
+		{
+			size_t	len;
+
+			len = SourceRead(self->source, self->buffer + avail,
+							 self->buffer_size - avail);
+			if (len == 0)
+				break;
+			avail += len;
+		}
+	}
+
+	self->buffer_len = avail;
+	self->pos = 0;
+
+	return avail;
+}
+
+/**
+ * @brief Find the next line in the record buffer
+ *
+ * The line does not include the new line. The last line of the file might
+ * have no new line.
+ * @return The line, or NULL at the end of the input file.
+ */
+static char *
+JSONLParserNextLine(JSONLParser *self)
+{
+	size_t	scanned = 0;
+	size_t	avail;
+	char   *line;
+	char   *nl;
+
+	BULKLOAD_PROFILE(&prof_reader_parser);
+	avail = self->buffer_len - self->pos;
+	for (;;)
+	{
+		nl = memchr(self->buffer + self->pos + scanned, '\n', avail - scanned);
+		if (nl != NULL)
+			break;
+
+		/* Read more for the rest of the line. */
+		scanned = avail;
+		if (JSONLParserFill(self, avail + 1) <= avail)
+		{
+			if (avail == 0)
+			{
+				BULKLOAD_PROFILE(&prof_reader_source);
+				return NULL;	/* eof */
+			}
+			nl = self->buffer + self->pos + avail;
+			break;
+		}
+		avail = self->buffer_len - self->pos;
+	}
+	BULKLOAD_PROFILE(&prof_reader_source);
+
+	line = self->buffer + self->pos;
+	self->record = line;
+	self->record_len = nl - line;
+	self->pos += Min(self->record_len + 1, avail);
+
+	return line;
+}
+
+/*
+ * Report a syntax error at p in the current line.
+ */
+static void
+JSONSyntaxError(JSONLParser *self, const char *p, const char *message)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+			 errmsg("invalid JSON at offset %d: %s",
+					(int) (p - self->record), message)));
+}
+
+/*
+ * Skip a string from the opening quote.  Returns the position after the
+ * closing quote, and sets *escaped if the string has escapes.
+ */
+static const char *
+SkipString(JSONLParser *self, const char *p, const char *end, bool *escaped)
+{
+	p++;	/* opening quote */
+	*escaped = false;
+	for (;;)
+	{
+		p += SimdScan(p, end - p, &self->string_set);
+		if (p >= end)
+			JSONSyntaxError(self, p, "unterminated string");
+		if (*p == '"')
+			return p + 1;
+
+		/* backslash */
+		*escaped = true;
+		p += 2;
+	}
+}
+
+/*
+ * Skip a value.  Objects and arrays are skipped by counting brackets out of
+ * strings.
+ */
+static const char *
+SkipValue(JSONLParser *self, const char *p, const char *end)
+{
+	const char *start = p;
+	bool		escaped;
+
+	if (p >= end)
+		JSONSyntaxError(self, p, "missing value");
+
+	if (*p == '"')
+		return SkipString(self, p, end, &escaped);
+	else if (*p == '{' || *p == '[')
+	{
+		int		depth = 0;
+
+		while (p < end)
+		{
+			switch (*p)
+			{
+				case '"':
+					p = SkipString(self, p, end, &escaped);
+					continue;
+				case '{':
+				case '[':
+					depth++;
+					break;
+				case '}':
+				case ']':
+					if (--depth == 0)
+						return p + 1;
+					break;
+			}
+			p++;
+		}
+		JSONSyntaxError(self, p, "unterminated object or array");
+	}
+
+	/* numbers, true, false and null */
+	while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+		   *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+		p++;
+	if (p == start)
+		JSONSyntaxError(self, p, "missing value");
+	return p;
+}
+
+/*
+ * Check a value that is neither a string, an object nor an array is a JSON
+ * literal or number. Values of unmapped keys are only skipped, but these
+ * reach the input functions of the columns, which would accept words that
+ * are not JSON.
+ */
+static void
+CheckScalar(JSONLParser *self, const char *p, const char *end)
+{
+	const char *start = p;
+
+	if (end - p == 4 && (memcmp(p, "true", 4) == 0 || memcmp(p, "null", 4) == 0))
+		return;
+	if (end - p == 5 && memcmp(p, "false", 5) == 0)
+		return;
+
+	if (p < end && *p == '-')
+		p++;
+	if (p < end && *p == '0')
+		p++;
+	else if (p < end && *p >= '1' && *p <= '9')
+	{
+		while (p < end && isdigit((unsigned char) *p))
+			p++;
+	}
+	else
+		JSONSyntaxError(self, start, "invalid value");
+
+	if (p < end && *p == '.')
+	{
+		p++;
+		if (p >= end || !isdigit((unsigned char) *p))
+			JSONSyntaxError(self, start, "invalid number");
+		while (p < end && isdigit((unsigned char) *p))
+			p++;
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		if (p < end && (*p == '+' || *p == '-'))
+			p++;
+		if (p >= end || !isdigit((unsigned char) *p))
+			JSONSyntaxError(self, start, "invalid number");
+		while (p < end && isdigit((unsigned char) *p))
+			p++;
+	}
+	if (p < end)
+		JSONSyntaxError(self, start, "invalid value");
+}
+
+static int
+HexDigit(JSONLParser *self, const char *p)
+{
+	char	c = *p;
+
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	else if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	else if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	JSONSyntaxError(self, p, "invalid Unicode escape");
+	return 0;	/* keep compiler quiet */
+}
+
+static int
+ReadHex4(JSONLParser *self, const char *p, const char *end)
+{
+	if (end - p < 4)
+		JSONSyntaxError(self, p, "invalid Unicode escape");
+
+	return (HexDigit(self, p) << 12) | (HexDigit(self, p + 1) << 8) |
+		   (HexDigit(self, p + 2) << 4) | HexDigit(self, p + 3);
+}
+
+/*
+ * Append the contents of a string between quotes to buf, resolving escapes.
+ * \uXXXX is written in UTF-8.
+ */
+static void
+AppendUnescaped(JSONLParser *self, StringInfo buf, const char *p, const char *end)
+{
+	while (p < end)
+	{
+		const char *q = p;
+
+		/* copy the run of bytes without escapes */
+		while (q < end && *q != '\\')
+			q++;
+		appendBinaryStringInfo(buf, p, q - p);
+		if (q >= end)
+			break;
+
+		p = q + 2;
+		switch (q[1])
+		{
+			case '"':
+			case '\\':
+			case '/':
+				appendStringInfoChar(buf, q[1]);
+				break;
+			case 'b':
+				appendStringInfoChar(buf, '\b');
+				break;
+			case 'f':
+				appendStringInfoChar(buf, '\f');
+				break;
+			case 'n':
+				appendStringInfoChar(buf, '\n');
+				break;
+			case 'r':
+				appendStringInfoChar(buf, '\r');
+				break;
+			case 't':
+				appendStringInfoChar(buf, '\t');
+				break;
+			case 'u':
+			{
+				pg_wchar		code;
+				unsigned char	utf8[8];
+
+				code = ReadHex4(self, p, end);
+				p += 4;
+				if (code >= 0xD800 && code <= 0xDBFF)
+				{
+					/* surrogate pair */
+					pg_wchar	low;
+
+					if (end - p < 6 || p[0] != '\\' || p[1] != 'u')
+						JSONSyntaxError(self, p, "invalid Unicode surrogate pair");
+					low = ReadHex4(self, p + 2, end);
+					if (low < 0xDC00 || low > 0xDFFF)
+						JSONSyntaxError(self, p, "invalid Unicode surrogate pair");
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+					p += 6;
+				}
+				else if (code >= 0xDC00 && code <= 0xDFFF)
+					JSONSyntaxError(self, q, "invalid Unicode surrogate pair");
+				else if (code == 0)
+					JSONSyntaxError(self, q, "\\u0000 cannot be converted to text");
+
+				unicode_to_utf8(code, utf8);
+				appendBinaryStringInfo(buf, (char *) utf8, pg_utf_mblen(utf8));
+				break;
+			}
+			default:
+				JSONSyntaxError(self, q, "invalid escape");
+		}
+	}
+}
+
+/*
+ * Find the mapped key of the name between p and end, or -1.
+ */
+static int
+LookupKey(JSONLParser *self, const char *p, const char *end, bool escaped)
+{
+	int		len;
+	int		i;
+
+	if (escaped)
+	{
+		resetStringInfo(&self->key_buf);
+		AppendUnescaped(self, &self->key_buf, p, end);
+		p = self->key_buf.data;
+		len = self->key_buf.len;
+	}
+	else
+		len = end - p;
+
+	for (i = 0; i < self->nkeys; i++)
+	{
+		if (self->keys[i].len == len &&
+			memcmp(self->keys[i].name, p, len) == 0)
+			return i;
+	}
+
+	UnmappedKey(self, p, len);
+
+	return -1;
+}
+
+/*
+ * Count a value of an unmapped key, and remember the name of the key for the
+ * log if it is one of the first MAX_UNMAPPED_KEYS keys.
+ */
+static void
+UnmappedKey(JSONLParser *self, const char *name, int len)
+{
+	MemoryContext	oldcontext;
+	ListCell	   *cell;
+	char		   *key;
+
+	self->unmapped++;
+
+	foreach(cell, self->unmapped_keys)
+	{
+		key = (char *) lfirst(cell);
+		if (strlen(key) == (size_t) len && memcmp(key, name, len) == 0)
+			return;
+	}
+	if (list_length(self->unmapped_keys) >= MAX_UNMAPPED_KEYS)
+		return;
+
+	/* Lines are parsed in a short-lived context. */
+	oldcontext = MemoryContextSwitchTo(self->context);
+	key = palloc(len + 1);
+	memcpy(key, name, len);
+	key[len] = '\0';
+	self->unmapped_keys = lappend(self->unmapped_keys, key);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/**
+ * @brief Scan the object in the current line, and copy the values of the
+ * mapped keys into the field buffer
+ *
+ * Strings are unescaped, and other values are copied as they are. Values of
+ * unmapped keys are skipped by matching quotes and brackets only. A key
+ * mapped to a json or jsonb column takes the JSON text of the value. null
+ * is NULL. If a key appears twice, the last value is taken.
+ */
+static void
+JSONLParserScan(JSONLParser *self)
+{
+	const char *p = self->record;
+	const char *end = self->record + self->record_len;
+	int			i;
+
+	resetStringInfo(&self->field_buf);
+	for (i = 0; i < self->nkeys; i++)
+		self->values[i] = -1;
+
+	SKIP_SPACES(p, end);
+	if (p >= end || *p != '{')
+		JSONSyntaxError(self, p, "a line must be an object");
+	p++;
+	SKIP_SPACES(p, end);
+
+	if (p < end && *p == '}')
+		p++;	/* empty object */
+	else
+	{
+		for (;;)
+		{
+			const char *name;
+			const char *value;
+			bool		escaped;
+			int			k;
+
+			/* key */
+			if (p >= end || *p != '"')
+				JSONSyntaxError(self, p, "expected string");
+			name = p;
+			p = SkipString(self, p, end, &escaped);
+			k = LookupKey(self, name + 1, p - 1, escaped);
+
+			SKIP_SPACES(p, end);
+			if (p >= end || *p != ':')
+				JSONSyntaxError(self, p, "expected \":\"");
+			p++;
+			SKIP_SPACES(p, end);
+
+			/* value */
+			value = p;
+			escaped = false;
+			if (p < end && *p == '"')
+				p = SkipString(self, p, end, &escaped);
+			else
+				p = SkipValue(self, p, end);
+			if (k >= 0)
+			{
+				StringInfo	buf = &self->field_buf;
+
+				if (*value != '"' && *value != '{' && *value != '[')
+					CheckScalar(self, value, p);
+				if (p - value == 4 && memcmp(value, "null", 4) == 0)
+					self->values[k] = -1;
+				else
+				{
+					self->values[k] = buf->len;
+					if (*value == '"' && !self->keys[k].raw)
+					{
+						if (escaped)
+							AppendUnescaped(self, buf, value + 1, p - 1);
+						else
+							appendBinaryStringInfo(buf, value + 1, p - value - 2);
+					}
+					else
+						appendBinaryStringInfo(buf, value, p - value);
+					appendStringInfoChar(buf, '\0');
+				}
+			}
+
+			SKIP_SPACES(p, end);
+			if (p < end && *p == ',')
+			{
+				p++;
+				SKIP_SPACES(p, end);
+				continue;
+			}
+			if (p < end && *p == '}')
+			{
+				p++;
+				break;
+			}
+			JSONSyntaxError(self, p, "expected \",\" or \"}\"");
+		}
+	}
+
+	SKIP_SPACES(p, end);
+	if (p < end)
+		JSONSyntaxError(self, p, "extra data after the object");
+}
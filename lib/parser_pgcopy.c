@@ -0,0 +1,696 @@
+/*
+ * pg_bulkload: lib/parser_pgcopy.c
+ *
+ *	  Copyright (c) 2007-2011, NIPPON TELEGRAPH AND TELEPHONE CORPORATION
+ */
+
+/**
+ * @file
+ * @brief Implementation of COPY binary file processing module
+ */
+#include "pg_bulkload.h"
+
+#include <arpa/inet.h>
+
+#include "access/htup.h"
+#include "catalog/pg_type.h"
+#include "lib/stringinfo.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+
+#include "logger.h"
+#include "reader.h"
+#include "pg_strutil.h"
+#include "pg_profile.h"
+
+/**
+ * @brief  Initial size of the record buffer
+ */
+#define READ_BUFFER_SIZE	(64 * 1024)
+
+/**
+ * @brief  Signature at the head of COPY binary files
+ */
+static const char BinarySignature[11] = "PGCOPY\n\377\r\n\0";
+
+/**
+ * @brief  Length of the header before the header extension
+ */
+#define HEADER_LEN			(sizeof(BinarySignature) + 8)
+
+typedef struct PgCopyParser
+{
+	Parser	base;
+
+	Source		   *source;
+	SourceOptions	source_opts;
+	Filter			filter;
+	TupleFormer		former;
+
+	int64	offset;				/**< lines to skip */
+	int64	need_offset;		/**< lines to skip */
+	int		nfiles;				/**< number of input files started */
+	bool	need_header;		/**< file header is not read yet */
+	bool	eof;				/**< trailer of the file is read */
+	bool	oids;				/**< tuples have OIDs */
+
+	char   *buffer;				/**< Record buffer, or window of the source */
+	size_t	buffer_len;			/**< # of bytes in buffer */
+	size_t	buffer_size;		/**< allocated size of buffer */
+	size_t	pos;				/**< offset of the next record in buffer */
+	char   *record;				/**< Current record */
+	size_t	record_len;			/**< length of the current record */
+
+	FmgrInfo   *typRecv;		/**< array[maxfields] of receive functions */
+	Oid		   *typRecvParam;	/**< array[maxfields] of receive parameters */
+	Oid		   *typFixed;		/**< array[maxfields] of types memcpy'ed, or 0 */
+	StringInfoData	buf;		/**< work buffer for receive functions */
+} PgCopyParser;
+
+/*
+ * Prototype declaration for local functions
+ */
+static void	PgCopyParserInit(PgCopyParser *self, Checker *checker, const char *infile, TupleDesc desc, bool multi_process, Oid collation);
+static HeapTuple PgCopyParserRead(PgCopyParser *self, Checker *checker);
+static int64	PgCopyParserTerm(PgCopyParser *self);
+static bool PgCopyParserParam(PgCopyParser *self, const char *keyword, char *value);
+static void PgCopyParserDumpParams(PgCopyParser *self);
+static void PgCopyParserDumpRecord(PgCopyParser *self, FILE *fp, char *badfile);
+static bool PgCopyParserNextFile(PgCopyParser *self);
+
+static size_t PgCopyParserFill(PgCopyParser *self, size_t need);
+static void PgCopyParserReadHeader(PgCopyParser *self);
+static char *PgCopyParserNextRecord(PgCopyParser *self);
+static void ExtractValuesFromCopy(PgCopyParser *self, char *record);
+
+/**
+ * @brief Create a new COPY binary parser.
+ */
+Parser *
+CreatePgCopyBinaryParser(void)
+{
+	PgCopyParser *self = palloc0(sizeof(PgCopyParser));
+	self->base.init = (ParserInitProc) PgCopyParserInit;
+	self->base.read = (ParserReadProc) PgCopyParserRead;
+	self->base.term = (ParserTermProc) PgCopyParserTerm;
+	self->base.param = (ParserParamProc) PgCopyParserParam;
+	self->base.dumpParams = (ParserDumpParamsProc) PgCopyParserDumpParams;
+	self->base.dumpRecord = (ParserDumpRecordProc) PgCopyParserDumpRecord;
+	self->base.nextFile = (ParserNextFileProc) PgCopyParserNextFile;
+	self->base.filter = &self->filter;
+	self->offset = -1;
+	return (Parser *)self;
+}
+
+static int16
+GetInt16(const char *in)
+{
+	uint16	v;
+
+	memcpy(&v, in, sizeof(v));
+	return (int16) ntohs(v);
+}
+
+static int32
+GetInt32(const char *in)
+{
+	uint32	v;
+
+	memcpy(&v, in, sizeof(v));
+	return (int32) ntohl(v);
+}
+
+static int64
+GetInt64(const char *in)
+{
+	return ((int64) (uint32) GetInt32(in) << 32) |
+			(int64) (uint32) GetInt32(in + 4);
+}
+
+/*
+ * Length of the types copied in place.
+ */
+static int
+FixedLength(Oid typid)
+{
+	switch (typid)
+	{
+		case INT2OID:
+			return 2;
+		case INT4OID:
+		case OIDOID:
+		case FLOAT4OID:
+			return 4;
+		default:
+			return 8;
+	}
+}
+
+/**
+ * @brief Initialize a module for reading COPY binary file
+ *
+ * Fields are read with the receive functions of the types of the columns, or
+ * of the arguments of the filter. Fixed-width types passed by value, whose
+ * receive functions never fail but for the length, are copied in place.
+ */
+static void
+PgCopyParserInit(PgCopyParser *self, Checker *checker, const char *infile, TupleDesc desc, bool multi_process, Oid collation)
+{
+	int					i;
+	TupleCheckStatus	status;
+
+	/*
+	 * set default values
+	 */
+	self->need_offset = self->offset = self->offset > 0 ? self->offset : 0;
+
+	self->source = CreateSource(infile, desc, multi_process, &self->source_opts);
+	self->base.filename = self->source->filename;
+	self->nfiles = 1;
+	self->need_header = true;
+
+	status = FilterInit(&self->filter, desc, collation);
+	if (checker->tchecker)
+		checker->tchecker->status = status;
+
+	TupleFormerInit(&self->former, &self->filter, desc);
+
+	/*
+	 * get receive functions of the fields
+	 */
+	self->typRecv = palloc0(sizeof(FmgrInfo) * Max(self->former.maxfields, 1));
+	self->typRecvParam = palloc0(sizeof(Oid) * Max(self->former.maxfields, 1));
+	self->typFixed = palloc0(sizeof(Oid) * Max(self->former.maxfields, 1));
+	for (i = 0; i < self->former.maxfields; i++)
+	{
+		int		j = self->former.attnum[i];
+		Oid		typid;
+		Oid		recv_func_oid;
+
+		if (j < 0)
+			continue;	/* skipped field */
+
+		typid = self->former.typId[j];
+		switch (typid)
+		{
+			case INT2OID:
+			case INT4OID:
+			case INT8OID:
+			case FLOAT4OID:
+			case FLOAT8OID:
+			case OIDOID:
+				if (get_typbyval(typid))
+				{
+					self->typFixed[i] = typid;
+					continue;
+				}
+				break;
+		}
+
+		getTypeBinaryInputInfo(typid, &recv_func_oid, &self->typRecvParam[i]);
+		fmgr_info(recv_func_oid, &self->typRecv[i]);
+	}
+	initStringInfo(&self->buf);
+
+	/* Records are parsed in place if the source lends its buffer. */
+	if (SourceHasWindow(self->source))
+		self->buffer = NULL;
+	else
+	{
+		self->buffer_size = READ_BUFFER_SIZE;
+		self->buffer = palloc(self->buffer_size);
+	}
+}
+
+/**
+ * @brief Free the resources used in the reading COPY binary file module.
+ */
+static int64
+PgCopyParserTerm(PgCopyParser *self)
+{
+	int64	skip;
+
+	/* SKIP applies to each input file */
+	skip = self->offset * self->nfiles;
+
+	if (self->buffer && !SourceHasWindow(self->source))
+		pfree(self->buffer);
+	if (self->source)
+		SourceClose(self->source);
+	if (self->typRecv)
+		pfree(self->typRecv);
+	if (self->typRecvParam)
+		pfree(self->typRecvParam);
+	if (self->typFixed)
+		pfree(self->typFixed);
+	if (self->buf.data)
+		pfree(self->buf.data);
+	FilterTerm(&self->filter);
+	TupleFormerTerm(&self->former);
+	pfree(self);
+
+	return skip;
+}
+
+/**
+ * @brief Read one tuple from input file and transfer binary fields to
+ * PostgreSQL internal format.
+ *
+ * Process flow
+ *	 - Read the file header at the head of each input file.
+ *	 - Find the next tuple in the record buffer. The record buffer is filled
+ *	   as needed, or borrowed from the source if it lends its buffer.
+ *		 * Return NULL if we reach the trailer or EOF.
+ *		 * If the file is broken, notify it to caller by ereport().
+ *	 - Read fields with their receive functions.
+ * @return	The tuple, or NULL at the end of the input file.
+ */
+static HeapTuple
+PgCopyParserRead(PgCopyParser *self, Checker *checker)
+{
+	HeapTuple	tuple;
+	char	   *record;
+
+	/* Errors in the file framing cannot be skipped. */
+	self->base.parsing_field = -1;
+
+	if (unlikely(self->need_header))
+	{
+		PgCopyParserReadHeader(self);
+		self->need_header = false;
+	}
+
+	/* Skip first offset tuples in the input file */
+	if (unlikely(self->need_offset > 0))
+	{
+		int64	i;
+
+		for (i = 0; i < self->need_offset; i++)
+		{
+			if (PgCopyParserNextRecord(self) == NULL)
+				ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+								errmsg("could not skip " int64_FMT
+								" records in the input file",
+								self->need_offset)));
+		}
+		self->need_offset = 0;
+	}
+
+	record = PgCopyParserNextRecord(self);
+	if (record == NULL)
+		return NULL;	/* eof */
+
+	/*
+	 * Increment the position *before* parsing the record so that we can
+	 * skip it when there are some errors on parsing it.
+	 */
+	self->base.count++;
+	self->record = record;
+
+	ExtractValuesFromCopy(self, record);
+	self->base.parsing_field = -1;
+
+	if (self->filter.funcstr)
+		tuple = FilterTuple(&self->filter, &self->former,
+							&self->base.parsing_field);
+	else
+		tuple = TupleFormerTuple(&self->former);
+
+	return tuple;
+}
+
+static bool
+PgCopyParserParam(PgCopyParser *self, const char *keyword, char *value)
+{
+	if (CompareKeyword(keyword, "SKIP") ||
+		CompareKeyword(keyword, "OFFSET"))
+	{
+		ASSERT_ONCE(self->offset < 0);
+		self->offset = ParseInt64(value, 0);
+	}
+	else if (CompareKeyword(keyword, "FILTER"))
+	{
+		ASSERT_ONCE(!self->filter.funcstr);
+		self->filter.funcstr = pstrdup(value);
+	}
+	else if (!SourceParam(&self->source_opts, keyword, value) &&
+			 !TupleFormerParam(&self->former, keyword, value))
+		return false;	/* unknown parameter */
+
+	return true;
+}
+
+static void
+PgCopyParserDumpParams(PgCopyParser *self)
+{
+	StringInfoData	buf;
+
+	initStringInfo(&buf);
+	appendStringInfoString(&buf, "TYPE = PGCOPY_BINARY\n");
+	appendStringInfo(&buf, "SKIP = " int64_FMT "\n", self->offset);
+	if (self->filter.funcstr)
+		appendStringInfo(&buf, "FILTER = %s\n", self->filter.funcstr);
+	SourceDumpParams(&self->source_opts, &buf);
+	TupleFormerDumpParams(&self->former, &buf);
+
+	LoggerLog(INFO, buf.data);
+	pfree(buf.data);
+}
+
+/*
+ * The parse badfile is a COPY binary file by itself; the header is written
+ * before the first tuple, and OIDs of the tuples are dropped.
+ */
+static void
+PgCopyParserDumpRecord(PgCopyParser *self, FILE *fp, char *badfile)
+{
+	size_t	oid_len = self->oids ? 8 : 0;
+	bool	ok = true;
+
+	if (ftell(fp) == 0)
+	{
+		char	header[HEADER_LEN];
+
+		memset(header, 0, sizeof(header));
+		memcpy(header, BinarySignature, sizeof(BinarySignature));
+		ok = fwrite(header, 1, sizeof(header), fp) == sizeof(header);
+	}
+
+	if (ok)
+		ok = fwrite(self->record, 1, 2, fp) == 2 &&
+			 fwrite(self->record + 2 + oid_len, 1,
+					self->record_len - 2 - oid_len, fp) ==
+				self->record_len - 2 - oid_len;
+
+	if (!ok || fflush(fp))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write parse badfile \"%s\": %m",
+						badfile)));
+}
+
+/*
+ * Go on to the next input file. Each file starts with its own header, and
+ * SKIP applies to the tuples after it.
+ */
+static bool
+PgCopyParserNextFile(PgCopyParser *self)
+{
+	if (!SourceNextFile(self->source))
+	{
+		self->base.filename = NULL;
+		return false;
+	}
+
+	self->base.filename = self->source->filename;
+	self->nfiles++;
+	self->need_offset = self->offset;
+	self->need_header = true;
+	self->eof = false;
+	self->buffer_len = self->pos = 0;
+
+	return true;
+}
+
+/**
+ * @brief Make need bytes from the next record available in the record buffer
+ *
+ * Same as BinaryParserFill(). Returns the number of bytes available, which is
+ * less than need only at the end of the input file.
+ */
+static size_t
+PgCopyParserFill(PgCopyParser *self, size_t need)
+{
+	size_t	avail = self->buffer_len - self->pos;
+
+	if (avail >= need)
+		return avail;
+
+	if (SourceHasWindow(self->source))
+	{
+		SourceConsume(self->source, self->pos);
+		self->buffer = SourceWindow(self->source, need, &avail);
+	}
+	else
+	{
+		if (self->pos > 0)
+			memmove(self->buffer, self->buffer + self->pos, avail);
+		if (need > self->buffer_size)
+		{
+			self->buffer_size = Max(need, self->buffer_size * 2);
+			self->buffer = repalloc(self->buffer, self->buffer_size);
+		}
+		while (avail < need)
+		{
+			size_t	len;
+
+			len = SourceRead(self->source, self->buffer + avail,
+							 self->buffer_size - avail);
+			if (len == 0)
+				break;
+			avail += len;
+		}
+	}
+
+	self->buffer_len = avail;
+	self->pos = 0;
+
+	return avail;
+}
+
+/**
+ * @brief Read the file header
+ *
+ * The header has the signature, the flags and the header extension, which
+ * is skipped.
+ */
+static void
+PgCopyParserReadHeader(PgCopyParser *self)
+{
+	char   *header;
+	int32	flags;
+	int32	ext_len;
+
+	if (PgCopyParserFill(self, HEADER_LEN) < HEADER_LEN)
+		ereport(ERROR,
+				(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+				 errmsg("invalid COPY file header (missing length)")));
+
+	header = self->buffer + self->pos;
+	if (memcmp(header, BinarySignature, sizeof(BinarySignature)) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+				 errmsg("COPY file signature not recognized")));
+
+	flags = GetInt32(header + sizeof(BinarySignature));
+	self->oids = (flags & (1 << 16)) != 0;
+	flags &= ~(1 << 16);
+	if ((flags >> 16) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+				 errmsg("unrecognized critical flags in COPY file header")));
+
+	ext_len = GetInt32(header + sizeof(BinarySignature) + 4);
+	if (ext_len < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+				 errmsg("invalid COPY file header (wrong length)")));
+	if (PgCopyParserFill(self, HEADER_LEN + ext_len) < HEADER_LEN + ext_len)
+		ereport(ERROR,
+				(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+				 errmsg("invalid COPY file header (wrong length)")));
+
+	self->pos += HEADER_LEN + ext_len;
+}
+
+/**
+ * @brief Find the next tuple in the record buffer
+ *
+ * Each tuple starts with the number of fields in 16 bits, followed by the
+ * OID if the file has OIDs, and the fields. Each field has its length in 32
+ * bits, or -1 for NULL, followed by its data. All numbers are in network
+ * byte order. The number of fields is -1 in the trailer of the file.
+ * @return The tuple, or NULL at the end of the input file.
+ */
+static char *
+PgCopyParserNextRecord(PgCopyParser *self)
+{
+	size_t	len;
+	int		fld_count;
+	int		i;
+	char   *record;
+
+	if (self->eof)
+		return NULL;
+
+	BULKLOAD_PROFILE(&prof_reader_parser);
+	len = PgCopyParserFill(self, 2);
+	BULKLOAD_PROFILE(&prof_reader_source);
+	if (len < 2)
+	{
+		/* EOF without the trailer is accepted as COPY does. */
+		if (len > 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+					 errmsg("unexpected EOF in COPY data")));
+		self->eof = true;
+		return NULL;
+	}
+
+	fld_count = GetInt16(self->buffer + self->pos);
+	if (fld_count == -1)
+	{
+		/* trailer; the rest of the file is ignored */
+		self->pos += 2;
+		self->eof = true;
+		return NULL;
+	}
+	if (fld_count < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+				 errmsg("invalid field count %d in COPY data", fld_count)));
+
+	/* The buffer might move while the tuple is walked. */
+	BULKLOAD_PROFILE(&prof_reader_parser);
+	len = 2;
+	for (i = (self->oids ? -1 : 0); i < fld_count; i++)
+	{
+		int32	fld_size;
+
+		if (PgCopyParserFill(self, len + 4) < len + 4)
+			ereport(ERROR,
+					(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+					 errmsg("unexpected EOF in COPY data")));
+		fld_size = GetInt32(self->buffer + self->pos + len);
+		len += 4;
+		if (fld_size == -1)
+			continue;
+		if (fld_size < 0 || (size_t) fld_size > MaxAllocSize - len)
+			ereport(ERROR,
+					(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+					 errmsg("invalid field size %d in COPY data", fld_size)));
+		if (i < 0 && fld_size != 4)
+			ereport(ERROR,
+					(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+					 errmsg("invalid OID size %d in COPY data", fld_size)));
+		len += fld_size;
+		if (PgCopyParserFill(self, len) < len)
+			ereport(ERROR,
+					(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+					 errmsg("unexpected EOF in COPY data")));
+	}
+	BULKLOAD_PROFILE(&prof_reader_source);
+
+	record = self->buffer + self->pos;
+	self->record_len = len;
+	self->pos += len;
+
+	return record;
+}
+
+/**
+ * @brief Extract internal format for each column from a tuple
+ *
+ * Fixed-width fields passed by value are copied in place. Other fields are
+ * copied to the work buffer for the receive function, which must consume
+ * the whole field.
+ * @note The record is not modified, so it can be a read-only window.
+ * @note If error occurs, return to the caller by ereport().
+ */
+static void
+ExtractValuesFromCopy(PgCopyParser *self, char *record)
+{
+	TupleFormer	   *former = &self->former;
+	int				fld_count;
+	char		   *in;
+	int				i;
+
+	fld_count = GetInt16(record);
+	in = record + 2 + (self->oids ? 8 : 0);
+
+	if (fld_count < former->minfields || fld_count > former->maxfields)
+	{
+		self->base.parsing_field = 0;
+		ereport(ERROR,
+				(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+				 errmsg("row field count is %d, expected %d",
+						fld_count, former->maxfields)));
+	}
+
+	for (i = 0; i < fld_count; i++)
+	{
+		int			j = former->attnum[i];	/* Index of physical fields */
+		int32		len;
+
+		len = GetInt32(in);
+		in += 4;
+		self->base.parsing_field = i + 1;	/* 1 origin */
+
+		if (j < 0)
+		{
+			/* skipped field */
+		}
+		else if (len == -1)
+		{
+			former->isnull[j] = true;
+			former->values[j] = (Datum) 0;
+		}
+		else if (self->typFixed[i])
+		{
+			Oid		typid = self->typFixed[i];
+
+			if (len != FixedLength(typid))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						 errmsg("incorrect binary data format")));
+
+			former->isnull[j] = false;
+			switch (typid)
+			{
+				case INT2OID:
+					former->values[j] = Int16GetDatum(GetInt16(in));
+					break;
+				case INT4OID:
+				case OIDOID:
+				case FLOAT4OID:
+					/* float4 is passed as its bits */
+					former->values[j] = Int32GetDatum(GetInt32(in));
+					break;
+				default:
+					former->values[j] = Int64GetDatum(GetInt64(in));
+					break;
+			}
+		}
+		else
+		{
+			StringInfo	buf = &self->buf;
+
+			resetStringInfo(buf);
+			appendBinaryStringInfo(buf, in, len);
+
+			former->isnull[j] = false;
+			former->values[j] = ReceiveFunctionCall(&self->typRecv[i], buf,
+										self->typRecvParam[i],
+										former->typMod[j]);
+
+			/* Trouble if it didn't eat the whole buffer */
+			if (buf->cursor != buf->len)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						 errmsg("incorrect binary data format")));
+		}
+
+		if (len > 0)
+			in += len;
+	}
+
+	/* set function default value */
+	for (; i < former->maxfields; i++)
+	{
+		int		index;
+
+		index = i - former->minfields;
+		former->isnull[i] = self->filter.defaultIsnull[index];
+		former->values[i] = self->filter.defaultValues[index];
+	}
+}
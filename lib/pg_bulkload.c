@@ -225,10 +225,11 @@ pg_bulkload(PG_FUNCTION_ARGS)
 	}
 	PG_CATCH();
 	{
-		if (rd)
-			ReaderClose(rd, true);
+		/* close writer first, and reader second */
 		if (wt)
 			WriterClose(wt, true);
+		if (rd)
+			ReaderClose(rd, true);
 		PG_RE_THROW();
 	}
 	PG_END_TRY();
@@ -258,30 +259,62 @@ pg_bulkload(PG_FUNCTION_ARGS)
 		Assert(wt->context);
 		ctx = MemoryContextSwitchTo(wt->context);
 
-		/* Loop for each input file record. */
-		while (wt->count < rd->limit)
+		if (rd->batch)
 		{
-			HeapTuple	tuple;
-
-			CHECK_FOR_INTERRUPTS();
-
-			/* read tuple */
-			BULKLOAD_PROFILE_PUSH();
-			tuple = ReaderNext(rd);
-			BULKLOAD_PROFILE_POP();
-			BULKLOAD_PROFILE(&prof_reader);
-			if (tuple == NULL)
-				break;
-
-			/* write tuple */
-			BULKLOAD_PROFILE_PUSH();
-			WriterInsert(wt, tuple);
-			wt->count += 1;
-			BULKLOAD_PROFILE_POP();
-			BULKLOAD_PROFILE(&prof_writer);
-
-			MemoryContextReset(wt->context);
-			BULKLOAD_PROFILE(&prof_reset);
+			/* Loop for each batch of input file records. */
+			while (wt->count < rd->limit)
+			{
+				HeapTuple  *tuples;
+				int			ntuples;
+
+				CHECK_FOR_INTERRUPTS();
+
+				/* read tuples */
+				BULKLOAD_PROFILE_PUSH();
+				ntuples = ReaderNextBatch(rd, rd->limit - wt->count, &tuples);
+				BULKLOAD_PROFILE_POP();
+				BULKLOAD_PROFILE(&prof_reader);
+				if (ntuples == 0)
+					break;
+
+				/* write tuples */
+				BULKLOAD_PROFILE_PUSH();
+				WriterInsertBatch(wt, tuples, ntuples);
+				wt->count += ntuples;
+				BULKLOAD_PROFILE_POP();
+				BULKLOAD_PROFILE(&prof_writer);
+
+				MemoryContextReset(wt->context);
+				BULKLOAD_PROFILE(&prof_reset);
+			}
+		}
+		else
+		{
+			/* Loop for each input file record. */
+			while (wt->count < rd->limit)
+			{
+				HeapTuple	tuple;
+
+				CHECK_FOR_INTERRUPTS();
+
+				/* read tuple */
+				BULKLOAD_PROFILE_PUSH();
+				tuple = ReaderNext(rd);
+				BULKLOAD_PROFILE_POP();
+				BULKLOAD_PROFILE(&prof_reader);
+				if (tuple == NULL)
+					break;
+
+				/* write tuple */
+				BULKLOAD_PROFILE_PUSH();
+				WriterInsert(wt, tuple);
+				wt->count += 1;
+				BULKLOAD_PROFILE_POP();
+				BULKLOAD_PROFILE(&prof_writer);
+
+				MemoryContextReset(wt->context);
+				BULKLOAD_PROFILE(&prof_reset);
+			}
 		}
 
 		MemoryContextSwitchTo(ctx);
@@ -10,6 +10,10 @@
 #include "postgres.h"
 #include "pgut-pthread.h"
 
+#ifndef WIN32
+#include <sys/time.h>
+#endif
+
 #ifdef WIN32
 
 typedef struct win32_pthread
@@ -251,3 +255,43 @@ pthread_getspecific(pthread_key_t key)
 }
 
 #endif
+
+/*
+ * pgut_cond_timedwait - wait for the condition at most msec milliseconds.
+ *
+ * Returns 0 when signaled, or ETIMEDOUT. Callers should re-check their
+ * predicate in both cases because spurious wakeups are allowed.
+ */
+int
+pgut_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, long msec)
+{
+#ifdef WIN32
+	int		ret;
+	DWORD	rc;
+
+	if ((ret = pthread_mutex_unlock(mutex)) != 0)
+		return ret;
+	rc = WaitForSingleObject(*cond, (DWORD) msec);
+	if ((ret = pthread_mutex_lock(mutex)) != 0)
+		return ret;
+	if (rc == WAIT_TIMEOUT)
+		return ETIMEDOUT;
+	if (rc != WAIT_OBJECT_0)
+		return maperr();
+	return 0;
+#else
+	struct timeval	now;
+	struct timespec	abstime;
+
+	gettimeofday(&now, NULL);
+	abstime.tv_sec = now.tv_sec + msec / 1000;
+	abstime.tv_nsec = (now.tv_usec + (msec % 1000) * 1000) * 1000;
+	if (abstime.tv_nsec >= 1000000000)
+	{
+		abstime.tv_sec++;
+		abstime.tv_nsec -= 1000000000;
+	}
+
+	return pthread_cond_timedwait(cond, mutex, &abstime);
+#endif
+}
@@ -58,5 +58,6 @@ extern void * pthread_getspecific(pthread_key_t key);
 
 extern void pgut_mutex_lock(pthread_mutex_t *mutex);
 extern void pgut_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+extern int pgut_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, long msec);
 
 #endif   /* PGUT_PTHREAD_H */
@@ -10,16 +10,27 @@
  */
 #include "pg_bulkload.h"
 
+#include <ctype.h>
 #include <fcntl.h>
 
+#include "access/hash.h"
 #include "access/heapam.h"
+#include "catalog/pg_language.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
+#include "executor/functions.h"
 #include "funcapi.h"
 #include "mb/pg_wchar.h"
+#include "nodes/nodeFuncs.h"
+#include "nodes/params.h"
+#include "optimizer/planner.h"
+#include "parser/analyze.h"
 #include "parser/parse_coerce.h"
 #include "pgstat.h"
+#include "tcop/tcopprot.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
@@ -32,8 +43,46 @@
 #include "pg_strutil.h"
 #include "pgut/pgut-be.h"
 #include "reader.h"
+#include "simd.h"
 
 #define DEFAULT_MAX_PARSE_ERRORS		0
+#define DEFAULT_FILTER_CACHE			1024
+
+/*
+ * The cache of FILTER is disabled if less than 1/FILTER_CACHE_MIN_RATE of the
+ * calls hit it after FILTER_CACHE_WINDOW calls.
+ */
+#define FILTER_CACHE_WINDOW				10000
+#define FILTER_CACHE_MIN_RATE			10
+
+typedef struct FilterCacheEntry
+{
+	uint32		hash;
+	Datum	   *args;		/* NULL if the slot is empty */
+	bool	   *nulls;
+	HeapTuple	tuple;		/* NULL if the function returned NULL */
+} FilterCacheEntry;
+
+static char *ReaderCatchError(MemoryContext ccxt);
+static int ReaderReadBlock(Reader *rd, int max);
+static void ReaderBlockReplayed(Reader *rd, HeapTuple *tuples, int ntuples);
+static bool ReaderParseError(Reader *rd, int64 count, int parsing_field, const char *message);
+#if PG_VERSION_NUM >= 80400
+static void FilterInline(Filter *filter, HeapTuple ftup, TupleDesc desc);
+static void FilterInlineQuery(Filter *filter, HeapTuple ftup, char *src, TupleDesc desc);
+#endif
+static Datum FilterEval(Filter *filter);
+static uint32 FilterCacheHash(Filter *filter);
+static int FilterCacheLookup(Filter *filter, uint32 hash);
+static void FilterCacheInsert(Filter *filter, uint32 hash, int slot, HeapTuple tuple);
+static void FilterArrayInvoke(Filter *filter, Datum *args, bool *nulls, int nrows, HeapTuple *tuples);
+static void FilterArrayCall(Filter *filter, Datum *args, bool *nulls, int nrows, HeapTuple *tuples);
+static Datum FilterInvoke(Filter *filter);
+static Datum FilterCall(Filter *filter);
+static Datum FilterBatchCall(Filter *filter, TupleFormer *former, int *parsing_field);
+static void FilterBatchSkip(Filter *filter);
+static void FilterBatchEnd(Filter *filter);
+static HeapTuple FilterResultTuple(Filter *filter, Datum datum);
 
 /**
  * @brief Create Reader
@@ -46,16 +95,24 @@ ReaderCreate(char *type)
 		"BINARY",
 		"FIXED",	/* alias for backward compatibility. */
 		"CSV",
+		"TEXT",
 		"TUPLE",
 		"FUNCTION",
+		"PGCOPY_BINARY",
+		"JSONL",
+		"ARROW",
 	};
 	const ParserCreate values[] =
 	{
 		CreateBinaryParser,
 		CreateBinaryParser,
 		CreateCSVParser,
+		CreateTextParser,
 		CreateTupleParser,
 		CreateFunctionParser,
+		CreatePgCopyBinaryParser,
+		CreateJSONLParser,
+		CreateArrowParser,
 	};
 
 	Reader	   *self;
@@ -66,6 +123,7 @@ ReaderCreate(char *type)
 
 	self = palloc0(sizeof(Reader));
 	self->max_parse_errors = -2;
+	self->filter_cache = -1;
 	self->limit = INT64_MAX;
 	self->checker.encoding = -1;
 
@@ -90,6 +148,28 @@ ReaderInit(Reader *self)
 	if (self->checker.encoding == -1 &&
 		pg_strcasecmp(self->infile, "stdin") == 0)
 		self->checker.encoding = pg_get_client_encoding();
+
+	/*
+	 * Records are read at a time if the parser supports it. Otherwise they
+	 * are read one by one, but written at a time.
+	 */
+	if (self->batch_size > 1)
+		self->batch = RecordBatchCreate(self->batch_size);
+
+	/* Sub-transactions of FILTER span records only when read at a time. */
+	if (self->filter_batch > 1 && self->batch == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("cannot use FILTER_BATCH without BATCH_SIZE greater than 1")));
+
+	if (self->parser->filter)
+	{
+		Filter	   *filter = self->parser->filter;
+
+		filter->batch_size = self->batch ? Min(self->filter_batch, self->batch_size) : 0;
+		filter->read_size = self->batch ? self->batch_size : 0;
+		filter->cache_size = self->filter_cache < 0 ? DEFAULT_FILTER_CACHE : self->filter_cache;
+	}
 }
 
 size_t
@@ -154,6 +234,21 @@ ReaderParam(Reader *rd, const char *keyword, char *target)
 	{
 		rd->checker.check_constraints = ParseBoolean(target);
 	}
+	else if (CompareKeyword(keyword, "BATCH_SIZE"))
+	{
+		ASSERT_ONCE(rd->batch_size == 0);
+		rd->batch_size = ParseInt32(target, 1);
+	}
+	else if (CompareKeyword(keyword, "FILTER_BATCH"))
+	{
+		ASSERT_ONCE(rd->filter_batch == 0);
+		rd->filter_batch = ParseInt32(target, 1);
+	}
+	else if (CompareKeyword(keyword, "FILTER_CACHE"))
+	{
+		ASSERT_ONCE(rd->filter_cache < 0);
+		rd->filter_cache = ParseInt32(target, 0);
+	}
 	else if (CompareKeyword(keyword, "ENCODING"))
 	{
 		ASSERT_ONCE(rd->checker.encoding < 0);
@@ -182,9 +277,17 @@ ReaderClose(Reader *rd, bool onError)
 	if (rd == NULL)
 		return 0;
 
-	/* Close and release members. */
+	/*
+	 * Close and release members. The parser is detached first because closing
+	 * the source might raise an error, and then we are called again.
+	 */
 	if (rd->parser)
-		skip = ParserTerm(rd->parser);
+	{
+		Parser	   *parser = rd->parser;
+
+		rd->parser = NULL;
+		skip = ParserTerm(parser);
+	}
 
 	CheckerTerm(&rd->checker);
 
@@ -208,8 +311,48 @@ ReaderClose(Reader *rd, bool onError)
 	return skip;
 }
 
+/*
+ * Finish the current input file and go on to the next one if any.
+ */
+static bool
+ReaderNextFile(Reader *rd)
+{
+	Parser	   *parser = rd->parser;
+
+	if (parser->filename == NULL)
+		return false;
+
+	LoggerLog(INFO, "Input file \"%s\": " int64_FMT " records read, "
+			  int64_FMT " parse errors\n", parser->filename,
+			  parser->count - rd->file_count,
+			  rd->parse_errors - rd->file_errors);
+	rd->file_count = parser->count;
+	rd->file_errors = rd->parse_errors;
+
+	return ParserNextFile(parser);
+}
+
+/*
+ * Log the byte offset of the first record after SKIP and SKIP_BYTES in the
+ * current input file, to be given to SKIP_BYTES to start there again.
+ */
+void
+ParserLogOffset(Parser *self, int64 offset)
+{
+	if (self->filename)
+		LoggerLog(INFO, "Input file \"%s\": first record at byte " int64_FMT
+				  "\n", self->filename, offset);
+	else
+		LoggerLog(INFO, "First record at byte " int64_FMT
+				  " of the input file\n", offset);
+}
+
 /**
  * @brief Read the next tuple from parser.
+ *
+ * Errors are caught for each record. Only loads with BATCH_SIZE greater than
+ * 1 catch them once for many records, see ReaderNextBatch().
+ *
  * @param rd  [in/out] reader
  * @return type
  */
@@ -233,7 +376,7 @@ ReaderNext(Reader *rd)
 		{
 			tuple = ParserRead(parser, &rd->checker);
 			if (tuple == NULL)
-				eof = true;
+				eof = !ReaderNextFile(rd);
 			else
 			{
 				tuple = CheckerTuple(&rd->checker, tuple,
@@ -243,65 +386,17 @@ ReaderNext(Reader *rd)
 		}
 		PG_CATCH();
 		{
-			ErrorData	   *errdata;
-			MemoryContext	ecxt;
-			char		   *message;
-			StringInfoData	buf;
+			char	   *message;
 
 			if (parser->parsing_field < 0)
 				PG_RE_THROW();	/* should not ignore */
 
-			ecxt = MemoryContextSwitchTo(ccxt);
-			errdata = CopyErrorData();
-
-			/* We cannot ignore query aborts. */
-			switch (errdata->sqlerrcode)
-			{
-				case ERRCODE_ADMIN_SHUTDOWN:
-				case ERRCODE_QUERY_CANCELED:
-					MemoryContextSwitchTo(ecxt);
-					PG_RE_THROW();
-					break;
-			}
-
-			/* Absorb parse errors. */
-			rd->parse_errors++;
-			if (errdata->message)
-				message = pstrdup(errdata->message);
-			else
-				message = "<no error message>";
-			FlushErrorState();
-			FreeErrorData(errdata);
-
-			initStringInfo(&buf);
-			appendStringInfo(&buf, "Parse error Record " int64_FMT
-				": Input Record " int64_FMT ": Rejected",
-				rd->parse_errors, parser->count);
-
-			if (parser->parsing_field > 0)
-				appendStringInfo(&buf, " - column %d", parser->parsing_field);
-
-			appendStringInfo(&buf, ". %s\n", message);
-
-			LoggerLog(WARNING, buf.data);
-
-			/* Terminate if PARSE_ERRORS has been reached. */
-			if (rd->parse_errors > rd->max_parse_errors)
-			{
+			/* Absorb parse errors; the rejected tuple is not returned. */
+			tuple = NULL;
+			message = ReaderCatchError(ccxt);
+			if (ReaderParseError(rd, parser->count, parser->parsing_field,
+								 message))
 				eof = true;
-				LoggerLog(WARNING,
-					"Maximum parse error count exceeded - " int64_FMT
-					" error(s) found in input file\n",
-					rd->parse_errors);
-			}
-
-			/* output parse bad file. */
-			if (rd->parse_fp == NULL)
-				if ((rd->parse_fp = AllocateFile(rd->parse_badfile, "w")) == NULL)
-					ereport(ERROR,
-							(errcode_for_file_access(),
-							 errmsg("could not open parse bad file \"%s\": %m",
-									rd->parse_badfile)));
 
 			ParserDumpRecord(parser, rd->parse_fp, rd->parse_badfile);
 
@@ -315,623 +410,2546 @@ ReaderNext(Reader *rd)
 	return tuple;
 }
 
-void
-ReaderDumpParams(Reader *self)
+/*
+ * Take the message of the error being caught, in the context ccxt. Query
+ * aborts cannot be ignored and are thrown again.
+ */
+static char *
+ReaderCatchError(MemoryContext ccxt)
 {
-	char		   *str;
-	StringInfoData	buf;
-
-	initStringInfo(&buf);
-
-	str = QuoteString(self->infile);
-	appendStringInfo(&buf, "INPUT = %s\n", str);
-	pfree(str);
-
-	str = QuoteString(self->parse_badfile);
-	appendStringInfo(&buf, "PARSE_BADFILE = %s\n", str);
-	pfree(str);
+	ErrorData	   *errdata;
+	MemoryContext	ecxt;
+	char		   *message;
 
-	str = QuoteString(self->logfile);
-	appendStringInfo(&buf, "LOGFILE = %s\n", str);
-	pfree(str);
+	ecxt = MemoryContextSwitchTo(ccxt);
+	errdata = CopyErrorData();
 
-	if (self->limit == INT64_MAX)
-		appendStringInfo(&buf, "LIMIT = INFINITE\n");
-	else
-		appendStringInfo(&buf, "LIMIT = " int64_FMT "\n", self->limit);
+	/* We cannot ignore query aborts. */
+	switch (errdata->sqlerrcode)
+	{
+		case ERRCODE_ADMIN_SHUTDOWN:
+		case ERRCODE_QUERY_CANCELED:
+			MemoryContextSwitchTo(ecxt);
+			PG_RE_THROW();
+			break;
+	}
 
-	if (self->max_parse_errors == INT64_MAX)
-		appendStringInfo(&buf, "PARSE_ERRORS = INFINITE\n");
+	if (errdata->message)
+		message = pstrdup(errdata->message);
 	else
-		appendStringInfo(&buf, "PARSE_ERRORS = " int64_FMT "\n",
-						 self->max_parse_errors);
-	if (PG_VALID_FE_ENCODING(self->checker.encoding))
-		appendStringInfo(&buf, "ENCODING = %s\n",
-						 pg_encoding_to_char(self->checker.encoding));
-	appendStringInfo(&buf, "CHECK_CONSTRAINTS = %s\n",
-		self->checker.check_constraints ? "YES" : "NO");
-
-	LoggerLog(INFO, buf.data);
-	pfree(buf.data);
+		message = "<no error message>";
+	FlushErrorState();
+	FreeErrorData(errdata);
 
-	ParserDumpParams(self->parser);
+	return message;
 }
 
-void
-CheckerInit(Checker *checker, Relation rel, TupleChecker *tchecker)
+/*
+ * Log a parse error of the record 'count' and open the parse bad file, to
+ * which the caller writes the record. Returns true if PARSE_ERRORS has been
+ * reached.
+ */
+static bool
+ReaderParseError(Reader *rd, int64 count, int parsing_field, const char *message)
 {
-	TupleDesc	desc;
-
-	checker->tchecker = tchecker;
+	Parser		   *parser = rd->parser;
+	StringInfoData	buf;
+	bool			exceeded = false;
 
-	/*
-	 * When specify ENCODING, we check the input data encoding.
-	 * Convert encoding if the client and server encodings are different.
-	 */
-	checker->db_encoding = GetDatabaseEncoding();
-	if (checker->encoding != -1 &&
-		(checker->encoding != PG_SQL_ASCII ||
-		checker->db_encoding != PG_SQL_ASCII))
-		checker->check_encoding = true;
+	rd->parse_errors++;
 
-	if (!rel)
-		return;
+	initStringInfo(&buf);
+	if (parser->filename)
+		appendStringInfo(&buf, "Parse error Record " int64_FMT
+			": Input File \"%s\" Record " int64_FMT ": Rejected",
+			rd->parse_errors, parser->filename,
+			count - rd->file_count);
+	else
+		appendStringInfo(&buf, "Parse error Record " int64_FMT
+			": Input Record " int64_FMT ": Rejected",
+			rd->parse_errors, count);
 
-	/* When specify CHECK_CONSTRAINTS, we check the constraints */
-	desc = RelationGetDescr(rel);
-	if (desc->constr &&
-		(checker->check_constraints || desc->constr->has_not_null))
-	{
-		if (checker->check_constraints)
-			checker->has_constraints = true;
+	if (parsing_field > 0)
+		appendStringInfo(&buf, " - column %d", parsing_field);
 
-		if (desc->constr->has_not_null)
-			checker->has_not_null = true;
+	appendStringInfo(&buf, ". %s\n", message);
 
-		checker->resultRelInfo = makeNode(ResultRelInfo);
-		checker->resultRelInfo->ri_RangeTableIndex = 1;		/* dummy */
-		checker->resultRelInfo->ri_RelationDesc = rel;
-		checker->resultRelInfo->ri_TrigDesc = NULL; /* TRIGGER is not supported */
-		checker->resultRelInfo->ri_TrigInstrument = NULL;
-	}
+	LoggerLog(WARNING, buf.data);
+	pfree(buf.data);
 
-	if (checker->has_constraints)
+	/* Terminate if PARSE_ERRORS has been reached. */
+	if (rd->parse_errors > rd->max_parse_errors)
 	{
-		checker->estate = CreateExecutorState();
-		checker->estate->es_result_relations = checker->resultRelInfo;
-		checker->estate->es_num_result_relations = 1;
-		checker->estate->es_result_relation_info = checker->resultRelInfo;
-
-		/* Set up a tuple slot too */
-		checker->slot = MakeSingleTupleTableSlot(desc);
+		exceeded = true;
+		LoggerLog(WARNING,
+			"Maximum parse error count exceeded - " int64_FMT
+			" error(s) found in input file\n",
+			rd->parse_errors);
 	}
 
-	if (!checker->has_constraints && checker->has_not_null)
-	{
-		int	i;
+	/* output parse bad file. */
+	if (rd->parse_fp == NULL)
+		if ((rd->parse_fp = AllocateFile(rd->parse_badfile, "w")) == NULL)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not open parse bad file \"%s\": %m",
+							rd->parse_badfile)));
 
-		checker->desc = CreateTupleDescCopy(desc);
-		for (i = 0; i < desc->natts; i++)
-			checker->desc->attrs[i]->attnotnull = desc->attrs[i]->attnotnull;
-	}
+	return exceeded;
 }
 
-void
-CheckerTerm(Checker *checker)
+/**
+ * @brief Create a batch of at most capacity records.
+ */
+RecordBatch *
+RecordBatchCreate(int capacity)
 {
-	if (checker->slot)
-		ExecDropSingleTupleTableSlot(checker->slot);
-
-	if (checker->estate)
-		FreeExecutorState(checker->estate);
+	RecordBatch	   *batch = palloc0(sizeof(RecordBatch));
+
+	batch->context = CurrentMemoryContext;
+	batch->capacity = capacity;
+	batch->count = palloc(capacity * sizeof(int64));
+	batch->record = palloc(capacity * sizeof(int));
+	batch->record_len = palloc(capacity * sizeof(int));
+	batch->error = palloc(capacity * sizeof(int));
+	batch->error_field = palloc(capacity * sizeof(int));
+	batch->tuples = palloc(capacity * sizeof(HeapTuple));
+	initStringInfo(&batch->data);
+
+	return batch;
 }
 
-char *
-CheckerConversion(Checker *checker, char *src)
+/**
+ * @brief Start the next record, which is the record 'count' in the input.
+ */
+void
+RecordBatchStart(RecordBatch *batch, int64 count)
 {
-	int	len;
-
-	if (!checker->check_encoding)
-		return src;
-
-	len = strlen(src);
+	int		row = batch->nrecords;
 
-	if (checker->encoding == checker->db_encoding ||
-		checker->encoding == PG_SQL_ASCII)
-	{
-		/*
-		 * No conversion is needed, but we must still validate the data.
-		 */
-		pg_verify_mbstr(checker->db_encoding, src, len, false);
-		return src;
-	}
+	Assert(row < batch->capacity && !batch->pending);
 
-	if (checker->db_encoding == PG_SQL_ASCII)
+	/* All records in a batch have the same fields. */
+	if (row == 0)
 	{
-		/*
-		 * No conversion is possible, but we must still validate the data,
-		 * because the client-side code might have done string escaping using
-		 * the selected client_encoding.  If the client encoding is ASCII-safe
-		 * then we just do a straight validation under that encoding.  For an
-		 * ASCII-unsafe encoding we have a problem: we dare not pass such data
-		 * to the parser but we have no way to convert it.	We compromise by
-		 * rejecting the data if it contains any non-ASCII characters.
-		 */
-		if (PG_VALID_BE_ENCODING(checker->encoding))
-			pg_verify_mbstr(checker->encoding, src, len, false);
-		else
+		batch->nfields = batch->former->maxfields;
+		if (batch->nfields > batch->maxfields)
 		{
-			int			i;
+			MemoryContext	ctx = MemoryContextSwitchTo(batch->context);
+			int				n = batch->nfields * batch->capacity;
 
-			for (i = 0; i < len; i++)
+			if (batch->offsets)
 			{
-				if (src[i] == '\0' || IS_HIGHBIT_SET(src[i]))
-					ereport(ERROR,
-							(errcode(ERRCODE_CHARACTER_NOT_IN_REPERTOIRE),
-					 errmsg("invalid byte value for encoding \"%s\": 0x%02x",
-							pg_enc2name_tbl[PG_SQL_ASCII].name,
-							(unsigned char) src[i])));
+				pfree(batch->offsets);
+				pfree(batch->lengths);
+				pfree(batch->nulls);
+				pfree(batch->values);
 			}
+			batch->offsets = palloc(n * sizeof(int));
+			batch->lengths = palloc(n * sizeof(int));
+			batch->nulls = palloc(n * sizeof(bool));
+			batch->values = palloc(n * sizeof(Datum));
+			batch->maxfields = batch->nfields;
+
+			MemoryContextSwitchTo(ctx);
 		}
-		return src;
 	}
 
-	/* Convert the input into the database encoding. */
-	return (char *) pg_do_encoding_conversion((unsigned char *) src,
-											  len,
-											  checker->encoding,
-											  checker->db_encoding);
+	batch->count[row] = count;
+	batch->record[row] = batch->data.len;
+	batch->record_len[row] = 0;
+	batch->error[row] = -1;
+	batch->pending = true;
 }
 
-HeapTuple
-CheckerConstraints(Checker *checker, HeapTuple tuple, int *parsing_field)
+/**
+ * @brief Append data to the record written to the parse bad file if the
+ * record is rejected.
+ */
+void
+RecordBatchRecord(RecordBatch *batch, const char *data, int len)
 {
-	if (checker->has_constraints)
-	{
-		*parsing_field = 0;
+	appendBinaryStringInfo(&batch->data, data, len);
+	batch->record_len[batch->nrecords] += len;
+}
 
-		/* Place tuple in tuple slot */
-		ExecStoreTuple(tuple, checker->slot, InvalidBuffer, false);
+/**
+ * @brief Set the string of a field of the record, or NULL.
+ */
+void
+RecordBatchField(RecordBatch *batch, int field, const char *str)
+{
+	int		k = field * batch->capacity + batch->nrecords;
 
-		/* Check the constraints of the tuple */
-		ExecConstraints(checker->resultRelInfo, checker->slot, checker->estate);
-	}
-	else if (checker->has_not_null && HeapTupleHasNulls(tuple))
+	if (str == NULL)
 	{
-		/*
-		 * Even if CHECK_CONSTRAINTS is not specified, check NOT NULL constraint
-		 */
-		TupleDesc	desc = checker->desc;
-		int			i;
-
-		for (i = 0; i < desc->natts; i++)
-		{
-			if (desc->attrs[i]->attnotnull &&
-				att_isnull(i, tuple->t_data->t_bits))
-			{
-				*parsing_field = i + 1;	/* 1 origin */
-				ereport(ERROR,
-						(errcode(ERRCODE_NOT_NULL_VIOLATION),
-						 errmsg("null value in column \"%s\" violates not-null constraint",
-						NameStr(desc->attrs[i]->attname))));
-			}
-		}
+		batch->nulls[k] = true;
+		return;
 	}
 
-	return tuple;
+	batch->nulls[k] = false;
+	batch->offsets[k] = batch->data.len;
+	batch->lengths[k] = strlen(str);
+	appendBinaryStringInfo(&batch->data, str, batch->lengths[k] + 1);
 }
 
+/**
+ * @brief End the record.
+ */
 void
-TupleFormerInit(TupleFormer *former, Filter *filter, TupleDesc desc)
+RecordBatchEnd(RecordBatch *batch)
 {
-	AttrNumber			natts;
-	AttrNumber			maxatts;
+	batch->nrecords++;
+	batch->pending = false;
+}
+
+/*
+ * Reject the record with an error in the field.
+ */
+static void
+RecordBatchError(RecordBatch *batch, int row, int field, const char *message)
+{
+	batch->error[row] = batch->data.len;
+	batch->error_field[row] = field;
+	appendBinaryStringInfo(&batch->data, message, strlen(message) + 1);
+}
+
+/*
+ * Parse records into the batch until it has max records or the current file
+ * ends. Errors are kept in the batch to be reported in the order of records.
+ */
+static void
+ReaderReadBatch(Reader *rd, int max)
+{
+	Parser		   *parser = rd->parser;
+	RecordBatch	   *batch = rd->batch;
+	MemoryContext	ccxt = CurrentMemoryContext;
+
+	batch->nrecords = 0;
+	batch->pending = false;
+	resetStringInfo(&batch->data);
+
+	while (batch->nrecords < max)
+	{
+		volatile bool	more = true;
+
+		parser->parsing_field = -1;
+
+		PG_TRY();
+		{
+			more = ParserReadBatch(parser, &rd->checker, batch, max);
+		}
+		PG_CATCH();
+		{
+			char	   *message;
+			int			row = batch->nrecords;
+
+			if (parser->parsing_field < 0)
+				PG_RE_THROW();	/* should not ignore */
+
+			message = ReaderCatchError(ccxt);
+
+			/*
+			 * The record is not known yet if reading the input failed, and
+			 * the parse bad file gets an empty record for it.
+			 */
+			if (!batch->pending)
+				RecordBatchStart(batch, parser->count);
+			RecordBatchError(batch, row, parser->parsing_field, message);
+			RecordBatchEnd(batch);
+
+			MemoryContextReset(ccxt);
+		}
+		PG_END_TRY();
+
+		if (!more)
+		{
+			if (batch->nrecords > 0)
+			{
+				/* go on to the next file after the batch is done */
+				rd->file_done = true;
+				break;
+			}
+			if (!ReaderNextFile(rd))
+			{
+				rd->eof = true;
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Read values of the batch column by column. A record is rejected at the
+ * first field in error, and the following fields of it are not read.
+ */
+static void
+ReaderBatchValues(Reader *rd)
+{
+	Parser		   *parser = rd->parser;
+	RecordBatch	   *batch = rd->batch;
+	TupleFormer	   *former = batch->former;
+	MemoryContext	ccxt = CurrentMemoryContext;
+	volatile int	field = 0;
+	volatile int	row = 0;
+
+	while (field < batch->nfields)
+	{
+		PG_TRY();
+		{
+			for (; field < batch->nfields; field++, row = 0)
+			{
+				int		col = former->attnum[field];
+				int		base = field * batch->capacity;
+
+				if (col < 0)
+					continue;	/* skipped field */
+
+				for (; row < batch->nrecords; row++)
+				{
+					int		k = base + row;
+
+					if (batch->error[row] >= 0 || batch->nulls[k])
+						continue;
+
+					batch->values[k] = TupleFormerValue(former,
+										batch->data.data + batch->offsets[k], col);
+				}
+			}
+		}
+		PG_CATCH();
+		{
+			char	   *message = ReaderCatchError(ccxt);
+
+			RecordBatchError(batch, row, field + 1, message);	/* 1 origin */
+			row++;
+		}
+		PG_END_TRY();
+	}
+
+	parser->parsing_field = -1;
+}
+
+/*
+ * Call FILTER taking arrays once for the records of the batch which are not
+ * rejected. If it fails, it is called again for each of the records, and
+ * only the records in error are rejected.
+ */
+static void
+ReaderBatchFilter(Reader *rd)
+{
+	RecordBatch	   *batch = rd->batch;
+	Filter		   *filter = batch->filter;
+	MemoryContext	ccxt = CurrentMemoryContext;
+	int				nargs = filter->nargs;
+	volatile bool	failed = true;
+	int			   *rows;
+	Datum		   *args;
+	bool		   *nulls;
+	HeapTuple	   *tuples;
+	int				nrows = 0;
+	int				row;
+	int				i;
+
+	if (batch->filtered == NULL)
+		batch->filtered = MemoryContextAlloc(batch->context,
+								batch->capacity * sizeof(HeapTuple));
+
+	rows = palloc(batch->nrecords * sizeof(int));
+	for (row = 0; row < batch->nrecords; row++)
+	{
+		if (batch->error[row] < 0)
+			rows[nrows++] = row;
+	}
+	if (nrows == 0)
+		return;
+
+	/* The field i of a record is the argument i, see TupleFormerInit(). */
+	args = palloc(nargs * nrows * sizeof(Datum));
+	nulls = palloc(nargs * nrows * sizeof(bool));
+	for (i = 0; i < nargs; i++)
+	{
+		for (row = 0; row < nrows; row++)
+		{
+			int		k = i * batch->capacity + rows[row];
+
+			args[i * nrows + row] = batch->nulls[k] ? (Datum) 0 : batch->values[k];
+			nulls[i * nrows + row] = batch->nulls[k];
+		}
+	}
+
+	tuples = palloc(nrows * sizeof(HeapTuple));
+
+	PG_TRY();
+	{
+		FilterArrayCall(filter, args, nulls, nrows, tuples);
+		failed = false;
+	}
+	PG_CATCH();
+	{
+		/* The records in error are found below. */
+		ReaderCatchError(ccxt);
+	}
+	PG_END_TRY();
+
+	if (!failed)
+	{
+		for (row = 0; row < nrows; row++)
+			batch->filtered[rows[row]] = tuples[row];
+		return;
+	}
+
+	for (row = 0; row < nrows; row++)
+	{
+		Datum	rowargs[FUNC_MAX_ARGS];
+		bool	rownulls[FUNC_MAX_ARGS];
+
+		for (i = 0; i < nargs; i++)
+		{
+			rowargs[i] = args[i * nrows + row];
+			rownulls[i] = nulls[i * nrows + row];
+		}
+
+		PG_TRY();
+		{
+			FilterArrayCall(filter, rowargs, rownulls, 1,
+							&batch->filtered[rows[row]]);
+		}
+		PG_CATCH();
+		{
+			char	   *message = ReaderCatchError(ccxt);
+
+			RecordBatchError(batch, rows[row], 0, message);
+		}
+		PG_END_TRY();
+	}
+}
+
+/*
+ * Form and check tuples of the batch, and report parse errors in the order of
+ * records. Returns the number of tuples.
+ */
+static int
+ReaderBatchTuples(Reader *rd)
+{
+	Parser		   *parser = rd->parser;
+	RecordBatch	   *batch = rd->batch;
+	TupleFormer	   *former = batch->former;
+	MemoryContext	ccxt = CurrentMemoryContext;
+	int				ntuples = 0;
+	int				row;
+
+	if (batch->filter)
+		ReaderBatchFilter(rd);
+
+	for (row = 0; row < batch->nrecords; row++)
+	{
+		char	   *volatile message = NULL;
+		int			field;
+		size_t		len;
+
+		if (batch->error[row] >= 0)
+			message = batch->data.data + batch->error[row];
+		else
+		{
+			for (field = 0; field < batch->nfields && !batch->filter; field++)
+			{
+				int		col = former->attnum[field];
+				int		k = field * batch->capacity + row;
+
+				if (col < 0)
+					continue;	/* skipped field */
+
+				former->isnull[col] = batch->nulls[k];
+				former->values[col] = batch->nulls[k] ? (Datum) 0 : batch->values[k];
+			}
+
+			parser->parsing_field = -1;
+
+			PG_TRY();
+			{
+				HeapTuple	tuple;
+
+				if (batch->filter)
+					tuple = batch->filtered[row];
+				else
+					tuple = TupleFormerTuple(former);
+
+				tuple = CheckerTuple(&rd->checker, tuple,
+									 &parser->parsing_field);
+				CheckerConstraints(&rd->checker, tuple, &parser->parsing_field);
+				batch->tuples[ntuples] = tuple;
+			}
+			PG_CATCH();
+			{
+				if (parser->parsing_field < 0)
+					PG_RE_THROW();	/* should not ignore */
+
+				message = ReaderCatchError(ccxt);
+				batch->error_field[row] = parser->parsing_field;
+			}
+			PG_END_TRY();
+
+			if (message == NULL)
+			{
+				ntuples++;
+				continue;
+			}
+		}
+
+		/* Absorb parse errors. */
+		if (ReaderParseError(rd, batch->count[row], batch->error_field[row],
+							 message))
+		{
+			/* Records after it are not read. */
+			parser->count = batch->count[row];
+			rd->eof = true;
+		}
+
+		/* output parse bad file. */
+		len = batch->record_len[row];
+		if (!CheckerWriteRecord(&rd->checker, rd->parse_fp,
+								batch->data.data + batch->record[row], len) ||
+			fflush(rd->parse_fp))
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not write parse badfile \"%s\": %m",
+							rd->parse_badfile)));
+
+		if (rd->eof)
+			break;
+	}
+
+	return ntuples;
+}
+
+/*
+ * Read at most max tuples one by one for parsers without readBatch. Unlike
+ * ReaderNext, errors are caught by one frame for all the records, which is
+ * set up again only after a parse error; the record in error is the one
+ * being read, and it is rejected as ReaderNext does. Each record is parsed
+ * in a memory context reset after it, and its tuple is copied out, so the
+ * memory of rejected records is not kept for the whole batch.
+ */
+static int
+ReaderReadBlock(Reader *rd, int max)
+{
+	Parser		   *parser = rd->parser;
+	HeapTuple	   *tuples = rd->batch->tuples;
+	MemoryContext	ccxt = CurrentMemoryContext;
+	MemoryContext	rowcxt;
+	volatile int	ntuples = 0;
+	volatile bool	done = false;
+
+	rowcxt = AllocSetContextCreate(ccxt,
+								   "ReaderRow",
+								   ALLOCSET_DEFAULT_MINSIZE,
+								   ALLOCSET_DEFAULT_INITSIZE,
+								   ALLOCSET_DEFAULT_MAXSIZE);
+
+	while (!done)
+	{
+		PG_TRY();
+		{
+			while (ntuples < max)
+			{
+				HeapTuple	record;
+				HeapTuple	tuple;
+
+				parser->parsing_field = -1;
+
+				MemoryContextSwitchTo(rowcxt);
+				record = ParserRead(parser, &rd->checker);
+				if (record == NULL)
+				{
+					MemoryContextSwitchTo(ccxt);
+					FilterBatchEnd(parser->filter);
+					if (ReaderNextFile(rd))
+						continue;
+					rd->eof = true;
+					break;
+				}
+
+				tuple = CheckerTuple(&rd->checker, record,
+									 &parser->parsing_field);
+				CheckerConstraints(&rd->checker, tuple, &parser->parsing_field);
+
+				/* The tuple must survive the records read after it. */
+				MemoryContextSwitchTo(ccxt);
+				tuples[ntuples++] = heap_copytuple(tuple);
+				MemoryContextReset(rowcxt);
+			}
+			done = true;
+		}
+		PG_CATCH();
+		{
+			char	   *message;
+
+			MemoryContextSwitchTo(ccxt);
+
+			if (parser->parsing_field < 0)
+			{
+				/* The sub-transaction is aborted with the transaction. */
+				if (parser->filter)
+					parser->filter->batch_owner = NULL;
+				PG_RE_THROW();	/* should not ignore */
+			}
+
+			/* Absorb parse errors; the rejected tuple is not returned. */
+			message = ReaderCatchError(rowcxt);
+			MemoryContextSwitchTo(ccxt);
+			FilterBatchEnd(parser->filter);
+			if (parser->filter && parser->filter->batch_replayed > 0)
+				ReaderBlockReplayed(rd, tuples, ntuples);
+			if (ReaderParseError(rd, parser->count, parser->parsing_field,
+								 message))
+			{
+				rd->eof = true;
+				done = true;
+			}
+
+			ParserDumpRecord(parser, rd->parse_fp, rd->parse_badfile);
+
+			MemoryContextReset(rowcxt);
+		}
+		PG_END_TRY();
+	}
+
+	MemoryContextSwitchTo(ccxt);
+	MemoryContextDelete(rowcxt);
+
+	/* The tuples are written after the function calls are committed. */
+	FilterBatchEnd(parser->filter);
+
+	return ntuples;
+}
+
+/*
+ * Replace the last tuples read in the sub-transaction of FILTER_BATCH with
+ * the rows returned by running the calls again, see FilterBatchCall(). The
+ * rows of the rolled back calls must not be loaded, because the effects of
+ * the calls committed are those of running them again. The records have
+ * passed the checks once, so an error in checking them cannot be ignored.
+ */
+static void
+ReaderBlockReplayed(Reader *rd, HeapTuple *tuples, int ntuples)
+{
+	Filter	   *filter = rd->parser->filter;
+	int			first = ntuples - filter->batch_replayed;
+	int			parsing_field = -1;
+	int			i;
+
+	for (i = 0; i < filter->batch_replayed; i++)
+	{
+		HeapTuple	tuple = filter->batch_tuples[i];
+
+		if (tuple == NULL)
+			continue;	/* not run again */
+
+		tuple = CheckerTuple(&rd->checker, tuple, &parsing_field);
+		CheckerConstraints(&rd->checker, tuple, &parsing_field);
+		tuples[first + i] = heap_copytuple(tuple);
+	}
+
+	filter->batch_replayed = 0;
+}
+
+/**
+ * @brief Read the next tuples with the batch of the parser.
+ *
+ * Records are parsed into the batch first, then the values are read column
+ * by column, and the tuples are formed and checked last. Parse errors are
+ * reported in the same order and with the same record numbers as ReaderNext.
+ * Parsers without readBatch read records one by one, see ReaderReadBlock().
+ *
+ * @param rd  [in/out] reader
+ * @param max [in] max number of tuples
+ * @param tuples [out] tuples read
+ * @return the number of tuples, or zero at the end of input.
+ */
+int
+ReaderNextBatch(Reader *rd, int64 max, HeapTuple **tuples)
+{
+	int		ntuples = 0;
+	int		nrecords = (int) Min(max, rd->batch->capacity);
+
+	*tuples = rd->batch->tuples;
+
+	if (rd->parser->readBatch == NULL)
+	{
+		if (!rd->eof)
+			ntuples = ReaderReadBlock(rd, nrecords);
+		BULKLOAD_PROFILE(&prof_reader_parser);
+		return ntuples;
+	}
+
+	while (ntuples == 0 && !rd->eof)
+	{
+		if (rd->file_done)
+		{
+			rd->file_done = false;
+			if (!ReaderNextFile(rd))
+			{
+				rd->eof = true;
+				break;
+			}
+		}
+
+		ReaderReadBatch(rd, nrecords);
+		BULKLOAD_PROFILE(&prof_reader_parser);
+		ReaderBatchValues(rd);
+		ntuples = ReaderBatchTuples(rd);
+	}
+
+	BULKLOAD_PROFILE(&prof_reader_parser);
+	return ntuples;
+}
+
+void
+ReaderDumpParams(Reader *self)
+{
+	char		   *str;
+	StringInfoData	buf;
+
+	initStringInfo(&buf);
+
+	str = QuoteString(self->infile);
+	appendStringInfo(&buf, "INPUT = %s\n", str);
+	pfree(str);
+
+	str = QuoteString(self->parse_badfile);
+	appendStringInfo(&buf, "PARSE_BADFILE = %s\n", str);
+	pfree(str);
+
+	str = QuoteString(self->logfile);
+	appendStringInfo(&buf, "LOGFILE = %s\n", str);
+	pfree(str);
+
+	if (self->limit == INT64_MAX)
+		appendStringInfo(&buf, "LIMIT = INFINITE\n");
+	else
+		appendStringInfo(&buf, "LIMIT = " int64_FMT "\n", self->limit);
+
+	if (self->max_parse_errors == INT64_MAX)
+		appendStringInfo(&buf, "PARSE_ERRORS = INFINITE\n");
+	else
+		appendStringInfo(&buf, "PARSE_ERRORS = " int64_FMT "\n",
+						 self->max_parse_errors);
+	if (PG_VALID_FE_ENCODING(self->checker.encoding))
+		appendStringInfo(&buf, "ENCODING = %s\n",
+						 pg_encoding_to_char(self->checker.encoding));
+	appendStringInfo(&buf, "CHECK_CONSTRAINTS = %s\n",
+		self->checker.check_constraints ? "YES" : "NO");
+	if (self->batch_size > 1)
+		appendStringInfo(&buf, "BATCH_SIZE = %d\n", self->batch_size);
+	if (self->filter_batch > 1)
+		appendStringInfo(&buf, "FILTER_BATCH = %d\n", self->filter_batch);
+	if (self->filter_cache >= 0)
+		appendStringInfo(&buf, "FILTER_CACHE = %d\n", self->filter_cache);
+
+	LoggerLog(INFO, buf.data);
+	pfree(buf.data);
+
+	ParserDumpParams(self->parser);
+}
+
+void
+CheckerInit(Checker *checker, Relation rel, TupleChecker *tchecker)
+{
+	TupleDesc	desc;
+
+	checker->tchecker = tchecker;
+
+	/*
+	 * When specify ENCODING, we check the input data encoding.
+	 * Convert encoding if the client and server encodings are different.
+	 */
+	checker->db_encoding = GetDatabaseEncoding();
+	if (checker->encoding != -1 &&
+		(checker->encoding != PG_SQL_ASCII ||
+		checker->db_encoding != PG_SQL_ASCII))
+		checker->check_encoding = true;
+
+	if (!rel)
+		return;
+
+	/* When specify CHECK_CONSTRAINTS, we check the constraints */
+	desc = RelationGetDescr(rel);
+	if (desc->constr &&
+		(checker->check_constraints || desc->constr->has_not_null))
+	{
+		if (checker->check_constraints)
+			checker->has_constraints = true;
+
+		if (desc->constr->has_not_null)
+			checker->has_not_null = true;
+
+		checker->resultRelInfo = makeNode(ResultRelInfo);
+		checker->resultRelInfo->ri_RangeTableIndex = 1;		/* dummy */
+		checker->resultRelInfo->ri_RelationDesc = rel;
+		checker->resultRelInfo->ri_TrigDesc = NULL; /* TRIGGER is not supported */
+		checker->resultRelInfo->ri_TrigInstrument = NULL;
+	}
+
+	if (checker->has_constraints)
+	{
+		checker->estate = CreateExecutorState();
+		checker->estate->es_result_relations = checker->resultRelInfo;
+		checker->estate->es_num_result_relations = 1;
+		checker->estate->es_result_relation_info = checker->resultRelInfo;
+
+		/* Set up a tuple slot too */
+		checker->slot = MakeSingleTupleTableSlot(desc);
+	}
+
+	if (!checker->has_constraints && checker->has_not_null)
+	{
+		int	i;
+
+		checker->desc = CreateTupleDescCopy(desc);
+		for (i = 0; i < desc->natts; i++)
+			checker->desc->attrs[i]->attnotnull = desc->attrs[i]->attnotnull;
+	}
+}
+
+void
+CheckerTerm(Checker *checker)
+{
+	if (checker->slot)
+		ExecDropSingleTupleTableSlot(checker->slot);
+
+	if (checker->estate)
+		FreeExecutorState(checker->estate);
+}
+
+char *
+CheckerConversion(Checker *checker, char *src)
+{
+	int	len;
+
+	if (!checker->check_encoding)
+		return src;
+
+	/* ASCII is valid and the same in all encodings. */
+	len = strlen(src);
+	if (ScanNonAscii(src, len) == len)
+		return src;
+
+	return CheckerConversionBytes(checker, src, len);
+}
+
+/*
+ * Same as CheckerConversion(), but src is len bytes which need not be
+ * terminated with NUL and must not contain NUL. Returns src itself if the
+ * bytes are only checked, or a palloc'd string terminated with NUL.
+ */
+char *
+CheckerConversionBytes(Checker *checker, char *src, int len)
+{
+	if (checker->encoding == checker->db_encoding ||
+		checker->encoding == PG_SQL_ASCII)
+	{
+		/*
+		 * No conversion is needed, but we must still validate the data.
+		 */
+		pg_verify_mbstr(checker->db_encoding, src, len, false);
+		return src;
+	}
+
+	if (checker->db_encoding == PG_SQL_ASCII)
+	{
+		/*
+		 * No conversion is possible, but we must still validate the data,
+		 * because the client-side code might have done string escaping using
+		 * the selected client_encoding.  If the client encoding is ASCII-safe
+		 * then we just do a straight validation under that encoding.  For an
+		 * ASCII-unsafe encoding we have a problem: we dare not pass such data
+		 * to the parser but we have no way to convert it.	We compromise by
+		 * rejecting the data if it contains any non-ASCII characters.
+		 */
+		if (PG_VALID_BE_ENCODING(checker->encoding))
+			pg_verify_mbstr(checker->encoding, src, len, false);
+		else
+		{
+			int			i;
+
+			for (i = 0; i < len; i++)
+			{
+				if (src[i] == '\0' || IS_HIGHBIT_SET(src[i]))
+					ereport(ERROR,
+							(errcode(ERRCODE_CHARACTER_NOT_IN_REPERTOIRE),
+					 errmsg("invalid byte value for encoding \"%s\": 0x%02x",
+							pg_enc2name_tbl[PG_SQL_ASCII].name,
+							(unsigned char) src[i])));
+			}
+		}
+		return src;
+	}
+
+	/* Convert the input into the database encoding. */
+	return (char *) pg_do_encoding_conversion((unsigned char *) src,
+											  len,
+											  checker->encoding,
+											  checker->db_encoding);
+}
+
+/*
+ * Check len bytes at src in the input encoding where it is not converted,
+ * without raising errors. NUL bytes are accepted. Returns false if the bytes
+ * are invalid.
+ */
+bool
+CheckerVerifyBytes(Checker *checker, const char *src, int len)
+{
+	const char *end = src + len;
+	int			encoding = checker->db_encoding;
+
+	Assert(!CheckerNeedConversion(checker));
+
+	if (checker->db_encoding == PG_SQL_ASCII)
+	{
+		/* See CheckerConversionBytes() */
+		if (!PG_VALID_BE_ENCODING(checker->encoding))
+			return ScanNonAscii(src, len) == len;
+		encoding = checker->encoding;
+	}
+
+	if (encoding == PG_UTF8)
+		return SimdUtf8Valid(src, len);
+
+	while (src < end)
+	{
+		const char *nul = memchr(src, '\0', end - src);
+		int			n = (nul ? nul : end) - src;
+
+		if (n > 0 && !pg_verify_mbstr(encoding, src, n, true))
+			return false;
+		src += n + 1;
+	}
+
+	return true;
+}
+
+/*
+ * Check a field read through a ConversionSource. Converted fields are in
+ * the server encoding already.
+ */
+void
+CheckerVerifyField(Checker *checker, char *str)
+{
+	if (CheckerNeedConversion(checker))
+		pg_verify_mbstr(checker->db_encoding, str, strlen(str), false);
+	else
+		CheckerConversion(checker, str);
+}
+
+/*
+ * Write a record to the parse bad file. A record converted by the source is
+ * converted back into the input encoding, so that the bad file can be loaded
+ * with the same ENCODING. Returns false on write errors.
+ */
+bool
+CheckerWriteRecord(Checker *checker, FILE *fp, const char *data, size_t len)
+{
+	const char *end = data + len;
+
+	if (!checker->source_conversion ||
+		!CheckerNeedConversion(checker) ||
+		ScanNonAscii(data, (int) len) == (int) len)
+		return fwrite(data, 1, len, fp) == len;
+
+	/* NUL bytes are not converted but written as they are. */
+	while (data < end)
+	{
+		const char *nul = memchr(data, '\0', end - data);
+		size_t		n = (nul ? nul : end) - data;
+
+		if (n > 0)
+		{
+			char   *str;
+
+			str = (char *) pg_do_encoding_conversion((unsigned char *) data,
+													 n,
+													 checker->db_encoding,
+													 checker->encoding);
+			if (str == data)
+			{
+				if (fwrite(data, 1, n, fp) != n)
+					return false;
+			}
+			else
+			{
+				size_t	slen = strlen(str);
+
+				if (fwrite(str, 1, slen, fp) != slen)
+					return false;
+				pfree(str);
+			}
+			data += n;
+		}
+		if (data < end)
+		{
+			if (putc('\0', fp) == EOF)
+				return false;
+			data++;
+		}
+	}
+
+	return true;
+}
+
+HeapTuple
+CheckerConstraints(Checker *checker, HeapTuple tuple, int *parsing_field)
+{
+	if (checker->has_constraints)
+	{
+		*parsing_field = 0;
+
+		/* Place tuple in tuple slot */
+		ExecStoreTuple(tuple, checker->slot, InvalidBuffer, false);
+
+		/* Check the constraints of the tuple */
+		ExecConstraints(checker->resultRelInfo, checker->slot, checker->estate);
+	}
+	else if (checker->has_not_null && HeapTupleHasNulls(tuple))
+	{
+		/*
+		 * Even if CHECK_CONSTRAINTS is not specified, check NOT NULL constraint
+		 */
+		TupleDesc	desc = checker->desc;
+		int			i;
+
+		for (i = 0; i < desc->natts; i++)
+		{
+			if (desc->attrs[i]->attnotnull &&
+				att_isnull(i, tuple->t_data->t_bits))
+			{
+				*parsing_field = i + 1;	/* 1 origin */
+				ereport(ERROR,
+						(errcode(ERRCODE_NOT_NULL_VIOLATION),
+						 errmsg("null value in column \"%s\" violates not-null constraint",
+						NameStr(desc->attrs[i]->attname))));
+			}
+		}
+	}
+
+	return tuple;
+}
+
+void
+TupleFormerInit(TupleFormer *former, Filter *filter, TupleDesc desc)
+{
+	AttrNumber			natts;
+	AttrNumber			maxatts;
 	int					i;
 	Oid					in_func_oid;
 
-	former->desc = CreateTupleDescCopy(desc);
-	for (i = 0; i < desc->natts; i++)
-		former->desc->attrs[i]->attnotnull = desc->attrs[i]->attnotnull;
+	former->desc = CreateTupleDescCopy(desc);
+	for (i = 0; i < desc->natts; i++)
+		former->desc->attrs[i]->attnotnull = desc->attrs[i]->attnotnull;
+
+	/*
+	 * allocate buffer to store columns or function arguments
+	 */
+	if (filter->funcstr)
+	{
+		natts = filter->nargs;
+		maxatts = Max(natts, desc->natts);
+	}
+	else
+		natts = maxatts = desc->natts;
+
+	former->values = palloc(sizeof(Datum) * maxatts);
+	former->isnull = palloc(sizeof(bool) * maxatts);
+	MemSet(former->isnull, true, sizeof(bool) * maxatts);
+
+	/*
+	 * get column information of the target relation
+	 */
+	former->typId = (Oid *) palloc(natts * sizeof(Oid));
+	former->typIOParam = (Oid *) palloc(natts * sizeof(Oid));
+	former->typInput = (FmgrInfo *) palloc(natts * sizeof(FmgrInfo));
+	former->typMod = (Oid *) palloc(natts * sizeof(Oid));
+	former->typFast = (FastInputProc *) palloc0(natts * sizeof(FastInputProc));
+	former->fastHits = (int64 *) palloc0(natts * sizeof(int64));
+	former->fastMisses = (int64 *) palloc0(natts * sizeof(int64));
+	former->typFormat = (ColumnFormat **) palloc0(natts * sizeof(ColumnFormat *));
+	former->attnum = palloc(natts * sizeof(int));
+
+	if (filter->funcstr)
+	{
+		if (former->formats != NIL)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("cannot use FILTER with COLUMN_FORMAT")));
+		if (former->fields != NIL)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("cannot use FILTER with FIELDS")));
+
+		former->maxfields = natts;
+		former->minfields = former->maxfields - filter->fn_ndargs;
+
+		for (i = 0; i < natts; i++)
+		{
+			/* get type information and input function */
+			getTypeInputInfo(filter->argtypes[i],
+						 &in_func_oid, &former->typIOParam[i]);
+			fmgr_info(in_func_oid, &former->typInput[i]);
+
+			former->typMod[i] = -1;
+			former->attnum[i] = i;
+			former->typId[i] = filter->argtypes[i];
+			former->typFast[i] = FastInputLookup(former->typId[i], -1);
+		}
+	}
+	else
+	{
+		Form_pg_attribute  *attrs;
+		ListCell		   *cell;
+
+		attrs = desc->attrs;
+		former->maxfields = 0;
+		for (i = 0; i < natts; i++)
+		{
+			/* ignore dropped columns */
+			if (attrs[i]->attisdropped)
+				continue;
+
+			/* get type information and input function */
+			getTypeInputInfo(attrs[i]->atttypid,
+							 &in_func_oid, &former->typIOParam[i]);
+			fmgr_info(in_func_oid, &former->typInput[i]);
+
+			former->typMod[i] = attrs[i]->atttypmod;
+			former->typId[i] = attrs[i]->atttypid;
+			former->typFast[i] = FastInputLookup(former->typId[i],
+												 former->typMod[i]);
+
+			/* update valid column information */
+			former->attnum[former->maxfields] = i;
+			former->maxfields++;
+		}
+
+		former->minfields = former->maxfields;
+
+		/* FIELDS = column, -, ... */
+		if (former->fields != NIL)
+			TupleFormerSetFields(former, former->fields, false);
+
+		/* COLUMN_FORMAT = column:format */
+		foreach(cell, former->formats)
+		{
+			char   *name = pstrdup(lfirst(cell));
+			char   *format = strchr(name, ':');
+
+			*format++ = '\0';
+			for (i = 0; i < natts; i++)
+			{
+				if (!attrs[i]->attisdropped &&
+					strcmp(name, NameStr(attrs[i]->attname)) == 0)
+					break;
+			}
+			if (i == natts)
+				ereport(ERROR,
+						(errcode(ERRCODE_UNDEFINED_COLUMN),
+						 errmsg("invalid column name [%s]", name)));
+			if (former->typFormat[i])
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("COLUMN_FORMAT specified twice for column \"%s\"",
+								name)));
+			former->typFormat[i] = ColumnFormatCreate(format, former->typId[i]);
+			pfree(name);
+		}
+	}
+}
+
+/**
+ * @brief Map the fields of the input to the columns by name.
+ *
+ * A field named "-" is skipped, and so is a field which matches no column if
+ * skip_unknown is true.  Columns without a field are loaded with NULL.
+ */
+void
+TupleFormerSetFields(TupleFormer *former, List *names, bool skip_unknown)
+{
+	TupleDesc	desc = former->desc;
+	bool	   *mapped;
+	ListCell   *cell;
+	int			nfields = 0;
+	int			i;
+
+	mapped = palloc0(Max(desc->natts, 1) * sizeof(bool));
+	former->attnum = repalloc(former->attnum,
+							  Max(list_length(names), 1) * sizeof(int));
+
+	foreach(cell, names)
+	{
+		const char *name = lfirst(cell);
+		int			col = -1;
+
+		if (strcmp(name, "-") != 0)
+		{
+			for (i = 0; i < desc->natts; i++)
+			{
+				if (!desc->attrs[i]->attisdropped &&
+					strcmp(name, NameStr(desc->attrs[i]->attname)) == 0)
+					break;
+			}
+			if (i < desc->natts)
+			{
+				if (mapped[i])
+					ereport(ERROR,
+							(errcode(ERRCODE_DUPLICATE_COLUMN),
+							 errmsg("column \"%s\" specified more than once",
+									name)));
+				mapped[i] = true;
+				col = i;
+			}
+			else if (!skip_unknown)
+				ereport(ERROR,
+						(errcode(ERRCODE_UNDEFINED_COLUMN),
+						 errmsg("invalid column name [%s]", name)));
+		}
+		former->attnum[nfields++] = col;
+	}
+
+	former->maxfields = former->minfields = nfields;
+
+	/* the mapping may change between input files */
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (!mapped[i])
+		{
+			former->values[i] = (Datum) 0;
+			former->isnull[i] = true;
+		}
+	}
+	pfree(mapped);
+}
+
+/**
+ * @brief Parse a parameter for TupleFormer.
+ */
+bool
+TupleFormerParam(TupleFormer *former, const char *keyword, char *value)
+{
+	if (CompareKeyword(keyword, "COLUMN_FORMAT"))
+	{
+		if (strchr(value, ':') == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("invalid COLUMN_FORMAT \"%s\"", value),
+					 errhint("COLUMN_FORMAT must be column:format.")));
+		former->formats = lappend(former->formats, pstrdup(value));
+	}
+	else if (CompareKeyword(keyword, "FIELDS"))
+	{
+		char	   *p = value;
+
+		ASSERT_ONCE(former->fields == NIL);
+		for (;;)
+		{
+			char   *next = strchr(p, ',');
+			char   *end = next ? next : p + strlen(p);
+
+			while (isspace((unsigned char) *p))
+				p++;
+			while (end > p && isspace((unsigned char) end[-1]))
+				end--;
+			if (end == p)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("invalid FIELDS \"%s\"", value),
+						 errhint("FIELDS must be a comma-separated list of column names or \"-\".")));
+			former->fields = lappend(former->fields, pnstrdup(p, end - p));
+			if (next == NULL)
+				break;
+			p = next + 1;
+		}
+	}
+	else
+		return false;	/* unknown parameter */
+
+	return true;
+}
+
+/*
+ * Dump TupleFormer options which are not default.
+ */
+void
+TupleFormerDumpParams(const TupleFormer *former, StringInfo buf)
+{
+	ListCell   *cell;
+
+	if (former->fields != NIL)
+	{
+		StringInfoData	names;
+		char		   *str;
+
+		initStringInfo(&names);
+		foreach(cell, former->fields)
+		{
+			if (names.len > 0)
+				appendStringInfoString(&names, ", ");
+			appendStringInfoString(&names, lfirst(cell));
+		}
+		str = QuoteString(names.data);
+		appendStringInfo(buf, "FIELDS = %s\n", str);
+		pfree(str);
+		pfree(names.data);
+	}
+
+	foreach(cell, former->formats)
+	{
+		char   *str = QuoteString(lfirst(cell));
+
+		appendStringInfo(buf, "COLUMN_FORMAT = %s\n", str);
+		pfree(str);
+	}
+}
+
+void
+TupleFormerTerm(TupleFormer *former)
+{
+	if (former->typFast)
+	{
+		int		i;
+		int		j;
+
+		/* report per type */
+		for (i = 0; i < former->maxfields; i++)
+		{
+			int		col = former->attnum[i];
+			Oid		typid;
+			int64	hits = 0;
+			int64	misses = 0;
+
+			if (col < 0)
+				continue;	/* skipped field */
+			typid = former->typId[col];
+			if (former->typFormat[col])
+			{
+				LoggerLog(INFO, "COLUMN_FORMAT \"%s\": " int64_FMT
+						  " values read by the format, " int64_FMT
+						  " passed to the input function\n",
+						  NameStr(former->desc->attrs[col]->attname),
+						  former->fastHits[col], former->fastMisses[col]);
+				continue;
+			}
+			if (former->typFast[col] == NULL)
+				continue;
+			for (j = 0; j < i; j++)
+			{
+				if (former->attnum[j] >= 0 &&
+					former->typFast[former->attnum[j]] &&
+					!former->typFormat[former->attnum[j]] &&
+					former->typId[former->attnum[j]] == typid)
+					break;
+			}
+			if (j < i)
+				continue;	/* already reported */
+
+			for (j = i; j < former->maxfields; j++)
+			{
+				if (former->attnum[j] >= 0 &&
+					!former->typFormat[former->attnum[j]] &&
+					former->typId[former->attnum[j]] == typid)
+				{
+					hits += former->fastHits[former->attnum[j]];
+					misses += former->fastMisses[former->attnum[j]];
+				}
+			}
+			elog(DEBUG1, "pg_bulkload: fast input of %s: " int64_FMT
+				 " values, " int64_FMT " passed to the input function",
+				 format_type_be(typid), hits, misses);
+		}
+
+		pfree(former->typFast);
+		pfree(former->fastHits);
+		pfree(former->fastMisses);
+		pfree(former->typFormat);
+	}
+
+	if (former->typId)
+		pfree(former->typId);
+
+	if (former->typIOParam)
+		pfree(former->typIOParam);
+
+	if (former->typInput)
+		pfree(former->typInput);
+
+	if (former->values)
+		pfree(former->values);
+
+	if (former->isnull)
+		pfree(former->isnull);
+
+	if (former->attnum)
+		pfree(former->attnum);
+
+	if (former->desc)
+		FreeTupleDesc(former->desc);
+}
+
+HeapTuple
+TupleFormerTuple(TupleFormer *former)
+{
+	return heap_form_tuple(former->desc, former->values, former->isnull);
+}
+
+static HeapTuple
+TupleFormerNullTuple(TupleFormer *former)
+{
+	memset(former->values, 0, former->desc->natts * sizeof(Datum));
+	memset(former->isnull, true, former->desc->natts * sizeof(bool));
+
+	return TupleFormerTuple(former);
+}
+
+/* Read null-terminated string and convert to internal format */
+Datum
+TupleFormerValue(TupleFormer *former, const char *str, int col)
+{
+	if (former->typFormat[col])
+	{
+		Datum	value;
+
+		if (ColumnFormatInput(former->typFormat[col], str,
+							  former->typMod[col], &value))
+		{
+			former->fastHits[col]++;
+			return value;
+		}
+		former->fastMisses[col]++;
+	}
+	else if (former->typFast[col])
+	{
+		Datum	value;
+
+		if (former->typFast[col](str, former->typMod[col], &value))
+		{
+			former->fastHits[col]++;
+			return value;
+		}
+		former->fastMisses[col]++;
+	}
+
+	return FunctionCall3(&former->typInput[col],
+		CStringGetDatum(str),
+		ObjectIdGetDatum(former->typIOParam[col]),
+		Int32GetDatum(former->typMod[col]));
+}
+
+/*
+ * Check that function result tuple type (src_tupdesc) matches or can
+ * be considered to match what the target table (dst_tupdesc). If
+ * they don't match, ereport.
+ *
+ * We really only care about number of attributes and data type.
+ * Also, we can ignore type mismatch on columns that are dropped in the
+ * destination type, so long as the physical storage matches.  This is
+ * helpful in some cases involving out-of-date cached plans.
+ */
+bool
+tupledesc_match(TupleDesc dst_tupdesc, TupleDesc src_tupdesc)
+{
+	int			i;
+
+	if (dst_tupdesc->tdhasoid != src_tupdesc->tdhasoid)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATATYPE_MISMATCH),
+				 errmsg("function return record definition and target table record definition do not match"),
+				 errdetail("Returned record hasoid %d, but target table hasoid %d.",
+						   src_tupdesc->tdhasoid, dst_tupdesc->tdhasoid)));
+
+	if (dst_tupdesc->natts != src_tupdesc->natts)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATATYPE_MISMATCH),
+				 errmsg("function return row and target table row do not match"),
+				 errdetail("Returned row contains %d attribute(s), but target table expects %d.",
+						   src_tupdesc->natts, dst_tupdesc->natts)));
+
+	for (i = 0; i < dst_tupdesc->natts; i++)
+	{
+		Form_pg_attribute dattr = dst_tupdesc->attrs[i];
+		Form_pg_attribute sattr = src_tupdesc->attrs[i];
+
+		if (dattr->atttypid == sattr->atttypid)
+			continue;			/* no worries */
+		if (!dattr->attisdropped)
+			return false;
+
+		if (dattr->attlen != sattr->attlen ||
+			dattr->attalign != sattr->attalign)
+			return false;
+	}
+
+	return true;
+}
+
+TupleCheckStatus
+FilterInit(Filter *filter, TupleDesc desc, Oid collation)
+{
+	int				i;
+	ParsedFunction	func;
+	HeapTuple		ftup;
+	Form_pg_proc	pp;
+	TupleCheckStatus	status = NEED_COERCION_CHECK;
+
+	if (filter->funcstr == NULL)
+		return NO_COERCION;
+
+	/* parse filter function */
+	func = ParseFunction(filter->funcstr, true);
+
+	filter->funcid = func.oid;
+	filter->nargs = func.nargs;
+	for (i = 0; i < filter->nargs; i++)
+	{
+		/* Check for polymorphic types and internal pseudo-type argument */
+		if (IsPolymorphicType(func.argtypes[i]) ||
+			func.argtypes[i] == INTERNALOID)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("filter function does not support a polymorphic function and having a internal pseudo-type argument function: %s",
+							get_func_name(filter->funcid))));
+
+		filter->argtypes[i] = func.argtypes[i];
+	}
+
+	ftup = SearchSysCache(PROCOID, ObjectIdGetDatum(filter->funcid), 0, 0, 0);
+	pp = (Form_pg_proc) GETSTRUCT(ftup);
+
+	/*
+	 * A function taking arrays and returning a set is called with arrays of
+	 * the records, and returns a row for each record. The records are read
+	 * as the element types.
+	 */
+	if (pp->proretset)
+	{
+		filter->array = filter->nargs > 0;
+		for (i = 0; i < filter->nargs; i++)
+		{
+			if (!OidIsValid(get_element_type(filter->argtypes[i])))
+				filter->array = false;
+		}
+
+		if (!filter->array)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("filter function must not return set")));
+#if PG_VERSION_NUM >= 80400
+		if (pp->pronargdefaults > 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("filter function taking arrays must not have default arguments")));
+#endif
+
+		for (i = 0; i < filter->nargs; i++)
+			filter->argtypes[i] = get_element_type(filter->argtypes[i]);
+	}
+
+	filter->arglen = palloc(Max(filter->nargs, 1) * sizeof(int16));
+	filter->argbyval = palloc(Max(filter->nargs, 1) * sizeof(bool));
+	filter->argalign = palloc(Max(filter->nargs, 1) * sizeof(char));
+	for (i = 0; i < filter->nargs; i++)
+		get_typlenbyvalalign(filter->argtypes[i], &filter->arglen[i],
+							 &filter->argbyval[i], &filter->argalign[i]);
+
+	/* Check data type of the function result value */
+	if (pp->prorettype == desc->tdtypeid && pp->prorettype != RECORDOID)
+		status = NO_COERCION;
+	else if (pp->prorettype == RECORDOID)
+	{
+		TupleDesc	resultDesc = NULL;
+
+		/* Check for OUT parameters defining a RECORD result */
+		resultDesc = build_function_result_tupdesc_t(ftup);
+
+		if (resultDesc)
+		{
+			if (tupledesc_match(desc, resultDesc))
+				status = NO_COERCION;
+
+			FreeTupleDesc(resultDesc);
+		}
+	}
+	else if (get_typtype(pp->prorettype) != TYPTYPE_COMPOSITE)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATATYPE_MISMATCH),
+				 errmsg("function return data type and target table data type do not match")));
+
+	/* Get default values */
+#if PG_VERSION_NUM >= 80400
+	filter->fn_ndargs = pp->pronargdefaults;
+	if (filter->fn_ndargs > 0)
+	{
+		Datum		proargdefaults;
+		bool		isnull;
+		char	   *str;
+		List	   *defaults;
+		ListCell   *l;
+
+		filter->defaultValues = palloc(sizeof(Datum) * filter->fn_ndargs);
+		filter->defaultIsnull = palloc(sizeof(bool) * filter->fn_ndargs);
+
+		proargdefaults = SysCacheGetAttr(PROCOID, ftup,
+										 Anum_pg_proc_proargdefaults,
+										 &isnull);
+		Assert(!isnull);
+		str = TextDatumGetCString(proargdefaults);
+		defaults = (List *) stringToNode(str);
+		Assert(IsA(defaults, List));
+		pfree(str);
+
+		filter->econtext = CreateStandaloneExprContext();
+		i = 0;
+		foreach(l, defaults)
+		{
+			Expr		   *expr = (Expr *) lfirst(l);
+			ExprState	   *argstate;
+			ExprDoneCond	thisArgIsDone;
+
+			argstate = ExecInitExpr(expr, NULL);
+
+			filter->defaultValues[i] = ExecEvalExpr(argstate,
+													filter->econtext,
+													&filter->defaultIsnull[i],
+													&thisArgIsDone);
+
+			if (thisArgIsDone != ExprSingleResult)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("functions and operators can take at most one set argument")));
+
+			i++;
+		}
+	}
+
+	if (OidIsValid(pp->provariadic))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("filter function does not support a valiadic function %s",
+						get_func_name(filter->funcid))));
+#else
+	filter->fn_ndargs = 0;
+#endif
+
+	/* Arrays of the records are never NULL. */
+	filter->fn_strict = pp->proisstrict && !filter->array;
+	filter->fn_rettype = pp->prorettype;
+
+	filter->collation = collation;
+
+#if PG_VERSION_NUM >= 80400
+	if (!filter->array)
+		FilterInline(filter, ftup, desc);
+	if (filter->exprs)
+		status = NO_COERCION;
+
+	/*
+	 * Inlined expressions share the sub-transaction of the records read at
+	 * a time unless FILTER_BATCH is given, so they do not pay for one per row.
+	 */
+	if (filter->exprs && filter->batch_size == 0 && filter->read_size > 1)
+		filter->batch_size = filter->read_size;
+#endif
+
+	if (filter->array)
+	{
+		filter->desc = CreateTupleDescCopy(desc);
+		if (filter->econtext == NULL)
+			filter->econtext = CreateStandaloneExprContext();
+	}
+
+	/*
+	 * Results of an IMMUTABLE function depend only on the arguments, and are
+	 * cached by them. Rows returned for arrays of records are not.
+	 */
+	if (pp->provolatile == PROVOLATILE_IMMUTABLE && !filter->array &&
+		filter->cache_size > 0)
+	{
+		int		nslots = 2;
+
+		while (nslots < filter->cache_size * 2)
+			nslots *= 2;
+		filter->cache = palloc0(nslots * sizeof(FilterCacheEntry));
+		filter->cache_mask = nslots - 1;
+		filter->cache_context = AllocSetContextCreate(CurrentMemoryContext,
+													  "FilterCache",
+													  ALLOCSET_DEFAULT_MINSIZE,
+													  ALLOCSET_DEFAULT_INITSIZE,
+													  ALLOCSET_DEFAULT_MAXSIZE);
+	}
+
+	ReleaseSysCache(ftup);
+
+	/* The function is looked up once, and called with the same fcinfo. */
+	fmgr_info(filter->funcid, &filter->flinfo);
+#if PG_VERSION_NUM >= 90100
+	InitFunctionCallInfoData(filter->fcinfo, &filter->flinfo, filter->nargs,
+							 filter->collation, NULL, NULL);
+#else
+	InitFunctionCallInfoData(filter->fcinfo, &filter->flinfo, filter->nargs,
+							 NULL, NULL);
+#endif
+
+	if (filter->batch_size > 1)
+	{
+		int		n = filter->batch_size * Max(filter->nargs, 1);
+
+		filter->batch_called = palloc(filter->batch_size * sizeof(bool));
+		filter->batch_args = palloc(n * sizeof(Datum));
+		filter->batch_nulls = palloc(n * sizeof(bool));
+		filter->batch_tuples = palloc(filter->batch_size * sizeof(HeapTuple));
+	}
+
+	return status;
+}
+
+void
+FilterTerm(Filter *filter)
+{
+	if (filter->funcstr)
+		pfree(filter->funcstr);
+	if (filter->defaultValues)
+		pfree(filter->defaultValues);
+	if (filter->defaultIsnull)
+		pfree(filter->defaultIsnull);
+	if (filter->econtext)
+		FreeExprContext(filter->econtext, true);
+	if (filter->batch_args)
+	{
+		pfree(filter->batch_called);
+		pfree(filter->batch_args);
+		pfree(filter->batch_nulls);
+		pfree(filter->batch_tuples);
+	}
+	if (filter->desc)
+		FreeTupleDesc(filter->desc);
+	if (filter->arglen)
+	{
+		pfree(filter->arglen);
+		pfree(filter->argbyval);
+		pfree(filter->argalign);
+	}
+
+	if (filter->cache_hits + filter->cache_misses > 0)
+		LoggerLog(INFO, "FILTER cache: " int64_FMT " hits, " int64_FMT
+				  " misses%s\n", filter->cache_hits, filter->cache_misses,
+				  filter->cache ? "" : " (disabled for the low hit rate)");
+	if (filter->cache)
+		pfree(filter->cache);
+	if (filter->cache_context)
+		MemoryContextDelete(filter->cache_context);
+}
+
+#if PG_VERSION_NUM >= 80400
+/*
+ * Compile a SQL function that is a single SELECT without FROM into the
+ * expressions of the columns, which are evaluated without calling the
+ * function. filter->exprs is left NULL if the function cannot be inlined,
+ * and then it is called as usual.
+ */
+static void
+FilterInline(Filter *filter, HeapTuple ftup, TupleDesc desc)
+{
+	Form_pg_proc	pp = (Form_pg_proc) GETSTRUCT(ftup);
+	MemoryContext	oldcontext = CurrentMemoryContext;
+	ResourceOwner	oldowner = CurrentResourceOwner;
+	Datum			prosrc;
+	bool			isnull;
+	char		   *src;
+	int				i;
+
+	if (pp->prolang != SQLlanguageId ||
+		pp->prosecdef ||
+		!heap_attisnull(ftup, Anum_pg_proc_proconfig))
+		return;
+
+	prosrc = SysCacheGetAttr(PROCOID, ftup, Anum_pg_proc_prosrc, &isnull);
+	if (isnull)
+		return;
+	src = TextDatumGetCString(prosrc);
+
+	/*
+	 * Analyze the function body inside a sub-transaction, so an error only
+	 * means the function is not inlined.
+	 */
+	BeginInternalSubTransaction(NULL);
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_TRY();
+	{
+		FilterInlineQuery(filter, ftup, src, desc);
+
+		ReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(oldcontext);
+		FlushErrorState();
+		RollbackAndReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
+
+		filter->exprs = NULL;
+	}
+	PG_END_TRY();
 
-	/*
-	 * allocate buffer to store columns or function arguments
-	 */
-	if (filter->funcstr)
+	pfree(src);
+
+	if (filter->exprs == NULL)
+		return;
+
+	/* Arguments are passed to the expressions as parameters. */
+	if (filter->econtext == NULL)
+		filter->econtext = CreateStandaloneExprContext();
+	filter->econtext->ecxt_param_list_info = palloc0(
+		offsetof(ParamListInfoData, params) +
+		Max(filter->nargs, 1) * sizeof(ParamExternData));
+	filter->econtext->ecxt_param_list_info->numParams = filter->nargs;
+	for (i = 0; i < filter->nargs; i++)
 	{
-		natts = filter->nargs;
-		maxatts = Max(natts, desc->natts);
+		filter->econtext->ecxt_param_list_info->params[i].ptype = filter->argtypes[i];
+		filter->econtext->ecxt_param_list_info->params[i].pflags = PARAM_FLAG_CONST;
 	}
-	else
-		natts = maxatts = desc->natts;
 
-	former->values = palloc(sizeof(Datum) * maxatts);
-	former->isnull = palloc(sizeof(bool) * maxatts);
-	MemSet(former->isnull, true, sizeof(bool) * maxatts);
+	filter->values = palloc(desc->natts * sizeof(Datum));
+	filter->nulls = palloc(desc->natts * sizeof(bool));
+}
+
+static void
+FilterInlineQuery(Filter *filter, HeapTuple ftup, char *src, TupleDesc desc)
+{
+	List		   *raw_parsetree_list;
+	Query		   *query;
+	ExprState	  **exprs;
+	ListCell	   *cell;
+	int				attnum;
+#if PG_VERSION_NUM >= 90200
+	SQLFunctionParseInfoPtr	pinfo;
+	ParseState	   *pstate;
+#endif
+
+	raw_parsetree_list = pg_parse_query(src);
+	if (list_length(raw_parsetree_list) != 1)
+		return;
+
+#if PG_VERSION_NUM >= 90200
+	/* Arguments might be referred by name. */
+	pinfo = prepare_sql_fn_parse_info(ftup, NULL, filter->collation);
+	pstate = make_parsestate(NULL);
+	pstate->p_sourcetext = src;
+	sql_fn_parser_setup(pstate, pinfo);
+	query = transformTopLevelStmt(pstate, linitial(raw_parsetree_list));
+	free_parsestate(pstate);
+#else
+	query = parse_analyze(linitial(raw_parsetree_list), src,
+						  filter->argtypes, filter->nargs);
+#endif
+
+	/* Only a SELECT of expressions of the arguments can be inlined. */
+	if (!IsA(query, Query) ||
+		query->commandType != CMD_SELECT ||
+		query->utilityStmt ||
+#if PG_VERSION_NUM < 90200
+		query->intoClause ||
+#endif
+		query->hasAggs ||
+		query->hasWindowFuncs ||
+		query->hasSubLinks ||
+		query->cteList ||
+		query->rtable ||
+		query->jointree->fromlist ||
+		query->jointree->quals ||
+		query->groupClause ||
+		query->havingQual ||
+		query->windowClause ||
+		query->distinctClause ||
+		query->sortClause ||
+		query->limitOffset ||
+		query->limitCount ||
+		query->setOperations)
+		return;
 
 	/*
-	 * get column information of the target relation
+	 * The expressions must give the columns of the target table in order,
+	 * in the same types. Dropped columns are NULL.
 	 */
-	former->typId = (Oid *) palloc(natts * sizeof(Oid));
-	former->typIOParam = (Oid *) palloc(natts * sizeof(Oid));
-	former->typInput = (FmgrInfo *) palloc(natts * sizeof(FmgrInfo));
-	former->typMod = (Oid *) palloc(natts * sizeof(Oid));
-	former->attnum = palloc(natts * sizeof(int));
+	exprs = palloc0(desc->natts * sizeof(ExprState *));
+	attnum = 0;
+	foreach(cell, query->targetList)
+	{
+		TargetEntry	   *tle = (TargetEntry *) lfirst(cell);
+		Expr		   *expr;
 
-	if (filter->funcstr)
+		if (tle->resjunk)
+			continue;
+
+		while (attnum < desc->natts && desc->attrs[attnum]->attisdropped)
+			attnum++;
+		if (attnum >= desc->natts ||
+			exprType((Node *) tle->expr) != desc->attrs[attnum]->atttypid)
+			return;
+
+		expr = expression_planner(tle->expr);
+		if (expression_returns_set((Node *) expr))
+			return;
+
+		exprs[attnum++] = ExecInitExpr(expr, NULL);
+	}
+
+	while (attnum < desc->natts && desc->attrs[attnum]->attisdropped)
+		attnum++;
+	if (attnum < desc->natts)
+		return;
+
+	filter->desc = CreateTupleDescCopy(desc);
+	filter->exprs = exprs;
+}
+#endif
+
+/*
+ * Evaluate the expressions of the inlined function with the arguments in
+ * filter->fcinfo, and return the row as the function would.
+ */
+static Datum
+FilterEval(Filter *filter)
+{
+	FunctionCallInfo	fcinfo = &filter->fcinfo;
+	ExprContext		   *econtext = filter->econtext;
+	ParamListInfo		params = econtext->ecxt_param_list_info;
+	HeapTuple			tuple;
+	int					i;
+
+	ResetExprContext(econtext);
+
+	for (i = 0; i < filter->nargs; i++)
 	{
-		former->maxfields = natts;
-		former->minfields = former->maxfields - filter->fn_ndargs;
+		params->params[i].value = fcinfo->arg[i];
+		params->params[i].isnull = fcinfo->argnull[i];
+	}
 
-		for (i = 0; i < natts; i++)
+	for (i = 0; i < filter->desc->natts; i++)
+	{
+		ExprDoneCond	isDone;
+
+		if (filter->exprs[i] == NULL)
 		{
-			/* get type information and input function */
-			getTypeInputInfo(filter->argtypes[i],
-						 &in_func_oid, &former->typIOParam[i]);
-			fmgr_info(in_func_oid, &former->typInput[i]);
+			filter->values[i] = (Datum) 0;
+			filter->nulls[i] = true;
+			continue;
+		}
 
-			former->typMod[i] = -1;
-			former->attnum[i] = i;
-			former->typId[i] = filter->argtypes[i];
+		filter->values[i] = ExecEvalExpr(filter->exprs[i], econtext,
+										 &filter->nulls[i], &isDone);
+	}
+
+	tuple = heap_form_tuple(filter->desc, filter->values, filter->nulls);
+
+	return PointerGetDatum(tuple->t_data);
+}
+
+HeapTuple
+FilterTuple(Filter *filter, TupleFormer *former, int *parsing_field)
+{
+	FunctionCallInfo	fcinfo = &filter->fcinfo;
+	HeapTuple			tuple;
+	Datum				datum;
+	uint32				hash = 0;
+	int					slot = 0;
+	int					i;
+
+	/*
+	 * If function is strict, and there are any NULL arguments, return tuple,
+	 * it's all columns of null.
+	 */
+	if (filter->fn_strict)
+	{
+		for (i = 0; i < filter->nargs; i++)
+		{
+			if (former->isnull[i])
+			{
+				FilterBatchSkip(filter);
+				return TupleFormerNullTuple(former);
+			}
 		}
 	}
-	else
+
+	for (i = 0; i < filter->nargs; i++)
 	{
-		Form_pg_attribute  *attrs;
+		fcinfo->arg[i] = former->values[i];
+		fcinfo->argnull[i] = former->isnull[i];
+	}
 
-		attrs = desc->attrs;
-		former->maxfields = 0;
-		for (i = 0; i < natts; i++)
+	/* A cached result needs neither the call nor a sub-transaction. */
+	if (filter->cache)
+	{
+		hash = FilterCacheHash(filter);
+		slot = FilterCacheLookup(filter, hash);
+		if (filter->cache[slot].args)
 		{
-			/* ignore dropped columns */
-			if (attrs[i]->attisdropped)
-				continue;
+			filter->cache_hits++;
+			FilterBatchSkip(filter);
+			if (filter->cache[slot].tuple == NULL)
+				return TupleFormerNullTuple(former);
+			return heap_copytuple(filter->cache[slot].tuple);
+		}
+		filter->cache_misses++;
+	}
 
-			/* get type information and input function */
-			getTypeInputInfo(attrs[i]->atttypid,
-							 &in_func_oid, &former->typIOParam[i]);
-			fmgr_info(in_func_oid, &former->typInput[i]);
+	*parsing_field = 0;
+	if (filter->batch_size > 1)
+		datum = FilterBatchCall(filter, former, parsing_field);
+	else
+		datum = FilterCall(filter);
+	*parsing_field = -1;
 
-			former->typMod[i] = attrs[i]->atttypmod;
-			former->typId[i] = attrs[i]->atttypid;
+	tuple = FilterResultTuple(filter, datum);
 
-			/* update valid column information */
-			former->attnum[former->maxfields] = i;
-			former->maxfields++;
-		}
+	if (filter->cache)
+		FilterCacheInsert(filter, hash, slot, tuple);
 
-		former->minfields = former->maxfields;
-	}
+	/*
+	 * If function result is NULL, return tuple, it's all columns of null.
+	 */
+	if (tuple == NULL)
+		return TupleFormerNullTuple(former);
+
+	return tuple;
 }
 
-void
-TupleFormerTerm(TupleFormer *former)
+/*
+ * Make a tuple of the row returned by the function, or NULL if the function
+ * returned NULL.
+ */
+static HeapTuple
+FilterResultTuple(Filter *filter, Datum datum)
 {
-	if (former->typId)
-		pfree(former->typId);
+	HeapTuple	tuple;
 
-	if (former->typIOParam)
-		pfree(former->typIOParam);
+	if (filter->fcinfo.isnull)
+		return NULL;
 
-	if (former->typInput)
-		pfree(former->typInput);
+	/* Tuples read at a time must not share the header. */
+	tuple = (HeapTuple) palloc0(HEAPTUPLESIZE);
+	tuple->t_data = DatumGetHeapTupleHeader(datum);
+	tuple->t_len = HeapTupleHeaderGetDatumLength(tuple->t_data);
 
-	if (former->values)
-		pfree(former->values);
+	return tuple;
+}
 
-	if (former->isnull)
-		pfree(former->isnull);
+/*
+ * Hash the arguments in filter->fcinfo by their binary images.
+ */
+static uint32
+FilterCacheHash(Filter *filter)
+{
+	FunctionCallInfo	fcinfo = &filter->fcinfo;
+	uint32				hash = 0;
+	int					i;
 
-	if (former->attnum)
-		pfree(former->attnum);
+	for (i = 0; i < filter->nargs; i++)
+	{
+		Datum	value = fcinfo->arg[i];
+		uint32	h;
+
+		if (fcinfo->argnull[i])
+			h = 0;
+		else if (filter->argbyval[i])
+			h = DatumGetUInt32(hash_any((unsigned char *) &value,
+										sizeof(Datum)));
+		else
+			h = DatumGetUInt32(hash_any((unsigned char *) DatumGetPointer(value),
+										datumGetSize(value, false,
+													 filter->arglen[i])));
 
-	if (former->desc)
-		FreeTupleDesc(former->desc);
-}
+		hash = ((hash << 1) | (hash >> 31)) ^ h;
+	}
 
-HeapTuple
-TupleFormerTuple(TupleFormer *former)
-{
-	return heap_form_tuple(former->desc, former->values, former->isnull);
+	return hash;
 }
 
-static HeapTuple
-TupleFormerNullTuple(TupleFormer *former)
+/*
+ * Find the slot of the arguments in filter->fcinfo, or the empty slot to
+ * insert them. There is always an empty slot because the table has twice
+ * the max entries.
+ */
+static int
+FilterCacheLookup(Filter *filter, uint32 hash)
 {
-	memset(former->values, 0, former->desc->natts * sizeof(Datum));
-	memset(former->isnull, true, former->desc->natts * sizeof(bool));
+	FunctionCallInfo	fcinfo = &filter->fcinfo;
+	int					slot = hash & filter->cache_mask;
 
-	return TupleFormerTuple(former);
+	for (;; slot = (slot + 1) & filter->cache_mask)
+	{
+		FilterCacheEntry   *entry = &filter->cache[slot];
+		int					i;
+
+		if (entry->args == NULL)
+			return slot;
+		if (entry->hash != hash)
+			continue;
+
+		for (i = 0; i < filter->nargs; i++)
+		{
+			if (entry->nulls[i] != fcinfo->argnull[i])
+				break;
+			if (!entry->nulls[i] &&
+				!datumIsEqual(entry->args[i], fcinfo->arg[i],
+							  filter->argbyval[i], filter->arglen[i]))
+				break;
+		}
+		if (i == filter->nargs)
+			return slot;
+	}
 }
 
-/* Read null-terminated string and convert to internal format */
-Datum
-TupleFormerValue(TupleFormer *former, const char *str, int col)
+/*
+ * Cache the row for the arguments in filter->fcinfo at the slot given by
+ * FilterCacheLookup(). The cache is emptied when it is full, and disabled
+ * when the hit rate is low.
+ */
+static void
+FilterCacheInsert(Filter *filter, uint32 hash, int slot, HeapTuple tuple)
 {
-	return FunctionCall3(&former->typInput[col],
-		CStringGetDatum(str),
-		ObjectIdGetDatum(former->typIOParam[col]),
-		Int32GetDatum(former->typMod[col]));
+	FunctionCallInfo	fcinfo = &filter->fcinfo;
+	FilterCacheEntry   *entry;
+	MemoryContext		oldcontext;
+	int64				calls = filter->cache_hits + filter->cache_misses;
+	int					i;
+
+	if (calls >= FILTER_CACHE_WINDOW &&
+		filter->cache_hits * FILTER_CACHE_MIN_RATE < calls)
+	{
+		pfree(filter->cache);
+		filter->cache = NULL;
+		MemoryContextDelete(filter->cache_context);
+		filter->cache_context = NULL;
+		return;
+	}
+
+	if (filter->cache_entries >= filter->cache_size)
+	{
+		memset(filter->cache, 0,
+			   (filter->cache_mask + 1) * sizeof(FilterCacheEntry));
+		MemoryContextReset(filter->cache_context);
+		filter->cache_entries = 0;
+		slot = hash & filter->cache_mask;
+	}
+
+	oldcontext = MemoryContextSwitchTo(filter->cache_context);
+
+	entry = &filter->cache[slot];
+	entry->hash = hash;
+	entry->args = palloc(Max(filter->nargs, 1) * sizeof(Datum));
+	entry->nulls = palloc(Max(filter->nargs, 1) * sizeof(bool));
+	for (i = 0; i < filter->nargs; i++)
+	{
+		entry->nulls[i] = fcinfo->argnull[i];
+		entry->args[i] = fcinfo->argnull[i] ? (Datum) 0 :
+			datumCopy(fcinfo->arg[i], filter->argbyval[i], filter->arglen[i]);
+	}
+	entry->tuple = tuple ? heap_copytuple(tuple) : NULL;
+	filter->cache_entries++;
+
+	MemoryContextSwitchTo(oldcontext);
 }
 
 /*
- * Check that function result tuple type (src_tupdesc) matches or can
- * be considered to match what the target table (dst_tupdesc). If
- * they don't match, ereport.
- *
- * We really only care about number of attributes and data type.
- * Also, we can ignore type mismatch on columns that are dropped in the
- * destination type, so long as the physical storage matches.  This is
- * helpful in some cases involving out-of-date cached plans.
+ * Call the filter function with the arguments in filter->fcinfo.
  */
-bool
-tupledesc_match(TupleDesc dst_tupdesc, TupleDesc src_tupdesc)
+static Datum
+FilterInvoke(Filter *filter)
 {
-	int			i;
+#if PG_VERSION_NUM >= 80400
+	PgStat_FunctionCallUsage	fcusage;
+#endif
+	FunctionCallInfo	fcinfo = &filter->fcinfo;
+	Datum				datum;
 
-	if (dst_tupdesc->tdhasoid != src_tupdesc->tdhasoid)
-		ereport(ERROR,
-				(errcode(ERRCODE_DATATYPE_MISMATCH),
-				 errmsg("function return record definition and target table record definition do not match"),
-				 errdetail("Returned record hasoid %d, but target table hasoid %d.",
-						   src_tupdesc->tdhasoid, dst_tupdesc->tdhasoid)));
+	fcinfo->isnull = false;
 
-	if (dst_tupdesc->natts != src_tupdesc->natts)
-		ereport(ERROR,
-				(errcode(ERRCODE_DATATYPE_MISMATCH),
-				 errmsg("function return row and target table row do not match"),
-				 errdetail("Returned row contains %d attribute(s), but target table expects %d.",
-						   src_tupdesc->natts, dst_tupdesc->natts)));
+	/* Inlined functions are not counted, as in queries. */
+	if (filter->exprs)
+		return FilterEval(filter);
 
-	for (i = 0; i < dst_tupdesc->natts; i++)
+	/* A record is passed in arrays of one element. */
+	if (filter->array)
 	{
-		Form_pg_attribute dattr = dst_tupdesc->attrs[i];
-		Form_pg_attribute sattr = src_tupdesc->attrs[i];
+		HeapTuple	tuple;
 
-		if (dattr->atttypid == sattr->atttypid)
-			continue;			/* no worries */
-		if (!dattr->attisdropped)
-			return false;
+		FilterArrayInvoke(filter, fcinfo->arg, fcinfo->argnull, 1, &tuple);
+		return PointerGetDatum(tuple->t_data);
+	}
 
-		if (dattr->attlen != sattr->attlen ||
-			dattr->attalign != sattr->attalign)
-			return false;
+	pgstat_init_function_usage(fcinfo, &fcusage);
+
+	PG_TRY();
+	{
+		datum = FunctionCallInvoke(fcinfo);
+	}
+	PG_CATCH();
+	{
+		pgstat_end_function_usage(&fcusage, true);
+		PG_RE_THROW();
 	}
+	PG_END_TRY();
+
+	pgstat_end_function_usage(&fcusage, true);
 
-	return true;
+	return datum;
 }
 
-TupleCheckStatus
-FilterInit(Filter *filter, TupleDesc desc, Oid collation)
+/*
+ * Call the filter function inside a sub-transaction of its own, so we can
+ * cope with errors sanely.
+ */
+static Datum
+FilterCall(Filter *filter)
 {
-	int				i;
-	ParsedFunction	func;
-	HeapTuple		ftup;
-	Form_pg_proc	pp;
-	TupleCheckStatus	status = NEED_COERCION_CHECK;
+	MemoryContext	oldcontext = CurrentMemoryContext;
+	ResourceOwner	oldowner = CurrentResourceOwner;
+	Datum			datum;
 
-	if (filter->funcstr == NULL)
-		return NO_COERCION;
+	BeginInternalSubTransaction(NULL);
 
-	/* parse filter function */
-	func = ParseFunction(filter->funcstr, true);
+	/* Want to run inside per tuple memory context */
+	MemoryContextSwitchTo(oldcontext);
 
-	filter->funcid = func.oid;
-	filter->nargs = func.nargs;
-	for (i = 0; i < filter->nargs; i++)
+	PG_TRY();
 	{
-		/* Check for polymorphic types and internal pseudo-type argument */
-		if (IsPolymorphicType(func.argtypes[i]) ||
-			func.argtypes[i] == INTERNALOID)
-			ereport(ERROR,
-					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					 errmsg("filter function does not support a polymorphic function and having a internal pseudo-type argument function: %s",
-							get_func_name(filter->funcid))));
-
-		filter->argtypes[i] = func.argtypes[i];
+		datum = FilterInvoke(filter);
 	}
-
-	ftup = SearchSysCache(PROCOID, ObjectIdGetDatum(filter->funcid), 0, 0, 0);
-	pp = (Form_pg_proc) GETSTRUCT(ftup);
-
-	if (pp->proretset)
-		ereport(ERROR,
-				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-				 errmsg("filter function must not return set")));
-
-	/* Check data type of the function result value */
-	if (pp->prorettype == desc->tdtypeid && pp->prorettype != RECORDOID)
-		status = NO_COERCION;
-	else if (pp->prorettype == RECORDOID)
+	PG_CATCH();
 	{
-		TupleDesc	resultDesc = NULL;
+		/* Abort the inner transaction */
+		RollbackAndReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
 
-		/* Check for OUT parameters defining a RECORD result */
-		resultDesc = build_function_result_tupdesc_t(ftup);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
 
-		if (resultDesc)
-		{
-			if (tupledesc_match(desc, resultDesc))
-				status = NO_COERCION;
+	/* Commit the inner transaction, return to outer xact context */
+	ReleaseCurrentSubTransaction();
+	MemoryContextSwitchTo(oldcontext);
+	CurrentResourceOwner = oldowner;
 
-			FreeTupleDesc(resultDesc);
-		}
-	}
-	else if (get_typtype(pp->prorettype) != TYPTYPE_COMPOSITE)
-		ereport(ERROR,
-				(errcode(ERRCODE_DATATYPE_MISMATCH),
-				 errmsg("function return data type and target table data type do not match")));
+	return datum;
+}
 
-	/* Get default values */
+/*
+ * Call the filter function taking arrays for nrows records, and store the
+ * row returned for each record to tuples. The argument i of the record r is
+ * in args[i * nrows + r]. The function must return a row for each record in
+ * the order of the records.
+ */
+static void
+FilterArrayInvoke(Filter *filter, Datum *args, bool *nulls, int nrows,
+				  HeapTuple *tuples)
+{
 #if PG_VERSION_NUM >= 80400
-	filter->fn_ndargs = pp->pronargdefaults;
-	if (filter->fn_ndargs > 0)
+	PgStat_FunctionCallUsage	fcusage;
+#endif
+	FunctionCallInfoData	fcinfo;
+	ReturnSetInfo			rsinfo;
+	volatile int			n = 0;
+	int						dims[1];
+	int						lbs[1];
+	int						i;
+
+#if PG_VERSION_NUM >= 90100
+	InitFunctionCallInfoData(fcinfo, &filter->flinfo, filter->nargs,
+							 filter->collation, NULL, (Node *) &rsinfo);
+#else
+	InitFunctionCallInfoData(fcinfo, &filter->flinfo, filter->nargs,
+							 NULL, (Node *) &rsinfo);
+#endif
+
+	dims[0] = nrows;
+	lbs[0] = 1;
+	for (i = 0; i < filter->nargs; i++)
 	{
-		Datum		proargdefaults;
-		bool		isnull;
-		char	   *str;
-		List	   *defaults;
-		ListCell   *l;
+		fcinfo.arg[i] = PointerGetDatum(construct_md_array(
+							args + i * nrows, nulls + i * nrows, 1, dims, lbs,
+							filter->argtypes[i], filter->arglen[i],
+							filter->argbyval[i], filter->argalign[i]));
+		fcinfo.argnull[i] = false;
+	}
 
-		filter->defaultValues = palloc(sizeof(Datum) * filter->fn_ndargs);
-		filter->defaultIsnull = palloc(sizeof(bool) * filter->fn_ndargs);
+	rsinfo.type = T_ReturnSetInfo;
+	rsinfo.econtext = filter->econtext;
+	rsinfo.expectedDesc = filter->desc;
+	rsinfo.allowedModes = (int) (SFRM_ValuePerCall | SFRM_Materialize);
+	rsinfo.returnMode = SFRM_ValuePerCall;
+	rsinfo.setResult = NULL;
+	rsinfo.setDesc = NULL;
 
-		proargdefaults = SysCacheGetAttr(PROCOID, ftup,
-										 Anum_pg_proc_proargdefaults,
-										 &isnull);
-		Assert(!isnull);
-		str = TextDatumGetCString(proargdefaults);
-		defaults = (List *) stringToNode(str);
-		Assert(IsA(defaults, List));
-		pfree(str);
+	pgstat_init_function_usage(&fcinfo, &fcusage);
 
-		filter->econtext = CreateStandaloneExprContext();
-		i = 0;
-		foreach(l, defaults)
+	PG_TRY();
+	{
+		for (;;)
 		{
-			Expr		   *expr = (Expr *) lfirst(l);
-			ExprState	   *argstate;
-			ExprDoneCond	thisArgIsDone;
+			Datum		datum;
+			HeapTuple	tuple;
 
-			argstate = ExecInitExpr(expr, NULL);
+			fcinfo.isnull = false;
+			rsinfo.isDone = ExprSingleResult;
+			datum = FunctionCallInvoke(&fcinfo);
 
-			filter->defaultValues[i] = ExecEvalExpr(argstate,
-													filter->econtext,
-													&filter->defaultIsnull[i],
-													&thisArgIsDone);
+			/* Which protocol does function want to use? */
+			if (rsinfo.returnMode != SFRM_ValuePerCall ||
+				rsinfo.isDone == ExprEndResult)
+				break;
 
-			if (thisArgIsDone != ExprSingleResult)
+			if (fcinfo.isnull)
 				ereport(ERROR,
-						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						 errmsg("functions and operators can take at most one set argument")));
+						(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+						 errmsg("function returning set of rows cannot return null value")));
 
-			i++;
+			if (n < nrows)
+			{
+				tuple = (HeapTuple) palloc0(HEAPTUPLESIZE);
+				tuple->t_data = DatumGetHeapTupleHeader(datum);
+				tuple->t_len = HeapTupleHeaderGetDatumLength(tuple->t_data);
+				tuples[n] = tuple;
+			}
+			n++;
+
+			if (rsinfo.isDone != ExprMultipleResult)
+				break;
 		}
 	}
+	PG_CATCH();
+	{
+		pgstat_end_function_usage(&fcusage, true);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
 
-	if (OidIsValid(pp->provariadic))
-		ereport(ERROR,
-				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-				 errmsg("filter function does not support a valiadic function %s",
-						get_func_name(filter->funcid))));
-#else
-	filter->fn_ndargs = 0;
-#endif
+	pgstat_end_function_usage(&fcusage, true);
 
-	filter->fn_strict = pp->proisstrict;
-	filter->fn_rettype = pp->prorettype;
+	if (rsinfo.returnMode == SFRM_Materialize)
+	{
+		/* check we're on the same page as the function author */
+		if (rsinfo.isDone != ExprSingleResult)
+			ereport(ERROR,
+					(errcode(ERRCODE_E_R_I_E_SRF_PROTOCOL_VIOLATED),
+					 errmsg("table-function protocol for materialize mode was not followed")));
 
-	filter->collation = collation;
+		if (rsinfo.setResult)
+		{
+			TupleTableSlot *slot = MakeSingleTupleTableSlot(filter->desc);
 
-	ReleaseSysCache(ftup);
+			while (tuplestore_gettupleslot(rsinfo.setResult, true, false, slot))
+			{
+				if (n < nrows)
+				{
+					HeapTuple	tuple;
+
+					/*
+					 * The row in the slot is freed when the slot is advanced
+					 * or dropped, so copy it as a composite datum.
+					 */
+					tuple = ExecCopySlotTuple(slot);
+					HeapTupleHeaderSetDatumLength(tuple->t_data, tuple->t_len);
+					HeapTupleHeaderSetTypeId(tuple->t_data,
+											 filter->desc->tdtypeid);
+					HeapTupleHeaderSetTypMod(tuple->t_data,
+											 filter->desc->tdtypmod);
+					tuples[n] = tuple;
+				}
+				n++;
+			}
 
-	return status;
-}
+			ExecDropSingleTupleTableSlot(slot);
+			tuplestore_end(rsinfo.setResult);
+		}
+	}
+	else if (rsinfo.returnMode != SFRM_ValuePerCall)
+		ereport(ERROR,
+				(errcode(ERRCODE_E_R_I_E_SRF_PROTOCOL_VIOLATED),
+				 errmsg("unrecognized table-function returnMode: %d",
+						(int) rsinfo.returnMode)));
 
-void
-FilterTerm(Filter *filter)
-{
-	if (filter->funcstr)
-		pfree(filter->funcstr);
-	if (filter->defaultValues)
-		pfree(filter->defaultValues);
-	if (filter->defaultIsnull)
-		pfree(filter->defaultIsnull);
-	if (filter->econtext)
-		FreeExprContext(filter->econtext, true);
+	if (n != nrows)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("filter function returned %d rows for %d records",
+						n, nrows)));
 }
 
-HeapTuple
-FilterTuple(Filter *filter, TupleFormer *former, int *parsing_field)
+/*
+ * Call the filter function taking arrays inside a sub-transaction of its
+ * own, as FilterCall() does.
+ */
+static void
+FilterArrayCall(Filter *filter, Datum *args, bool *nulls, int nrows,
+				HeapTuple *tuples)
 {
-#if PG_VERSION_NUM >= 80400
-	PgStat_FunctionCallUsage	fcusage;
-#endif
-	int						i;
-	FunctionCallInfoData	fcinfo;
-	FmgrInfo				flinfo;
-	MemoryContext			oldcontext;
-	ResourceOwner			oldowner;
-	Datum					datum;
+	MemoryContext	oldcontext = CurrentMemoryContext;
+	ResourceOwner	oldowner = CurrentResourceOwner;
 
-	/*
-	 * If function is strict, and there are any NULL arguments, return tuple,
-	 * it's all columns of null.
-	 */
-	if (filter->fn_strict)
+	BeginInternalSubTransaction(NULL);
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_TRY();
 	{
-		for (i = 0; i < filter->nargs; i++)
-		{
-			if (former->isnull[i])
-				return TupleFormerNullTuple(former);
-		}
+		FilterArrayInvoke(filter, args, nulls, nrows, tuples);
 	}
+	PG_CATCH();
+	{
+		RollbackAndReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
 
-	fmgr_info(filter->funcid, &flinfo);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
 
-#if PG_VERSION_NUM >= 90100
-	InitFunctionCallInfoData(fcinfo, &flinfo, filter->nargs, filter->collation, NULL, NULL);
-#else
-	InitFunctionCallInfoData(fcinfo, &flinfo, filter->nargs, NULL, NULL);
-#endif
+	ReleaseCurrentSubTransaction();
+	MemoryContextSwitchTo(oldcontext);
+	CurrentResourceOwner = oldowner;
+}
 
-	for (i = 0; i < filter->nargs; i++)
+/*
+ * Call the filter function inside the sub-transaction of FILTER_BATCH, which
+ * is started if not open. If the call fails, the sub-transaction is rolled
+ * back, and the calls for the records before are run again one by one in a
+ * new sub-transaction; then the error is thrown for the record. The rows
+ * returned by running them again are left in batch_tuples, and the reader
+ * loads them instead of the rows of the rolled back calls. The records
+ * before have passed the function once, so an error in running them again
+ * cannot be ignored.
+ */
+static Datum
+FilterBatchCall(Filter *filter, TupleFormer *former, int *parsing_field)
+{
+	FunctionCallInfo	fcinfo = &filter->fcinfo;
+	MemoryContext		oldcontext = CurrentMemoryContext;
+	ResourceOwner		oldowner = CurrentResourceOwner;
+	int					nargs = filter->nargs;
+	int					row;
+	Datum				datum;
+
+	if (filter->batch_owner == NULL)
 	{
-		fcinfo.arg[i] = former->values[i];
-		fcinfo.argnull[i] = former->isnull[i];
+		BeginInternalSubTransaction(NULL);
+		MemoryContextSwitchTo(oldcontext);
+		filter->batch_owner = CurrentResourceOwner;
+		CurrentResourceOwner = oldowner;
+		filter->batch_rows = 0;
 	}
 
-	/*
-	 * Execute the function inside a sub-transaction, so we can cope with
-	 * errors sanely
-	 */
-	oldcontext = CurrentMemoryContext;
-	oldowner = CurrentResourceOwner;
-	BeginInternalSubTransaction(NULL);
-
-	/* Want to run inside per tuple memory context */
-	MemoryContextSwitchTo(oldcontext);
-
-	*parsing_field = 0;
-	pgstat_init_function_usage(&fcinfo, &fcusage);
+	/* Keep the arguments to run the call again. */
+	row = filter->batch_rows;
+	filter->batch_called[row] = true;
+	memcpy(filter->batch_args + row * nargs, fcinfo->arg, nargs * sizeof(Datum));
+	memcpy(filter->batch_nulls + row * nargs, fcinfo->argnull, nargs * sizeof(bool));
 
-	fcinfo.isnull = false;
+	CurrentResourceOwner = filter->batch_owner;
 
 	PG_TRY();
 	{
-		datum = FunctionCallInvoke(&fcinfo);
+		datum = FilterInvoke(filter);
 	}
 	PG_CATCH();
 	{
-		pgstat_end_function_usage(&fcusage, true);
+		ErrorData  *errdata;
+		int			i;
 
-		/* Abort the inner transaction */
+		/* Abort the calls in the batch, and keep the error. */
+		MemoryContextSwitchTo(oldcontext);
+		errdata = CopyErrorData();
+		FlushErrorState();
 		RollbackAndReleaseCurrentSubTransaction();
 		MemoryContextSwitchTo(oldcontext);
 		CurrentResourceOwner = oldowner;
+		filter->batch_owner = NULL;
 
-		PG_RE_THROW();
+		if (row > 0)
+		{
+			*parsing_field = -1;
+
+			BeginInternalSubTransaction(NULL);
+			MemoryContextSwitchTo(oldcontext);
+			filter->batch_owner = CurrentResourceOwner;
+
+			for (i = 0; i < row; i++)
+			{
+				HeapTuple	tuple;
+
+				filter->batch_tuples[i] = NULL;
+				if (!filter->batch_called[i])
+					continue;	/* not passed to the function */
+
+				memcpy(fcinfo->arg, filter->batch_args + i * nargs, nargs * sizeof(Datum));
+				memcpy(fcinfo->argnull, filter->batch_nulls + i * nargs, nargs * sizeof(bool));
+				tuple = FilterResultTuple(filter, FilterInvoke(filter));
+				filter->batch_tuples[i] = tuple ? tuple : TupleFormerNullTuple(former);
+			}
+
+			CurrentResourceOwner = oldowner;
+			filter->batch_rows = row;
+			filter->batch_replayed = row;
+			*parsing_field = 0;
+		}
+
+		ReThrowError(errdata);
 	}
 	PG_END_TRY();
 
-	pgstat_end_function_usage(&fcusage, true);
+	CurrentResourceOwner = oldowner;
 
-	*parsing_field = -1;
+	if (++filter->batch_rows >= filter->batch_size)
+		FilterBatchEnd(filter);
+
+	return datum;
+}
+
+/*
+ * Count a record whose row is not returned by the function, from the cache
+ * for example, in the sub-transaction of FILTER_BATCH if open, so that the
+ * records in it are the last ones read. It is not run again.
+ */
+static void
+FilterBatchSkip(Filter *filter)
+{
+	if (filter->batch_owner == NULL)
+		return;
+
+	filter->batch_called[filter->batch_rows] = false;
+	if (++filter->batch_rows >= filter->batch_size)
+		FilterBatchEnd(filter);
+}
+
+/*
+ * Commit the sub-transaction of FILTER_BATCH if open.
+ */
+static void
+FilterBatchEnd(Filter *filter)
+{
+	MemoryContext	oldcontext = CurrentMemoryContext;
+	ResourceOwner	oldowner = CurrentResourceOwner;
+
+	if (filter == NULL || filter->batch_owner == NULL)
+		return;
 
-	/* Commit the inner transaction, return to outer xact context */
 	ReleaseCurrentSubTransaction();
 	MemoryContextSwitchTo(oldcontext);
 	CurrentResourceOwner = oldowner;
 
-	/*
-	 * If function result is NULL, return tuple, it's all columns of null.
-	 */
-	if (fcinfo.isnull)
-		return TupleFormerNullTuple(former);
-
-	filter->tuple.t_data = DatumGetHeapTupleHeader(datum);
-	filter->tuple.t_len = HeapTupleHeaderGetDatumLength(filter->tuple.t_data);
-
-	return &filter->tuple;
+	filter->batch_rows = 0;
+	filter->batch_owner = NULL;
 }
 
 TupleChecker *
@@ -0,0 +1,623 @@
+/*
+ * pg_bulkload: lib/simd.c
+ *
+ *	  Copyright (c) 2007-2011, NIPPON TELEGRAPH AND TELEPHONE CORPORATION
+ */
+
+/**
+ * @file
+ * @brief Vectorized byte scanning.
+ *
+ * Input is classified 64 bytes at a time into a bitmask of the bytes found
+ * in the set, and the first set bit is the answer.  AVX2 and SSE2 are used
+ * on x86 when the CPU supports them; elsewhere 8 bytes are tested at a time
+ * in a general purpose register.
+ *
+ * Lines are skipped by counting the line feeds in the bitmask of 64 bytes.
+ *
+ * UTF-8 is validated with the lookup tables of Keiser and Lemire, "Validating
+ * UTF-8 In Less Than One Instruction Per Byte": each byte is classified by
+ * the nibbles of itself and of the previous byte, and the bytes which must be
+ * the 3rd or 4th of a character are found from the bytes before them.  AVX2
+ * and SSSE3 are used when the CPU supports them.
+ */
+#include "pg_bulkload.h"
+
+#include "simd.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define USE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#define ONES		UINT64CONST(0x0101010101010101)
+#define HIGHS		UINT64CONST(0x8080808080808080)
+
+/* true if any byte in v is zero; may report a false zero only above a true one */
+#define HAS_ZERO(v)	(((v) - ONES) & ~(v) & HIGHS)
+
+#define IN_SET(ch, set) \
+	((ch) == (set)->c[0] || (ch) == (set)->c[1] || \
+	 (ch) == (set)->c[2] || (ch) == (set)->c[3])
+
+/* error classes of the UTF-8 validation */
+#define TOO_SHORT		(1 << 0)	/* a lead byte or ASCII after a lead byte */
+#define TOO_LONG		(1 << 1)	/* a continuation after ASCII */
+#define OVERLONG_3		(1 << 2)	/* E0 80..9F */
+#define TOO_LARGE		(1 << 3)	/* F4 90..BF and F5..FF */
+#define SURROGATE		(1 << 4)	/* ED A0..BF */
+#define OVERLONG_2		(1 << 5)	/* C0 and C1 */
+#define TOO_LARGE_1000	(1 << 6)	/* F5..FF 80..8F */
+#define OVERLONG_4		(1 << 6)	/* F0 80..8F */
+#define TWO_CONTS		(1 << 7)	/* a continuation after a continuation */
+#define CARRY			(TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/* classes by the high nibble of the previous byte */
+#define BYTE_1_HIGH \
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+	TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS, \
+	TOO_SHORT | OVERLONG_2, \
+	TOO_SHORT, \
+	TOO_SHORT | OVERLONG_3 | SURROGATE, \
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+
+/* classes by the low nibble of the previous byte */
+#define BYTE_1_LOW \
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, \
+	CARRY | OVERLONG_2, \
+	CARRY, \
+	CARRY, \
+	CARRY | TOO_LARGE, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000
+
+/* classes by the high nibble of the byte */
+#define BYTE_2_HIGH \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+
+/* the largest bytes at the end of input which do not start a character */
+#define MAX_INCOMPLETE \
+	-1, -1, -1, -1, -1, -1, -1, -1, \
+	-1, -1, -1, -1, -1, (char) (0xF0 - 1), (char) (0xE0 - 1), (char) (0xC0 - 1)
+
+static int	ScanChoose(const char *p, int len, const ByteSet *set);
+static int	SkipLinesChoose(const char *p, int len, int64 *lines);
+static bool	Utf8ValidChoose(const char *p, int len);
+
+ByteSetScan		SimdScan = ScanChoose;
+LineSkip		SimdSkipLines = SkipLinesChoose;
+Utf8Validate	SimdUtf8Valid = Utf8ValidChoose;
+
+void
+ByteSetInit(ByteSet *set, char c0, char c1, char c2, char c3)
+{
+	set->c[0] = c0;
+	set->c[1] = c1;
+	set->c[2] = c2;
+	set->c[3] = c3;
+}
+
+/*
+ * Portable version: 8 bytes are tested at a time.
+ */
+static int
+ScanScalar(const char *p, int len, const ByteSet *set)
+{
+	uint64	b0 = ONES * (unsigned char) set->c[0];
+	uint64	b1 = ONES * (unsigned char) set->c[1];
+	uint64	b2 = ONES * (unsigned char) set->c[2];
+	uint64	b3 = ONES * (unsigned char) set->c[3];
+	int		i;
+
+	for (i = 0; i + 8 <= len; i += 8)
+	{
+		uint64	v;
+
+		memcpy(&v, p + i, sizeof(v));
+		if (HAS_ZERO(v ^ b0) || HAS_ZERO(v ^ b1) ||
+			HAS_ZERO(v ^ b2) || HAS_ZERO(v ^ b3))
+			break;
+	}
+
+	for (; i < len; i++)
+	{
+		if (IN_SET(p[i], set))
+			break;
+	}
+
+	return i;
+}
+
+/*
+ * Portable version: the lines are walked with SimdScan.
+ */
+static int
+SkipLinesScalar(const char *p, int len, int64 *lines)
+{
+	ByteSet	newlines;
+	int		i = 0;
+
+	ByteSetInit(&newlines, '\r', '\n', '\r', '\n');
+	while (*lines > 0)
+	{
+		i += SimdScan(p + i, len - i, &newlines);
+		if (i >= len || p[i] == '\r')
+			break;
+		i++;
+		(*lines)--;
+	}
+
+	return i;
+}
+
+/*
+ * Non-ASCII bytes are rare in most input, so 8 bytes are tested at a time
+ * without vector instructions; this runs at memory speed anyway.
+ */
+int
+ScanNonAscii(const char *p, int len)
+{
+	int		i;
+
+	for (i = 0; i + 8 <= len; i += 8)
+	{
+		uint64	v;
+
+		memcpy(&v, p + i, sizeof(v));
+		if (v & HIGHS)
+			break;
+	}
+
+	for (; i < len; i++)
+	{
+		if (IS_HIGHBIT_SET(p[i]))
+			break;
+	}
+
+	return i;
+}
+
+/*
+ * Portable version: a character at a time, with ASCII skipped 8 bytes at a
+ * time.
+ */
+static bool
+Utf8ValidScalar(const char *s, int len)
+{
+	const unsigned char *p = (const unsigned char *) s;
+	const unsigned char *end = p + len;
+
+	while (p < end)
+	{
+		unsigned char	c = p[0];
+		unsigned char	lo = 0x80;
+		unsigned char	hi = 0xBF;
+		int				n;
+		int				i;
+
+		if (!IS_HIGHBIT_SET(c))
+		{
+			p += ScanNonAscii((const char *) p, end - p);
+			continue;
+		}
+
+		if (c >= 0xC2 && c <= 0xDF)
+			n = 2;
+		else if (c >= 0xE0 && c <= 0xEF)
+			n = 3;
+		else if (c >= 0xF0 && c <= 0xF4)
+			n = 4;
+		else
+			return false;
+		if (end - p < n)
+			return false;
+
+		/* overlong forms, surrogates and code points above U+10FFFF */
+		if (c == 0xE0)
+			lo = 0xA0;
+		else if (c == 0xED)
+			hi = 0x9F;
+		else if (c == 0xF0)
+			lo = 0x90;
+		else if (c == 0xF4)
+			hi = 0x8F;
+		if (p[1] < lo || p[1] > hi)
+			return false;
+
+		for (i = 2; i < n; i++)
+		{
+			if ((p[i] & 0xC0) != 0x80)
+				return false;
+		}
+		p += n;
+	}
+
+	return true;
+}
+
+#ifdef USE_X86_SIMD
+
+__attribute__((target("sse2")))
+static int
+ScanSSE2(const char *p, int len, const ByteSet *set)
+{
+	__m128i		c0 = _mm_set1_epi8(set->c[0]);
+	__m128i		c1 = _mm_set1_epi8(set->c[1]);
+	__m128i		c2 = _mm_set1_epi8(set->c[2]);
+	__m128i		c3 = _mm_set1_epi8(set->c[3]);
+	int			i;
+
+#define MATCH_SSE2(v) \
+	((uint64) (uint32) _mm_movemask_epi8( \
+		_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8((v), c0), _mm_cmpeq_epi8((v), c1)), \
+					 _mm_or_si128(_mm_cmpeq_epi8((v), c2), _mm_cmpeq_epi8((v), c3)))))
+
+	for (i = 0; i + 64 <= len; i += 64)
+	{
+		__m128i		v0 = _mm_loadu_si128((const __m128i *) (p + i));
+		__m128i		v1 = _mm_loadu_si128((const __m128i *) (p + i + 16));
+		__m128i		v2 = _mm_loadu_si128((const __m128i *) (p + i + 32));
+		__m128i		v3 = _mm_loadu_si128((const __m128i *) (p + i + 48));
+		uint64		mask;
+
+		mask = MATCH_SSE2(v0) | MATCH_SSE2(v1) << 16 |
+			   MATCH_SSE2(v2) << 32 | MATCH_SSE2(v3) << 48;
+		if (mask)
+			return i + __builtin_ctzll(mask);
+	}
+
+#undef MATCH_SSE2
+
+	return i + ScanScalar(p + i, len - i, set);
+}
+
+__attribute__((target("avx2")))
+static int
+ScanAVX2(const char *p, int len, const ByteSet *set)
+{
+	__m256i		c0 = _mm256_set1_epi8(set->c[0]);
+	__m256i		c1 = _mm256_set1_epi8(set->c[1]);
+	__m256i		c2 = _mm256_set1_epi8(set->c[2]);
+	__m256i		c3 = _mm256_set1_epi8(set->c[3]);
+	int			i;
+
+#define MATCH_AVX2(v) \
+	((uint64) (uint32) _mm256_movemask_epi8( \
+		_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8((v), c0), _mm256_cmpeq_epi8((v), c1)), \
+						_mm256_or_si256(_mm256_cmpeq_epi8((v), c2), _mm256_cmpeq_epi8((v), c3)))))
+
+	for (i = 0; i + 64 <= len; i += 64)
+	{
+		__m256i		v0 = _mm256_loadu_si256((const __m256i *) (p + i));
+		__m256i		v1 = _mm256_loadu_si256((const __m256i *) (p + i + 32));
+		uint64		mask;
+
+		mask = MATCH_AVX2(v0) | MATCH_AVX2(v1) << 32;
+		if (mask)
+			return i + __builtin_ctzll(mask);
+	}
+
+#undef MATCH_AVX2
+
+	return i + ScanScalar(p + i, len - i, set);
+}
+
+/*
+ * Skip the lines in 64 bytes given the bitmasks of the line feeds
+ * and the carriage returns in them. Returns the offset in the 64 bytes,
+ * or -1 if all of them are skipped.
+ */
+static inline int
+SkipLinesInMask(uint64 lf, uint64 cr, int64 *lines)
+{
+	int64	n;
+
+	/* stop at the first carriage return */
+	if (cr)
+		lf &= (cr & -cr) - 1;
+
+	n = __builtin_popcountll(lf);
+	if (n >= *lines)
+	{
+		/* find the *lines-th line feed */
+		for (n = 1; n < *lines; n++)
+			lf &= lf - 1;
+		*lines = 0;
+		return __builtin_ctzll(lf) + 1;
+	}
+
+	*lines -= n;
+	if (cr)
+		return __builtin_ctzll(cr);
+	return -1;
+}
+
+__attribute__((target("sse2")))
+static int
+SkipLinesSSE2(const char *p, int len, int64 *lines)
+{
+	__m128i		lf = _mm_set1_epi8('\n');
+	__m128i		cr = _mm_set1_epi8('\r');
+	int			i;
+
+#define MASK_SSE2(v, c) \
+	((uint64) (uint32) _mm_movemask_epi8(_mm_cmpeq_epi8((v), (c))))
+
+	for (i = 0; i + 64 <= len && *lines > 0; i += 64)
+	{
+		__m128i		v0 = _mm_loadu_si128((const __m128i *) (p + i));
+		__m128i		v1 = _mm_loadu_si128((const __m128i *) (p + i + 16));
+		__m128i		v2 = _mm_loadu_si128((const __m128i *) (p + i + 32));
+		__m128i		v3 = _mm_loadu_si128((const __m128i *) (p + i + 48));
+		int			off;
+
+		off = SkipLinesInMask(
+			MASK_SSE2(v0, lf) | MASK_SSE2(v1, lf) << 16 |
+			MASK_SSE2(v2, lf) << 32 | MASK_SSE2(v3, lf) << 48,
+			MASK_SSE2(v0, cr) | MASK_SSE2(v1, cr) << 16 |
+			MASK_SSE2(v2, cr) << 32 | MASK_SSE2(v3, cr) << 48,
+			lines);
+		if (off >= 0)
+			return i + off;
+	}
+
+#undef MASK_SSE2
+
+	return i + SkipLinesScalar(p + i, len - i, lines);
+}
+
+__attribute__((target("avx2")))
+static int
+SkipLinesAVX2(const char *p, int len, int64 *lines)
+{
+	__m256i		lf = _mm256_set1_epi8('\n');
+	__m256i		cr = _mm256_set1_epi8('\r');
+	int			i;
+
+#define MASK_AVX2(v, c) \
+	((uint64) (uint32) _mm256_movemask_epi8(_mm256_cmpeq_epi8((v), (c))))
+
+	for (i = 0; i + 64 <= len && *lines > 0; i += 64)
+	{
+		__m256i		v0 = _mm256_loadu_si256((const __m256i *) (p + i));
+		__m256i		v1 = _mm256_loadu_si256((const __m256i *) (p + i + 32));
+		int			off;
+
+		off = SkipLinesInMask(MASK_AVX2(v0, lf) | MASK_AVX2(v1, lf) << 32,
+							  MASK_AVX2(v0, cr) | MASK_AVX2(v1, cr) << 32,
+							  lines);
+		if (off >= 0)
+			return i + off;
+	}
+
+#undef MASK_AVX2
+
+	return i + SkipLinesScalar(p + i, len - i, lines);
+}
+
+__attribute__((target("ssse3")))
+static bool
+Utf8ValidSSSE3(const char *p, int len)
+{
+	const __m128i	byte_1_high = _mm_setr_epi8(BYTE_1_HIGH);
+	const __m128i	byte_1_low = _mm_setr_epi8(BYTE_1_LOW);
+	const __m128i	byte_2_high = _mm_setr_epi8(BYTE_2_HIGH);
+	const __m128i	max_incomplete = _mm_setr_epi8(MAX_INCOMPLETE);
+	const __m128i	nibble = _mm_set1_epi8(0x0F);
+	__m128i			prev = _mm_setzero_si128();
+	__m128i			incomplete = _mm_setzero_si128();
+	__m128i			error = _mm_setzero_si128();
+	int				i;
+
+	for (i = 0; i < len; i += 16)
+	{
+		__m128i		v;
+
+		if (i + 16 <= len)
+			v = _mm_loadu_si128((const __m128i *) (p + i));
+		else
+		{
+			/* NUL padding fails a character cut at the end */
+			char	tail[16];
+
+			memset(tail, 0, sizeof(tail));
+			memcpy(tail, p + i, len - i);
+			v = _mm_loadu_si128((const __m128i *) tail);
+		}
+
+		if (_mm_movemask_epi8(v) == 0)
+		{
+			/* ASCII only; the previous character must be complete */
+			error = _mm_or_si128(error, incomplete);
+			incomplete = _mm_setzero_si128();
+		}
+		else
+		{
+			__m128i		prev1 = _mm_alignr_epi8(v, prev, 15);
+			__m128i		prev2 = _mm_alignr_epi8(v, prev, 14);
+			__m128i		prev3 = _mm_alignr_epi8(v, prev, 13);
+			__m128i		special;
+			__m128i		must23;
+
+			special = _mm_and_si128(
+				_mm_and_si128(
+					_mm_shuffle_epi8(byte_1_high,
+						_mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+					_mm_shuffle_epi8(byte_1_low,
+						_mm_and_si128(prev1, nibble))),
+				_mm_shuffle_epi8(byte_2_high,
+					_mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+			must23 = _mm_or_si128(
+				_mm_subs_epu8(prev2, _mm_set1_epi8((char) (0xE0 - 0x80))),
+				_mm_subs_epu8(prev3, _mm_set1_epi8((char) (0xF0 - 0x80))));
+			must23 = _mm_and_si128(must23, _mm_set1_epi8((char) 0x80));
+			error = _mm_or_si128(error, _mm_xor_si128(must23, special));
+			incomplete = _mm_subs_epu8(v, max_incomplete);
+		}
+		prev = v;
+	}
+
+	error = _mm_or_si128(error, incomplete);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+
+__attribute__((target("avx2")))
+static bool
+Utf8ValidAVX2(const char *p, int len)
+{
+	const __m256i	byte_1_high = _mm256_setr_epi8(BYTE_1_HIGH, BYTE_1_HIGH);
+	const __m256i	byte_1_low = _mm256_setr_epi8(BYTE_1_LOW, BYTE_1_LOW);
+	const __m256i	byte_2_high = _mm256_setr_epi8(BYTE_2_HIGH, BYTE_2_HIGH);
+	const __m256i	max_incomplete = _mm256_setr_epi8(
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		MAX_INCOMPLETE);
+	const __m256i	nibble = _mm256_set1_epi8(0x0F);
+	__m256i			prev = _mm256_setzero_si256();
+	__m256i			incomplete = _mm256_setzero_si256();
+	__m256i			error = _mm256_setzero_si256();
+	int				i;
+
+	for (i = 0; i < len; i += 32)
+	{
+		__m256i		v;
+
+		if (i + 32 <= len)
+			v = _mm256_loadu_si256((const __m256i *) (p + i));
+		else
+		{
+			/* NUL padding fails a character cut at the end */
+			char	tail[32];
+
+			memset(tail, 0, sizeof(tail));
+			memcpy(tail, p + i, len - i);
+			v = _mm256_loadu_si256((const __m256i *) tail);
+		}
+
+		if (_mm256_movemask_epi8(v) == 0)
+		{
+			/* ASCII only; the previous character must be complete */
+			error = _mm256_or_si256(error, incomplete);
+			incomplete = _mm256_setzero_si256();
+		}
+		else
+		{
+			/* shifts across the lanes need the lanes before them */
+			__m256i		before = _mm256_permute2x128_si256(prev, v, 0x21);
+			__m256i		prev1 = _mm256_alignr_epi8(v, before, 15);
+			__m256i		prev2 = _mm256_alignr_epi8(v, before, 14);
+			__m256i		prev3 = _mm256_alignr_epi8(v, before, 13);
+			__m256i		special;
+			__m256i		must23;
+
+			special = _mm256_and_si256(
+				_mm256_and_si256(
+					_mm256_shuffle_epi8(byte_1_high,
+						_mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+					_mm256_shuffle_epi8(byte_1_low,
+						_mm256_and_si256(prev1, nibble))),
+				_mm256_shuffle_epi8(byte_2_high,
+					_mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+			must23 = _mm256_or_si256(
+				_mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xE0 - 0x80))),
+				_mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xF0 - 0x80))));
+			must23 = _mm256_and_si256(must23, _mm256_set1_epi8((char) 0x80));
+			error = _mm256_or_si256(error, _mm256_xor_si256(must23, special));
+			incomplete = _mm256_subs_epu8(v, max_incomplete);
+		}
+		prev = v;
+	}
+
+	error = _mm256_or_si256(error, incomplete);
+	return _mm256_movemask_epi8(_mm256_cmpeq_epi8(error, _mm256_setzero_si256())) == -1;
+}
+
+#endif   /* USE_X86_SIMD */
+
+/*
+ * Selects the implementation on the first call.
+ */
+static int
+ScanChoose(const char *p, int len, const ByteSet *set)
+{
+	const char *name = "scalar";
+
+	SimdScan = ScanScalar;
+#ifdef USE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		SimdScan = ScanAVX2;
+		name = "avx2";
+	}
+	else if (__builtin_cpu_supports("sse2"))
+	{
+		SimdScan = ScanSSE2;
+		name = "sse2";
+	}
+#endif
+	elog(DEBUG1, "pg_bulkload: %s byte scan", name);
+
+	return SimdScan(p, len, set);
+}
+
+/*
+ * Selects the line skipper on the first call.
+ */
+static int
+SkipLinesChoose(const char *p, int len, int64 *lines)
+{
+	SimdSkipLines = SkipLinesScalar;
+#ifdef USE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		SimdSkipLines = SkipLinesAVX2;
+	else if (__builtin_cpu_supports("sse2"))
+		SimdSkipLines = SkipLinesSSE2;
+#endif
+
+	return SimdSkipLines(p, len, lines);
+}
+
+/*
+ * Selects the UTF-8 validator on the first call.
+ */
+static bool
+Utf8ValidChoose(const char *p, int len)
+{
+	const char *name = "scalar";
+
+	SimdUtf8Valid = Utf8ValidScalar;
+#ifdef USE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		SimdUtf8Valid = Utf8ValidAVX2;
+		name = "avx2";
+	}
+	else if (__builtin_cpu_supports("ssse3"))
+	{
+		SimdUtf8Valid = Utf8ValidSSSE3;
+		name = "ssse3";
+	}
+#endif
+	elog(DEBUG1, "pg_bulkload: %s UTF-8 validation", name);
+
+	return SimdUtf8Valid(p, len);
+}
@@ -6,18 +6,42 @@
 
 #include "pg_bulkload.h"
 
+#include <ctype.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <glob.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
 #include "pgut/pgut-pthread.h"
 
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef ENABLE_BULKLOAD_ZSTD
+#include <zstd.h>
+#endif
+#ifdef ENABLE_BULKLOAD_LZ4
+#include <lz4frame.h>
+#endif
+
 #include "access/htup.h"
 #include "catalog/pg_type.h"
 #include "fmgr.h"
 #include "libpq/libpq.h"
 #include "libpq/pqformat.h"
+#include "mb/pg_wchar.h"
 #include "miscadmin.h"
 #include "tcop/dest.h"
+#include "utils/timestamp.h"
 
+#include "logger.h"
 #include "reader.h"
+#include "pg_strutil.h"
+#include "simd.h"
 
 #include "pgut/pgut-be.h"
 
@@ -37,22 +61,80 @@ ProtocolVersion	FrontendProtocol = 3;
 /* ========================================================================
  * AsyncSource
  * ========================================================================*/
-#define SPIN_SLEEP_MSEC		10
 #define READ_UNIT_SIZE		(1024 * 1024)
-#define INITIAL_BUF_LEN		(16 * READ_UNIT_SIZE)
+#define ASYNC_SLAB_NUM		16
+#define WAIT_TIMEOUT_MSEC	100
 #define ERROR_MESSAGE_LEN	1024
+#define PIPE_BUFFER_SIZE	(1024 * 1024)	/* requested capacity of pipes */
+#define PROGRAM_PREFIX		"program:"
 
-typedef struct AsyncSource
+static const char *COMPRESSION_NAMES[] =
 {
-	Source	base;
+	"NONE",
+	"AUTO",
+	"GZIP",
+	"ZSTD",
+	"LZ4"
+};
 
-	FILE   *fd;
-	bool	eof;
+typedef struct AsyncSource AsyncSource;
+
+/*
+ * Fill a slab with at most *len bytes of input in the read thread. Returns
+ * false with a message in errbuf on error.
+ */
+typedef bool (*AsyncFillProc)(AsyncSource *self, char *buffer, size_t *len,
+							  bool *eof, char *errbuf);
+
+/*
+ * Decompress the compressed input in inbuf into buffer as far as possible.
+ */
+typedef bool (*AsyncDecompressProc)(AsyncSource *self, char *buffer, size_t len,
+									size_t *produced, char *errbuf);
+
+/*
+ * AsyncSource is a single-producer/single-consumer ring of read slabs.
+ * The read thread fills slabs[head % ASYNC_SLAB_NUM] and the backend drains
+ * slabs[tail % ASYNC_SLAB_NUM]. The thread reads into a slab without holding
+ * the lock; the lock is held only to publish head and tail, and each side
+ * sleeps on a condition variable only when the ring is empty or full.
+ */
+struct AsyncSource
+{
+	Source	base;
 
-	char   *buffer;		/* read buffer */
-	int		size;		/* buffer size */
-	int		begin;		/* begin of the buffer finished with reading */
-	int		end;		/* end of the buffer finished with reading */
+	/*
+	 * Input files. If INPUT has multiple files, the read thread opens them
+	 * one by one, and the backend parses files[cur_file].
+	 */
+	char  **files;
+	int		nfiles;
+	int		cur_file;		/* file being parsed; owned by the backend */
+	bool	thread_open;	/* files are opened by the read thread? */
+	FILE   *fd;				/* file being read by the thread */
+	FILE   *next_fd;		/* next file opened in advance */
+	char   *program;		/* command of INPUT = program:command, or NULL */
+	bool	is_pipe;		/* reading from a program or a named pipe? */
+	AsyncFillProc	fill;
+
+	char   *slabs[ASYNC_SLAB_NUM];		/* fixed read slabs */
+	size_t	slab_len[ASYNC_SLAB_NUM];	/* valid bytes in each slab */
+	int		slab_file[ASYNC_SLAB_NUM];	/* index of the file of each slab */
+	uint32	head;		/* number of slabs filled; written by the thread */
+	uint32	tail;		/* number of slabs drained; written by the backend */
+	uint32	ready;		/* head seen by the backend at the last wait */
+	size_t	offset;		/* read position in the slab at tail */
+	bool	eof;		/* the thread reached end of input */
+	bool	quit;		/* the backend asks the thread to stop */
+	bool	stopped;	/* the thread has been joined */
+
+	/* statistics */
+	int64	bytes_read;		/* bytes read by the thread */
+	size_t	in_flight;		/* bytes read but not consumed yet */
+	size_t	max_in_flight;	/* high-water mark of in_flight */
+	int64	stalls;			/* number of waits for the thread */
+	long	stall_secs;		/* time spent in the waits */
+	int		stall_usecs;
 
 	/*
 	 * because ereport() does not support multi-thread, the read thread stores
@@ -60,13 +142,50 @@ typedef struct AsyncSource
 	 */
 	char	errmsg[ERROR_MESSAGE_LEN];
 
+	/*
+	 * Decompression runs in the read thread, which owns the members below
+	 * while it is running. inbuf also keeps the bytes peeked to detect the
+	 * compression method.
+	 */
+	SourceCompression	method;			/* COMPRESSION option */
+	SourceCompression	compression;	/* method of the current file */
+	AsyncDecompressProc	decompress;
+	void   *codecs[lengthof(COMPRESSION_NAMES)];	/* decompressors */
+	char   *inbuf;			/* compressed input */
+	size_t	inpos;			/* read position in inbuf */
+	size_t	inlen;			/* valid bytes in inbuf */
+	bool	in_eof;			/* reached end of the input */
+	bool	frame_open;		/* in the middle of a compressed stream */
+	uint32	methods_used;	/* bitmask of the methods used */
+	int64	compressed_read;	/* bytes read from compressed files */
+	int64	decompressed;		/* bytes decompressed */
+
 	pthread_t		th;
 	pthread_mutex_t	lock;
-} AsyncSource;
+	pthread_cond_t	filled;		/* a slab is filled, or eof or error */
+	pthread_cond_t	drained;	/* a slab is drained, or quit */
+};
 
 static size_t AsyncSourceRead(AsyncSource *self, void *buffer, size_t len);
+static bool AsyncSourceNextFile(AsyncSource *self);
 static void AsyncSourceClose(AsyncSource *self);
+static void AsyncSourceStop(AsyncSource *self);
+static bool PipeSourceEnd(AsyncSource *self, char *errbuf);
 static void *AsyncSourceMain(void *arg);
+static bool AsyncSourceCodecAvailable(SourceCompression method);
+static void AsyncSourceStart(AsyncSource *self, SourceCompression compression);
+static bool AsyncSourceReadInput(AsyncSource *self, char *buffer, size_t *len, bool *eof, char *errbuf);
+static bool AsyncSourceFillFile(AsyncSource *self, char *buffer, size_t *len, bool *eof, char *errbuf);
+static bool AsyncSourceFillCompressed(AsyncSource *self, char *buffer, size_t *len, bool *eof, char *errbuf);
+#ifdef HAVE_LIBZ
+static bool AsyncSourceInflate(AsyncSource *self, char *buffer, size_t len, size_t *produced, char *errbuf);
+#endif
+#ifdef ENABLE_BULKLOAD_ZSTD
+static bool AsyncSourceZstd(AsyncSource *self, char *buffer, size_t len, size_t *produced, char *errbuf);
+#endif
+#ifdef ENABLE_BULKLOAD_LZ4
+static bool AsyncSourceLz4(AsyncSource *self, char *buffer, size_t len, size_t *produced, char *errbuf);
+#endif
 
 /* ========================================================================
  * FileSource
@@ -80,298 +199,1446 @@ typedef struct FileSource
 } FileSource;
 
 static size_t FileSourceRead(FileSource *self, void *buffer, size_t len);
+static int64 FileSourceSkip(FileSource *self, int64 len);
 static void FileSourceClose(FileSource *self);
 
+/* ========================================================================
+ * MmapSource
+ * ========================================================================*/
+
+#define MMAP_WINDOW_SIZE	(8 * 1024 * 1024)
+
+/*
+ * MmapSource lends read-only windows of the page cache to parsers. Only a
+ * window around the current position is mapped; it slides forward when the
+ * parser asks for data beyond it.
+ */
+typedef struct MmapSource
+{
+	Source	base;
+
+	FILE   *fd;
+	off_t	size;		/* file size */
+	off_t	pos;		/* current position */
+	char   *map;		/* mapped window, or NULL */
+	off_t	map_offset;	/* file offset of the window */
+	size_t	map_len;	/* length of the window */
+} MmapSource;
+
+#ifndef WIN32
+static size_t MmapSourceRead(MmapSource *self, void *buffer, size_t len);
+static char *MmapSourceWindow(MmapSource *self, size_t need, size_t *avail);
+static void MmapSourceConsume(MmapSource *self, size_t len);
+static int64 MmapSourceSkip(MmapSource *self, int64 len);
+static void MmapSourceClose(MmapSource *self);
+#endif
+
 /* ========================================================================
  * RemoteSource
  * ========================================================================*/
 
+/*
+ * RemoteSource lends received CopyData messages to parsers. A window across
+ * two messages is built in the join buffer from the rest of the current
+ * message and the head of the next one, and parsers go back to the message
+ * itself after the joined bytes. Clients should send large messages of whole
+ * lines so that most of the input is parsed in place.
+ */
 typedef struct RemoteSource
 {
 	Source	base;
 
 	bool		eof;
-	StringInfo	buffer;
+	StringInfo	buffer;		/* the current CopyData message */
+	int			msgpos;		/* head of the bytes not joined in buffer */
+	StringInfo	join;		/* bytes just before buffer->data[msgpos] */
+	int			pos;		/* current position from the head of join */
+	int			lent;		/* pos of the last window lent from join */
+
+	/* statistics */
+	int64		messages;	/* number of CopyData messages */
+	int64		received;	/* bytes received */
+	int64		joined;		/* bytes copied into the join buffer */
 } RemoteSource;
 
 static size_t RemoteSourceRead(RemoteSource *self, void *buffer, size_t len);
+static char *RemoteSourceWindow(RemoteSource *self, size_t need, size_t *avail);
+static void RemoteSourceConsume(RemoteSource *self, size_t len);
 static size_t RemoteSourceReadOld(RemoteSource *self, void *buffer, size_t len);
 static void RemoteSourceClose(RemoteSource *self);
 
-static Source *CreateAsyncSource(const char *path, TupleDesc desc);
+/* ========================================================================
+ * ConversionSource
+ * ========================================================================*/
+
+/*
+ * ConversionSource converts the input of another source into the server
+ * encoding a block at a time, so that parsers see the input in the server
+ * encoding. A multibyte character split at the end of a block is carried
+ * over to the next block. Blocks of ASCII bytes only are passed through, and
+ * blocks which only need to be checked are lent from the block buffer. Input
+ * which cannot be converted is an error, but input which is only checked is
+ * left to the parser to be rejected record by record.
+ */
+typedef struct ConversionSource
+{
+	Source	base;
+
+	Source		   *source;		/* source of the input */
+	Checker		   *checker;
+	bool			convert;	/* convert, or only check the input? */
+	int				encoding;	/* encoding to find whole characters */
+	char		   *raw;		/* block read from the source */
+	size_t			raw_len;	/* valid bytes in raw */
+	size_t			complete;	/* bytes of whole characters in raw */
+	const char	   *data;		/* block converted, in raw or in buf */
+	size_t			data_len;	/* valid bytes in data */
+	size_t			pos;		/* read position in data */
+	StringInfoData	buf;		/* converted block */
+
+	/* statistics */
+	int64			blocks;		/* blocks read */
+	int64			ascii;		/* blocks of ASCII bytes only */
+} ConversionSource;
+
+static size_t ConversionSourceRead(ConversionSource *self, void *buffer, size_t len);
+static int64 ConversionSourceSkip(ConversionSource *self, int64 len);
+static bool ConversionSourceNextFile(ConversionSource *self);
+static void ConversionSourceClose(ConversionSource *self);
+
+static Source *CreateAsyncSource(const char *path, List *files, TupleDesc desc, SourceCompression compression);
+#ifndef WIN32
+static Source *CreatePipeSource(const char *path, const char *program, TupleDesc desc, SourceCompression compression);
+static void PipeSourceWaitWriter(int fd, const char *path);
+#endif
 static Source *CreateFileSource(const char *path, TupleDesc desc);
+static Source *CreateMmapSource(const char *path, TupleDesc desc);
 static Source *CreateRemoteSource(const char *path, TupleDesc desc);
+static List *ExpandInputFiles(const char *path);
 
 Source *
-CreateSource(const char *path, TupleDesc desc, bool async_read)
+CreateSource(const char *path, TupleDesc desc, bool async_read, const SourceOptions *options)
 {
+	if (!AsyncSourceCodecAvailable(options->compression))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("COMPRESSION = %s is not supported by this build",
+						COMPRESSION_NAMES[options->compression])));
+
 	if (pg_strcasecmp(path, "stdin") == 0)
 	{
 		if (whereToSendOutput != DestRemote)
 			ereport(ERROR,
 				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 				 errmsg("local stdin read is not supported")));
+		if (options->use_mmap)
+			ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("MMAP cannot be used with stdin")));
+		if (options->compression != COMPRESSION_NONE)
+			ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("COMPRESSION cannot be used with stdin")));
 
 		return CreateRemoteSource(NULL, desc);
 	}
+	else if (pg_strncasecmp(path, PROGRAM_PREFIX, strlen(PROGRAM_PREFIX)) == 0)
+	{
+		const char *program = path + strlen(PROGRAM_PREFIX);
+
+		while (isspace((unsigned char) *program))
+			program++;
+		if (*program == '\0')
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("no command in INPUT: %s", path)));
+		if (options->use_mmap)
+			ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("MMAP cannot be used with a program")));
+
+#ifndef WIN32
+		return CreatePipeSource(NULL, program, desc, options->compression);
+#else
+		ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("program input is not supported on this platform")));
+#endif
+	}
 	else
 	{
-		if (!is_absolute_path(path))
+		List   *files = ExpandInputFiles(path);
+#ifndef WIN32
+		struct stat	st;
+#endif
+
+		/* a pattern or a list resolved to one file is read as a plain file */
+		if (list_length(files) == 1)
+		{
+			path = (const char *) linitial(files);
+			list_free(files);
+			files = NIL;
+		}
+
+		if (files == NIL && !is_absolute_path(path))
 			ereport(ERROR,
 					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 					 errmsg("relative path not allowed for INPUT: %s", path)));
 
-		if (async_read)
-			return CreateAsyncSource(path, desc);
+#ifndef WIN32
+		/* a named pipe is read like the output of a program */
+		if (files == NIL && stat(path, &st) == 0 && S_ISFIFO(st.st_mode))
+		{
+			if (options->use_mmap)
+				ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("MMAP cannot be used with a named pipe")));
+			return CreatePipeSource(path, NULL, desc, options->compression);
+		}
+#endif
+
+		if (options->use_mmap)
+		{
+			if (options->compression != COMPRESSION_NONE)
+				ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("MMAP cannot be used with COMPRESSION")));
+			if (files != NIL)
+				ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("MMAP cannot be used with multiple input files")));
+			return CreateMmapSource(path, desc);
+		}
+
+		/*
+		 * Multiple files are opened and prefetched, and compressed input is
+		 * decompressed, always in the read thread.
+		 */
+		if (async_read || files != NIL ||
+			options->compression != COMPRESSION_NONE)
+			return CreateAsyncSource(path, files, desc, options->compression);
 
 		return CreateFileSource(path, desc);
 	}
 }
 
+/*
+ * Expand INPUT to the list of input files. INPUT can be a comma separated
+ * list of paths, and each of them can be a glob pattern. The list might have
+ * only one file, which the caller reads as a plain file. Returns NIL if INPUT
+ * is a single path, or if INPUT names an existing file as a whole, so that a
+ * file named like "/data/a,b.csv" is never split. A comma in a list is written
+ * as "\,", and a wildcard character as "\*", "\?" or "\[".
+ */
+static List *
+ExpandInputFiles(const char *path)
+{
+	List   *files = NIL;
+	char   *paths;
+	char   *tok;
+	char   *next;
+	struct stat	st;
+
+	if (strpbrk(path, ",*?[") == NULL || stat(path, &st) == 0)
+		return NIL;
+
+	paths = pstrdup(path);
+	for (tok = paths; tok != NULL; tok = next)
+	{
+		char   *src;
+		char   *dst;
+		char   *end;
+
+		/* split at an unescaped comma, and unescape "\," */
+		next = NULL;
+		for (src = dst = tok; *src; src++)
+		{
+			if (src[0] == '\\' && src[1] == ',')
+				src++;
+			else if (*src == ',')
+			{
+				next = src + 1;
+				break;
+			}
+			*dst++ = *src;
+		}
+		*dst = '\0';
+
+		/* trim spaces */
+		while (isspace((unsigned char) *tok))
+			tok++;
+		for (end = tok + strlen(tok); end > tok && isspace((unsigned char) end[-1]); end--);
+		*end = '\0';
+		if (*tok == '\0')
+			continue;
+
+		if (!is_absolute_path(tok))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("relative path not allowed for INPUT: %s", tok)));
+
+#ifndef WIN32
+		if (strpbrk(tok, "*?[") != NULL)
+		{
+			glob_t	g;
+			size_t	i;
+			int		ret;
+
+			/*
+			 * Matched paths are sorted. g is allocated with malloc, so it is
+			 * freed before any error is raised.
+			 */
+			ret = glob(tok, 0, NULL, &g);
+			if (ret != 0)
+			{
+				globfree(&g);
+				if (ret == GLOB_NOMATCH)
+					ereport(ERROR,
+							(errcode(ERRCODE_UNDEFINED_FILE),
+							 errmsg("no input file matches \"%s\"", tok)));
+				else
+					ereport(ERROR,
+							(errcode_for_file_access(),
+							 errmsg("could not expand \"%s\"", tok)));
+			}
+
+			PG_TRY();
+			{
+				for (i = 0; i < g.gl_pathc; i++)
+					files = lappend(files, pstrdup(g.gl_pathv[i]));
+			}
+			PG_CATCH();
+			{
+				globfree(&g);
+				PG_RE_THROW();
+			}
+			PG_END_TRY();
+			globfree(&g);
+			continue;
+		}
+#endif
+
+		files = lappend(files, pstrdup(tok));
+	}
+	pfree(paths);
+
+	if (files == NIL)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("no input file in INPUT: %s", path)));
+
+	return files;
+}
+
+bool
+SourceParam(SourceOptions *options, const char *keyword, char *value)
+{
+	if (CompareKeyword(keyword, "MMAP"))
+	{
+		options->use_mmap = ParseBoolean(value);
+	}
+	else if (CompareKeyword(keyword, "COMPRESSION"))
+	{
+		options->compression = (SourceCompression)
+			choice(keyword, value, COMPRESSION_NAMES, lengthof(COMPRESSION_NAMES));
+	}
+	else
+		return false;	/* unknown parameter */
+
+	return true;
+}
+
+/*
+ * Dump source options which are not default.
+ */
+void
+SourceDumpParams(const SourceOptions *options, StringInfo buf)
+{
+	if (options->use_mmap)
+		appendStringInfoString(buf, "MMAP = YES\n");
+	if (options->compression != COMPRESSION_NONE)
+		appendStringInfo(buf, "COMPRESSION = %s\n",
+						 COMPRESSION_NAMES[options->compression]);
+}
+
+/*
+ * Skip len bytes of the input. Sources which cannot seek lend or read the
+ * data, and it is discarded.
+ */
+int64
+SourceSkip(Source *self, int64 len)
+{
+	int64	skipped = 0;
+	char   *buffer = NULL;
+
+	if (self->skip)
+		return self->skip(self, len);
+
+	while (skipped < len)
+	{
+		size_t	need = Min(len - skipped, READ_UNIT_SIZE);
+		size_t	n;
+
+		if (SourceHasWindow(self))
+		{
+			SourceWindow(self, need, &n);
+			n = Min(n, need);
+			SourceConsume(self, n);
+		}
+		else
+		{
+			if (buffer == NULL)
+				buffer = palloc(READ_UNIT_SIZE);
+			n = SourceRead(self, buffer, need);
+		}
+
+		if (n == 0)
+			break;	/* end of input */
+		skipped += n;
+	}
+
+	if (buffer != NULL)
+		pfree(buffer);
+
+	return skipped;
+}
+
 /* ========================================================================
  * AsyncSource
  * ========================================================================*/
 
+/*
+ * Is the decompressor for the method built in?
+ */
+static bool
+AsyncSourceCodecAvailable(SourceCompression method)
+{
+	switch (method)
+	{
+		case COMPRESSION_NONE:
+		case COMPRESSION_AUTO:
+#ifdef HAVE_LIBZ
+		case COMPRESSION_GZIP:
+#endif
+#ifdef ENABLE_BULKLOAD_ZSTD
+		case COMPRESSION_ZSTD:
+#endif
+#ifdef ENABLE_BULKLOAD_LZ4
+		case COMPRESSION_LZ4:
+#endif
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+ * Detect the compression method of the current file by the magic number at
+ * its head. The peeked bytes are kept in inbuf. Called in the read thread.
+ */
+static bool
+AsyncSourceDetect(AsyncSource *self, char *errbuf)
+{
+	static const unsigned char	gzip_magic[] = { 0x1f, 0x8b };
+	static const unsigned char	zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+	static const unsigned char	lz4_magic[] = { 0x04, 0x22, 0x4d, 0x18 };
+
+	bool	eof = false;
+
+	/* a pipe might return less than requested */
+	while (self->inlen < sizeof(zstd_magic) && !eof)
+	{
+		size_t	n = sizeof(zstd_magic) - self->inlen;
+
+		if (!AsyncSourceReadInput(self, self->inbuf + self->inlen, &n, &eof, errbuf))
+			return false;
+		if (n == 0 && !eof)
+			break;	/* asked to quit */
+		self->inlen += n;
+	}
+	self->in_eof = eof;
+
+	if (self->inlen >= sizeof(gzip_magic) &&
+		memcmp(self->inbuf, gzip_magic, sizeof(gzip_magic)) == 0)
+		self->compression = COMPRESSION_GZIP;
+	else if (self->inlen >= sizeof(zstd_magic) &&
+		memcmp(self->inbuf, zstd_magic, sizeof(zstd_magic)) == 0)
+		self->compression = COMPRESSION_ZSTD;
+	else if (self->inlen >= sizeof(lz4_magic) &&
+		memcmp(self->inbuf, lz4_magic, sizeof(lz4_magic)) == 0)
+		self->compression = COMPRESSION_LZ4;
+	else
+		self->compression = COMPRESSION_NONE;
+
+	return true;
+}
+
+/*
+ * Set up the decompressor for the current file. Decompressors are created on
+ * first use and reused for the following files, because each of them is
+ * ready for a new stream after the end of the previous one. Called in the
+ * read thread, so they are allocated with malloc.
+ */
+static bool
+AsyncSourceInitCodec(AsyncSource *self, char *errbuf)
+{
+	void  **codec = &self->codecs[self->compression];
+
+	switch (self->compression)
+	{
+#ifdef HAVE_LIBZ
+		case COMPRESSION_GZIP:
+			if (*codec == NULL)
+			{
+				z_stream   *zs = calloc(1, sizeof(z_stream));
+
+				/* accept both gzip and zlib headers */
+				if (zs == NULL || inflateInit2(zs, 15 + 32) != Z_OK)
+				{
+					free(zs);
+					break;
+				}
+				*codec = zs;
+			}
+			self->decompress = AsyncSourceInflate;
+			return true;
+#endif
+#ifdef ENABLE_BULKLOAD_ZSTD
+		case COMPRESSION_ZSTD:
+			if (*codec == NULL && (*codec = ZSTD_createDCtx()) == NULL)
+				break;
+			self->decompress = AsyncSourceZstd;
+			return true;
+#endif
+#ifdef ENABLE_BULKLOAD_LZ4
+		case COMPRESSION_LZ4:
+			if (*codec == NULL)
+			{
+				LZ4F_dctx  *dctx;
+
+				if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION)))
+					break;
+				*codec = dctx;
+			}
+			self->decompress = AsyncSourceLz4;
+			return true;
+#endif
+		default:
+			snprintf(errbuf, ERROR_MESSAGE_LEN,
+					 "COMPRESSION = %s is not supported by this build",
+					 COMPRESSION_NAMES[self->compression]);
+			return false;
+	}
+
+	snprintf(errbuf, ERROR_MESSAGE_LEN, "could not initialize %s decompression",
+			 COMPRESSION_NAMES[self->compression]);
+	return false;
+}
+
+static void
+AsyncSourceTermCodecs(AsyncSource *self)
+{
+#ifdef HAVE_LIBZ
+	if (self->codecs[COMPRESSION_GZIP])
+	{
+		inflateEnd((z_stream *) self->codecs[COMPRESSION_GZIP]);
+		free(self->codecs[COMPRESSION_GZIP]);
+	}
+#endif
+#ifdef ENABLE_BULKLOAD_ZSTD
+	if (self->codecs[COMPRESSION_ZSTD])
+		ZSTD_freeDCtx((ZSTD_DCtx *) self->codecs[COMPRESSION_ZSTD]);
+#endif
+#ifdef ENABLE_BULKLOAD_LZ4
+	if (self->codecs[COMPRESSION_LZ4])
+		LZ4F_freeDecompressionContext((LZ4F_dctx *) self->codecs[COMPRESSION_LZ4]);
+#endif
+	memset(self->codecs, 0, sizeof(self->codecs));
+}
+
+/*
+ * Create an AsyncSource. If files is not NIL, the read thread opens them in
+ * order instead of path.
+ */
 static Source *
-CreateAsyncSource(const char *path, TupleDesc desc)
+CreateAsyncSource(const char *path, List *files, TupleDesc desc,
+				  SourceCompression compression)
 {
 	AsyncSource *self = palloc0(sizeof(AsyncSource));
+	int			i;
+
 	self->base.read = (SourceReadProc) AsyncSourceRead;
 	self->base.close = (SourceCloseProc) AsyncSourceClose;
 
-	self->size = INITIAL_BUF_LEN;
-	self->begin = 0;
-	self->end = 0;
-	self->buffer = palloc0(self->size);
-	self->errmsg[0] = '\0';
+	if (files != NIL)
+	{
+		ListCell   *cell;
+
+		self->base.next_file = (SourceNextFileProc) AsyncSourceNextFile;
+		self->nfiles = list_length(files);
+		self->files = palloc(sizeof(char *) * self->nfiles);
+		i = 0;
+		foreach (cell, files)
+			self->files[i++] = lfirst(cell);
+		self->base.filename = self->files[0];
+		self->thread_open = true;
+	}
+	else
+	{
+		self->nfiles = 1;
+		self->files = palloc(sizeof(char *));
+		self->files[0] = pstrdup(path);
 
-	self->eof = false;
-	self->fd = AllocateFile(path, "r");
-	if (self->fd == NULL)
-		ereport(ERROR, (errcode_for_file_access(),
-			errmsg("could not open \"%s\" %m", path)));
+		self->fd = AllocateFile(path, "r");
+		if (self->fd == NULL)
+			ereport(ERROR, (errcode_for_file_access(),
+				errmsg("could not open \"%s\" %m", path)));
 
 #if defined(USE_POSIX_FADVISE)
-	posix_fadvise(fileno(self->fd), 0, 0, POSIX_FADV_SEQUENTIAL | POSIX_FADV_NOREUSE | POSIX_FADV_WILLNEED);
+		posix_fadvise(fileno(self->fd), 0, 0, POSIX_FADV_SEQUENTIAL | POSIX_FADV_NOREUSE | POSIX_FADV_WILLNEED);
 #endif
+	}
 
-	pthread_mutex_init(&self->lock, NULL);
-
-	if (pthread_create(&self->th, NULL, AsyncSourceMain, self) != 0)
-		elog(ERROR, "pthread_create");
+	AsyncSourceStart(self, compression);
 
 	return (Source *) self;
 }
 
-static size_t
-AsyncSourceRead(AsyncSource *self, void *buffer, size_t len)
+#ifndef WIN32
+/*
+ * Create an AsyncSource reading the output of a program or a named pipe.
+ * The read thread reads the pipe without blocking, so that it can stop
+ * anytime even if the writer is idle.
+ */
+static Source *
+CreatePipeSource(const char *path, const char *program, TupleDesc desc,
+				 SourceCompression compression)
 {
-	char   *data;
-	int		size;
-	int		begin;
-	int		end;
-	char	errhead;
-	size_t	bytesread;
-	int		n;
-
-	/* 4 times of the needs size allocate a buffer at least */
-	if (self->size < len * 4)
-	{
-		char   *newbuf;
-		int		newsize;
-
-		/* read buffer a multiple of READ_UNIT_SIZE */
-		newsize = (len * 4 - 1) -
-				  ((len * 4 - 1) / READ_UNIT_SIZE) +
-				  READ_UNIT_SIZE;
-		newbuf = palloc0(newsize);
+	AsyncSource *self = palloc0(sizeof(AsyncSource));
+	int			fd;
+	int			flags;
 
-		pthread_mutex_lock(&self->lock);
+	self->base.read = (SourceReadProc) AsyncSourceRead;
+	self->base.close = (SourceCloseProc) AsyncSourceClose;
+	self->nfiles = 1;
+	self->files = palloc(sizeof(char *));
+	self->is_pipe = true;
 
-		/* copy it in new buffer from old buffer */
-		if (self->begin > self->end)
+	if (program != NULL)
+	{
+		self->program = pstrdup(program);
+		self->files[0] = self->program;
+
+		fflush(stdout);
+		fflush(stderr);
+#if PG_VERSION_NUM >= 90300
+		self->fd = OpenPipeStream(program, PG_BINARY_R);
+#else
+		self->fd = popen(program, PG_BINARY_R);
+#endif
+		if (self->fd == NULL)
+			ereport(ERROR, (errcode_for_file_access(),
+				errmsg("could not execute command \"%s\": %m", program)));
+	}
+	else
+	{
+		self->files[0] = pstrdup(path);
+
+		/*
+		 * Opening a named pipe blocks until a writer opens it, and cannot be
+		 * canceled then. Open it without blocking, and wait for a writer here.
+		 */
+		fd = BasicOpenFile((FileName) path, O_RDONLY | O_NONBLOCK | PG_BINARY, 0);
+		if (fd < 0)
+			ereport(ERROR, (errcode_for_file_access(),
+				errmsg("could not open \"%s\" %m", path)));
+
+		PG_TRY();
 		{
-			memcpy(newbuf, self->buffer + self->begin,
-				   self->size - self->begin);
-			memcpy(newbuf + self->size - self->begin, self->buffer, self->end);
-			self->end = self->size - self->begin + self->end;
+			PipeSourceWaitWriter(fd, path);
 		}
-		else
+		PG_CATCH();
 		{
-			memcpy(newbuf, self->buffer + self->begin, self->end - self->begin);
-			self->end = self->end - self->begin;
+			close(fd);
+			PG_RE_THROW();
 		}
+		PG_END_TRY();
 
-		pfree(self->buffer);
-		self->buffer = newbuf;
-		self->size = newsize;
-		self->begin = 0;
+		if ((self->fd = fdopen(fd, PG_BINARY_R)) == NULL)
+		{
+			close(fd);
+			ereport(ERROR, (errcode_for_file_access(),
+				errmsg("could not open \"%s\" %m", path)));
+		}
+	}
 
-		pthread_mutex_unlock(&self->lock);
+	fd = fileno(self->fd);
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		ereport(ERROR, (errcode_for_file_access(),
+			errmsg("could not set pipe to non-blocking mode: %m")));
+
+#ifdef F_SETPIPE_SZ
+	/*
+	 * A larger pipe lets the writer run ahead and the thread read in larger
+	 * chunks. The capacity is limited by fs.pipe-max-size for non-root users,
+	 * so failure is not an error.
+	 */
+	(void) fcntl(fd, F_SETPIPE_SZ, PIPE_BUFFER_SIZE);
+#endif
+
+	AsyncSourceStart(self, compression);
+
+	return (Source *) self;
+}
+
+/*
+ * Wait until a writer opens the named pipe opened without blocking, or has
+ * written and gone. Reading it before would return end of input.
+ */
+static void
+PipeSourceWaitWriter(int fd, const char *path)
+{
+	for (;;)
+	{
+		struct pollfd	pfd;
+		int				rc;
+
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		rc = poll(&pfd, 1, WAIT_TIMEOUT_MSEC);
+		if (rc > 0)
+			break;
+		if (rc < 0 && errno != EINTR)
+			ereport(ERROR, (errcode_for_file_access(),
+				errmsg("could not poll \"%s\": %m", path)));
+
+		CHECK_FOR_INTERRUPTS();
 	}
+}
+#endif
+
+/*
+ * Allocate buffers and start the read thread.
+ */
+static void
+AsyncSourceStart(AsyncSource *self, SourceCompression compression)
+{
+	int		i;
+
+	for (i = 0; i < ASYNC_SLAB_NUM; i++)
+		self->slabs[i] = palloc(READ_UNIT_SIZE);
+	self->errmsg[0] = '\0';
 
-	/* this value that a read thread does not change */
-	data = self->buffer;
-	size = self->size;
-	begin = self->begin;
+	self->method = compression;
+	if (compression != COMPRESSION_NONE)
+		self->inbuf = palloc(READ_UNIT_SIZE);
 
-	bytesread = 0;
-retry:
-	end = self->end;
-	errhead = self->errmsg[0];
+	pthread_mutex_init(&self->lock, NULL);
+	pthread_cond_init(&self->filled, NULL);
+	pthread_cond_init(&self->drained, NULL);
+
+	if (pthread_create(&self->th, NULL, AsyncSourceMain, self) != 0)
+		elog(ERROR, "pthread_create");
+}
 
-	/* error in read thread */
-	if (errhead != '\0')
+/*
+ * Wait until the read thread publishes a slab. Returns false at end of input.
+ */
+static bool
+AsyncSourceWait(AsyncSource *self)
+{
+	TimestampTz	start = 0;
+	bool		stalled = false;
+	bool		found;
+
+	pthread_mutex_lock(&self->lock);
+	while (self->head == self->tail && !self->eof && self->errmsg[0] == '\0')
 	{
-		/* wait for error message to be set */
-		pthread_mutex_lock(&self->lock);
-		pthread_mutex_unlock(&self->lock);
+		if (!stalled)
+		{
+			stalled = true;
+			start = GetCurrentTimestamp();
+		}
+
+		/* wake up periodically to accept cancel requests */
+		pgut_cond_timedwait(&self->filled, &self->lock, WAIT_TIMEOUT_MSEC);
+
+		if (self->head == self->tail && !self->eof && self->errmsg[0] == '\0')
+		{
+			pthread_mutex_unlock(&self->lock);
+			CHECK_FOR_INTERRUPTS();
+			pthread_mutex_lock(&self->lock);
+		}
+	}
+	self->ready = self->head;
+	found = (self->ready != self->tail);
+	pthread_mutex_unlock(&self->lock);
 
+	if (stalled)
+	{
+		long	secs;
+		int		usecs;
+
+		TimestampDifference(start, GetCurrentTimestamp(), &secs, &usecs);
+		self->stalls++;
+		self->stall_secs += secs;
+		self->stall_usecs += usecs;
+		if (self->stall_usecs >= 1000000)
+		{
+			self->stall_secs++;
+			self->stall_usecs -= 1000000;
+		}
+	}
+
+	/* slabs filled before an error are still consumed first */
+	if (!found && self->errmsg[0] != '\0')
 		ereport(ERROR,
 				(errcode_for_file_access(),
 				 errmsg("%s", self->errmsg)));
+
+	/*
+	 * Check the exit status of the program before the last rows are written,
+	 * so that a failed program aborts the load as COPY FROM PROGRAM does.
+	 */
+	if (!found && self->program != NULL && self->fd != NULL)
+	{
+		char	failure[ERROR_MESSAGE_LEN];
+
+		AsyncSourceStop(self);
+		if (!PipeSourceEnd(self, failure))
+			ereport(ERROR,
+					(errcode(ERRCODE_EXTERNAL_ROUTINE_EXCEPTION),
+					 errmsg("%s", failure)));
 	}
 
-	if (begin < end)
+	return found;
+}
+
+/*
+ * Ask the read thread to stop and wait for it.
+ */
+static void
+AsyncSourceStop(AsyncSource *self)
+{
+	if (self->stopped)
+		return;
+
+	pthread_mutex_lock(&self->lock);
+	self->quit = true;
+	pthread_cond_signal(&self->drained);
+	pthread_mutex_unlock(&self->lock);
+	pthread_join(self->th, NULL);
+	self->stopped = true;
+}
+
+/*
+ * Close the pipe to the program and wait for it. Returns false with a message
+ * in errbuf if the program failed.
+ */
+static bool
+PipeSourceEnd(AsyncSource *self, char *errbuf)
+{
+#if PG_VERSION_NUM >= 90300
+	int		status = ClosePipeStream(self->fd);
+#else
+	int		status = pclose(self->fd);
+#endif
+	bool	sigpipe;
+
+	self->fd = NULL;
+
+	if (status == -1)
 	{
-		n = Min(len - bytesread, end - begin);
-		memcpy((char *) buffer + bytesread, data + begin, n);
-		begin += n;
-		bytesread += n;
+		snprintf(errbuf, ERROR_MESSAGE_LEN,
+				 "could not close pipe to external command: %s",
+				 strerror(errno));
+		return false;
 	}
-	else if (begin > end)
+
+	/*
+	 * The program gets SIGPIPE if it is still writing when we stop reading,
+	 * for example when LIMIT is reached or a parse error is being raised.
+	 * The shell reports it as an exit status.
+	 */
+	sigpipe = !self->eof &&
+		((WIFSIGNALED(status) && WTERMSIG(status) == SIGPIPE) ||
+		 (WIFEXITED(status) && WEXITSTATUS(status) == 128 + SIGPIPE));
+
+	if (WIFEXITED(status))
 	{
-		n = Min(len - bytesread, size - begin);
-		memcpy((char *) buffer + bytesread, data + begin, n);
-		begin += n;
+		LoggerLog(INFO, "Program exited with status %d\n",
+				  WEXITSTATUS(status));
+		if (WEXITSTATUS(status) != 0 && !sigpipe)
+		{
+			snprintf(errbuf, ERROR_MESSAGE_LEN,
+					 "program \"%s\" exited with status %d",
+					 self->program, WEXITSTATUS(status));
+			return false;
+		}
+	}
+	else if (WIFSIGNALED(status))
+	{
+		LoggerLog(INFO, "Program was terminated by signal %d\n",
+				  WTERMSIG(status));
+		if (!sigpipe)
+		{
+			snprintf(errbuf, ERROR_MESSAGE_LEN,
+					 "program \"%s\" was terminated by signal %d",
+					 self->program, WTERMSIG(status));
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static size_t
+AsyncSourceRead(AsyncSource *self, void *buffer, size_t len)
+{
+	size_t	bytesread = 0;
+
+	while (bytesread < len)
+	{
+		int		slot;
+		size_t	n;
+
+		/* slabs before ready were published under the lock */
+		if (self->ready == self->tail && !AsyncSourceWait(self))
+			break;	/* end of input */
+
+		/* stop at the end of the current file */
+		slot = self->tail % ASYNC_SLAB_NUM;
+		if (self->slab_file[slot] != self->cur_file)
+			break;
+
+		n = Min(len - bytesread, self->slab_len[slot] - self->offset);
+		memcpy((char *) buffer + bytesread, self->slabs[slot] + self->offset, n);
+		self->offset += n;
 		bytesread += n;
 
-		if (begin == size)
+		if (self->offset >= self->slab_len[slot])
 		{
-			self->begin = begin = 0;
-
-			if (bytesread < len)
-				goto retry;
+			/* give the slab back to the read thread */
+			pthread_mutex_lock(&self->lock);
+			self->in_flight -= self->slab_len[slot];
+			self->tail++;
+			pthread_cond_signal(&self->drained);
+			pthread_mutex_unlock(&self->lock);
+			self->offset = 0;
 		}
 	}
 
-	self->begin = begin;
+	return bytesread;
+}
 
-	if (bytesread == len || (self->eof && begin == end))
-		return bytesread;
+static bool
+AsyncSourceNextFile(AsyncSource *self)
+{
+	if (self->cur_file + 1 >= self->nfiles)
+	{
+		self->base.filename = NULL;
+		return false;
+	}
 
-	/* not enough data yet */
-	CHECK_FOR_INTERRUPTS();
-	pg_usleep(SPIN_SLEEP_MSEC * 1000);
+	self->cur_file++;
+	self->base.filename = self->files[self->cur_file];
 
-	goto retry;
+	return true;
 }
 
 static void
 AsyncSourceClose(AsyncSource *self)
 {
-	self->eof = true;
+	int		i;
+	bool	failed = false;
+	char	failure[ERROR_MESSAGE_LEN];
 
-	pthread_mutex_unlock(&self->lock);
-	pthread_join(self->th, NULL);
+	AsyncSourceStop(self);
 
-	if (self->fd != NULL && FreeFile(self->fd) < 0)
+	elog(DEBUG1, "async source: " int64_FMT " bytes read, %lu bytes in flight at most, "
+		 int64_FMT " stalls for %ld.%06d sec",
+		 self->bytes_read, (unsigned long) self->max_in_flight,
+		 self->stalls, self->stall_secs, self->stall_usecs);
+
+	if (self->methods_used != 0)
+	{
+		StringInfoData	buf;
+
+		initStringInfo(&buf);
+		for (i = 0; i < lengthof(COMPRESSION_NAMES); i++)
+		{
+			if ((self->methods_used & (1 << i)) == 0)
+				continue;
+			if (buf.len > 0)
+				appendStringInfoString(&buf, ", ");
+			appendStringInfoString(&buf, COMPRESSION_NAMES[i]);
+		}
+		LoggerLog(INFO, "Input was decompressed with %s: "
+				  int64_FMT " bytes read, " int64_FMT " bytes decompressed\n",
+				  buf.data, self->compressed_read, self->decompressed);
+		pfree(buf.data);
+	}
+
+	AsyncSourceTermCodecs(self);
+
+	if (self->is_pipe)
+		LoggerLog(INFO, "Input %s \"%s\": " int64_FMT " bytes read, "
+				  "waited " int64_FMT " times for %ld.%06d sec\n",
+				  self->program ? "program" : "pipe", self->files[0],
+				  self->bytes_read, self->stalls,
+				  self->stall_secs, self->stall_usecs);
+
+	if (self->program != NULL)
+	{
+		if (self->fd != NULL)
+			failed = !PipeSourceEnd(self, failure);
+	}
+	else if (self->thread_open)
+	{
+		/* the thread has gone, so close the files it left open */
+		if (self->fd != NULL)
+			fclose(self->fd);
+		if (self->next_fd != NULL)
+			fclose(self->next_fd);
+	}
+	else if (self->is_pipe)
+	{
+		/* named pipes are opened without AllocateFile */
+		if (self->fd != NULL)
+			fclose(self->fd);
+	}
+	else if (self->fd != NULL && FreeFile(self->fd) < 0)
 	{
 		ereport(WARNING, (errcode_for_file_access(),
 			errmsg("could not close source file: %m")));
 	}
 	self->fd = NULL;
+	self->next_fd = NULL;
 
-	if (self->buffer != NULL)
-		pfree(self->buffer);
-	self->buffer = NULL;
+	pthread_cond_destroy(&self->filled);
+	pthread_cond_destroy(&self->drained);
+	pthread_mutex_destroy(&self->lock);
+
+	for (i = 0; i < ASYNC_SLAB_NUM; i++)
+		pfree(self->slabs[i]);
+	if (self->inbuf != NULL)
+		pfree(self->inbuf);
 
 	pfree(self);
+
+	/* raised after the cleanup so that nothing is left behind */
+	if (failed)
+		ereport(ERROR,
+				(errcode(ERRCODE_EXTERNAL_ROUTINE_EXCEPTION),
+				 errmsg("%s", failure)));
+}
+
+/*
+ * Start reading the file. Called in the read thread, so the files are opened
+ * with stdio directly, and the next file is opened in advance to have the
+ * kernel read its head ahead while this file is parsed.
+ *
+ * AllocateFile() cannot be used here because fd.c is not thread-safe and
+ * raises errors with ereport(). Bypassing it is safe because the thread holds
+ * at most two descriptors (fd and next_fd), which fit in the descriptors that
+ * fd.c leaves for other uses (NUM_RESERVED_FDS), and AsyncSourceClose(), which
+ * is called on error paths too, joins the thread and closes them.
+ */
+static bool
+AsyncSourceBeginFile(AsyncSource *self, int file, char *errbuf)
+{
+	if (self->thread_open)
+	{
+		if (self->next_fd != NULL)
+		{
+			self->fd = self->next_fd;
+			self->next_fd = NULL;
+		}
+		else if ((self->fd = fopen(self->files[file], "r")) == NULL)
+		{
+			snprintf(errbuf, ERROR_MESSAGE_LEN, "could not open \"%s\" %s",
+					 self->files[file], strerror(errno));
+			return false;
+		}
+
+		/* errors on the next file are reported when it is read */
+		if (file + 1 < self->nfiles &&
+			(self->next_fd = fopen(self->files[file + 1], "r")) != NULL)
+		{
+#if defined(USE_POSIX_FADVISE)
+			posix_fadvise(fileno(self->next_fd), 0,
+						  ASYNC_SLAB_NUM * READ_UNIT_SIZE, POSIX_FADV_WILLNEED);
+#endif
+		}
+	}
+
+	self->fill = AsyncSourceFillFile;
+	self->inpos = self->inlen = 0;
+	self->in_eof = self->frame_open = false;
+
+	self->compression = self->method;
+	if (self->compression == COMPRESSION_AUTO &&
+		!AsyncSourceDetect(self, errbuf))
+		return false;
+
+	if (self->compression != COMPRESSION_NONE)
+	{
+		if (!AsyncSourceInitCodec(self, errbuf))
+			return false;
+		self->fill = AsyncSourceFillCompressed;
+		self->methods_used |= (1 << self->compression);
+		self->compressed_read += self->inlen;	/* peeked bytes */
+	}
+
+	return true;
+}
+
+static void
+AsyncSourceEndFile(AsyncSource *self)
+{
+	if (self->thread_open && self->fd != NULL)
+	{
+		fclose(self->fd);
+		self->fd = NULL;
+	}
 }
 
 static void *
 AsyncSourceMain(void *arg)
 {
-	AsyncSource   *self = (AsyncSource *) arg;
-	size_t			bytesread;
-	int				begin;
-	int				end;
-	int				size;
-	int				len;
-	char		   *data;
-
-	Assert(self->begin == 0);
-	Assert(self->end == 0);
+	AsyncSource *self = (AsyncSource *) arg;
+	char		errbuf[ERROR_MESSAGE_LEN];
+	int			file = 0;
+	bool		in_file = false;
 
 	for (;;)
 	{
+		int		slot;
+		size_t	bytesread = 0;
+		bool	eof = false;
+		bool	ok;
+
+		/* wait for a free slab */
 		pthread_mutex_lock(&self->lock);
+		while (self->head - self->tail >= ASYNC_SLAB_NUM && !self->quit)
+			pthread_cond_wait(&self->drained, &self->lock);
+		if (self->quit)
+		{
+			pthread_mutex_unlock(&self->lock);
+			break;
+		}
+		pthread_mutex_unlock(&self->lock);
 
-		begin = self->begin;
-		end = self->end;
-		size = self->size;
-		data = self->buffer;
+		/* the slab at head is owned by this thread until it is published */
+		slot = self->head % ASYNC_SLAB_NUM;
+		ok = in_file || AsyncSourceBeginFile(self, file, errbuf);
+		if (ok)
+		{
+			in_file = true;
+			bytesread = READ_UNIT_SIZE;
+			ok = self->fill(self, self->slabs[slot], &bytesread, &eof, errbuf);
+			if (ok && self->compression != COMPRESSION_NONE)
+				self->decompressed += bytesread;
+		}
 
-		if (begin > end)
+		pthread_mutex_lock(&self->lock);
+		if (!ok)
 		{
-			len = begin - end;
-			if (len <= READ_UNIT_SIZE)
-				len = 0;
+			strlcpy(self->errmsg, errbuf, ERROR_MESSAGE_LEN);
+			pthread_cond_signal(&self->filled);
+			pthread_mutex_unlock(&self->lock);
+			break;
 		}
-		else
+
+		if (bytesread > 0)
+		{
+			self->slab_len[slot] = bytesread;
+			self->slab_file[slot] = file;
+			self->bytes_read += bytesread;
+			self->in_flight += bytesread;
+			if (self->max_in_flight < self->in_flight)
+				self->max_in_flight = self->in_flight;
+			self->head++;
+		}
+		if (eof && file + 1 >= self->nfiles)
+			self->eof = true;
+		pthread_cond_signal(&self->filled);
+		pthread_mutex_unlock(&self->lock);
+
+		if (eof)
+		{
+			AsyncSourceEndFile(self);
+			if (++file >= self->nfiles)
+				break;
+			in_file = false;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Read at most *len bytes from the current file into buffer. A pipe is read
+ * without blocking; this returns what is available as soon as any data has
+ * arrived, and returns nothing without eof when the backend asks to quit.
+ */
+static bool
+AsyncSourceReadInput(AsyncSource *self, char *buffer, size_t *len, bool *eof,
+					 char *errbuf)
+{
+	size_t	bytesread = 0;
+
+	*eof = false;
+
+	if (!self->is_pipe)
+	{
+		bytesread = fread(buffer, 1, *len, self->fd);
+		if (ferror(self->fd))
+		{
+			snprintf(errbuf, ERROR_MESSAGE_LEN,
+					 "could not read from source file: %s", strerror(errno));
+			return false;
+		}
+		*eof = (bytesread < *len && feof(self->fd));
+		*len = bytesread;
+		return true;
+	}
+
+#ifndef WIN32
+	while (bytesread < *len)
+	{
+		ssize_t			n;
+		struct pollfd	pfd;
+		bool			quit;
+
+		n = read(fileno(self->fd), buffer + bytesread, *len - bytesread);
+		if (n > 0)
+		{
+			bytesread += n;
+			continue;
+		}
+		if (n == 0)
+		{
+			*eof = true;
+			break;
+		}
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			snprintf(errbuf, ERROR_MESSAGE_LEN,
+					 "could not read from pipe: %s", strerror(errno));
+			return false;
+		}
+
+		/* the pipe is empty; hand over what we have */
+		if (bytesread > 0)
+			break;
+
+		pthread_mutex_lock(&self->lock);
+		quit = self->quit;
+		pthread_mutex_unlock(&self->lock);
+		if (quit)
+			break;
+
+		pfd.fd = fileno(self->fd);
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, WAIT_TIMEOUT_MSEC) < 0 && errno != EINTR)
+		{
+			snprintf(errbuf, ERROR_MESSAGE_LEN,
+					 "could not poll pipe: %s", strerror(errno));
+			return false;
+		}
+	}
+#endif
+
+	*len = bytesread;
+	return true;
+}
+
+/*
+ * Read plain input. Bytes peeked to detect compression are returned first.
+ */
+static bool
+AsyncSourceFillFile(AsyncSource *self, char *buffer, size_t *len, bool *eof,
+					char *errbuf)
+{
+	size_t	bytesread = 0;
+
+	if (self->inpos < self->inlen)
+	{
+		bytesread = Min(*len, self->inlen - self->inpos);
+		memcpy(buffer, self->inbuf + self->inpos, bytesread);
+		self->inpos += bytesread;
+	}
+
+	if (self->in_eof)
+		*eof = true;
+	else
+	{
+		size_t	n = *len - bytesread;
+
+		if (!AsyncSourceReadInput(self, buffer + bytesread, &n, eof, errbuf))
+			return false;
+		bytesread += n;
+	}
+
+	*len = bytesread;
+	return true;
+}
+
+/*
+ * Decompress input until the buffer is full or the input ends.
+ */
+static bool
+AsyncSourceFillCompressed(AsyncSource *self, char *buffer, size_t *len,
+						  bool *eof, char *errbuf)
+{
+	size_t	total = 0;
+
+	while (total < *len)
+	{
+		size_t	produced;
+
+		if (self->inpos >= self->inlen && !self->in_eof)
 		{
-			len = size - end;
-			if (begin == 0 && len <= READ_UNIT_SIZE)
-				len = 0;
+			self->inpos = 0;
+			self->inlen = READ_UNIT_SIZE;
+			if (!AsyncSourceReadInput(self, self->inbuf, &self->inlen,
+									  &self->in_eof, errbuf))
+				return false;
+			self->compressed_read += self->inlen;
+
+			/* nothing read from a pipe only when asked to quit */
+			if (self->inlen == 0 && !self->in_eof)
+				break;
+		}
+
+		if (!self->decompress(self, buffer + total, *len - total,
+							  &produced, errbuf))
+			return false;
+		total += produced;
+
+		/* the decompressor cannot progress any more */
+		if (produced == 0 && self->inpos >= self->inlen && self->in_eof)
+		{
+			if (self->frame_open)
+			{
+				snprintf(errbuf, ERROR_MESSAGE_LEN,
+						 "unexpected end of %s compressed input",
+						 COMPRESSION_NAMES[self->compression]);
+				return false;
+			}
+			*eof = true;
+			break;
 		}
+	}
 
-		if (len == 0)
-		{
-			pthread_mutex_unlock(&self->lock);
-
-			if (self->eof)
-				break;
+	*len = total;
+	return true;
+}
 
-			pg_usleep(SPIN_SLEEP_MSEC * 1000);
+#ifdef HAVE_LIBZ
+static bool
+AsyncSourceInflate(AsyncSource *self, char *buffer, size_t len,
+				   size_t *produced, char *errbuf)
+{
+	z_stream   *zs = (z_stream *) self->codecs[COMPRESSION_GZIP];
+	int			ret;
 
-			continue;
-			/* retry */
-		}
+	zs->next_in = (Bytef *) self->inbuf + self->inpos;
+	zs->avail_in = self->inlen - self->inpos;
+	zs->next_out = (Bytef *) buffer;
+	zs->avail_out = len;
+	if (zs->avail_in > 0)
+		self->frame_open = true;
 
-		len = Min(len, READ_UNIT_SIZE);
+	ret = inflate(zs, Z_NO_FLUSH);
+	self->inpos = self->inlen - zs->avail_in;
+	*produced = len - zs->avail_out;
 
-		bytesread = fread(data + end, 1, len, self->fd);
+	if (ret == Z_STREAM_END)
+	{
+		/* a gzip file can be a concatenation of members */
+		inflateReset(zs);
+		self->frame_open = false;
+	}
+	else if (ret != Z_OK && ret != Z_BUF_ERROR)
+	{
+		snprintf(errbuf, ERROR_MESSAGE_LEN,
+				 "could not decompress gzip input: %s",
+				 zs->msg ? zs->msg : "unknown error");
+		return false;
+	}
 
-		if (ferror(self->fd))
-		{
-			snprintf(self->errmsg, ERROR_MESSAGE_LEN,
-					 "could not read from source file: %m");
-			pthread_mutex_unlock(&self->lock);
-			return NULL;
-		}
+	return true;
+}
+#endif
 
-		end += bytesread;
-		if (end == self->size)
-			end = 0;
+#ifdef ENABLE_BULKLOAD_ZSTD
+static bool
+AsyncSourceZstd(AsyncSource *self, char *buffer, size_t len,
+				size_t *produced, char *errbuf)
+{
+	ZSTD_inBuffer	in;
+	ZSTD_outBuffer	out;
+	size_t			ret;
+
+	in.src = self->inbuf;
+	in.size = self->inlen;
+	in.pos = self->inpos;
+	out.dst = buffer;
+	out.size = len;
+	out.pos = 0;
+
+	ret = ZSTD_decompressStream((ZSTD_DCtx *) self->codecs[COMPRESSION_ZSTD], &out, &in);
+	if (ZSTD_isError(ret))
+	{
+		snprintf(errbuf, ERROR_MESSAGE_LEN,
+				 "could not decompress zstd input: %s", ZSTD_getErrorName(ret));
+		return false;
+	}
 
-		self->end = end;
+	/* 0 means a frame is completely decoded and flushed */
+	if (in.pos > self->inpos || out.pos > 0)
+		self->frame_open = (ret != 0);
+	self->inpos = in.pos;
+	*produced = out.pos;
 
-		if (feof(self->fd))
-		{
-			self->eof = true;
-			break;
-		}
+	return true;
+}
+#endif
 
-		if (self->eof)
-			break;
+#ifdef ENABLE_BULKLOAD_LZ4
+static bool
+AsyncSourceLz4(AsyncSource *self, char *buffer, size_t len,
+			   size_t *produced, char *errbuf)
+{
+	size_t	dstlen = len;
+	size_t	srclen = self->inlen - self->inpos;
+	size_t	ret;
 
-		pthread_mutex_unlock(&self->lock);
+	ret = LZ4F_decompress((LZ4F_dctx *) self->codecs[COMPRESSION_LZ4], buffer, &dstlen,
+						  self->inbuf + self->inpos, &srclen, NULL);
+	if (LZ4F_isError(ret))
+	{
+		snprintf(errbuf, ERROR_MESSAGE_LEN,
+				 "could not decompress lz4 input: %s", LZ4F_getErrorName(ret));
+		return false;
 	}
 
-	pthread_mutex_unlock(&self->lock);
+	/* 0 means a frame is completely decoded and flushed */
+	if (srclen > 0 || dstlen > 0)
+		self->frame_open = (ret != 0);
+	self->inpos += srclen;
+	*produced = dstlen;
 
-	return NULL;
+	return true;
 }
+#endif
 
 /* ========================================================================
  * FileSource
@@ -382,6 +1649,7 @@ CreateFileSource(const char *path, TupleDesc desc)
 {
 	FileSource *self = palloc0(sizeof(FileSource));
 	self->base.read = (SourceReadProc) FileSourceRead;
+	self->base.skip = (SourceSkipProc) FileSourceSkip;
 	self->base.close = (SourceCloseProc) FileSourceClose;
 
 	self->fd = AllocateFile(path, "r");
@@ -410,6 +1678,31 @@ FileSourceRead(FileSource *self, void *buffer, size_t len)
 	return bytesread;
 }
 
+/*
+ * Seek forward, but not beyond the end of file.
+ */
+static int64
+FileSourceSkip(FileSource *self, int64 len)
+{
+	struct stat	st;
+	off_t		pos;
+
+	pos = ftello(self->fd);
+	if (pos < 0 || fstat(fileno(self->fd), &st) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not seek in source file: %m")));
+
+	if (len > st.st_size - pos)
+		len = Max(st.st_size - pos, 0);
+	if (fseeko(self->fd, pos + len, SEEK_SET) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not seek in source file: %m")));
+
+	return len;
+}
+
 static void
 FileSourceClose(FileSource *self)
 {
@@ -421,6 +1714,162 @@ FileSourceClose(FileSource *self)
 	pfree(self);
 }
 
+/* ========================================================================
+ * MmapSource
+ * ========================================================================*/
+
+#ifndef WIN32
+
+static Source *
+CreateMmapSource(const char *path, TupleDesc desc)
+{
+	MmapSource *self = palloc0(sizeof(MmapSource));
+	struct stat	st;
+
+	self->base.read = (SourceReadProc) MmapSourceRead;
+	self->base.window = (SourceWindowProc) MmapSourceWindow;
+	self->base.consume = (SourceConsumeProc) MmapSourceConsume;
+	self->base.skip = (SourceSkipProc) MmapSourceSkip;
+	self->base.close = (SourceCloseProc) MmapSourceClose;
+
+	self->fd = AllocateFile(path, "r");
+	if (self->fd == NULL)
+		ereport(ERROR, (errcode_for_file_access(),
+			errmsg("could not open \"%s\" %m", path)));
+
+	if (fstat(fileno(self->fd), &st) < 0)
+		ereport(ERROR, (errcode_for_file_access(),
+			errmsg("could not stat \"%s\" %m", path)));
+	if (!S_ISREG(st.st_mode))
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			errmsg("MMAP requires a regular file: \"%s\"", path)));
+
+	self->size = st.st_size;
+
+	return (Source *) self;
+}
+
+static char *
+MmapSourceWindow(MmapSource *self, size_t need, size_t *avail)
+{
+	off_t	end;
+
+	/* cannot lend beyond the end of file */
+	if (need > self->size - self->pos)
+		need = self->size - self->pos;
+
+	if (need == 0)
+	{
+		*avail = 0;
+		return self->map ? self->map + (self->pos - self->map_offset) : "";
+	}
+
+	end = self->map_offset + self->map_len;
+	if (self->map == NULL || self->pos < self->map_offset ||
+		self->pos + need > end)
+	{
+		long	pagesize = sysconf(_SC_PAGESIZE);
+		off_t	offset;
+		size_t	len;
+
+		/* slide the window; the head must be aligned to a page */
+		if (self->map != NULL)
+			munmap(self->map, self->map_len);
+		self->map = NULL;
+
+		offset = self->pos - self->pos % pagesize;
+		len = Max(MMAP_WINDOW_SIZE, (self->pos - offset) + need);
+		len = Min(len, self->size - offset);
+
+		self->map = mmap(NULL, len, PROT_READ, MAP_SHARED,
+						 fileno(self->fd), offset);
+		if (self->map == MAP_FAILED)
+		{
+			self->map = NULL;
+			ereport(ERROR, (errcode_for_file_access(),
+				errmsg("could not map source file: %m")));
+		}
+#ifdef MADV_SEQUENTIAL
+		madvise(self->map, len, MADV_SEQUENTIAL);
+#endif
+		self->map_offset = offset;
+		self->map_len = len;
+		end = offset + len;
+	}
+
+	*avail = end - self->pos;
+	return self->map + (self->pos - self->map_offset);
+}
+
+static void
+MmapSourceConsume(MmapSource *self, size_t len)
+{
+	Assert(self->pos + len <= self->size);
+	self->pos += len;
+}
+
+static size_t
+MmapSourceRead(MmapSource *self, void *buffer, size_t len)
+{
+	size_t	bytesread = 0;
+
+	while (bytesread < len)
+	{
+		size_t	avail;
+		char   *data;
+
+		data = MmapSourceWindow(self, Min(len - bytesread, MMAP_WINDOW_SIZE), &avail);
+		if (avail == 0)
+			break;
+		avail = Min(avail, len - bytesread);
+		memcpy((char *) buffer + bytesread, data, avail);
+		MmapSourceConsume(self, avail);
+		bytesread += avail;
+	}
+
+	return bytesread;
+}
+
+/*
+ * Move the current position only; the window slides when data is asked.
+ */
+static int64
+MmapSourceSkip(MmapSource *self, int64 len)
+{
+	if (len > self->size - self->pos)
+		len = self->size - self->pos;
+	self->pos += len;
+
+	return len;
+}
+
+static void
+MmapSourceClose(MmapSource *self)
+{
+	if (self->map != NULL)
+		munmap(self->map, self->map_len);
+
+	if (self->fd != NULL && FreeFile(self->fd) < 0)
+	{
+		ereport(WARNING, (errcode_for_file_access(),
+			errmsg("could not close source file: %m")));
+	}
+	pfree(self);
+}
+
+#else
+
+static Source *
+CreateMmapSource(const char *path, TupleDesc desc)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("MMAP is not supported on this platform")));
+	return NULL;	/* keep compiler quiet */
+}
+
+#endif
+
 /* ========================================================================
  * RemoteSource
  * ========================================================================*/
@@ -442,6 +1891,8 @@ CreateRemoteSource(const char *path, TupleDesc desc)
 		int				i;
 
 		self->base.read = (SourceReadProc) RemoteSourceRead;
+		self->base.window = (SourceWindowProc) RemoteSourceWindow;
+		self->base.consume = (SourceConsumeProc) RemoteSourceConsume;
 
 		/* count valid fields */
 		for (nattrs = 0, i = 0; i < desc->natts; i++)
@@ -459,6 +1910,7 @@ CreateRemoteSource(const char *path, TupleDesc desc)
 			pq_sendint(&buf, format, 2);		/* per-column formats */
 		pq_endmessage(&buf);
 		self->buffer = makeStringInfo();
+		self->join = makeStringInfo();
 	}
 	else if (PG_PROTOCOL_MAJOR(FrontendProtocol) >= 2)
 	{
@@ -488,70 +1940,164 @@ CreateRemoteSource(const char *path, TupleDesc desc)
 	return (Source *) self;
 }
 
-static size_t
-RemoteSourceRead(RemoteSource *self, void *buffer, size_t len)
+/*
+ * Receive the next CopyData message into buffer. Returns false at the end of
+ * COPY data.
+ */
+static bool
+RemoteSourceReceive(RemoteSource *self)
 {
-	size_t	bytesread;
-	size_t	minread = len;
+	int			mtype;
+
+readmessage:
+	mtype = pq_getbyte();
+	if (mtype == EOF)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+			 errmsg("unexpected EOF on client connection")));
+	if (pq_getmessage(self->buffer, 0))
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+			 errmsg("unexpected EOF on client connection")));
+	switch (mtype)
+	{
+		case 'd':		/* CopyData */
+			self->messages++;
+			self->received += self->buffer->len;
+			return true;
+		case 'c':		/* CopyDone */
+			/* COPY IN correctly terminated by frontend */
+			resetStringInfo(self->buffer);
+			self->eof = true;
+			return false;
+		case 'f':		/* CopyFail */
+			ereport(ERROR,
+					(errcode(ERRCODE_QUERY_CANCELED),
+					 errmsg("COPY from stdin failed: %s",
+					   pq_getmsgstring(self->buffer))));
+			break;
+		case 'H':		/* Flush */
+		case 'S':		/* Sync */
+
+			/*
+			 * Ignore Flush/Sync for the convenience of client
+			 * libraries (such as libpq) that may send those
+			 * without noticing that the command they just
+			 * sent was COPY.
+			 */
+			goto readmessage;
+		default:
+			ereport(ERROR,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg("unexpected message type 0x%02X during COPY from stdin",
+							mtype)));
+			break;
+	}
+
+	return false;	/* keep compiler quiet */
+}
 
-	bytesread = 0;
-	while (len > 0 && bytesread < minread && !self->eof)
+static char *
+RemoteSourceWindow(RemoteSource *self, size_t need, size_t *avail)
+{
+	StringInfo	join = self->join;
+	StringInfo	msg = self->buffer;
+	bool		growing = false;
+
+	for (;;)
 	{
-		int			avail;
+		bool	msg_end = (self->msgpos >= msg->len);
+		size_t	n;
+		char   *nl;
 
-		while (self->buffer->cursor >= self->buffer->len)
+		if (self->pos >= join->len)
 		{
-			/* Try to receive another message */
-			int			mtype;
+			/* in the message */
+			int		offset = self->msgpos + (self->pos - join->len);
 
-readmessage:
-			mtype = pq_getbyte();
-			if (mtype == EOF)
-				ereport(ERROR,
-						(errcode(ERRCODE_CONNECTION_FAILURE),
-					 errmsg("unexpected EOF on client connection")));
-			if (pq_getmessage(self->buffer, 0))
-				ereport(ERROR,
-						(errcode(ERRCODE_CONNECTION_FAILURE),
-					 errmsg("unexpected EOF on client connection")));
-			switch (mtype)
+			if (msg->len - offset >= need || (msg_end && self->eof))
 			{
-				case 'd':		/* CopyData */
-					break;
-				case 'c':		/* CopyDone */
-					/* COPY IN correctly terminated by frontend */
-					self->eof = true;
-					return bytesread;
-				case 'f':		/* CopyFail */
-					ereport(ERROR,
-							(errcode(ERRCODE_QUERY_CANCELED),
-							 errmsg("COPY from stdin failed: %s",
-							   pq_getmsgstring(self->buffer))));
-					break;
-				case 'H':		/* Flush */
-				case 'S':		/* Sync */
-
-					/*
-					 * Ignore Flush/Sync for the convenience of client
-					 * libraries (such as libpq) that may send those
-					 * without noticing that the command they just
-					 * sent was COPY.
-					 */
-					goto readmessage;
-				default:
-					ereport(ERROR,
-							(errcode(ERRCODE_PROTOCOL_VIOLATION),
-							 errmsg("unexpected message type 0x%02X during COPY from stdin",
-									mtype)));
-					break;
+				*avail = msg->len - offset;
+				return msg->data + offset;
+			}
+
+			/* join from the current position */
+			self->msgpos = offset;
+			resetStringInfo(join);
+		}
+		else
+		{
+			/* in the joined bytes */
+			if (join->len - self->pos >= need || (msg_end && self->eof))
+			{
+				*avail = join->len - self->pos;
+				self->lent = self->pos;
+				return join->data + self->pos;
+			}
+
+			/* nothing consumed since the last window; a record is long */
+			if (self->pos == self->lent)
+				growing = true;
+
+			if (self->pos > 0)
+			{
+				join->len -= self->pos;
+				memmove(join->data, join->data + self->pos, join->len);
+				join->data[join->len] = '\0';
 			}
 		}
-		avail = self->buffer->len - self->buffer->cursor;
-		if (avail > len)
-			avail = len;
-		pq_copymsgbytes(self->buffer, (char *) buffer, avail);
-		buffer = (void *) ((char *) buffer + avail);
-		len -= avail;
+		self->pos = 0;
+		self->lent = 0;
+
+		if (self->msgpos >= msg->len)
+		{
+			/* move on to the next message */
+			RemoteSourceReceive(self);
+			self->msgpos = 0;
+			continue;
+		}
+
+		/*
+		 * Join just enough bytes so that parsers, which consume whole records,
+		 * come back to the message soon. If a record is still incomplete,
+		 * join up to the end of the line, which is the end of the record in
+		 * most cases.
+		 */
+		n = Min(need - join->len, msg->len - self->msgpos);
+		if (growing &&
+			(nl = memchr(msg->data + self->msgpos + n, '\n',
+						 msg->len - self->msgpos - n)) != NULL)
+			n = nl + 1 - (msg->data + self->msgpos);
+		else if (growing)
+			n = msg->len - self->msgpos;
+		appendBinaryStringInfo(join, msg->data + self->msgpos, n);
+		self->msgpos += n;
+		self->joined += n;
+	}
+}
+
+static void
+RemoteSourceConsume(RemoteSource *self, size_t len)
+{
+	self->pos += len;
+}
+
+static size_t
+RemoteSourceRead(RemoteSource *self, void *buffer, size_t len)
+{
+	size_t	bytesread = 0;
+
+	while (bytesread < len)
+	{
+		size_t	avail;
+		char   *data;
+
+		data = RemoteSourceWindow(self, 1, &avail);
+		if (avail == 0)
+			break;	/* end of input */
+		avail = Min(avail, len - bytesread);
+		memcpy((char *) buffer + bytesread, data, avail);
+		RemoteSourceConsume(self, avail);
 		bytesread += avail;
 	}
 
@@ -627,6 +2173,220 @@ RemoteSourceClose(RemoteSource *self)
 		{"duration", FLOAT8OID, 8, -1}
 	};
 
+	if (self->buffer != NULL)
+		elog(DEBUG1, "remote source: " int64_FMT " bytes received in "
+			 int64_FMT " messages, " int64_FMT " bytes joined",
+			 self->received, self->messages, self->joined);
+
 	SendResultDescriptionMessage(attrs, PG_BULKLOAD_COLS);
 	pfree(self);
 }
+
+/* ========================================================================
+ * ConversionSource
+ * ========================================================================*/
+
+/*
+ * Wrap source with a ConversionSource for ENCODING. checker must have been
+ * initialized by CheckerInit(), and the returned source owns source.
+ */
+Source *
+CreateConversionSource(Source *source, Checker *checker)
+{
+	ConversionSource *self = palloc0(sizeof(ConversionSource));
+	self->base.read = (SourceReadProc) ConversionSourceRead;
+	self->base.skip = (SourceSkipProc) ConversionSourceSkip;
+	self->base.next_file = (SourceNextFileProc) ConversionSourceNextFile;
+	self->base.close = (SourceCloseProc) ConversionSourceClose;
+	self->base.filename = source->filename;
+
+	self->source = source;
+	self->checker = checker;
+	self->convert = CheckerNeedConversion(checker);
+	/* Characters are checked in the database encoding if not converted. */
+	if (checker->encoding == PG_SQL_ASCII)
+		self->encoding = checker->db_encoding;
+	else
+		self->encoding = checker->encoding;
+	self->raw = palloc(READ_UNIT_SIZE);
+	initStringInfo(&self->buf);
+
+	checker->source_conversion = true;
+
+	return (Source *) self;
+}
+
+/*
+ * Read the next block from the source and convert the whole characters in
+ * it. Returns false at the end of the current file.
+ */
+static bool
+ConversionSourceFill(ConversionSource *self)
+{
+	Checker	   *checker = self->checker;
+	size_t		carry = self->raw_len - self->complete;
+	size_t		len;
+	char	   *p;
+	char	   *end;
+
+	/* Move the partial character to the head of the block. */
+	if (carry > 0)
+		memmove(self->raw, self->raw + self->complete, carry);
+	self->raw_len = carry;
+	self->complete = 0;
+	self->data_len = self->pos = 0;
+
+	len = SourceRead(self->source, self->raw + carry, READ_UNIT_SIZE - carry);
+	if (len == 0 && carry == 0)
+		return false;
+	self->raw_len += len;
+	self->blocks++;
+
+	p = self->raw;
+	end = self->raw + self->raw_len;
+	p += ScanNonAscii(p, end - p);
+	if (p >= end)
+	{
+		self->ascii++;
+		self->complete = self->raw_len;
+		self->data = self->raw;
+		self->data_len = self->raw_len;
+		return true;
+	}
+
+	/*
+	 * Find the end of the last whole character. A partial character at the
+	 * end of the file is left to the checks below to be reported.
+	 */
+	while (p < end)
+	{
+		if (IS_HIGHBIT_SET(*p))
+		{
+			int		mblen = pg_encoding_mblen(self->encoding, p);
+
+			if (mblen > end - p)
+			{
+				if (len > 0)
+					break;
+				p = end;
+			}
+			else
+				p += mblen;
+		}
+		else
+			p += ScanNonAscii(p, end - p);
+	}
+	self->complete = p - self->raw;
+
+	if (!self->convert)
+	{
+		/*
+		 * The block is only checked. Invalid input is lent as it is, and the
+		 * parser checks the fields from then on to report the records.
+		 */
+		if (!checker->check_fields &&
+			!CheckerVerifyBytes(checker, self->raw, (int) self->complete))
+			checker->check_fields = true;
+		self->data = self->raw;
+		self->data_len = self->complete;
+		return true;
+	}
+
+	/* NUL bytes are passed through because the conversions reject them. */
+	resetStringInfo(&self->buf);
+	for (p = self->raw, end = self->raw + self->complete; p < end;)
+	{
+		char   *nul = memchr(p, '\0', end - p);
+		int		n = (nul ? nul : end) - p;
+
+		if (n > 0)
+		{
+			char   *str = CheckerConversionBytes(checker, p, n);
+
+			if (str == p)
+				appendBinaryStringInfo(&self->buf, p, n);
+			else
+			{
+				appendStringInfoString(&self->buf, str);
+				pfree(str);
+			}
+			p += n;
+		}
+		if (p < end)
+		{
+			appendStringInfoChar(&self->buf, '\0');
+			p++;
+		}
+	}
+
+	self->data = self->buf.data;
+	self->data_len = self->buf.len;
+
+	return true;
+}
+
+static size_t
+ConversionSourceRead(ConversionSource *self, void *buffer, size_t len)
+{
+	size_t	n;
+
+	while (self->pos >= self->data_len)
+	{
+		if (!ConversionSourceFill(self))
+			return 0;	/* end of the current file */
+	}
+
+	n = Min(len, self->data_len - self->pos);
+	memcpy(buffer, self->data + self->pos, n);
+	self->pos += n;
+
+	return n;
+}
+
+/*
+ * Skip the input, the rest of the current block first. Offsets are counted in
+ * the input bytes, so this is for input which is only checked and lent as it
+ * is; parsers refuse to skip bytes of input which is converted.
+ */
+static int64
+ConversionSourceSkip(ConversionSource *self, int64 len)
+{
+	int64	skipped;
+
+	skipped = Min(len, (int64) (self->data_len - self->pos));
+	self->pos += skipped;
+	if (skipped == len)
+		return skipped;
+
+	/* The partial character carried over is dropped too. */
+	skipped += self->raw_len - self->complete;
+	self->raw_len = self->complete = 0;
+	self->data_len = self->pos = 0;
+	if (skipped >= len)
+		return len;
+
+	return skipped + SourceSkip(self->source, len - skipped);
+}
+
+static bool
+ConversionSourceNextFile(ConversionSource *self)
+{
+	bool	ret = SourceNextFile(self->source);
+
+	self->base.filename = self->source->filename;
+
+	return ret;
+}
+
+static void
+ConversionSourceClose(ConversionSource *self)
+{
+	elog(DEBUG1, "conversion source: " int64_FMT " blocks read, "
+		 int64_FMT " blocks of ASCII only",
+		 self->blocks, self->ascii);
+
+	SourceClose(self->source);
+	pfree(self->raw);
+	pfree(self->buf.data);
+	pfree(self);
+}
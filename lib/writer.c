@@ -88,6 +88,25 @@ WriterParam(Writer *self, const char *keyword, char *value)
 	return true;
 }
 
+/**
+ * @brief Insert tuples at a time, or one by one if the writer does not
+ * support it.
+ */
+void
+WriterInsertBatch(Writer *self, HeapTuple *tuples, int ntuples)
+{
+	int		i;
+
+	if (self->insertBatch)
+	{
+		self->insertBatch(self, tuples, ntuples);
+		return;
+	}
+
+	for (i = 0; i < ntuples; i++)
+		WriterInsert(self, tuples[i]);
+}
+
 void
 WriterDumpParams(Writer *self)
 {
@@ -165,7 +165,11 @@ BinaryWriterInsert(BinaryWriter *self, HeapTuple tuple)
 		Field  *field = self->fields + i;
 
 		if (!self->nulls[i])
+		{
 			field->write(col, field->len, self->values[i], self->nulls[i]);
+			if (field->swap)
+				BinaryReverseBytes(col, field->len);
+		}
 		else
 			field->write(col, field->len, PointerGetDatum(field->nullif), field->nulllen);
 
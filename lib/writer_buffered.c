@@ -32,6 +32,9 @@ typedef struct BufferedWriter
 
 static void	BufferedWriterInit(BufferedWriter *self);
 static void	BufferedWriterInsert(BufferedWriter *self, HeapTuple tuple);
+#if PG_VERSION_NUM >= 90200
+static void	BufferedWriterInsertBatch(BufferedWriter *self, HeapTuple *tuples, int ntuples);
+#endif
 static WriterResult	BufferedWriterClose(BufferedWriter *self, bool onError);
 static bool	BufferedWriterParam(BufferedWriter *self, const char *keyword, char *value);
 static void	BufferedWriterDumpParams(BufferedWriter *self);
@@ -50,6 +53,9 @@ CreateBufferedWriter(void *opt)
 	BufferedWriter *self = palloc0(sizeof(BufferedWriter));
 	self->base.init = (WriterInitProc) BufferedWriterInit;
 	self->base.insert = (WriterInsertProc) BufferedWriterInsert;
+#if PG_VERSION_NUM >= 90200
+	self->base.insertBatch = (WriterInsertBatchProc) BufferedWriterInsertBatch;
+#endif
 	self->base.close = (WriterCloseProc) BufferedWriterClose;
 	self->base.param = (WriterParamProc) BufferedWriterParam;
 	self->base.dumpParams = (WriterDumpParamsProc) BufferedWriterDumpParams;
@@ -98,6 +104,24 @@ BufferedWriterInsert(BufferedWriter *self, HeapTuple tuple)
 	SpoolerInsert(&self->spooler, tuple);
 }
 
+#if PG_VERSION_NUM >= 90200
+/**
+ * @brief Store tuples into the heap at a time, filling each page with
+ * one lock and one WAL record.
+ * @return void
+ */
+static void
+BufferedWriterInsertBatch(BufferedWriter *self, HeapTuple *tuples, int ntuples)
+{
+	int		i;
+
+	heap_multi_insert(self->base.rel, tuples, ntuples, self->cid, 0,
+					  self->bistate);
+	for (i = 0; i < ntuples; i++)
+		SpoolerInsert(&self->spooler, tuples[i]);
+}
+#endif
+
 static WriterResult
 BufferedWriterClose(BufferedWriter *self, bool onError)
 {
@@ -71,6 +71,10 @@ typedef struct DirectWriter
 
 static void	DirectWriterInit(DirectWriter *self);
 static void	DirectWriterInsert(DirectWriter *self, HeapTuple tuple);
+static void	DirectWriterInsertBatch(DirectWriter *self, HeapTuple *tuples, int ntuples);
+static HeapTuple	DirectWriterPrepare(DirectWriter *self, HeapTuple tuple);
+static Page	DirectWriterNextPage(DirectWriter *self);
+static void	DirectWriterPut(DirectWriter *self, Page page, HeapTuple tuple);
 static WriterResult	DirectWriterClose(DirectWriter *self, bool onError);
 static bool	DirectWriterParam(DirectWriter *self, const char *keyword, char *value);
 static void	DirectWriterDumpParams(DirectWriter *self);
@@ -105,6 +109,7 @@ CreateDirectWriter(void *opt)
 	self = palloc0(sizeof(DirectWriter));
 	self->base.init = (WriterInitProc) DirectWriterInit;
 	self->base.insert = (WriterInsertProc) DirectWriterInsert,
+	self->base.insertBatch = (WriterInsertBatchProc) DirectWriterInsertBatch;
 	self->base.close = (WriterCloseProc) DirectWriterClose,
 	self->base.param = (WriterParamProc) DirectWriterParam;
 	self->base.dumpParams = (WriterDumpParamsProc) DirectWriterDumpParams,
@@ -194,15 +199,93 @@ static void
 DirectWriterInsert(DirectWriter *self, HeapTuple tuple)
 {
 	Page			page;
-	OffsetNumber	offnum;
-	ItemId			itemId;
-	Item			item;
-	LoadStatus	   *ls = &self->ls;
 
+	tuple = DirectWriterPrepare(self, tuple);
+	BULKLOAD_PROFILE(&prof_writer_toast);
+
+	/* Fill current page, or go to next page if the page is full. */
+	page = GetCurrentPage(self);
+	if (PageGetFreeSpace(page) < MAXALIGN(tuple->t_len) +
+		RelationGetTargetPageFreeSpace(self->base.rel, HEAP_DEFAULT_FILLFACTOR))
+		page = DirectWriterNextPage(self);
+
+	DirectWriterPut(self, page, tuple);
+
+	BULKLOAD_PROFILE(&prof_writer_table);
+	SpoolerInsert(&self->spooler, tuple);
+	BULKLOAD_PROFILE(&prof_writer_index);
+}
+
+/**
+ * @brief Load heap tuples directly at a time.
+ *
+ * The tuples are prepared first, then the tuples that fit in the current
+ * page are counted by their sizes and put on it in one pass, without checking
+ * the free space of the page for each tuple.
+ * @return void
+ */
+static void
+DirectWriterInsertBatch(DirectWriter *self, HeapTuple *tuples, int ntuples)
+{
+	Size	reserved;
+	int		first;
+	int		i;
+
+	for (i = 0; i < ntuples; i++)
+		tuples[i] = DirectWriterPrepare(self, tuples[i]);
+	BULKLOAD_PROFILE(&prof_writer_toast);
+
+	reserved = RelationGetTargetPageFreeSpace(self->base.rel,
+											  HEAP_DEFAULT_FILLFACTOR);
+
+	for (first = 0; first < ntuples;)
+	{
+		Page	page;
+		Size	freespace;
+		int		last;
+
+		/* The first tuple goes to the next page if it does not fit. */
+		page = GetCurrentPage(self);
+		freespace = PageGetFreeSpace(page);
+		if (freespace < MAXALIGN(tuples[first]->t_len) + reserved)
+		{
+			page = DirectWriterNextPage(self);
+			freespace = PageGetFreeSpace(page);
+		}
+
+		/* Count the tuples that fit as PageGetFreeSpace() would. */
+		last = first;
+		do
+		{
+			Size	len = MAXALIGN(tuples[last]->t_len) + sizeof(ItemIdData);
+
+			freespace = (freespace > len ? freespace - len : 0);
+			last++;
+		} while (last < ntuples &&
+				 freespace >= MAXALIGN(tuples[last]->t_len) + reserved);
+
+		for (i = first; i < last; i++)
+			DirectWriterPut(self, page, tuples[i]);
+		BULKLOAD_PROFILE(&prof_writer_table);
+
+		for (i = first; i < last; i++)
+			SpoolerInsert(&self->spooler, tuples[i]);
+		BULKLOAD_PROFILE(&prof_writer_index);
+
+		first = last;
+	}
+}
+
+/**
+ * @brief Toast the tuple, assign its oid and set its header for the load.
+ * @return the tuple to be put
+ */
+static HeapTuple
+DirectWriterPrepare(DirectWriter *self, HeapTuple tuple)
+{
 	/* Compress the tuple data if needed. */
 	if (tuple->t_len > TOAST_TUPLE_THRESHOLD)
 		tuple = toast_insert_or_update(self->base.rel, tuple, NULL, 0);
-	BULKLOAD_PROFILE(&prof_writer_toast);
 
 	/* Assign oids if needed. */
 	if (self->base.rel->rd_rel->relhasoids)
@@ -219,26 +302,6 @@ DirectWriterInsert(DirectWriter *self, HeapTuple tuple)
 						(unsigned long) tuple->t_len,
 						(unsigned long) MaxHeapTupleSize)));
 
-	/* Fill current page, or go to next page if the page is full. */
-	page = GetCurrentPage(self);
-	if (PageGetFreeSpace(page) < MAXALIGN(tuple->t_len) +
-		RelationGetTargetPageFreeSpace(self->base.rel, HEAP_DEFAULT_FILLFACTOR))
-	{
-		if (self->curblk < BLOCK_BUF_NUM - 1)
-			self->curblk++;
-		else
-		{
-			flush_pages(self);
-			self->curblk = 0;	/* recycle from first block */
-		}
-
-		page = GetCurrentPage(self);
-
-		/* Initialize current block */
-		PageInit(page, BLCKSZ, 0);
-		PageSetTLI(page, ThisTimeLineID);
-	}
-
 	tuple->t_data->t_infomask &= ~(HEAP_XACT_MASK);
 	tuple->t_data->t_infomask2 &= ~(HEAP2_XACT_MASK);
 	tuple->t_data->t_infomask |= HEAP_XMAX_INVALID;
@@ -246,6 +309,47 @@ DirectWriterInsert(DirectWriter *self, HeapTuple tuple)
 	HeapTupleHeaderSetCmin(tuple->t_data, self->cid);
 	HeapTupleHeaderSetXmax(tuple->t_data, 0);
 
+	return tuple;
+}
+
+/**
+ * @brief Go to the next block buffer, flushing the buffers if all are used.
+ * @return the initialized page
+ */
+static Page
+DirectWriterNextPage(DirectWriter *self)
+{
+	Page	page;
+
+	if (self->curblk < BLOCK_BUF_NUM - 1)
+		self->curblk++;
+	else
+	{
+		flush_pages(self);
+		self->curblk = 0;	/* recycle from first block */
+	}
+
+	page = GetCurrentPage(self);
+
+	/* Initialize current block */
+	PageInit(page, BLCKSZ, 0);
+	PageSetTLI(page, ThisTimeLineID);
+
+	return page;
+}
+
+/**
+ * @brief Put the tuple on the current page.
+ * @return void
+ */
+static void
+DirectWriterPut(DirectWriter *self, Page page, HeapTuple tuple)
+{
+	LoadStatus	   *ls = &self->ls;
+	OffsetNumber	offnum;
+	ItemId			itemId;
+	Item			item;
+
 	/* put the tuple on local page. */
 	offnum = PageAddItem(page, (Item) tuple->t_data,
 		tuple->t_len, InvalidOffsetNumber, false, true);
@@ -254,10 +358,6 @@ DirectWriterInsert(DirectWriter *self, HeapTuple tuple)
 	itemId = PageGetItemId(page, offnum);
 	item = PageGetItem(page, itemId);
 	((HeapTupleHeader) item)->t_ctid = tuple->t_self;
-
-	BULKLOAD_PROFILE(&prof_writer_table);
-	SpoolerInsert(&self->spooler, tuple);
-	BULKLOAD_PROFILE(&prof_writer_index);
 }
 
 /**
@@ -29,6 +29,7 @@
 
 #define DEFAULT_BUFFER_SIZE		(16 * 1024 * 1024)	/* 16MB */
 #define DEFAULT_TIMEOUT_MSEC	100	/* 100ms */
+#define MAX_WRITE_SIZE			(DEFAULT_BUFFER_SIZE / 4)	/* per write of a batch */
 
 typedef struct ParallelWriter
 {
@@ -41,12 +42,14 @@ typedef struct ParallelWriter
 
 static void	ParallelWriterInit(ParallelWriter *self);
 static void	ParallelWriterInsert(ParallelWriter *self, HeapTuple tuple);
+static void	ParallelWriterInsertBatch(ParallelWriter *self, HeapTuple *tuples, int ntuples);
 static WriterResult	ParallelWriterClose(ParallelWriter *self, bool onError);
 static bool	ParallelWriterParam(ParallelWriter *self, const char *keyword, char *value);
 static void	ParallelWriterDumpParams(ParallelWriter *self);
 static int	ParallelWriterSendQuery(ParallelWriter *self, PGconn *conn, char *queueName, char *logfile, bool verbose);
 static const char *finish_and_get_message(ParallelWriter *self);
 static void write_queue(ParallelWriter *self, const void *buffer, uint32 len);
+static void write_queue_iov(ParallelWriter *self, const struct iovec iov[], int count);
 static void transfer_message(void *arg, const PGresult *res);
 static char *escape_param_str(const char *str);
 static PGconn *connect_to_localhost(void);
@@ -63,6 +66,7 @@ CreateParallelWriter(void *opt)
 	self = palloc0(sizeof(ParallelWriter));
 	self->base.init = (WriterInitProc) ParallelWriterInit;
 	self->base.insert = (WriterInsertProc) ParallelWriterInsert,
+	self->base.insertBatch = (WriterInsertBatchProc) ParallelWriterInsertBatch;
 	self->base.close = (WriterCloseProc) ParallelWriterClose,
 	self->base.param = (WriterParamProc) ParallelWriterParam;
 	self->base.dumpParams = (WriterDumpParamsProc) ParallelWriterDumpParams,
@@ -158,6 +162,49 @@ ParallelWriterInsert(ParallelWriter *self, HeapTuple tuple)
 	write_queue(self, tuple->t_data, tuple->t_len);
 }
 
+/*
+ * Send the tuples to the queue with as few writes as possible. The reader
+ * reads them one by one as if they were written one by one.
+ */
+static void
+ParallelWriterInsertBatch(ParallelWriter *self, HeapTuple *tuples, int ntuples)
+{
+	struct iovec   *iov = palloc(2 * ntuples * sizeof(struct iovec));
+	uint32		   *lens = palloc(ntuples * sizeof(uint32));
+	int				first;
+
+	for (first = 0; first < ntuples;)
+	{
+		uint32	total = 0;
+		int		count = 0;
+		int		i;
+
+		/* a tuple larger than MAX_WRITE_SIZE is written alone */
+		for (i = first; i < ntuples; i++)
+		{
+			uint32	len = sizeof(uint32) + tuples[i]->t_len;
+
+			if (i > first && total + len > MAX_WRITE_SIZE)
+				break;
+
+			lens[i] = tuples[i]->t_len;
+			iov[count].iov_base = &lens[i];
+			iov[count].iov_len = sizeof(uint32);
+			count++;
+			iov[count].iov_base = (void *) tuples[i]->t_data;
+			iov[count].iov_len = tuples[i]->t_len;
+			count++;
+			total += len;
+		}
+
+		write_queue_iov(self, iov, count);
+		first = i;
+	}
+
+	pfree(iov);
+	pfree(lens);
+}
+
 static WriterResult
 ParallelWriterClose(ParallelWriter *self, bool onError)
 {
@@ -307,8 +354,6 @@ write_queue(ParallelWriter *self, const void *buffer, uint32 len)
 {
 	struct iovec	iov[2];
 
-	AssertArg(self->conn != NULL);
-	AssertArg(self->queue != NULL);
 	AssertArg(len == 0 || buffer != NULL);
 
 	iov[0].iov_base = &len;
@@ -316,9 +361,18 @@ write_queue(ParallelWriter *self, const void *buffer, uint32 len)
 	iov[1].iov_base = (void *) buffer;
 	iov[1].iov_len = len;
 
+	write_queue_iov(self, iov, 2);
+}
+
+static void
+write_queue_iov(ParallelWriter *self, const struct iovec iov[], int count)
+{
+	AssertArg(self->conn != NULL);
+	AssertArg(self->queue != NULL);
+
 	for (;;)
 	{
-		if (QueueWrite(self->queue, iov, 2, DEFAULT_TIMEOUT_MSEC, false))
+		if (QueueWrite(self->queue, iov, count, DEFAULT_TIMEOUT_MSEC, false))
 			return;
 
 		PQconsumeInput(self->conn);